@@ -12,6 +12,7 @@
 #include "helper.h"
 #include "config.h"
 #include "os_specific.h"
+#include "packs.h"
 
 const char *argp_program_version = "xdccget 1.8";
 const char *argp_program_bug_address ="<nobody@nobody.org>";
@@ -21,7 +22,7 @@ static char doc[] =
 "xdccget -- download from cmd with xdcc";
 
 /* A description of the arguments we accept. */
-static char args_doc[] = "<server> <channel(s)> <bot cmds>";
+static char args_doc[] = "<server> <channel(s)> [<bot cmds>]";
 
 #define OPT_ACCEPT_ALL_NICKS 1
 #define OPT_DONT_CONFIRM_OFFSETS 2
@@ -30,6 +31,14 @@ static char args_doc[] = "<server> <channel(s)> <bot cmds>";
 #define OPT_LISTEN_IP_COMMAND 5
 #define OPT_LISTEN_PORT_COMMAND 6
 #define OPT_ACCEPT_ALL_CERTS 7
+#define OPT_THROTTLE_PER_DOWNLOAD 8
+#define OPT_THROTTLE_PER_BOT 9
+#define OPT_THROTTLE_HOST 10
+#define OPT_QUEUE_FILE 11
+#define OPT_MAX_DOWNLOADS 12
+#define OPT_MAX_DOWNLOADS_PER_BOT 13
+#define OPT_DAEMON 14
+#define OPT_CONTROL_SOCKET 15
 
 static void set_quiet_loglevel(struct xdccGetConfig* cfg) {
     DBG_OK("setting log-level as quiet.");
@@ -86,9 +95,64 @@ static void set_throttle_download(struct xdccGetConfig* cfg, char* arg) {
     sds val = sdsnew(arg);
     val = sdstrim(val, " \t");
     setMaxTransferSpeed(cfg, val);
+    cfg_set_bit(cfg, MAX_SPEED_ARG_FLAG);
     sdsfree(val);
 }
 
+static void set_throttle_per_download(struct xdccGetConfig* cfg, char* arg) {
+    DBG_OK("setting throttle per download to %s.", arg);
+    sds val = sdsnew(arg);
+    val = sdstrim(val, " \t");
+    cfg->maxTransferSpeedPerDownload = parseTransferSpeed(val);
+    cfg_set_bit(cfg, DOWNLOAD_SPEED_ARG_FLAG);
+    sdsfree(val);
+}
+
+static void set_throttle_per_bot(struct xdccGetConfig* cfg, char* arg) {
+    DBG_OK("setting throttle per bot to %s.", arg);
+    sds val = sdsnew(arg);
+    val = sdstrim(val, " \t");
+    cfg->maxTransferSpeedPerBot = parseTransferSpeed(val);
+    cfg_set_bit(cfg, BOT_SPEED_ARG_FLAG);
+    sdsfree(val);
+}
+
+static void set_throttle_host(struct xdccGetConfig* cfg, char* arg) {
+    DBG_OK("setting throttle for the host to %s.", arg);
+    sds val = sdsnew(arg);
+    val = sdstrim(val, " \t");
+    cfg->maxHostTransferSpeed = parseTransferSpeed(val);
+    cfg_set_bit(cfg, HOST_SPEED_ARG_FLAG);
+    sdsfree(val);
+}
+
+static void set_queue_file(struct xdccGetConfig* cfg, char* arg) {
+    DBG_OK("setting queue file to %s.", arg);
+    sdsfree(cfg->queueFile);
+    cfg->queueFile = sdstrim(sdsnew(arg), " \t");
+}
+
+static void set_max_downloads(struct xdccGetConfig* cfg, char* arg) {
+    cfg->maxConcurrentDownloads = (uint32_t) strtoul(arg, NULL, 10);
+    DBG_OK("setting max concurrent downloads to %u.", cfg->maxConcurrentDownloads);
+}
+
+static void set_max_downloads_per_bot(struct xdccGetConfig* cfg, char* arg) {
+    cfg->maxConcurrentDownloadsPerBot = (uint32_t) strtoul(arg, NULL, 10);
+    DBG_OK("setting max concurrent downloads per bot to %u.", cfg->maxConcurrentDownloadsPerBot);
+}
+
+static void set_daemon(struct xdccGetConfig* cfg) {
+    DBG_OK("setting daemon mode.");
+    cfg_set_bit(cfg, DAEMON_FLAG);
+}
+
+static void set_control_socket(struct xdccGetConfig* cfg, char* arg) {
+    DBG_OK("setting control socket to %s.", arg);
+    sdsfree(cfg->controlSocket);
+    cfg->controlSocket = sdstrim(sdsnew(arg), " \t");
+}
+
 static void set_delay_command(struct xdccGetConfig* cfg, char* arg) {
     sds val = sdsnew(arg);
     val = sdstrim(val, " \t");
@@ -169,6 +233,14 @@ static struct argp_option options[] = {
 {"accept-all-certs",   OPT_ACCEPT_ALL_CERTS, 0,      0,  "Accept all certificates in tls handshakes, ignore all errors and do not abort the handshake on any tls related error.", 0 },
 {"dont-confirm-offsets",   OPT_DONT_CONFIRM_OFFSETS, 0,      0,  "Do not send file offsets to the bots. Can be used on bots where the transfer gets stucked after a short while.", 0 },
 {"throttle",  OPT_THROTTLE_DOWNLOAD, "<speed>",      0,  "Limit the maximum transfer speed for the downloads in each xdccget instance to the specified value per seconds. valid suffixes are KByte, MByte and TByte - e.g. 1Mbyte throttles the speed to 1MByte/s.", 0 },
+{"throttle-download",  OPT_THROTTLE_PER_DOWNLOAD, "<speed>",      0,  "Limit the maximum transfer speed of each single download to the specified value per seconds. uses the same suffixes as --throttle.", 0 },
+{"throttle-bot",  OPT_THROTTLE_PER_BOT, "<speed>",      0,  "Limit the maximum transfer speed of all downloads from the same bot to the specified value per seconds. uses the same suffixes as --throttle.", 0 },
+{"throttle-host",  OPT_THROTTLE_HOST, "<speed>",      0,  "Limit the maximum transfer speed of all xdccget processes on this host together, that use this option. uses the same suffixes as --throttle.", 0 },
+{"queue-file",  OPT_QUEUE_FILE, "<file>",      0,  "Read the bot cmds line by line from this file or from stdin, if the file is -. Then the <bot cmds> argument is optional.", 0 },
+{"max-downloads",  OPT_MAX_DOWNLOADS, "<number>",      0,  "Send at most this many xdcc requests at the same time. the next request is sent, when a download finished. 0 means no limit.", 0 },
+{"max-downloads-per-bot",  OPT_MAX_DOWNLOADS_PER_BOT, "<number>",      0,  "Send at most this many xdcc requests to the same bot at the same time. 0 means no limit.", 0 },
+{"daemon",  OPT_DAEMON, 0,      0,  "Stay connected, when all downloads are finished, and take commands from the control socket. Then the <bot cmds> argument is optional.", 0 },
+{"control-socket",  OPT_CONTROL_SOCKET, "<path>",      0,  "Use this unix domain socket for the commands of the daemon mode instead of control.sock in the config directory.", 0 },
 {"delay", OPT_DELAY_COMMAND, "<time in seconds>",      0,  "Delay the sending of the xdcc send ccommand to specified seconds.", 0 },
 {"listen-ip", OPT_LISTEN_IP_COMMAND, "<ipv4 address>",      0,  "When using passive dcc use this listen ip address (normally your external ip address).", 0 },
 {"listen-port", OPT_LISTEN_PORT_COMMAND, "<port number>",      0,  "When using passive dcc use this listen port (needs to enabled in your router).", 0 },
@@ -235,6 +307,30 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
     case OPT_THROTTLE_DOWNLOAD:
         set_throttle_download(cfg, arg);
         break;
+    case OPT_THROTTLE_PER_DOWNLOAD:
+        set_throttle_per_download(cfg, arg);
+        break;
+    case OPT_THROTTLE_PER_BOT:
+        set_throttle_per_bot(cfg, arg);
+        break;
+    case OPT_THROTTLE_HOST:
+        set_throttle_host(cfg, arg);
+        break;
+    case OPT_QUEUE_FILE:
+        set_queue_file(cfg, arg);
+        break;
+    case OPT_MAX_DOWNLOADS:
+        set_max_downloads(cfg, arg);
+        break;
+    case OPT_MAX_DOWNLOADS_PER_BOT:
+        set_max_downloads_per_bot(cfg, arg);
+        break;
+    case OPT_DAEMON:
+        set_daemon(cfg);
+        break;
+    case OPT_CONTROL_SOCKET:
+        set_control_socket(cfg, arg);
+        break;
     case OPT_DELAY_COMMAND:
         set_delay_command(cfg, arg); 
         break;
@@ -265,7 +361,8 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
     break;
 
     case ARGP_KEY_END:
-        if (state->arg_num < 3)
+        /* the bot cmds can also come from the queue file or the control socket */
+        if (state->arg_num < 2 || (state->arg_num < 3 && cfg->queueFile == NULL && !cfg_get_bit(cfg, DAEMON_FLAG)))
             /* Not enough arguments. */
             argp_usage(state);
         break;
@@ -296,6 +393,14 @@ static struct option long_options[] = {
         {"accept-all-certs",  no_argument, NULL, 0},
         {"dont-confirm-offsets",  no_argument, NULL, 0},
         {"throttle",  required_argument, NULL, 0},
+        {"throttle-download",  required_argument, NULL, 0},
+        {"throttle-bot",  required_argument, NULL, 0},
+        {"throttle-host",  required_argument, NULL, 0},
+        {"queue-file",  required_argument, NULL, 0},
+        {"max-downloads",  required_argument, NULL, 0},
+        {"max-downloads-per-bot",  required_argument, NULL, 0},
+        {"daemon",  no_argument, NULL, 0},
+        {"control-socket",  required_argument, NULL, 0},
         {"delay",  required_argument, NULL, 0},
         {"listen-ip",  required_argument, NULL, 0},
         {"listen-port",  required_argument, NULL, 0},
@@ -320,6 +425,30 @@ static void eval_long_option(struct xdccGetConfig* cfg, char* option_name, char*
     else if (strcmp(option_name, "throttle") == 0) {
         set_throttle_download(cfg, optarg);
     }
+    else if (strcmp(option_name, "throttle-download") == 0) {
+        set_throttle_per_download(cfg, optarg);
+    }
+    else if (strcmp(option_name, "throttle-bot") == 0) {
+        set_throttle_per_bot(cfg, optarg);
+    }
+    else if (strcmp(option_name, "throttle-host") == 0) {
+        set_throttle_host(cfg, optarg);
+    }
+    else if (strcmp(option_name, "queue-file") == 0) {
+        set_queue_file(cfg, optarg);
+    }
+    else if (strcmp(option_name, "max-downloads") == 0) {
+        set_max_downloads(cfg, optarg);
+    }
+    else if (strcmp(option_name, "max-downloads-per-bot") == 0) {
+        set_max_downloads_per_bot(cfg, optarg);
+    }
+    else if (strcmp(option_name, "daemon") == 0) {
+        set_daemon(cfg);
+    }
+    else if (strcmp(option_name, "control-socket") == 0) {
+        set_control_socket(cfg, optarg);
+    }
     else if (strcmp(option_name, "delay") == 0) {
         set_delay_command(cfg, optarg);
     }
@@ -339,11 +468,11 @@ static void eval_long_option(struct xdccGetConfig* cfg, char* option_name, char*
 
 static void print_usage_message() {
     if (shouldColorOutput()) {
-        printf("Usage: xdccget.exe %s<optional options>%s %s<server>%s %s<channel(s)>%s %s<bot cmds>%s\n", KCYN, KNRM, KGRN, KNRM, KGRN, KNRM, KGRN, KNRM);
+        printf("Usage: xdccget.exe %s<optional options>%s %s<server>%s %s<channel(s)>%s %s[<bot cmds>]%s\n", KCYN, KNRM, KGRN, KNRM, KGRN, KNRM, KGRN, KNRM);
         printf("For example: xdccget.exe %s--port=6667%s %s\"irc.sample.net\"%s %s\"#sample-channel\"%s %s\"sample-xdccget-bot xdcc send #42\"%s\n\n", KCYN, KNRM, KGRN, KNRM, KGRN, KNRM, KGRN, KNRM);
     }
     else {
-        printf("Usage: xdccget.exe <optional options> <server> <channel(s)> <bot cmds>\n");
+        printf("Usage: xdccget.exe <optional options> <server> <channel(s)> [<bot cmds>]\n");
         printf("For example: xdccget.exe --port=6667 \"irc.sample.net\" \"#sample-channel\" \"sample-xdccget-bot xdcc send #42\"\n\n");
     }
     printf("The supported optional options are:\n");
@@ -438,7 +567,7 @@ void parseArguments(int argc, char** argv, struct xdccGetConfig* cfg) {
     }
 
     if (!show_version_info_called) {
-        if (actual_argument_counter != 3) {
+        if (actual_argument_counter != 3 && (actual_argument_counter != 2 || (cfg->queueFile == NULL && !cfg_get_bit(cfg, DAEMON_FLAG)))) {
             print_usage_message();
             exitPgm(0);
         }
@@ -449,7 +578,7 @@ void parseArguments(int argc, char** argv, struct xdccGetConfig* cfg) {
 
     cfg->args[0] = argv[optind];
     cfg->args[1] = argv[optind+1];
-    cfg->args[2] = argv[optind+2];
+    cfg->args[2] = (actual_argument_counter == 3) ? argv[optind+2] : NULL;
 
 #endif
 
@@ -460,15 +589,48 @@ void parseArguments(int argc, char** argv, struct xdccGetConfig* cfg) {
 
 struct dccDownload* newDccDownload(sds botNick, sds xdccCmd) {
     struct dccDownload *t = (struct dccDownload*) Malloc(sizeof (struct dccDownload));
+    t->network = NULL;
     t->botNick = botNick;
     t->xdccCmd = xdccCmd;
     t->md5 = NULL;
+    t->weight = 0;
+    t->priority = DOWNLOAD_PRIORITY_DEFAULT;
+    t->deadline = 0;
+    t->started = false;
+    t->offeredFile = NULL;
+    t->answered = false;
+    t->requestTime = 0;
+    t->retries = 0;
+    t->queuedAtBot = false;
+    t->journalId = 0;
+    t->requested = false;
+    t->journalOffset = 0;
+    t->mirrors = NULL;
+    t->raceDownload = NULL;
+    t->raceOf = NULL;
+    t->segmented = NULL;
+    t->segmentOf = NULL;
+    t->numSegmentSources = 0;
+    t->segmentRequestWaiting = false;
+    t->packRanges = NULL;
+    t->nearlyDone = false;
+    t->next = NULL;
     return t;
 }
 
 void freeDccDownload(struct dccDownload *t) {
+    while (t->mirrors != NULL) {
+        struct dccDownload *next = t->mirrors->next;
+        freeDccDownload(t->mirrors);
+        t->mirrors = next;
+    }
+
+    sdsfree(t->network);
     sdsfree(t->botNick);
     sdsfree(t->xdccCmd);
+    sdsfree(t->md5);
+    sdsfree(t->offeredFile);
+    freePackRanges(t->packRanges);
     FREE(t);
 }
 
@@ -520,6 +682,58 @@ void parseDccDownload(char *dccDownloadString, sds *nick, sds *xdccCmd) {
     *xdccCmd = xdccPtr;
 }
 
+static bool parseDccDownloadOption(struct dccDownload *download, const char *option) {
+    if (strn_equals(option, "weight=", 7)) {
+        unsigned long weight = strtoul(option + 7, NULL, 10);
+
+        if (weight == 0 || weight > DOWNLOAD_MAX_WEIGHT) {
+            logprintf(LOG_WARN, "ignoring invalid weight %s for %s", option + 7, download->botNick);
+            return true;
+        }
+
+        download->weight = (uint32_t) weight;
+        return true;
+    }
+    else if (strn_equals(option, "priority=", 9)) {
+        int priority = parseDownloadPriority(option + 9);
+
+        if (priority == DOWNLOAD_PRIORITY_DEFAULT) {
+            logprintf(LOG_WARN, "ignoring invalid priority %s for %s", option + 9, download->botNick);
+            return true;
+        }
+
+        download->priority = priority;
+        return true;
+    }
+    else if (strn_equals(option, "deadline=", 9)) {
+        time_t duration = parseDuration(option + 9);
+
+        if (duration == 0) {
+            logprintf(LOG_WARN, "ignoring invalid deadline %s for %s", option + 9, download->botNick);
+            return true;
+        }
+
+        download->deadline = time(NULL) + duration;
+        return true;
+    }
+
+    return false;
+}
+
+void parseDccDownloadOptions(struct dccDownload *download) {
+    /* the options are appended to the xdcc command, e.g. "bot xdcc send #1 priority=high weight=4" */
+    for (;;) {
+        sdstrim(download->xdccCmd, " \t");
+        char *lastSpace = strrchr(download->xdccCmd, ' ');
+
+        if (lastSpace == NULL || !parseDccDownloadOption(download, lastSpace + 1)) {
+            break;
+        }
+
+        sdsrange(download->xdccCmd, 0, (lastSpace - download->xdccCmd) - 1);
+    }
+}
+
 sds* parseChannels(char *channelString, uint32_t *numChannels) {
     DBG_OK("in parseChannels");
     int numFound = 0;
@@ -542,6 +756,89 @@ sds* parseChannels(char *channelString, uint32_t *numChannels) {
     return splittedString;
 }
 
+static struct dccDownload* parseSingleDccDownload(char *line) {
+    sds network = NULL;
+    sds nick = NULL;
+    sds xdccCmd = NULL;
+
+    /* the network of the request is given in front of the bot, e.g. "@rizon bot xdcc send #1" */
+    if (line[0] == '@') {
+        char *space = strchr(line, ' ');
+
+        if (space == NULL) {
+            return NULL;
+        }
+
+        network = sdsnewlen(line + 1, space - line - 1);
+        line = space + 1;
+
+        while (*line == ' ') {
+            line++;
+        }
+    }
+
+    parseDccDownload(line, &nick, &xdccCmd);
+    DBG_OK("'%s' '%s'\n", nick, xdccCmd);
+
+    if (nick == NULL || xdccCmd == NULL || sdslen(nick) == 0 || sdslen(xdccCmd) == 0 || (network != NULL && sdslen(network) == 0)) {
+        sdsfree(network);
+        sdsfree(nick);
+        sdsfree(xdccCmd);
+        return NULL;
+    }
+
+    struct dccDownload *download = newDccDownload(nick, xdccCmd);
+    download->network = network;
+    parseDccDownloadOptions(download);
+    parseBatchRequest(download);
+    return download;
+}
+
+struct dccDownload* parseDccDownloadLine(char *line) {
+    struct dccDownload *download = NULL;
+    struct dccDownload **lastMirror = NULL;
+
+    while (line != NULL) {
+        char *bar = strchr(line, '|');
+
+        if (bar != NULL) {
+            *bar = '\0';
+        }
+
+        sds part = sdstrim(sdsnew(line), " \t");
+        struct dccDownload *parsed = parseSingleDccDownload(part);
+        sdsfree(part);
+
+        if (parsed == NULL) {
+            if (download != NULL) {
+                freeDccDownload(download);
+            }
+
+            return NULL;
+        }
+
+        if (download == NULL) {
+            download = parsed;
+            lastMirror = &download->mirrors;
+        }
+        else {
+            *lastMirror = parsed;
+            lastMirror = &parsed->next;
+        }
+
+        line = (bar != NULL) ? bar + 1 : NULL;
+    }
+
+    /* the mirrors would need the same packs in the same order */
+    if (download->packRanges != NULL && download->mirrors != NULL) {
+        logprintf(LOG_WARN, "the mirrors of the packs %s of %s are not used.", download->xdccCmd, download->botNick);
+        freeDccDownload(download->mirrors);
+        download->mirrors = NULL;
+    }
+
+    return download;
+}
+
 struct dccDownload** parseDccDownloads(char *dccDownloadString, unsigned int *numDownloads) {
     int numFound = 0;
     int i = 0, j = 0;
@@ -556,29 +853,30 @@ struct dccDownload** parseDccDownloads(char *dccDownloadString, unsigned int *nu
 
     struct dccDownload **dccDownloadArray = (struct dccDownload**) Calloc(numFound + 1, sizeof (struct dccDownload*));
 
-    *numDownloads = numFound;
-
     for (i = 0; i < numFound; i++) {
         sdstrim(splittedString[i], " \t");
-        sds nick = NULL;
-        sds xdccCmd = NULL;
         DBG_OK("%d: '%s'\n", i, splittedString[i]);
-        parseDccDownload(splittedString[i], &nick, &xdccCmd);
-        DBG_OK("%d: '%s' '%s'\n", i, nick, xdccCmd);
-        if (nick != NULL && xdccCmd != NULL) {
-            dccDownloadArray[j] = newDccDownload(nick, xdccCmd);
-            j++;
+
+        /* a list of packs like "bot xdcc send #10-#80,#95" is split at its commas as well */
+        if (i + 1 < numFound && isPackListContinuation(splittedString[i + 1])) {
+            sds joined = sdscatprintf(sdsempty(), "%s,%s", splittedString[i], splittedString[i + 1]);
+            sdsfree(splittedString[i + 1]);
+            sdsfree(splittedString[i]);
+            splittedString[i + 1] = joined;
+            continue;
         }
-        else {
-            if (nick != NULL)
-                sdsfree(nick);
 
-            if (xdccCmd != NULL)
-                sdsfree(xdccCmd);
+        dccDownloadArray[j] = parseDccDownloadLine(splittedString[i]);
+
+        if (dccDownloadArray[j] != NULL) {
+            j++;
         }
+
         sdsfree(splittedString[i]);
     }
 
+    *numDownloads = j;
+
     FREE(splittedString);
     return dccDownloadArray;
 }
@@ -4,10 +4,54 @@
 #include "sds.h"
 #include "helper.h"
 
+struct packRange;
+
 struct dccDownload {
+    /* the network, that was given with @name, or NULL for the network of the command line */
+    sds network;
     sds botNick;
     sds xdccCmd;
     sds md5;
+    /* 0 and DOWNLOAD_PRIORITY_DEFAULT mean, that the defaults from the config are used. */
+    uint32_t weight;
+    int priority;
+    time_t deadline;
+    /* set, when the bot started the dcc transfer of this request */
+    bool started;
+    /* the name of the file, that the bot offered for this request, or NULL, before it offered one */
+    sds offeredFile;
+    /* set, when the bot answered the request with a notice */
+    bool answered;
+    /* set, when the bot put the request into its queue. it does not take a slot of the global window then */
+    bool queuedAtBot;
+    /* the monotonic time in ms, when the request was sent to the bot the last time */
+    uint64_t requestTime;
+    /* how often the request was sent again, because the bot refused it or did not answer */
+    uint32_t retries;
+    /* 0 if the request is not in the journal */
+    uint64_t journalId;
+    bool requested;
+    /* the last received offset, that was written to the journal */
+    irc_dcc_size_t journalOffset;
+    /* other bots with the same file, e.g. "bot1 xdcc send #1 | bot2 xdcc send #7". linked by next */
+    struct dccDownload *mirrors;
+    /* the request to a mirror, that was sent, because the transfer of this request straggles */
+    struct dccDownload *raceDownload;
+    /* the straggling request, that this request to a mirror races */
+    struct dccDownload *raceOf;
+    /* the file, that this request and its mirrors download in segments */
+    struct segmentedFile *segmented;
+    /* the request with the segmented file, that this request to a mirror sends segments of */
+    struct dccDownload *segmentOf;
+    /* the requests, that still send or may send segments of the file, including this one */
+    uint32_t numSegmentSources;
+    /* set for a request for segments, that waits for a free slot of the windows and the pacing of its bot, before it is sent */
+    bool segmentRequestWaiting;
+    /* the remaining packs of a batch like "bot xdcc send #10-#80", that is expanded in the queue, or NULL */
+    struct packRange *packRanges;
+    /* set, when the transfer ends soon, so that the next request to the bot is sent already */
+    bool nearlyDone;
+    struct dccDownload *next;
 };
 
 #define NUM_AVERAGE_SPEED_VALUES 8
@@ -40,6 +84,14 @@ void freeDccProgress(struct dccDownloadProgress *progress);
 
 void parseDccDownload (char *dccDownloadString, char **nick, char **xdccCmd);
 
+/* strips the trailing weight=, priority= and deadline= options from the xdcc command of the download. */
+void parseDccDownloadOptions(struct dccDownload *download);
+
+/* parses a single request like "bot xdcc send #1 priority=high" or "@network bot xdcc send #1".
+   mirrors of the same file follow after |, e.g. "bot1 xdcc send #1 | @rizon bot2 xdcc send #7".
+   returns NULL, if the request or one of its mirrors is not valid. */
+struct dccDownload* parseDccDownloadLine(char *line);
+
 sds* parseChannels(char *channelString, uint32_t *numChannels);
 
 struct dccDownload** parseDccDownloads(char *dccDownloadString, unsigned int *numDownloads);
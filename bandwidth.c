@@ -0,0 +1,464 @@
+#include <string.h>
+
+#include "bandwidth.h"
+#include "network.h"
+#include "shared_bandwidth.h"
+#include "schedule.h"
+#include "os_specific.h"
+
+struct botBandwidth {
+    sds botNick;
+    struct tokenBucket bucket;
+    struct botBandwidth *next;
+};
+
+static struct xdccGetConfig *limiterConfig = NULL;
+static struct tokenBucket globalBucket;
+static struct botBandwidth *botBuckets = NULL;
+/* downloads that share the global budget, the ones with a deadline first and sorted by it */
+static struct dccDownloadContext *sharedDownloads = NULL;
+static uint64_t lastRefillTime = 0;
+static time_t lastScheduleCheck = 0;
+
+static inline irc_dcc_size_t min_size(irc_dcc_size_t a, irc_dcc_size_t b) {
+    return (a < b) ? a : b;
+}
+
+static void setTokenBucketRate(struct tokenBucket *bucket, irc_dcc_size_t rate) {
+    bucket->rate = rate;
+    bucket->capacity = (rate * BANDWIDTH_BURST_MS) / 1000;
+
+    if (bucket->capacity < BANDWIDTH_MIN_BURST) {
+        bucket->capacity = BANDWIDTH_MIN_BURST;
+    }
+
+    if (bucket->tokens > bucket->capacity) {
+        bucket->tokens = bucket->capacity;
+    }
+}
+
+static void initTokenBucket(struct tokenBucket *bucket, irc_dcc_size_t rate, uint64_t now) {
+    memset(bucket, 0, sizeof(struct tokenBucket));
+    setTokenBucketRate(bucket, rate);
+    /* start with a tenth of a second worth of tokens, so the first read does not have to wait for the timer */
+    bucket->tokens = min_size(bucket->capacity, rate / 10 + 1);
+    bucket->lastRefill = now;
+}
+
+/* changes the rate of a running bucket. the tokens of the elapsed time are still added with the old rate. */
+static void changeTokenBucketRate(struct tokenBucket *bucket, irc_dcc_size_t rate, uint64_t now);
+
+static void refillTokenBucket(struct tokenBucket *bucket, uint64_t now) {
+    if (bucket->rate == NO_SPEED_LIMIT || now <= bucket->lastRefill) {
+        return;
+    }
+
+    /* keep the sub-byte remainder, so that small refill intervals dont lose any bandwidth */
+    irc_dcc_size_t milliBytes = bucket->rate * (now - bucket->lastRefill) + bucket->fraction;
+    bucket->tokens += milliBytes / 1000;
+    bucket->fraction = milliBytes % 1000;
+    bucket->lastRefill = now;
+
+    if (bucket->tokens >= bucket->capacity) {
+        bucket->tokens = bucket->capacity;
+        bucket->fraction = 0;
+    }
+}
+
+static void changeTokenBucketRate(struct tokenBucket *bucket, irc_dcc_size_t rate, uint64_t now) {
+    if (bucket->rate == rate) {
+        return;
+    }
+
+    if (bucket->rate == NO_SPEED_LIMIT) {
+        initTokenBucket(bucket, rate, now);
+        return;
+    }
+
+    refillTokenBucket(bucket, now);
+    setTokenBucketRate(bucket, rate);
+}
+
+static inline irc_dcc_size_t getBucketTokens(struct tokenBucket *bucket) {
+    if (bucket == NULL || bucket->rate == NO_SPEED_LIMIT) {
+        return BANDWIDTH_UNLIMITED;
+    }
+
+    return bucket->tokens;
+}
+
+static inline void takeBucketTokens(struct tokenBucket *bucket, irc_dcc_size_t amount) {
+    if (bucket == NULL || bucket->rate == NO_SPEED_LIMIT) {
+        return;
+    }
+
+    bucket->tokens = (amount < bucket->tokens) ? bucket->tokens - amount : 0;
+}
+
+static struct tokenBucket* getBotBucket(const char *botNick) {
+    struct botBandwidth *current;
+
+    for (current = botBuckets; current != NULL; current = current->next) {
+        if (strcasecmp(current->botNick, botNick) == 0) {
+            return &current->bucket;
+        }
+    }
+
+    current = Malloc(sizeof(struct botBandwidth));
+    current->botNick = sdsnew(botNick);
+    initTokenBucket(&current->bucket, limiterConfig->maxTransferSpeedPerBot, lastRefillTime);
+    current->next = botBuckets;
+    botBuckets = current;
+
+    return &current->bucket;
+}
+
+static uint32_t getPriorityFactor(int priority) {
+    switch (priority) {
+    case DOWNLOAD_PRIORITY_HIGH:
+        return BANDWIDTH_HIGH_PRIORITY_FACTOR;
+    case DOWNLOAD_PRIORITY_LOW:
+        return BANDWIDTH_LOW_PRIORITY_FACTOR;
+    default:
+        return BANDWIDTH_NORMAL_PRIORITY_FACTOR;
+    }
+}
+
+static bool isBefore(struct dccDownloadContext *a, struct dccDownloadContext *b) {
+    if (a->share.deadline == 0) {
+        return false;
+    }
+
+    return b->share.deadline == 0 || a->share.deadline < b->share.deadline;
+}
+
+static void addSharedDownload(struct dccDownloadContext *context) {
+    struct dccDownloadContext **current = &sharedDownloads;
+
+    while (*current != NULL && !isBefore(context, *current)) {
+        current = &(*current)->share.next;
+    }
+
+    context->share.next = *current;
+    *current = context;
+}
+
+/* the bytes per second the download needs to finish in time. */
+static irc_dcc_size_t getRequiredRate(struct dccDownloadContext *context) {
+    struct dccDownloadProgress *progress = context->progress;
+
+    if (context->share.deadline == 0 || progress->sizeRcvd >= progress->completeFileSize) {
+        return 0;
+    }
+
+    irc_dcc_size_t remaining = progress->completeFileSize - progress->sizeRcvd;
+    time_t secondsLeft = context->share.deadline - time(NULL);
+
+    if (secondsLeft < 1) {
+        return remaining;
+    }
+
+    return remaining / secondsLeft;
+}
+
+/* the maximum deficit a download can save up. what does not fit in there flows to the other downloads. */
+static irc_dcc_size_t getShareCapacity(struct dccDownloadContext *context, uint64_t totalWeight) {
+    irc_dcc_size_t capacity = (globalBucket.capacity * context->share.weight) / totalWeight;
+    irc_dcc_size_t reservedCapacity = (getRequiredRate(context) * BANDWIDTH_BURST_MS) / 1000;
+
+    if (capacity < reservedCapacity) {
+        capacity = reservedCapacity;
+    }
+
+    if (capacity < BANDWIDTH_MIN_SHARE) {
+        capacity = BANDWIDTH_MIN_SHARE;
+    }
+
+    return capacity;
+}
+
+static irc_dcc_size_t giveShare(struct dccDownloadContext *context, irc_dcc_size_t amount, uint64_t totalWeight) {
+    irc_dcc_size_t capacity = getShareCapacity(context, totalWeight);
+
+    if (context->share.deficit >= capacity) {
+        return 0;
+    }
+
+    amount = min_size(amount, capacity - context->share.deficit);
+    context->share.deficit += amount;
+
+    return amount;
+}
+
+/* hands out the global budget like a deficit round robin over the dcc sessions. downloads with a deadline
+   get the rate they need first, the rest is shared by weight. a download that does not read saturates its
+   deficit, so its unused share goes to the others in the next round. */
+static void shareGlobalBandwidth(uint64_t elapsedMs) {
+    struct dccDownloadContext *current;
+    irc_dcc_size_t pool = globalBucket.tokens;
+    uint64_t totalWeight = 0;
+
+    for (current = sharedDownloads; current != NULL; current = current->share.next) {
+        totalWeight += current->share.weight;
+    }
+
+    if (totalWeight == 0) {
+        return;
+    }
+
+    for (current = sharedDownloads; current != NULL && current->share.deadline != 0 && pool > 0; current = current->share.next) {
+        irc_dcc_size_t reserved = (getRequiredRate(current) * elapsedMs) / 1000;
+        pool -= giveShare(current, min_size(reserved, pool), totalWeight);
+    }
+
+    /* every round either hands out the whole pool or saturates at least one download */
+    for (;;) {
+        uint64_t unsaturatedWeight = 0;
+        irc_dcc_size_t handedOut = 0;
+
+        for (current = sharedDownloads; current != NULL; current = current->share.next) {
+            if (current->share.deficit < getShareCapacity(current, totalWeight)) {
+                unsaturatedWeight += current->share.weight;
+            }
+        }
+
+        if (unsaturatedWeight == 0 || pool == 0) {
+            break;
+        }
+
+        for (current = sharedDownloads; current != NULL; current = current->share.next) {
+            irc_dcc_size_t quantum = (pool * current->share.weight) / unsaturatedWeight;
+            handedOut += giveShare(current, quantum, totalWeight);
+        }
+
+        if (handedOut == 0) {
+            break;
+        }
+
+        pool -= handedOut;
+    }
+
+    globalBucket.tokens = pool;
+}
+
+/* the leased bytes, that are not received yet, are in the global bucket or in the deficits of the downloads. */
+static irc_dcc_size_t getHeldBandwidth() {
+    struct dccDownloadContext *current;
+    irc_dcc_size_t held = globalBucket.tokens;
+
+    for (current = sharedDownloads; current != NULL; current = current->share.next) {
+        held += current->share.deficit;
+    }
+
+    return held;
+}
+
+/* the process wide limit. if only the host wide limit is set, this process may use all of it, as long as the others dont. */
+static irc_dcc_size_t getGlobalRate(struct xdccGetConfig *config) {
+    irc_dcc_size_t rate = getScheduledTransferSpeed(config->throttleSchedule, time(NULL), config->maxTransferSpeed);
+
+    if (rate != NO_SPEED_LIMIT || !isSharedBandwidthAttached()) {
+        return rate;
+    }
+
+    return config->maxHostTransferSpeed;
+}
+
+static void attachHostBandwidth(struct xdccGetConfig *config) {
+    const char *name = (config->sharedBandwidthName != NULL) ? config->sharedBandwidthName : SHARED_BANDWIDTH_DEFAULT_NAME;
+
+    if (!attachSharedBandwidth(name, config->maxHostTransferSpeed)) {
+        logprintf(LOG_WARN, "could not set up the host wide bandwidth limit, only the limits of this process are used.");
+    }
+}
+
+static void setGlobalRate(irc_dcc_size_t rate) {
+    if (globalBucket.rate == rate) {
+        return;
+    }
+
+    if (rate == NO_SPEED_LIMIT) {
+        logprintf(LOG_INFO, "the transfer speed of this process is not limited anymore.");
+    }
+    else {
+        logprintf(LOG_INFO, "the transfer speed of this process is now limited to %" IRC_DCC_SIZE_T_FORMAT " bytes per second.", rate);
+    }
+
+    changeTokenBucketRate(&globalBucket, rate, lastRefillTime);
+}
+
+void initBandwidthLimiter(struct xdccGetConfig *config) {
+    limiterConfig = config;
+    lastRefillTime = getMonotonicTimeMs();
+    lastScheduleCheck = time(NULL);
+
+    if (config->maxHostTransferSpeed != NO_SPEED_LIMIT) {
+        attachHostBandwidth(config);
+    }
+
+    initTokenBucket(&globalBucket, getGlobalRate(config), lastRefillTime);
+
+    /* all tokens of the global bucket have to be leased from the host wide bucket */
+    if (isSharedBandwidthAttached()) {
+        globalBucket.tokens = 0;
+    }
+}
+
+bool isBandwidthLimited() {
+    return limiterConfig->maxTransferSpeed != NO_SPEED_LIMIT
+        || limiterConfig->maxTransferSpeedPerDownload != NO_SPEED_LIMIT
+        || limiterConfig->maxTransferSpeedPerBot != NO_SPEED_LIMIT
+        || limiterConfig->throttleSchedule != NULL
+        || isSharedBandwidthAttached();
+}
+
+void updateBandwidthLimits() {
+    struct botBandwidth *currentBot;
+    struct dccDownloadContext *currentDownload;
+    struct ircNetwork *network;
+
+    if (limiterConfig->maxHostTransferSpeed == NO_SPEED_LIMIT) {
+        detachSharedBandwidth();
+    }
+    else if (isSharedBandwidthAttached()) {
+        setSharedBandwidthRate(limiterConfig->maxHostTransferSpeed);
+    }
+    else {
+        attachHostBandwidth(limiterConfig);
+    }
+
+    setGlobalRate(getGlobalRate(limiterConfig));
+
+    for (currentBot = botBuckets; currentBot != NULL; currentBot = currentBot->next) {
+        changeTokenBucketRate(&currentBot->bucket, limiterConfig->maxTransferSpeedPerBot, lastRefillTime);
+    }
+
+    for (currentDownload = sharedDownloads; currentDownload != NULL; currentDownload = currentDownload->share.next) {
+        changeTokenBucketRate(&currentDownload->bucket, limiterConfig->maxTransferSpeedPerDownload, lastRefillTime);
+    }
+
+    /* every session may be the last one, that runs the event loop. without any limit the loop does not need to wake
+       up for the refills anymore */
+    for (network = limiterConfig->networks; network != NULL; network = network->next) {
+        if (network->session != NULL) {
+            irc_set_run_timeout(network->session, isBandwidthLimited() ? BANDWIDTH_REFILL_INTERVAL_MS : 0);
+        }
+    }
+}
+
+void refillBandwidthBuckets() {
+    struct botBandwidth *current;
+    uint64_t now = getMonotonicTimeMs();
+    uint64_t elapsedMs = now - lastRefillTime;
+    irc_dcc_size_t tokensBefore = globalBucket.tokens;
+
+    lastRefillTime = now;
+
+    /* the time of day rules can change the limit at any minute */
+    if (limiterConfig->throttleSchedule != NULL && time(NULL) != lastScheduleCheck) {
+        lastScheduleCheck = time(NULL);
+        setGlobalRate(getGlobalRate(limiterConfig));
+        tokensBefore = globalBucket.tokens;
+    }
+
+    refillTokenBucket(&globalBucket, lastRefillTime);
+
+    if (isSharedBandwidthAttached()) {
+        /* the refill of the process wide bucket is only what the host wide bucket can spare */
+        globalBucket.tokens = tokensBefore + leaseSharedBandwidth(globalBucket.tokens - tokensBefore, now);
+    }
+
+    if (globalBucket.rate != NO_SPEED_LIMIT) {
+        shareGlobalBandwidth(elapsedMs);
+    }
+
+    if (isSharedBandwidthAttached() && globalBucket.rate != NO_SPEED_LIMIT) {
+        settleSharedBandwidth(getHeldBandwidth());
+    }
+
+    for (current = botBuckets; current != NULL; current = current->next) {
+        refillTokenBucket(&current->bucket, lastRefillTime);
+    }
+}
+
+void attachDownloadBandwidth(struct dccDownloadContext *context, const char *botNick, struct dccDownload *download) {
+    uint32_t weight = limiterConfig->defaultWeight;
+    int priority = limiterConfig->defaultPriority;
+
+    initTokenBucket(&context->bucket, limiterConfig->maxTransferSpeedPerDownload, lastRefillTime);
+    context->botBucket = getBotBucket(botNick);
+
+    memset(&context->share, 0, sizeof(struct bandwidthShare));
+
+    if (download != NULL) {
+        weight = (download->weight != 0) ? download->weight : weight;
+        priority = (download->priority != DOWNLOAD_PRIORITY_DEFAULT) ? download->priority : priority;
+        context->share.deadline = download->deadline;
+    }
+
+    if (weight == 0) {
+        weight = DOWNLOAD_DEFAULT_WEIGHT;
+    }
+
+    context->share.weight = weight * getPriorityFactor(priority);
+    addSharedDownload(context);
+
+    DBG_OK("download from %s has the bandwidth weight %u", botNick, context->share.weight);
+}
+
+void detachDownloadBandwidth(struct dccDownloadContext *context) {
+    struct dccDownloadContext **current = &sharedDownloads;
+
+    while (*current != NULL) {
+        if (*current == context) {
+            *current = context->share.next;
+            /* give the unused share back to the others */
+            globalBucket.tokens = min_size(globalBucket.tokens + context->share.deficit, globalBucket.capacity);
+            context->share.deficit = 0;
+            context->share.next = NULL;
+            return;
+        }
+
+        current = &(*current)->share.next;
+    }
+}
+
+irc_dcc_size_t getDownloadQuota(struct dccDownloadContext *context) {
+    /* the download buckets are refilled lazily with the time of the last timer tick */
+    refillTokenBucket(&context->bucket, lastRefillTime);
+
+    irc_dcc_size_t quota = (globalBucket.rate != NO_SPEED_LIMIT) ? context->share.deficit : BANDWIDTH_UNLIMITED;
+    quota = min_size(quota, getBucketTokens(context->botBucket));
+    quota = min_size(quota, getBucketTokens(&context->bucket));
+
+    return quota;
+}
+
+void consumeDownloadBandwidth(struct dccDownloadContext *context, irc_dcc_size_t amount) {
+    if (globalBucket.rate != NO_SPEED_LIMIT) {
+        context->share.deficit = (amount < context->share.deficit) ? context->share.deficit - amount : 0;
+    }
+
+    if (isSharedBandwidthAttached()) {
+        consumeSharedBandwidth(amount);
+    }
+
+    takeBucketTokens(context->botBucket, amount);
+    takeBucketTokens(&context->bucket, amount);
+}
+
+void freeBandwidthLimiter() {
+    struct botBandwidth *current = botBuckets;
+
+    while (current != NULL) {
+        struct botBandwidth *next = current->next;
+        sdsfree(current->botNick);
+        FREE(current);
+        current = next;
+    }
+
+    botBuckets = NULL;
+    sharedDownloads = NULL;
+
+    detachSharedBandwidth();
+}
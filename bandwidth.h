@@ -0,0 +1,51 @@
+#ifndef BANDWIDTH_H
+#define BANDWIDTH_H
+
+#include "helper.h"
+#include "argument_parser.h"
+
+/* interval in which the event loop wakes up to refill the token buckets, if any limit is set. */
+#define BANDWIDTH_REFILL_INTERVAL_MS 50
+/* the buckets can hold the tokens of this many milliseconds, so short stalls of the loop dont lose bandwidth. */
+#define BANDWIDTH_BURST_MS 200
+/* minimum bucket capacity, so that slow limits still allow reasonable socket reads. */
+#define BANDWIDTH_MIN_BURST 4096
+/* minimum amount of the global budget, that a single download can save up while it is not reading. */
+#define BANDWIDTH_MIN_SHARE 1024
+
+/* the weights of the downloads are multiplied with these factors, so urgent packs get most of the link. */
+#define BANDWIDTH_LOW_PRIORITY_FACTOR    1
+#define BANDWIDTH_NORMAL_PRIORITY_FACTOR 4
+#define BANDWIDTH_HIGH_PRIORITY_FACTOR   16
+
+#define BANDWIDTH_UNLIMITED ((irc_dcc_size_t) -1)
+
+/* creates the global bucket from the limits in the config. */
+void initBandwidthLimiter(struct xdccGetConfig *config);
+
+/* returns true, if any of the global, per download or per bot limits is set. */
+bool isBandwidthLimited();
+
+/* applies changed limits of the config, e.g. after a reload of the config file, to the running buckets. */
+void updateBandwidthLimits();
+
+/* called from the timer of the event loop to refill the global and the per bot buckets.
+   the refilled global budget is then shared between the downloads by their deadlines and weights. */
+void refillBandwidthBuckets();
+
+/* creates the bucket of a new download and attaches it to the bucket of the sending bot.
+   download is the matching request and may be NULL, then the defaults from the config are used. */
+void attachDownloadBandwidth(struct dccDownloadContext *context, const char *botNick, struct dccDownload *download);
+
+/* removes a finished or failed download from the global bandwidth share. */
+void detachDownloadBandwidth(struct dccDownloadContext *context);
+
+/* returns the amount of bytes the download may receive right now. */
+irc_dcc_size_t getDownloadQuota(struct dccDownloadContext *context);
+
+/* takes the received bytes from all buckets of the download. */
+void consumeDownloadBandwidth(struct dccDownloadContext *context, irc_dcc_size_t amount);
+
+void freeBandwidthLimiter();
+
+#endif
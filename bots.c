@@ -0,0 +1,103 @@
+#include <string.h>
+
+#include "bots.h"
+#include "network.h"
+#include "notice_matcher.h"
+
+static struct botState *botStates = NULL;
+
+struct botState* findBotState(const char *network, const char *nick) {
+    struct botState *state;
+
+    for (state = botStates; state != NULL; state = state->next) {
+        if (isSameNetwork(state->network, network) && strcasecmp(state->nick, nick) == 0) {
+            return state;
+        }
+    }
+
+    return NULL;
+}
+
+struct botState* getBotState(const char *network, const char *nick) {
+    struct botState *state = findBotState(network, nick);
+
+    if (state != NULL) {
+        return state;
+    }
+
+    state = Calloc(1, sizeof(struct botState));
+    state->network = (network != NULL) ? sdsnew(network) : NULL;
+    state->nick = sdsnew(nick);
+    state->queuePosition = BOT_UNKNOWN;
+    state->queueSize = BOT_UNKNOWN;
+    state->openSlots = BOT_UNKNOWN;
+    state->totalSlots = BOT_UNKNOWN;
+    state->maxTransfersPerUser = BOT_UNKNOWN;
+    state->next = botStates;
+    botStates = state;
+    return state;
+}
+
+enum botReply parseBotNotice(struct botState *state, const struct noticeMatch *match) {
+    if (match->openSlots != BOT_UNKNOWN) {
+        state->openSlots = match->openSlots;
+    }
+
+    if (match->totalSlots != BOT_UNKNOWN) {
+        state->totalSlots = match->totalSlots;
+    }
+
+    if (match->maxTransfersPerUser != BOT_UNKNOWN) {
+        state->maxTransfersPerUser = match->maxTransfersPerUser;
+    }
+
+    if (match->queueSize != BOT_UNKNOWN) {
+        state->queueSize = match->queueSize;
+    }
+
+    if ((match->reply == BOT_REPLY_QUEUED || match->reply == BOT_REPLY_ALREADY_QUEUED) && match->queuePosition != BOT_UNKNOWN) {
+        state->queuePosition = match->queuePosition;
+    }
+
+    if (match->reply == BOT_REPLY_SENDING) {
+        state->queuePosition = BOT_UNKNOWN;
+    }
+
+    return match->reply;
+}
+
+bool isBotBackingOff(struct botState *state, uint64_t now) {
+    return state != NULL && now < state->retryTime;
+}
+
+bool isBotRequestPaced(struct botState *state, uint64_t now) {
+    return state != NULL && state->lastRequestTime != 0 && now < state->lastRequestTime + BOT_REQUEST_GAP_MS;
+}
+
+void backOffBot(struct botState *state, uint64_t now) {
+    if (state->retryDelay == 0) {
+        state->retryDelay = BOT_RETRY_MIN_DELAY_MS;
+    }
+
+    state->retryTime = now + state->retryDelay;
+    state->retryDelay *= 2;
+
+    if (state->retryDelay > BOT_RETRY_MAX_DELAY_MS) {
+        state->retryDelay = BOT_RETRY_MAX_DELAY_MS;
+    }
+}
+
+void releaseBotSlot(struct botState *state) {
+    state->retryTime = 0;
+    state->retryDelay = 0;
+}
+
+void freeBotStates() {
+    while (botStates != NULL) {
+        struct botState *next = botStates->next;
+        sdsfree(botStates->network);
+        sdsfree(botStates->nick);
+        FREE(botStates);
+        botStates = next;
+    }
+}
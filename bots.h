@@ -0,0 +1,73 @@
+#ifndef BOTS_H
+#define BOTS_H
+
+#include "helper.h"
+
+/* a bot, that refused a request, is asked again after this delay. it doubles with every refusal. */
+#define BOT_RETRY_MIN_DELAY_MS 30000
+#define BOT_RETRY_MAX_DELAY_MS 600000
+/* the requests to the same bot are sent at least this far apart, so that a batch does not flood the bot */
+#define BOT_REQUEST_GAP_MS 2000
+/* the value of the counters, that the bot did not tell yet */
+#define BOT_UNKNOWN 0xFFFFFFFF
+
+/* the meaning of a notice, that a bot sent as answer to a request. */
+enum botReply {
+    BOT_REPLY_NONE,
+    /* the bot starts the dcc transfer of the pack */
+    BOT_REPLY_SENDING,
+    /* the bot put the request into its queue and sends the pack, when a slot is free */
+    BOT_REPLY_QUEUED,
+    /* the bot has the request already in its queue */
+    BOT_REPLY_ALREADY_QUEUED,
+    /* the slots or the queue of the bot are full or the limit per user is reached. the request is sent again later */
+    BOT_REPLY_RETRY_LATER,
+    /* the pack does not exist */
+    BOT_REPLY_INVALID_PACK
+};
+
+/* what is known about a bot from its notices. */
+struct botState {
+    /* the network of the bot or NULL for the network of the command line */
+    sds network;
+    sds nick;
+    /* the position of our oldest request in the queue of the bot */
+    uint32_t queuePosition;
+    uint32_t queueSize;
+    uint32_t openSlots;
+    uint32_t totalSlots;
+    /* the number of transfers, that the bot allows a single user at the same time */
+    uint32_t maxTransfersPerUser;
+    /* no request is sent to the bot before this monotonic time in ms */
+    uint64_t retryTime;
+    uint64_t retryDelay;
+    /* the monotonic time in ms, when the last request was sent to the bot */
+    uint64_t lastRequestTime;
+    struct botState *next;
+};
+
+/* returns the state of the bot and creates it, if the bot is new. */
+struct botState* getBotState(const char *network, const char *nick);
+
+/* returns the state of the bot or NULL, if the bot did not send a notice yet. */
+struct botState* findBotState(const char *network, const char *nick);
+
+/* returns the reply of a notice of a bot like "All Slots Full, Added you to the main queue in position 7"
+   and records the queue position, the slots and the limits, that the notice matcher found in it, in state. */
+enum botReply parseBotNotice(struct botState *state, const struct noticeMatch *match);
+
+/* returns true, if the bot refused a request and must not be asked again yet. */
+bool isBotBackingOff(struct botState *state, uint64_t now);
+
+/* returns true, if a request was sent to the bot less than BOT_REQUEST_GAP_MS ago. */
+bool isBotRequestPaced(struct botState *state, uint64_t now);
+
+/* delays the next request to the bot and doubles the delay for the next refusal. */
+void backOffBot(struct botState *state, uint64_t now);
+
+/* a transfer of the bot ended, so that it has a free slot. the next request is sent at once. */
+void releaseBotSlot(struct botState *state);
+
+void freeBotStates();
+
+#endif
@@ -0,0 +1,152 @@
+#include <inttypes.h>
+
+#include "concurrency.h"
+#include "os_specific.h"
+
+enum concurrencyAction {
+    CONCURRENCY_HOLD,
+    CONCURRENCY_INCREASE,
+    CONCURRENCY_DECREASE
+};
+
+static struct xdccGetConfig *concurrencyConfig = NULL;
+static uint32_t window = 0;
+static uint32_t maxWindow = 0;
+static enum concurrencyAction lastAction = CONCURRENCY_HOLD;
+static uint32_t holdProbes = 0;
+
+/* the measurement of the running interval */
+static uint64_t intervalStart = 0;
+static irc_dcc_size_t intervalBytes = 0;
+static uint32_t intervalSeconds = 0;
+static uint32_t limitedSeconds = 0;
+static uint64_t transferSeconds = 0;
+/* the goodput of the last interval, that the window limited, or 0 */
+static irc_dcc_size_t lastGoodput = 0;
+
+static void startController() {
+    window = (CONCURRENCY_INITIAL_WINDOW < maxWindow) ? CONCURRENCY_INITIAL_WINDOW : maxWindow;
+    lastAction = CONCURRENCY_HOLD;
+    holdProbes = 0;
+    intervalStart = getMonotonicTimeMs();
+    intervalBytes = 0;
+    intervalSeconds = 0;
+    limitedSeconds = 0;
+    transferSeconds = 0;
+    lastGoodput = 0;
+    logprintf(LOG_INFO, "concurrency: starting with %" PRIu32 " transfers, at most %" PRIu32 ".", window, maxWindow);
+}
+
+/* adaptiveConcurrency and maxConcurrentDownloads can change by a reload or the control socket. the controller starts,
+   when the flag is set, and the window follows the limit. */
+static bool isControllerEnabled() {
+    if (concurrencyConfig == NULL || !cfg_get_bit(concurrencyConfig, ADAPTIVE_CONCURRENCY_FLAG)) {
+        window = 0;
+        return false;
+    }
+
+    maxWindow = (concurrencyConfig->maxConcurrentDownloads != 0) ? concurrencyConfig->maxConcurrentDownloads : CONCURRENCY_MAX_WINDOW;
+
+    if (window == 0) {
+        startController();
+    }
+    else if (window > maxWindow) {
+        window = maxWindow;
+    }
+
+    return true;
+}
+
+void initConcurrencyController(struct xdccGetConfig *config) {
+    concurrencyConfig = config;
+    isControllerEnabled();
+}
+
+uint32_t getConcurrencyWindow() {
+    if (!isControllerEnabled()) {
+        return concurrencyConfig != NULL ? concurrencyConfig->maxConcurrentDownloads : 0;
+    }
+
+    return window;
+}
+
+void recordGoodput(irc_dcc_size_t amount) {
+    intervalBytes += amount;
+}
+
+static void setWindow(uint32_t newWindow, enum concurrencyAction action, irc_dcc_size_t goodput, uint32_t numTransfers, const char *reason) {
+    if (newWindow < 1) {
+        newWindow = 1;
+    }
+
+    if (newWindow > maxWindow) {
+        newWindow = maxWindow;
+    }
+
+    logprintf(LOG_INFO, "concurrency: %" IRC_DCC_SIZE_T_FORMAT " bytes/s with %" PRIu32 " transfers, window %" PRIu32 " -> %" PRIu32 " (%s).",
+        goodput, numTransfers, window, newWindow, reason);
+
+    window = newWindow;
+    lastAction = action;
+}
+
+/* decides the window for the next interval from the goodput of the interval, that just ended. */
+static void probeWindow(irc_dcc_size_t goodput, uint32_t numTransfers) {
+    /* the mean rate of a transfer. an added transfer, that only takes bandwidth from the others, raises the goodput by less than half of it */
+    irc_dcc_size_t sessionRate = (numTransfers != 0) ? goodput / numTransfers : 0;
+
+    if (lastGoodput != 0 && goodput * 100 < lastGoodput * (100 - CONCURRENCY_LOSS_PERCENT)) {
+        holdProbes = CONCURRENCY_HOLD_PROBES;
+        setWindow(window * 3 / 4, CONCURRENCY_DECREASE, goodput, numTransfers, "goodput dropped");
+    }
+    else if (lastAction == CONCURRENCY_INCREASE && goodput < lastGoodput + sessionRate / 2) {
+        holdProbes = CONCURRENCY_HOLD_PROBES;
+        setWindow(window - 1, CONCURRENCY_DECREASE, goodput, numTransfers, "the added transfer did not raise the goodput");
+    }
+    else if (holdProbes != 0) {
+        holdProbes--;
+        lastAction = CONCURRENCY_HOLD;
+    }
+    else if (window < maxWindow) {
+        setWindow(window + 1, CONCURRENCY_INCREASE, goodput, numTransfers, "probing");
+    }
+
+    lastGoodput = goodput;
+}
+
+void updateConcurrencyWindow(uint32_t numTransfers, bool windowLimited) {
+    if (!isControllerEnabled()) {
+        return;
+    }
+
+    uint64_t now = getMonotonicTimeMs();
+
+    intervalSeconds++;
+    transferSeconds += numTransfers;
+
+    if (windowLimited) {
+        limitedSeconds++;
+    }
+
+    if (now < intervalStart + CONCURRENCY_PROBE_INTERVAL_MS) {
+        return;
+    }
+
+    irc_dcc_size_t goodput = intervalBytes * 1000 / (now - intervalStart);
+    uint32_t meanTransfers = (uint32_t) ((transferSeconds + intervalSeconds / 2) / intervalSeconds);
+
+    /* an interval, in which the queue had no waiting requests, says nothing about a bigger window */
+    if (limitedSeconds * 2 >= intervalSeconds) {
+        probeWindow(goodput, meanTransfers);
+    }
+    else {
+        lastGoodput = 0;
+        lastAction = CONCURRENCY_HOLD;
+    }
+
+    intervalStart = now;
+    intervalBytes = 0;
+    intervalSeconds = 0;
+    limitedSeconds = 0;
+    transferSeconds = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef CONCURRENCY_H
+#define CONCURRENCY_H
+
+#include "helper.h"
+
+/* the goodput of the transfers is compared over intervals of this length */
+#define CONCURRENCY_PROBE_INTERVAL_MS 15000
+/* the window, that the controller starts with */
+#define CONCURRENCY_INITIAL_WINDOW 2
+/* the upper limit of the window, if maxConcurrentDownloads is 0 */
+#define CONCURRENCY_MAX_WINDOW 32
+/* a drop of the goodput by this percentage shrinks the window by a quarter */
+#define CONCURRENCY_LOSS_PERCENT 20
+/* after an added transfer did not raise the goodput, the window is kept for this many intervals, before it is probed again */
+#define CONCURRENCY_HOLD_PROBES 4
+
+/* the window starts at CONCURRENCY_INITIAL_WINDOW, when adaptiveConcurrency is set, also later by a reload or the control
+   socket. otherwise maxConcurrentDownloads is used. */
+void initConcurrencyController(struct xdccGetConfig *config);
+
+/* returns the number of requests, that may be in flight at the same time. 0 means no limit. */
+uint32_t getConcurrencyWindow();
+
+/* counts the bytes, that the transfers wrote to the disk. */
+void recordGoodput(irc_dcc_size_t amount);
+
+/* is called once a second. windowLimited is set, if requests wait, because the window is full. at the end of each
+   interval the window grows by one transfer, while every added transfer raises the goodput by at least half of the
+   rate of a single transfer. otherwise the last transfer is taken back, and a drop of the goodput shrinks the window. */
+void updateConcurrencyWindow(uint32_t numTransfers, bool windowLimited);
+
+#endif
@@ -2,6 +2,13 @@
 
 #include "file.h"
 #include "helper.h"
+#include "network.h"
+#include "notice_matcher.h"
+#include "queue.h"
+#include "schedule.h"
+#include "shared_bandwidth.h"
+
+#include <signal.h>
 
 #ifndef _MSC_VER
 #include <netinet/in.h>
@@ -16,6 +23,29 @@ static void allowAllCertsCallback(struct xdccGetConfig *config, sds value);
 static void verifyChecksumsCallback (struct xdccGetConfig *config, sds value);
 static void confirmFileOffsetsCallback (struct xdccGetConfig *config, sds value);
 static void maxTransferSpeedCallback (struct xdccGetConfig *config, sds value);
+static void maxTransferSpeedPerDownloadCallback (struct xdccGetConfig *config, sds value);
+static void maxTransferSpeedPerBotCallback (struct xdccGetConfig *config, sds value);
+static void maxHostTransferSpeedCallback (struct xdccGetConfig *config, sds value);
+static void sharedBandwidthNameCallback (struct xdccGetConfig *config, sds value);
+static void throttleScheduleCallback (struct xdccGetConfig *config, sds value);
+static void noticePatternCallback (struct xdccGetConfig *config, sds value);
+static void defaultDownloadWeightCallback (struct xdccGetConfig *config, sds value);
+static void defaultDownloadPriorityCallback (struct xdccGetConfig *config, sds value);
+static void adaptiveSocketBuffersCallback (struct xdccGetConfig *config, sds value);
+static void maxSocketBufferSizeCallback (struct xdccGetConfig *config, sds value);
+static void maxConcurrentDownloadsCallback (struct xdccGetConfig *config, sds value);
+static void maxConcurrentDownloadsPerBotCallback (struct xdccGetConfig *config, sds value);
+static void useJournalCallback (struct xdccGetConfig *config, sds value);
+static void useHistoryCallback (struct xdccGetConfig *config, sds value);
+static void useSaslCallback (struct xdccGetConfig *config, sds value);
+static void requestTimeoutCallback (struct xdccGetConfig *config, sds value);
+static void maxRequestRetriesCallback (struct xdccGetConfig *config, sds value);
+static void stragglerSpeedRatioCallback (struct xdccGetConfig *config, sds value);
+static void stragglerMaxEtaCallback (struct xdccGetConfig *config, sds value);
+static void segmentedDownloadsCallback (struct xdccGetConfig *config, sds value);
+static void adaptiveConcurrencyCallback (struct xdccGetConfig *config, sds value);
+static void controlSocketCallback (struct xdccGetConfig *config, sds value);
+static void networkCallback (struct xdccGetConfig *config, sds value);
 static void listenIpCallback (struct xdccGetConfig *config, sds value);
 static void listenPortCallback (struct xdccGetConfig *config, sds value);
 
@@ -24,17 +54,42 @@ typedef void (*ConfigLineParserFunction) (struct xdccGetConfig *config, sds valu
 struct ConfigLineParser {
     char *type;
     ConfigLineParserFunction parse_line;
+    /* the option is read, whenever it is needed, so that SET can change it while xdccget runs */
+    bool runtime;
 };
 
 static struct ConfigLineParser configLineCallbacks[] = {
-    {"downloadDir",     downloadDirCallback},
-    {"logLevel",        parseLogLevel},
-    {"allowAllCerts",   allowAllCertsCallback},
-    {"verifyChecksums", verifyChecksumsCallback},
-    {"confirmFileOffsets", confirmFileOffsetsCallback},
-    {"maxTransferSpeed", maxTransferSpeedCallback},
-    {"listenIp", listenIpCallback},
-    {"listenPort", listenPortCallback},
+    {"downloadDir", downloadDirCallback, true},
+    {"logLevel", parseLogLevel, true},
+    {"allowAllCerts", allowAllCertsCallback, false},
+    {"verifyChecksums", verifyChecksumsCallback, true},
+    {"confirmFileOffsets", confirmFileOffsetsCallback, true},
+    {"maxTransferSpeed", maxTransferSpeedCallback, true},
+    {"maxTransferSpeedPerDownload", maxTransferSpeedPerDownloadCallback, true},
+    {"maxTransferSpeedPerBot", maxTransferSpeedPerBotCallback, true},
+    {"maxHostTransferSpeed", maxHostTransferSpeedCallback, true},
+    {"sharedBandwidthName", sharedBandwidthNameCallback, false},
+    {"throttleSchedule", throttleScheduleCallback, true},
+    {"noticePattern", noticePatternCallback, true},
+    {"defaultDownloadWeight", defaultDownloadWeightCallback, true},
+    {"defaultDownloadPriority", defaultDownloadPriorityCallback, true},
+    {"adaptiveSocketBuffers", adaptiveSocketBuffersCallback, true},
+    {"maxSocketBufferSize", maxSocketBufferSizeCallback, true},
+    {"maxConcurrentDownloads", maxConcurrentDownloadsCallback, true},
+    {"maxConcurrentDownloadsPerBot", maxConcurrentDownloadsPerBotCallback, true},
+    {"adaptiveConcurrency", adaptiveConcurrencyCallback, false},
+    {"useJournal", useJournalCallback, false},
+    {"useHistory", useHistoryCallback, false},
+    {"useSasl", useSaslCallback, false},
+    {"requestTimeout", requestTimeoutCallback, true},
+    {"maxRequestRetries", maxRequestRetriesCallback, true},
+    {"stragglerSpeedRatio", stragglerSpeedRatioCallback, true},
+    {"stragglerMaxEta", stragglerMaxEtaCallback, true},
+    {"segmentedDownloads", segmentedDownloadsCallback, true},
+    {"controlSocket", controlSocketCallback, false},
+    {"network", networkCallback, false},
+    {"listenIp", listenIpCallback, false},
+    {"listenPort", listenPortCallback, false},
 };
 
 static void verifyChecksumsCallback (struct xdccGetConfig *config, sds value) {
@@ -73,6 +128,204 @@ static void maxTransferSpeedCallback (struct xdccGetConfig *config, sds value) {
      setMaxTransferSpeed(config, value);
 }
 
+static void maxTransferSpeedPerDownloadCallback (struct xdccGetConfig *config, sds value) {
+     config->maxTransferSpeedPerDownload = parseTransferSpeed(value);
+}
+
+static void maxTransferSpeedPerBotCallback (struct xdccGetConfig *config, sds value) {
+     config->maxTransferSpeedPerBot = parseTransferSpeed(value);
+}
+
+static void maxHostTransferSpeedCallback (struct xdccGetConfig *config, sds value) {
+     config->maxHostTransferSpeed = parseTransferSpeed(value);
+}
+
+static void sharedBandwidthNameCallback (struct xdccGetConfig *config, sds value) {
+    sdsfree(config->sharedBandwidthName);
+    config->sharedBandwidthName = sdsdup(value);
+}
+
+static void throttleScheduleCallback (struct xdccGetConfig *config, sds value) {
+    if (!parseThrottleRule(value, &config->throttleSchedule)) {
+        logprintf(LOG_WARN, "the throttle schedule %s in config file is not valid. it needs to look like mon-fri 08:00-18:00 20MByte.", value);
+    }
+}
+
+static void noticePatternCallback (struct xdccGetConfig *config, sds value) {
+    if (!parseNoticePattern(value, &config->noticePatterns)) {
+        logprintf(LOG_WARN, "the notice pattern %s in config file is not valid. it needs to look like retry-later no free slots.", value);
+    }
+}
+
+static void defaultDownloadWeightCallback (struct xdccGetConfig *config, sds value) {
+    unsigned long weight = strtoul(value, NULL, 10);
+
+    if (weight == 0 || weight > DOWNLOAD_MAX_WEIGHT) {
+        logprintf(LOG_WARN, "the download weight %s in config file is not valid. using the default weight.", value);
+        return;
+    }
+
+    config->defaultWeight = (uint32_t) weight;
+}
+
+static void defaultDownloadPriorityCallback (struct xdccGetConfig *config, sds value) {
+    int priority = parseDownloadPriority(value);
+
+    if (priority == DOWNLOAD_PRIORITY_DEFAULT) {
+        logprintf(LOG_WARN, "the download priority %s in config file is not valid. valid options are high, normal and low.", value);
+        return;
+    }
+
+    config->defaultPriority = priority;
+}
+
+static void adaptiveSocketBuffersCallback (struct xdccGetConfig *config, sds value) {
+    if (str_equals(value, "true")) {
+        cfg_set_bit(config, ADAPTIVE_SOCKET_BUFFERS_FLAG);
+    }
+    else {
+        cfg_clear_bit(config, ADAPTIVE_SOCKET_BUFFERS_FLAG);
+    }
+}
+
+static void maxSocketBufferSizeCallback (struct xdccGetConfig *config, sds value) {
+    irc_dcc_size_t size = parseTransferSpeed(value);
+
+    if (size == NO_SPEED_LIMIT) {
+        logprintf(LOG_WARN, "the socket buffer size %s in config file is not valid. valid suffixes are KByte and MByte.", value);
+        return;
+    }
+
+    config->maxSocketBufferSize = size;
+}
+
+static void maxConcurrentDownloadsCallback (struct xdccGetConfig *config, sds value) {
+    config->maxConcurrentDownloads = (uint32_t) strtoul(value, NULL, 10);
+}
+
+static void maxConcurrentDownloadsPerBotCallback (struct xdccGetConfig *config, sds value) {
+    config->maxConcurrentDownloadsPerBot = (uint32_t) strtoul(value, NULL, 10);
+}
+
+static void adaptiveConcurrencyCallback (struct xdccGetConfig *config, sds value) {
+    if (str_equals(value, "true")) {
+        cfg_set_bit(config, ADAPTIVE_CONCURRENCY_FLAG);
+    }
+    else {
+        cfg_clear_bit(config, ADAPTIVE_CONCURRENCY_FLAG);
+    }
+}
+
+static void requestTimeoutCallback (struct xdccGetConfig *config, sds value) {
+    if (str_equals(value, "0")) {
+        config->requestTimeout = 0;
+        return;
+    }
+
+    time_t timeout = parseDuration(value);
+
+    if (timeout == 0) {
+        logprintf(LOG_WARN, "the requestTimeout %s in config file is not a valid duration.", value);
+        return;
+    }
+
+    config->requestTimeout = timeout;
+}
+
+static void maxRequestRetriesCallback (struct xdccGetConfig *config, sds value) {
+    config->maxRequestRetries = (uint32_t) strtoul(value, NULL, 10);
+}
+
+static void stragglerSpeedRatioCallback (struct xdccGetConfig *config, sds value) {
+    unsigned long ratio = strtoul(value, NULL, 10);
+
+    if (ratio >= 100) {
+        logprintf(LOG_WARN, "the stragglerSpeedRatio %s in config file is not below 100 percent.", value);
+        return;
+    }
+
+    config->stragglerSpeedRatio = (uint32_t) ratio;
+}
+
+static void stragglerMaxEtaCallback (struct xdccGetConfig *config, sds value) {
+    if (str_equals(value, "0")) {
+        config->stragglerMaxEta = 0;
+        return;
+    }
+
+    time_t maxEta = parseDuration(value);
+
+    if (maxEta == 0) {
+        logprintf(LOG_WARN, "the stragglerMaxEta %s in config file is not a valid duration.", value);
+        return;
+    }
+
+    config->stragglerMaxEta = maxEta;
+}
+
+static void segmentedDownloadsCallback (struct xdccGetConfig *config, sds value) {
+    if (str_equals(value, "true")) {
+        cfg_set_bit(config, SEGMENTED_DOWNLOADS_FLAG);
+    }
+    else {
+        cfg_clear_bit(config, SEGMENTED_DOWNLOADS_FLAG);
+    }
+}
+
+static void useJournalCallback (struct xdccGetConfig *config, sds value) {
+    if (str_equals(value, "false")) {
+        cfg_set_bit(config, NO_JOURNAL_FLAG);
+    }
+    else {
+        cfg_clear_bit(config, NO_JOURNAL_FLAG);
+    }
+}
+
+static void useHistoryCallback (struct xdccGetConfig *config, sds value) {
+    if (str_equals(value, "false")) {
+        cfg_set_bit(config, NO_HISTORY_FLAG);
+    }
+    else {
+        cfg_clear_bit(config, NO_HISTORY_FLAG);
+    }
+}
+
+static void useSaslCallback (struct xdccGetConfig *config, sds value) {
+    if (str_equals(value, "false")) {
+        cfg_set_bit(config, NO_SASL_FLAG);
+    }
+    else {
+        cfg_clear_bit(config, NO_SASL_FLAG);
+    }
+}
+
+static void controlSocketCallback (struct xdccGetConfig *config, sds value) {
+    sdsfree(config->controlSocket);
+    config->controlSocket = sdsdup(value);
+}
+
+static void networkCallback (struct xdccGetConfig *config, sds value) {
+    struct ircNetwork *network = parseNetwork(value);
+    struct ircNetwork **last = &config->networks;
+
+    if (network == NULL) {
+        logprintf(LOG_WARN, "the network %s in config file is not valid. it needs to look like rizon irc.rizon.net 6667 #chan1,#chan2.", value);
+        return;
+    }
+
+    if (findNetwork(config, network->name) != NULL) {
+        logprintf(LOG_WARN, "ignoring the second network with the name %s in config file.", network->name);
+        freeNetworks(network);
+        return;
+    }
+
+    while (*last != NULL) {
+        last = &(*last)->next;
+    }
+
+    *last = network;
+}
+
 static void listenIpCallback (struct xdccGetConfig *config, sds value) {
     struct in_addr addr_buf;
     
@@ -121,6 +374,48 @@ static sds getDefaultConfigContent() {
     content = sdscatprintf(content, "confirmFileOffsets=false\n");
     content = sdscatprintf(content, "# Limit the maximum transfer speed for the downloads in each xdccget instance to the specified value per seconds. valid suffixes are KByte, MByte and TByte\n");
     content = sdscatprintf(content, "#maxTransferSpeed=1MByte\n");
+    content = sdscatprintf(content, "# Limit the maximum transfer speed of each single download. uses the same suffixes as maxTransferSpeed\n");
+    content = sdscatprintf(content, "#maxTransferSpeedPerDownload=512KByte\n");
+    content = sdscatprintf(content, "# Limit the maximum transfer speed of all downloads from the same bot. uses the same suffixes as maxTransferSpeed\n");
+    content = sdscatprintf(content, "#maxTransferSpeedPerBot=1MByte\n");
+    content = sdscatprintf(content, "# Limit the transfer speed of all xdccget processes on this host together. the processes share the limit over the shared memory sharedBandwidthName\n");
+    content = sdscatprintf(content, "#maxHostTransferSpeed=10MByte\n");
+    content = sdscatprintf(content, "#sharedBandwidthName=%s\n", SHARED_BANDWIDTH_DEFAULT_NAME);
+    content = sdscatprintf(content, "# Time of day rules, that override maxTransferSpeed. the first matching rule is used. can be given multiple times\n");
+    content = sdscatprintf(content, "# the throttle settings are reloaded on SIGHUP or when this file is changed\n");
+    content = sdscatprintf(content, "#throttleSchedule=mon-fri 08:00-18:00 20MByte\n");
+    content = sdscatprintf(content, "#throttleSchedule=22:00-06:00 unlimited\n");
+    content = sdscatprintf(content, "# A reply of a bot or of nickserv, that is not known yet. the kinds are sending, queued, already-queued, retry-later, invalid-pack, md5 and password-accepted. can be given multiple times\n");
+    content = sdscatprintf(content, "#noticePattern=retry-later no free slots\n");
+    content = sdscatprintf(content, "# Share of maxTransferSpeed for downloads without an own weight=<n> or priority=<high|normal|low> option in the request\n");
+    content = sdscatprintf(content, "#defaultDownloadWeight=1\n");
+    content = sdscatprintf(content, "#defaultDownloadPriority=normal\n");
+    content = sdscatprintf(content, "# Size the receive buffers of the downloads from the measured round trip time and throughput. maxSocketBufferSize limits the memory for each download\n");
+    content = sdscatprintf(content, "#adaptiveSocketBuffers=true\n");
+    content = sdscatprintf(content, "#maxSocketBufferSize=4MByte\n");
+    content = sdscatprintf(content, "# Number of xdcc requests, that are sent at the same time in total and to the same bot. the next request is sent, when a download finished. 0 means no limit\n");
+    content = sdscatprintf(content, "#maxConcurrentDownloads=%d\n", QUEUE_DEFAULT_MAX_DOWNLOADS);
+    content = sdscatprintf(content, "#maxConcurrentDownloadsPerBot=1\n");
+    content = sdscatprintf(content, "# A request, that the bot neither queued nor sent within requestTimeout, is sent again. it fails, when it was refused or timed out maxRequestRetries times. 0 disables them\n");
+    content = sdscatprintf(content, "#requestTimeout=%dm\n", QUEUE_DEFAULT_REQUEST_TIMEOUT_SECS / 60);
+    content = sdscatprintf(content, "#maxRequestRetries=%d\n", QUEUE_DEFAULT_MAX_RETRIES);
+    content = sdscatprintf(content, "# Adjust the number of requests, that are sent at the same time, to the measured throughput. maxConcurrentDownloads is the upper limit then\n");
+    content = sdscatprintf(content, "#adaptiveConcurrency=true\n");
+    content = sdscatprintf(content, "# Record the queue and the progress of the downloads in a journal in this directory, so that unfinished downloads are continued after a crash\n");
+    content = sdscatprintf(content, "#useJournal=true\n");
+    content = sdscatprintf(content, "# Record the throughput of the bots in a history in this directory and ask the mirror first, that is expected to be the fastest at this hour\n");
+    content = sdscatprintf(content, "#useHistory=true\n");
+    content = sdscatprintf(content, "# Log in with sasl during the connect, if the login command is like NickServ identify [account] password and the server supports it\n");
+    content = sdscatprintf(content, "#useSasl=true\n");
+    content = sdscatprintf(content, "# A request with mirrors like bot1 xdcc send #1 | bot2 xdcc send #7 asks the next mirror, when its transfer is slower than this percentage of the median of the other transfers or needs longer than stragglerMaxEta. 0 disables them\n");
+    content = sdscatprintf(content, "#stragglerSpeedRatio=%d\n", QUEUE_DEFAULT_STRAGGLER_RATIO);
+    content = sdscatprintf(content, "#stragglerMaxEta=2h\n");
+    content = sdscatprintf(content, "# Download files of at least 16MByte with mirrors in segments from all mirrors at the same time instead of racing them\n");
+    content = sdscatprintf(content, "#segmentedDownloads=true\n");
+    content = sdscatprintf(content, "# The unix domain socket, at which xdccget --daemon accepts commands. control.sock in this directory by default\n");
+    content = sdscatprintf(content, "#controlSocket=/tmp/xdccget.sock\n");
+    content = sdscatprintf(content, "# An other irc network, that is connected at the same time. requests like @rizon bot xdcc send #1 are sent there. the nick and the login-command are optional\n");
+    content = sdscatprintf(content, "#network=rizon irc.rizon.net 6667 #chan1,#chan2 mynick nickserv identify password\n");
     content = sdscatprintf(content, "# Sets the listen ip for passive dcc transfers. Should normally your external ip address.\n");
     content = sdscatprintf(content, "#listenIp=85.48.89.195\n");
     content = sdscatprintf(content, "# Sets the listen port for passive dcc transfers. This port needs to be forwared in your router, such that external TCP acknowledgements are not blocked.\n");
@@ -160,9 +455,27 @@ static void createDefaultConfigFile() {
     sdsfree(configDir);
 }
 
-static void parseConfigLine(struct xdccGetConfig *config, sds line) {
-    int count, i;
+/* runtimeOnly skips the options, that are only read at the start. their callbacks may exit on a bad value. */
+static bool applyConfigOption(struct xdccGetConfig *config, const char *type, sds value, bool runtimeOnly) {
+    size_t numCallbacks = sizeof (configLineCallbacks) / sizeof (struct ConfigLineParser);
     size_t j = 0;
+
+    for (; j < numCallbacks; j++) {
+        struct ConfigLineParser *lineParser = &configLineCallbacks[j];
+        if (str_equals(type, lineParser->type)) {
+            if (!runtimeOnly || lineParser->runtime) {
+                lineParser->parse_line(config, value);
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void parseConfigLine(struct xdccGetConfig *config, sds line, bool runtimeOnly) {
+    int count, i;
     char *seperator = "=";
     sds *splitted = sdssplitlen(line, sdslen(line), seperator, strlen(seperator), &count);
 
@@ -176,14 +489,7 @@ static void parseConfigLine(struct xdccGetConfig *config, sds line) {
     sds type = splitted[0], value = splitted[1];
     DBG_OK("%s=%s", type, value);
 
-    size_t numCallbacks = sizeof (configLineCallbacks) / sizeof (struct ConfigLineParser);
-
-    for (; j < numCallbacks; j++) {
-        struct ConfigLineParser *lineParser = &configLineCallbacks[j];
-        if (str_equals(type, lineParser->type)) {
-            lineParser->parse_line(config, value);
-        }
-    }
+    applyConfigOption(config, type, value, runtimeOnly);
 
     sdsfreesplitres(splitted, count);
 }
@@ -192,7 +498,7 @@ static inline bool ignoreLine(sds line) {
     return strcmp(line, "") == 0 || line[0] == '#';
 }
 
-static void parseConfigString(struct xdccGetConfig *config, sds content) {
+static void parseConfigString(struct xdccGetConfig *config, sds content, bool runtimeOnly) {
     int count, i;
     char *seperator = "\n";
     sds *splitted = sdssplitlen(content, sdslen(content), seperator, strlen(seperator), &count);
@@ -203,16 +509,26 @@ static void parseConfigString(struct xdccGetConfig *config, sds content) {
             continue;
         }
 
-        parseConfigLine(config, splitted[i]);
+        parseConfigLine(config, splitted[i], runtimeOnly);
     }
 
     sdsfreesplitres(splitted, count);
 }
 
-void parseConfigFile(struct xdccGetConfig *config) {
-    DBG_OK("in parseConfigFile");
+static volatile sig_atomic_t reloadRequested = 0;
+static time_t configFileMtime = 0;
+static time_t lastConfigFileCheck = 0;
+
+static sds getConfigFilePath() {
     sds configDir = getConfigDirectory();
     sds configFilePath = sdscatprintf(sdsempty(), "%s%s", configDir, "config");
+    sdsfree(configDir);
+    return configFilePath;
+}
+
+void parseConfigFile(struct xdccGetConfig *config) {
+    DBG_OK("in parseConfigFile");
+    sds configFilePath = getConfigFilePath();
 
     if (!file_exists(configFilePath)) {
         DBG_OK("config file does not exist, need to create one!");
@@ -220,9 +536,129 @@ void parseConfigFile(struct xdccGetConfig *config) {
     }
 
     sds content = readTextFile(configFilePath);
-    parseConfigString(config, content);
+    parseConfigString(config, content, false);
+    configFileMtime = get_file_mtime(configFilePath);
 
     sdsfree(content);
-    sdsfree(configDir);
+    sdsfree(configFilePath);
+}
+
+enum configOptionResult setConfigOption(struct xdccGetConfig *config, const char *option, const char *value) {
+    size_t numCallbacks = sizeof (configLineCallbacks) / sizeof (struct ConfigLineParser);
+    size_t j;
+
+    for (j = 0; j < numCallbacks; j++) {
+        if (str_equals(option, configLineCallbacks[j].type)) {
+            break;
+        }
+    }
+
+    if (j == numCallbacks) {
+        return CONFIG_OPTION_UNKNOWN;
+    }
+
+    if (!configLineCallbacks[j].runtime) {
+        return CONFIG_OPTION_STARTUP_ONLY;
+    }
+
+    sds trimmedValue = sdstrim(sdsnew(value), " \t");
+    configLineCallbacks[j].parse_line(config, trimmedValue);
+    sdsfree(trimmedValue);
+
+    /* the added pattern only takes effect in a new automaton */
+    if (configLineCallbacks[j].parse_line == noticePatternCallback) {
+        buildNoticeMatcher(config->noticePatterns);
+    }
+
+    return CONFIG_OPTION_SET;
+}
+
+void requestConfigReload() {
+    reloadRequested = 1;
+}
+
+bool shouldReloadConfig() {
+    if (reloadRequested) {
+        return true;
+    }
+
+    time_t now = time(NULL);
+
+    if (now - lastConfigFileCheck < CONFIG_WATCH_INTERVAL) {
+        return false;
+    }
+
+    lastConfigFileCheck = now;
+
+    sds configFilePath = getConfigFilePath();
+    time_t mtime = get_file_mtime(configFilePath);
+    sdsfree(configFilePath);
+
+    return mtime != 0 && mtime != configFileMtime;
+}
+
+/* takes the throttle settings of the reloaded config. limits given on the command line always win. */
+static void applyThrottleSettings(struct xdccGetConfig *config, struct xdccGetConfig *reloaded) {
+    if (!cfg_get_bit(config, MAX_SPEED_ARG_FLAG)) {
+        config->maxTransferSpeed = reloaded->maxTransferSpeed;
+    }
+
+    if (!cfg_get_bit(config, DOWNLOAD_SPEED_ARG_FLAG)) {
+        config->maxTransferSpeedPerDownload = reloaded->maxTransferSpeedPerDownload;
+    }
+
+    if (!cfg_get_bit(config, BOT_SPEED_ARG_FLAG)) {
+        config->maxTransferSpeedPerBot = reloaded->maxTransferSpeedPerBot;
+    }
+
+    if (!cfg_get_bit(config, HOST_SPEED_ARG_FLAG)) {
+        config->maxHostTransferSpeed = reloaded->maxHostTransferSpeed;
+    }
+
+    config->defaultWeight = reloaded->defaultWeight;
+    config->defaultPriority = reloaded->defaultPriority;
+
+    freeThrottleSchedule(config->throttleSchedule);
+    config->throttleSchedule = reloaded->throttleSchedule;
+    reloaded->throttleSchedule = NULL;
+}
+
+void reloadConfigFile(struct xdccGetConfig *config) {
+    struct xdccGetConfig reloaded;
+    sds configFilePath = getConfigFilePath();
+
+    reloadRequested = 0;
+    lastConfigFileCheck = time(NULL);
+
+    if (!file_exists(configFilePath)) {
+        logprintf(LOG_WARN, "the config file %s does not exist anymore, keeping the current settings.", configFilePath);
+        configFileMtime = 0;
+        sdsfree(configFilePath);
+        return;
+    }
+
+    memset(&reloaded, 0, sizeof(struct xdccGetConfig));
+    reloaded.maxTransferSpeed = NO_SPEED_LIMIT;
+    reloaded.maxTransferSpeedPerDownload = NO_SPEED_LIMIT;
+    reloaded.maxTransferSpeedPerBot = NO_SPEED_LIMIT;
+    reloaded.maxHostTransferSpeed = NO_SPEED_LIMIT;
+    reloaded.defaultWeight = DOWNLOAD_DEFAULT_WEIGHT;
+    reloaded.defaultPriority = DOWNLOAD_PRIORITY_NORMAL;
+
+    sds content = readTextFile(configFilePath);
+    /* a running process keeps the options of the start, a typo in them must not end it */
+    parseConfigString(&reloaded, content, true);
+    configFileMtime = get_file_mtime(configFilePath);
+
+    applyThrottleSettings(config, &reloaded);
+
+    freeNoticePatterns(config->noticePatterns);
+    config->noticePatterns = reloaded.noticePatterns;
+    reloaded.noticePatterns = NULL;
+    buildNoticeMatcher(config->noticePatterns);
+    logprintf(LOG_INFO, "reloaded the throttle settings and the notice patterns from %s", configFilePath);
+
+    sdsfree(reloaded.targetDir);
+    sdsfree(content);
     sdsfree(configFilePath);
 }
@@ -7,8 +7,31 @@ extern "C" {
     
 #include "helper.h"
 
+/* how often the config file is checked for changes in seconds. */
+#define CONFIG_WATCH_INTERVAL 2
+
 void parseConfigFile (struct xdccGetConfig *config);
 
+enum configOptionResult {
+    CONFIG_OPTION_SET,
+    CONFIG_OPTION_UNKNOWN,
+    /* the option is only read at the start, e.g. the networks or the journal */
+    CONFIG_OPTION_STARTUP_ONLY
+};
+
+/* applies a single option like a line option=value of the config file to the running config. the options, that are
+   only read at the start, are left unchanged. */
+enum configOptionResult setConfigOption(struct xdccGetConfig *config, const char *option, const char *value);
+
+/* called from the signal handler of SIGHUP. the reload itself happens in the event loop. */
+void requestConfigReload();
+
+/* returns true, if a reload was requested or the config file has changed. */
+bool shouldReloadConfig();
+
+/* parses the config file again and applies the throttle settings to the running config. */
+void reloadConfigFile(struct xdccGetConfig *config);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -0,0 +1,398 @@
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#ifdef _MSC_VER
+#include <winsock2.h>
+#endif
+
+#include "control.h"
+#include "config.h"
+#include "queue.h"
+#include "bandwidth.h"
+#include "xdccget.h"
+#include "network.h"
+#include "os_specific.h"
+
+struct controlClient {
+    int fd;
+    sds input;
+    sds output;
+    /* set, if the client is disconnected after its output was sent */
+    bool closing;
+};
+
+struct ControlCommand {
+    char *name;
+    void (*run) (irc_session_t *session, struct controlClient *client, char *args);
+};
+
+static void enqueueCommand(irc_session_t *session, struct controlClient *client, char *args);
+static void cancelCommand(irc_session_t *session, struct controlClient *client, char *args);
+static void setCommand(irc_session_t *session, struct controlClient *client, char *args);
+static void statusCommand(irc_session_t *session, struct controlClient *client, char *args);
+static void shutdownCommand(irc_session_t *session, struct controlClient *client, char *args);
+
+static struct ControlCommand controlCommands[] = {
+    {"ENQUEUE", enqueueCommand},
+    {"CANCEL", cancelCommand},
+    {"SET", setCommand},
+    {"STATUS", statusCommand},
+    {"SHUTDOWN", shutdownCommand},
+};
+
+static int controlSocket = -1;
+static sds controlSocketPath = NULL;
+static struct controlClient controlClients[CONTROL_MAX_CLIENTS];
+static uint32_t numControlClients = 0;
+
+static void reply(struct controlClient *client, const char *line) {
+    client->output = sdscat(client->output, line);
+    client->output = sdscat(client->output, "\n");
+}
+
+static void startRequests(irc_session_t *session) {
+    /* before the channels are joined, the requests are sent by send_xdcc_requests */
+    if (cfg_get_bit(getCfg(), SENDED_FLAG)) {
+        startQueuedDownloads();
+    }
+}
+
+static void enqueueCommand(irc_session_t *session, struct controlClient *client, char *args) {
+    struct dccDownload *download = parseDccDownloadLine(args);
+
+    if (download == NULL) {
+        reply(client, "ERR invalid bot cmd");
+        return;
+    }
+
+    logprintf(LOG_INFO, "queued %s %s from the control socket.", download->botNick, download->xdccCmd);
+    enqueueDownload(download);
+    startRequests(session);
+    reply(client, "OK");
+}
+
+static void cancelCommand(irc_session_t *session, struct controlClient *client, char *args) {
+    struct dccDownload *download = parseDccDownloadLine(args);
+
+    if (download == NULL) {
+        reply(client, "ERR invalid bot cmd");
+        return;
+    }
+
+    if (cancelDownload(download)) {
+        logprintf(LOG_INFO, "canceled %s %s from the control socket.", download->botNick, download->xdccCmd);
+        startRequests(session);
+        reply(client, "OK");
+    }
+    else {
+        reply(client, "ERR no such request");
+    }
+
+    freeDccDownload(download);
+}
+
+static void setCommand(irc_session_t *session, struct controlClient *client, char *args) {
+    char *value = strchr(args, ' ');
+
+    if (value == NULL) {
+        reply(client, "ERR missing value");
+        return;
+    }
+
+    *value = '\0';
+    value++;
+
+    switch (setConfigOption(getCfg(), args, value)) {
+        case CONFIG_OPTION_SET:
+            break;
+        case CONFIG_OPTION_UNKNOWN:
+            reply(client, "ERR unknown option");
+            return;
+        case CONFIG_OPTION_STARTUP_ONLY:
+            reply(client, "ERR the option is only read at the start");
+            return;
+    }
+
+    logprintf(LOG_INFO, "set %s to %s from the control socket.", args, value);
+    updateBandwidthLimits();
+    /* the windows of the queue may have grown */
+    startRequests(session);
+    reply(client, "OK");
+}
+
+static void statusCommand(irc_session_t *session, struct controlClient *client, char *args) {
+    struct xdccGetConfig *config = getCfg();
+    struct ircNetwork *network;
+    uint64_t processed = 0, dropped = 0;
+    irc_send_queue_stats_t sendQueue;
+    irc_server_lag_t lag;
+
+    memset(&sendQueue, 0, sizeof(sendQueue));
+    memset(&lag, 0, sizeof(lag));
+
+    for (network = config->networks; network != NULL; network = network->next) {
+        if (network->session != NULL) {
+            uint64_t networkProcessed, networkDropped;
+            irc_send_queue_stats_t networkQueue;
+            irc_server_lag_t networkLag;
+
+            irc_get_line_counters(network->session, &networkProcessed, &networkDropped);
+            processed += networkProcessed;
+            dropped += networkDropped;
+
+            irc_get_send_queue_stats(network->session, &networkQueue);
+            sendQueue.waiting_lines += networkQueue.waiting_lines;
+            sendQueue.unsent_bytes += networkQueue.unsent_bytes;
+            sendQueue.sent_lines += networkQueue.sent_lines;
+            sendQueue.delay_sum_ms += networkQueue.delay_sum_ms;
+
+            if (networkQueue.max_delay_ms > sendQueue.max_delay_ms) {
+                sendQueue.max_delay_ms = networkQueue.max_delay_ms;
+            }
+
+            irc_get_server_lag(network->session, &networkLag);
+            lag.samples += networkLag.samples;
+
+            if (networkLag.current_ms > lag.current_ms) {
+                lag.current_ms = networkLag.current_ms;
+            }
+
+            if (networkLag.max_ms > lag.max_ms) {
+                lag.max_ms = networkLag.max_ms;
+            }
+        }
+    }
+
+    client->output = appendDownloadStatus(client->output);
+    client->output = sdscatprintf(client->output, "QUEUE %" PRIu32 " %" PRIu32 "\n", getNumPendingDownloads(), getNumRequestedDownloads());
+    client->output = sdscatprintf(client->output, "LIMITS %" IRC_DCC_SIZE_T_FORMAT " %" IRC_DCC_SIZE_T_FORMAT " %" IRC_DCC_SIZE_T_FORMAT " %" PRIu32 " %" PRIu32 "\n",
+        config->maxTransferSpeed, config->maxTransferSpeedPerDownload, config->maxTransferSpeedPerBot,
+        config->maxConcurrentDownloads, config->maxConcurrentDownloadsPerBot);
+    client->output = sdscatprintf(client->output, "LINES %" PRIu64 " %" PRIu64 "\n", processed, dropped);
+    client->output = sdscatprintf(client->output, "SENDQ %u %zu %" PRIu64 " %" PRIu64 "\n", sendQueue.waiting_lines, sendQueue.unsent_bytes,
+        (sendQueue.sent_lines != 0) ? sendQueue.delay_sum_ms / sendQueue.sent_lines : 0, sendQueue.max_delay_ms);
+    client->output = sdscatprintf(client->output, "LAG %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", lag.samples, lag.current_ms, lag.max_ms);
+    reply(client, "OK");
+}
+
+static void shutdownCommand(irc_session_t *session, struct controlClient *client, char *args) {
+    logprintf(LOG_INFO, "shutting down on request of the control socket.");
+    reply(client, "OK");
+    client->closing = true;
+    quitNetworks(getCfg(), "Goodbye!");
+}
+
+static void runCommand(irc_session_t *session, struct controlClient *client, char *line) {
+    size_t numCommands = sizeof (controlCommands) / sizeof (struct ControlCommand);
+    char *args = strchr(line, ' ');
+    size_t i;
+
+    if (args != NULL) {
+        *args = '\0';
+        args++;
+    }
+    else {
+        args = line + strlen(line);
+    }
+
+    for (i = 0; i < numCommands; i++) {
+        if (strcasecmp(line, controlCommands[i].name) == 0) {
+            controlCommands[i].run(session, client, args);
+            return;
+        }
+    }
+
+    reply(client, "ERR unknown command");
+}
+
+/* runs all complete lines of the input. the last incomplete line stays in the buffer. */
+static void runCommands(irc_session_t *session, struct controlClient *client) {
+    char *start = client->input;
+    char *end;
+
+    while (!client->closing && (end = strchr(start, '\n')) != NULL) {
+        *end = '\0';
+
+        if (end != start && end[-1] == '\r') {
+            end[-1] = '\0';
+        }
+
+        if (*start != '\0') {
+            runCommand(session, client, start);
+        }
+
+        start = end + 1;
+    }
+
+    sdsrange(client->input, start - client->input, -1);
+
+    if (sdslen(client->input) > CONTROL_MAX_LINE_LENGTH) {
+        reply(client, "ERR line too long");
+        client->closing = true;
+    }
+}
+
+static bool isWouldBlockError() {
+#ifdef _MSC_VER
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+static bool readClient(irc_session_t *session, struct controlClient *client) {
+    char chunk[CONTROL_READ_CHUNK];
+    int readBytes = recv(client->fd, chunk, sizeof(chunk), 0);
+
+    if (readBytes < 0) {
+        return isWouldBlockError();
+    }
+
+    if (readBytes == 0) {
+        return false;
+    }
+
+    client->input = sdscatlen(client->input, chunk, readBytes);
+    runCommands(session, client);
+    return true;
+}
+
+static bool writeClient(struct controlClient *client) {
+    int sentBytes = send(client->fd, client->output, sdslen(client->output), 0);
+
+    if (sentBytes < 0) {
+        /* the rest is sent, when the socket is writable again */
+        return isWouldBlockError();
+    }
+
+    sdsrange(client->output, sentBytes, -1);
+    return true;
+}
+
+static void closeClient(uint32_t index) {
+    struct controlClient *client = &controlClients[index];
+
+    closeLocalSocket(client->fd);
+    sdsfree(client->input);
+    sdsfree(client->output);
+
+    numControlClients--;
+    controlClients[index] = controlClients[numControlClients];
+}
+
+static void acceptClients() {
+    int fd;
+
+    while ((fd = acceptLocalSocket(controlSocket)) != -1) {
+        if (numControlClients == CONTROL_MAX_CLIENTS) {
+            logprintf(LOG_WARN, "refusing a client of the control socket, because %d clients are connected.", CONTROL_MAX_CLIENTS);
+            closeLocalSocket(fd);
+            continue;
+        }
+
+        struct controlClient *client = &controlClients[numControlClients];
+        client->fd = fd;
+        client->input = sdsempty();
+        client->output = sdsempty();
+        client->closing = false;
+        numControlClients++;
+    }
+}
+
+bool openControlSocket(struct xdccGetConfig *config) {
+    if (config->controlSocket != NULL) {
+        controlSocketPath = sdsdup(config->controlSocket);
+    }
+    else {
+        sds configDir = getConfigDirectory();
+        controlSocketPath = sdscatprintf(sdsempty(), "%s%s", configDir, CONTROL_SOCKET_FILE_NAME);
+        sdsfree(configDir);
+    }
+
+    controlSocket = openLocalSocket(controlSocketPath);
+
+    if (controlSocket == -1) {
+        sdsfree(controlSocketPath);
+        controlSocketPath = NULL;
+        return false;
+    }
+
+    logprintf(LOG_INFO, "waiting for commands at the control socket %s.", controlSocketPath);
+    return true;
+}
+
+void addControlDescriptors(irc_session_t *session) {
+    uint32_t i;
+
+    if (controlSocket == -1) {
+        return;
+    }
+
+    irc_watch_descriptor(session, controlSocket, LIBIRC_WATCH_READ);
+
+    for (i = 0; i < numControlClients; i++) {
+        struct controlClient *client = &controlClients[i];
+        int flags = client->closing ? 0 : LIBIRC_WATCH_READ;
+
+        if (sdslen(client->output) != 0) {
+            flags |= LIBIRC_WATCH_WRITE;
+        }
+
+        irc_watch_descriptor(session, client->fd, flags);
+    }
+}
+
+void processControlDescriptors(irc_session_t *session) {
+    uint32_t numWatchedClients = numControlClients;
+    uint32_t i = 0;
+
+    if (controlSocket == -1) {
+        return;
+    }
+
+    /* the clients, that are accepted now, were not watched in this round */
+    while (i < numWatchedClients) {
+        struct controlClient *client = &controlClients[i];
+        bool connected = true;
+
+        if (!client->closing && irc_is_descriptor_ready(session, client->fd, LIBIRC_WATCH_READ)) {
+            connected = readClient(session, client);
+        }
+
+        /* most answers fit into the socket buffer and are sent right away */
+        if (connected && sdslen(client->output) != 0) {
+            connected = writeClient(client);
+        }
+
+        if (!connected || (client->closing && sdslen(client->output) == 0)) {
+            /* the last client is moved into this slot and processed next */
+            closeClient(i);
+            numWatchedClients--;
+            continue;
+        }
+
+        i++;
+    }
+
+    if (irc_is_descriptor_ready(session, controlSocket, LIBIRC_WATCH_READ)) {
+        acceptClients();
+    }
+}
+
+void closeControlSocket() {
+    if (controlSocket == -1) {
+        return;
+    }
+
+    while (numControlClients != 0) {
+        closeClient(numControlClients - 1);
+    }
+
+    closeLocalSocket(controlSocket);
+    controlSocket = -1;
+
+    remove(controlSocketPath);
+    sdsfree(controlSocketPath);
+    controlSocketPath = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "helper.h"
+
+/* the control socket is placed in the config directory, if controlSocket is not set. */
+#define CONTROL_SOCKET_FILE_NAME "control.sock"
+#define CONTROL_MAX_CLIENTS 16
+/* a client, that sends a longer line, is disconnected. */
+#define CONTROL_MAX_LINE_LENGTH 4096
+#define CONTROL_READ_CHUNK 1024
+
+/*
+ * The daemon mode takes commands over a local stream socket, one command per line.
+ * Every command is answered with OK or ERR <reason> in a line of its own:
+ *   ENQUEUE <bot cmd>         appends a request like a line of the queue file
+ *   CANCEL <bot cmd>          removes the request from the queue or aborts its transfer
+ *   SET <option> <value>      changes an option of the config file, e.g. SET maxTransferSpeed 2MByte
+ *   STATUS                    lists the running downloads, the queue and the limits before the OK
+ *   SHUTDOWN                  quits the irc connection and exits xdccget
+ */
+
+/* listens at the controlSocket of config or at the default socket in the config directory.
+   returns false, if the socket can not be created. */
+bool openControlSocket(struct xdccGetConfig *config);
+
+/* adds the listening socket and the clients to the network loop. used as add_descriptors callback. */
+void addControlDescriptors(irc_session_t *session);
+
+/* accepts new clients, runs their commands and sends the answers. used as process_descriptors callback. */
+void processControlDescriptors(irc_session_t *session);
+
+/* disconnects all clients and removes the socket file. */
+void closeControlSocket();
+
+#endif
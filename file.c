@@ -1,10 +1,15 @@
 #ifdef FILE_API
     #include <stdio.h>
-#else
-    #include <fcntl.h>
+#endif
+
+#include <fcntl.h>
+
+#ifdef _MSC_VER
+#include <io.h>
 #endif
 
 #include "file.h"
+#include "os_specific.h"
 
 #define FILE_READ_BUFFER_SIZE BUFSIZ
 
@@ -19,6 +24,8 @@ file_io_t *Open(const char *pathname, char *mode) {
         fd->fd = fopen(pathname, "ab");
     } else if (str_equals(mode, "r")) {
         fd->fd = fopen(pathname, "rb");
+    } else if (str_equals(mode, "rw")) {
+        fd->fd = fopen(pathname, "rb+");
     }
 
     if (fd->fd == NULL) {
@@ -40,6 +47,8 @@ file_io_t *Open(const char *pathname, char *mode) {
         fd->fd = open(pathname, O_WRONLY | O_APPEND, 0 /*ignored*/);
     } else if (str_equals(mode, "r")) {
         fd->fd = open(pathname, O_RDONLY, 0 /*ignored*/);
+    } else if (str_equals(mode, "rw")) {
+        fd->fd = open(pathname, O_WRONLY, 0 /*ignored*/);
     }
 
     if (fd->fd == -1) {
@@ -103,6 +112,18 @@ void Seek(file_io_t *fd, uint64_t offset, int whence) {
 #endif
 }
 
+void Flush(file_io_t *fd) {
+#ifdef FILE_API
+    if (fflush(fd->fd) != 0) {
+        logprintf(LOG_ERR, "Cant flush the file %s. Exiting now.", fd->fileName);
+        exitPgm(EXIT_FAILURE);
+    }
+#else
+    /* write is not buffered */
+    (void) fd;
+#endif
+}
+
 void readFile(char *filename, FileReader callback, void *ctx) {
     char buffer[FILE_READ_BUFFER_SIZE + 1];
     size_t bytesRead;
@@ -156,4 +177,28 @@ irc_dcc_size_t get_file_size(char* filename) {
 
    return (irc_dcc_size_t) size.QuadPart;
 }
-#endif
\ No newline at end of file
+#endif
+bool replaceFile(const char *path, const char *content, size_t length, bool sync) {
+    sds tmpPath = sdscatprintf(sdsempty(), "%s.tmp", path);
+    bool success = false;
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    if (fd != -1) {
+        success = write(fd, content, length) == (ssize_t) length && (!sync || syncFile(fd));
+        close(fd);
+
+#ifdef _MSC_VER
+        /* rename does not replace existing files on windows, MoveFileEx does it in one step */
+        if (success && !MoveFileExA(tmpPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+            /* MoveFileEx sets no errno */
+            errno = EIO;
+            success = false;
+        }
+#else
+        success = success && rename(tmpPath, path) == 0;
+#endif
+    }
+
+    sdsfree(tmpPath);
+    return success;
+}
@@ -60,6 +60,17 @@ static inline bool dir_exists(char *dir) {
     return false;
 }
 
+/* returns the time of the last modification of file or 0, if the file cant be accessed. */
+static inline time_t get_file_mtime(char *file) {
+    struct stat s;
+
+    if (stat(file, &s) == -1) {
+        return 0;
+    }
+
+    return s.st_mtime;
+}
+
 irc_dcc_size_t get_file_size(char* filename);
 
 #ifdef FILE_API
@@ -117,7 +128,14 @@ static inline void Write(file_io_t *fd, const void *buf, size_t count) {
 file_io_t* Open(const char *pathname, char *mode);
 void Close(file_io_t *fd);
 void Seek(file_io_t *fd, uint64_t offset, int whence);
+/* hands the buffered data of fd to the operating system. */
+void Flush(file_io_t *fd);
 void readFile(char *filename, FileReader callback, void *ctx);
 
+/* writes content to a temporary file beside path and replaces path with it at once, so that a crash leaves either the
+   old or the new file and never a torn or a missing one. sync flushes the data to the disk before. returns false and
+   sets errno, if the file cant be written. */
+bool replaceFile(const char *path, const char *content, size_t length, bool sync);
+
 #endif	/* FILE_H */
 
@@ -329,7 +329,7 @@ irc_dcc_size_t getSizeOf(unsigned int value, char *size) {
     }
 }
 
-void setMaxTransferSpeed(struct xdccGetConfig *config, sds value) {
+irc_dcc_size_t parseTransferSpeed(sds value) {
     int val = 0;
     char size[SPEED_READER_BUFSIZE+1];
     memset(size, 0, sizeof(size));
@@ -339,16 +339,53 @@ void setMaxTransferSpeed(struct xdccGetConfig *config, sds value) {
 #else
     int ret = sscanf(value, "%d%100s", &val, size);
 #endif
-    if (ret == 2) {
+    if (ret == 2 && val > 0) {
        irc_dcc_size_t maxSpeed = getSizeOf(val, size);
-       if (maxSpeed > 0) {
-          config->maxTransferSpeed = maxSpeed;
-       } else {
-          config->maxTransferSpeed = NO_SPEED_LIMIT;
+       if (maxSpeed != (irc_dcc_size_t) -1) {
+          return maxSpeed;
        }
-    } else {
-         config->maxTransferSpeed = NO_SPEED_LIMIT;
     }
+
+    return NO_SPEED_LIMIT;
+}
+
+void setMaxTransferSpeed(struct xdccGetConfig *config, sds value) {
+    config->maxTransferSpeed = parseTransferSpeed(value);
+}
+
+int parseDownloadPriority(const char *value) {
+    if (str_equals(value, "high")) {
+        return DOWNLOAD_PRIORITY_HIGH;
+    }
+    else if (str_equals(value, "normal")) {
+        return DOWNLOAD_PRIORITY_NORMAL;
+    }
+    else if (str_equals(value, "low")) {
+        return DOWNLOAD_PRIORITY_LOW;
+    }
+
+    return DOWNLOAD_PRIORITY_DEFAULT;
+}
+
+time_t parseDuration(const char *value) {
+    char *end = NULL;
+    long val = strtol(value, &end, 10);
+
+    if (end == value || val <= 0) {
+        return 0;
+    }
+
+    if (*end == '\0' || str_equals(end, "s")) {
+        return val;
+    }
+    else if (str_equals(end, "m")) {
+        return val * 60;
+    }
+    else if (str_equals(end, "h")) {
+        return val * 60 * 60;
+    }
+
+    return 0;
 }
 
 void setDelay(struct xdccGetConfig* config, sds value) {
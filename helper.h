@@ -110,20 +110,67 @@ do {\
 
 #define bitset_t uint64_t
 
-typedef unsigned int sleeptime_t;
 #define NO_SPEED_LIMIT 0
 
+/* priority classes of a download. the share of the global bandwidth is the weight multiplied with the factor of the class. */
+#define DOWNLOAD_PRIORITY_DEFAULT -1
+#define DOWNLOAD_PRIORITY_LOW      0
+#define DOWNLOAD_PRIORITY_NORMAL   1
+#define DOWNLOAD_PRIORITY_HIGH     2
+
+#define DOWNLOAD_DEFAULT_WEIGHT 1
+#define DOWNLOAD_MAX_WEIGHT     1000
+
+/* default upper limit of the adaptive receive buffer of each download, 4MByte */
+#define DEFAULT_MAX_SOCKET_BUFFER_SIZE (4 * 1024 * 1024)
+
 struct xdccSendDelay {
     time_t sendDelayInSecs;
     time_t timeToSendCommand;
 };
 
+struct ircNetwork;
+struct segmentedFile;
+struct fileSegment;
+struct noticeMatch;
+
 struct xdccGetConfig {
+    /* the session of the network of the command line */
     irc_session_t *session;
+    /* the network of the command line first, then the networks of the config file */
+    struct ircNetwork *networks;
     uint32_t logLevel;
     struct dccDownload **dccDownloadArray;
     uint32_t numDownloads;
     irc_dcc_size_t maxTransferSpeed;
+    irc_dcc_size_t maxTransferSpeedPerDownload;
+    irc_dcc_size_t maxTransferSpeedPerBot;
+    /* limit for all xdccget processes on this host, shared via sharedBandwidthName */
+    irc_dcc_size_t maxHostTransferSpeed;
+    sds sharedBandwidthName;
+    uint32_t defaultWeight;
+    int defaultPriority;
+    /* time of day rules, that override maxTransferSpeed */
+    struct throttleRule *throttleSchedule;
+    /* the patterns of the config file, that the notice matcher finds in front of the built in ones */
+    struct noticePattern *noticePatterns;
+    /* upper limit of the receive buffer of each download, if adaptiveSocketBuffers is enabled */
+    irc_dcc_size_t maxSocketBufferSize;
+    /* file with one request per line, - for stdin */
+    sds queueFile;
+    /* number of requests, that are in flight at the same time. 0 means no limit */
+    uint32_t maxConcurrentDownloads;
+    uint32_t maxConcurrentDownloadsPerBot;
+    /* a request, that the bot neither queued nor sent within this time in seconds, is sent again. 0 disables it */
+    time_t requestTimeout;
+    /* a request, that was refused or timed out this many times, fails. 0 means no limit */
+    uint32_t maxRequestRetries;
+    /* a transfer, whose speed is below this percentage of the median speed of the other transfers, is raced by a mirror. 0 disables it */
+    uint32_t stragglerSpeedRatio;
+    /* a transfer, whose remaining time is longer than this in seconds, is raced by a mirror. 0 disables it */
+    time_t stragglerMaxEta;
+    /* the unix domain socket of the daemon mode */
+    sds controlSocket;
     struct xdccSendDelay* sendDelay;
     bitset_t flags;
     
@@ -148,7 +195,23 @@ struct xdccGetConfig {
 #define SENDED_FLAG               0x06
 #define ACCEPT_ALL_NICKS_FLAG     0x07
 #define DONT_CONFIRM_OFFSETS_FLAG 0x08
-#define ON_CONNECT_EVENT_DONE     0x09
+/* set if the limit was given on the command line, so that a reload of the config file keeps it. */
+#define MAX_SPEED_ARG_FLAG        0x0A
+#define DOWNLOAD_SPEED_ARG_FLAG   0x0B
+#define BOT_SPEED_ARG_FLAG        0x0C
+#define HOST_SPEED_ARG_FLAG       0x0D
+#define ADAPTIVE_SOCKET_BUFFERS_FLAG 0x0E
+#define NO_JOURNAL_FLAG           0x0F
+/* keeps the connection after the queue drained and takes commands from the control socket */
+#define DAEMON_FLAG               0x10
+/* splits big files with mirrors into segments, that are downloaded from all mirrors at the same time */
+#define SEGMENTED_DOWNLOADS_FLAG  0x11
+/* the number of concurrent requests is adjusted to the measured goodput instead of maxConcurrentDownloads */
+#define ADAPTIVE_CONCURRENCY_FLAG 0x12
+/* set if useHistory is false, so that the throughput of the bots is neither recorded nor used to rank mirrors */
+#define NO_HISTORY_FLAG           0x13
+/* set if useSasl is false, so that a NickServ login command is sent after the welcome instead of logging in with sasl */
+#define NO_SASL_FLAG              0x14
 
 
 struct terminalDimension {
@@ -161,9 +224,48 @@ struct checksumThreadData {
 	sds expectedHash;
 };
 
+struct tokenBucket {
+    irc_dcc_size_t rate;
+    irc_dcc_size_t capacity;
+    irc_dcc_size_t tokens;
+    /* sub-byte remainder of the last refill in thousandths of a byte */
+    irc_dcc_size_t fraction;
+    uint64_t lastRefill;
+};
+
+struct bandwidthShare {
+    /* weight of the download multiplied with the factor of its priority class */
+    uint32_t weight;
+    /* absolute time, when the download should be finished, or 0 */
+    time_t deadline;
+    /* bytes of the global budget, that were handed out to this download but not yet received */
+    irc_dcc_size_t deficit;
+    struct dccDownloadContext *next;
+};
+
 struct dccDownloadContext {
+    /* the request of the queue, that this transfer belongs to. may be NULL with --accept-all-nicks */
+    struct dccDownload *download;
+    irc_dcc_t dccid;
+    /* the session of the network, that the bot is connected to */
+    irc_session_t *session;
+    /* set, when the transfer finished or failed. libircclient may still call back with the context then */
+    bool finished;
+    uint64_t finishTime;
+    struct dccDownloadContext *nextFinished;
     struct dccDownloadProgress *progress;
     struct file_io_t *fd;
+    /* the part of a segmented file, that this transfer writes, or NULL if it writes the whole file */
+    struct fileSegment *segment;
+    struct segmentedFile *segmentedFile;
+    /* the monotonic times in ms, when the offer was accepted and when the first byte arrived, for the history of the bot */
+    uint64_t offerTime;
+    uint64_t firstByteTime;
+    irc_dcc_size_t firstByteOffset;
+    irc_dcc_size_t peakSpeed;
+    struct tokenBucket bucket;
+    struct tokenBucket *botBucket;
+    struct bandwidthShare share;
 };
 
 static inline void clear_bit(bitset_t* x, int bitNum) {
@@ -222,6 +324,18 @@ static inline void* Calloc(size_t numElements, size_t sizeOfElement) {
     return t;
 }
 
+/* wraps realloc call. */
+static inline void* Realloc(void *ptr, size_t size) {
+    void *t = realloc(ptr, size);
+    if (unlikely(t == NULL))
+    {
+        logprintf(LOG_ERR, "realloc failed. exiting now.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return t;
+}
+
 static inline sds getConfigDirectory() {
     sds configDir = sdscatprintf(sdsempty(), "%s%s%s%s", getHomeDir(), getPathSeperator(), ".xdccget", getPathSeperator());
     return configDir;
@@ -244,8 +358,16 @@ irc_dcc_size_t getSizeOf(unsigned int value, char *size);
 
 void outputProgress(struct dccDownloadProgress *tdp);
 
+irc_dcc_size_t parseTransferSpeed(sds value);
+
 void setMaxTransferSpeed(struct xdccGetConfig *config, sds value);
 
+/* parses high, normal or low. returns DOWNLOAD_PRIORITY_DEFAULT, if value is not a valid priority class. */
+int parseDownloadPriority(const char *value);
+
+/* parses a duration like 90s, 30m or 2h and returns it in seconds. returns 0 if value is not valid. */
+time_t parseDuration(const char *value);
+
 static inline bool ends_with(const char* str, const char* suffix) {
     if (!str || !suffix) return false;
     size_t len_str = strlen(str);
@@ -0,0 +1,322 @@
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "history.h"
+#include "file.h"
+#include "network.h"
+#include "os_specific.h"
+
+/* the transfers of a bot in an hour of the day. the times are sums over all transfers. */
+struct botHistory {
+    /* the network of the bot or NULL for the network of the command line */
+    sds network;
+    sds nick;
+    int hour;
+    uint32_t transfers;
+    uint32_t failures;
+    uint64_t bytes;
+    uint64_t durationMs;
+    uint64_t firstByteMs;
+    irc_dcc_size_t peakSpeed;
+    struct botHistory *next;
+};
+
+static struct botHistory *histories = NULL;
+static bool historyEnabled = false;
+static bool historyDirty = false;
+static uint64_t lastSaveTime = 0;
+
+static sds getHistoryPath() {
+    sds configDir = getConfigDirectory();
+    sds path = sdscatprintf(sdsempty(), "%s%s", configDir, HISTORY_FILE_NAME);
+    sdsfree(configDir);
+    return path;
+}
+
+static int getHourOfDay() {
+    time_t now = time(NULL);
+    struct tm localTime;
+
+#ifdef _MSC_VER
+    localtime_s(&localTime, &now);
+#else
+    localtime_r(&now, &localTime);
+#endif
+
+    return localTime.tm_hour;
+}
+
+static struct botHistory* getBotHistory(const char *network, const char *nick, int hour) {
+    struct botHistory *history;
+
+    for (history = histories; history != NULL; history = history->next) {
+        if (history->hour == hour && isSameNetwork(history->network, network) && strcasecmp(history->nick, nick) == 0) {
+            return history;
+        }
+    }
+
+    history = Calloc(1, sizeof(struct botHistory));
+    history->network = (network != NULL) ? sdsnew(network) : NULL;
+    history->nick = sdsnew(nick);
+    history->hour = hour;
+    history->next = histories;
+    histories = history;
+    return history;
+}
+
+/* parses a line like "rizon bot 21 12 1 5368709120 2684354 9500 4194304". the network of the command line is written as -. */
+static void parseHistoryLine(sds line) {
+    int count = 0;
+    sds *fields = sdssplitlen(line, sdslen(line), " ", 1, &count);
+
+    if (count == 9) {
+        int hour = atoi(fields[2]);
+
+        if (hour >= 0 && hour < 24) {
+            struct botHistory *history = getBotHistory(str_equals(fields[0], "-") ? NULL : fields[0], fields[1], hour);
+            history->transfers = (uint32_t) strtoul(fields[3], NULL, 10);
+            history->failures = (uint32_t) strtoul(fields[4], NULL, 10);
+            history->bytes = strtoull(fields[5], NULL, 10);
+            history->durationMs = strtoull(fields[6], NULL, 10);
+            history->firstByteMs = strtoull(fields[7], NULL, 10);
+            history->peakSpeed = strtoull(fields[8], NULL, 10);
+        }
+    }
+
+    sdsfreesplitres(fields, count);
+}
+
+void loadHistory(struct xdccGetConfig *config) {
+    historyEnabled = !cfg_get_bit(config, NO_HISTORY_FLAG);
+    lastSaveTime = getMonotonicTimeMs();
+
+    if (!historyEnabled) {
+        return;
+    }
+
+    sds path = getHistoryPath();
+
+    if (file_exists(path)) {
+        sds content = readTextFile(path);
+        int numLines = 0;
+        sds *lines = sdssplitlen(content, sdslen(content), "\n", 1, &numLines);
+        int i;
+
+        for (i = 0; i < numLines; i++) {
+            sdstrim(lines[i], " \t\r");
+
+            if (sdslen(lines[i]) != 0 && lines[i][0] != '#') {
+                parseHistoryLine(lines[i]);
+            }
+        }
+
+        sdsfreesplitres(lines, numLines);
+        sdsfree(content);
+    }
+
+    sdsfree(path);
+}
+
+void recordTransferHistory(const char *network, const char *botNick, struct transferStats *stats) {
+    if (!historyEnabled) {
+        return;
+    }
+
+    struct botHistory *history = getBotHistory(network, botNick, getHourOfDay());
+
+    if (history->transfers >= HISTORY_DECAY_TRANSFERS) {
+        history->transfers /= 2;
+        history->failures /= 2;
+        history->bytes /= 2;
+        history->durationMs /= 2;
+        history->firstByteMs /= 2;
+    }
+
+    history->transfers++;
+    history->failures += stats->failed ? 1 : 0;
+    history->bytes += stats->bytes;
+    history->durationMs += stats->durationMs;
+    history->firstByteMs += stats->firstByteMs;
+
+    if (stats->peakSpeed > history->peakSpeed) {
+        history->peakSpeed = stats->peakSpeed;
+    }
+
+    historyDirty = true;
+}
+
+/* returns the expected time in ms, that the bot needs for a file of HISTORY_REFERENCE_SIZE, or false, if the bot has no history. */
+static bool getExpectedTime(const char *network, const char *nick, int hour, uint64_t *expectedMs) {
+    struct botHistory *history;
+    struct botHistory sum;
+
+    memset(&sum, 0, sizeof(sum));
+
+    for (history = histories; history != NULL; history = history->next) {
+        if (history->hour == hour && isSameNetwork(history->network, network) && strcasecmp(history->nick, nick) == 0) {
+            sum = *history;
+            break;
+        }
+    }
+
+    /* too few transfers in this hour. the other hours tell more than nothing */
+    if (sum.transfers < HISTORY_MIN_HOUR_TRANSFERS) {
+        memset(&sum, 0, sizeof(sum));
+
+        for (history = histories; history != NULL; history = history->next) {
+            if (isSameNetwork(history->network, network) && strcasecmp(history->nick, nick) == 0) {
+                sum.transfers += history->transfers;
+                sum.failures += history->failures;
+                sum.bytes += history->bytes;
+                sum.durationMs += history->durationMs;
+                sum.firstByteMs += history->firstByteMs;
+            }
+        }
+    }
+
+    if (sum.transfers == 0) {
+        return false;
+    }
+
+    uint64_t transferMs = HISTORY_UNREACHABLE_MS;
+
+    if (sum.bytes != 0 && sum.durationMs != 0) {
+        irc_dcc_size_t speed = sum.bytes * 1000 / sum.durationMs;
+        transferMs = (speed != 0) ? HISTORY_REFERENCE_SIZE / speed * 1000 : HISTORY_UNREACHABLE_MS;
+    }
+
+    uint64_t succeeded = sum.transfers - ((sum.failures < sum.transfers) ? sum.failures : sum.transfers);
+    *expectedMs = (sum.firstByteMs / sum.transfers + transferMs) * (sum.transfers + 1) / (succeeded + 1);
+    return true;
+}
+
+void rankMirrors(struct dccDownload *download) {
+    struct dccDownload *current;
+    uint32_t numBots;
+    uint32_t numKnown = 0;
+    uint64_t knownSum = 0;
+    uint32_t i, j;
+
+    if (!historyEnabled || download->mirrors == NULL || histories == NULL) {
+        return;
+    }
+
+    for (current = download->mirrors, numBots = 1; current != NULL; current = current->next) {
+        numBots++;
+    }
+
+    struct dccDownload **bots = Calloc(numBots, sizeof(struct dccDownload*));
+    uint64_t *expected = Calloc(numBots, sizeof(uint64_t));
+    bool *known = Calloc(numBots, sizeof(bool));
+    int hour = getHourOfDay();
+
+    bots[0] = download;
+
+    for (i = 1, current = download->mirrors; current != NULL; i++, current = current->next) {
+        bots[i] = current;
+    }
+
+    for (i = 0; i < numBots; i++) {
+        known[i] = getExpectedTime(bots[i]->network, bots[i]->botNick, hour, &expected[i]);
+
+        if (known[i]) {
+            knownSum += expected[i];
+            numKnown++;
+        }
+    }
+
+    if (numKnown != 0) {
+        /* the order of the bots, that the request gives. an insertion sort keeps it for equal times */
+        sds *networks = Calloc(numBots, sizeof(sds));
+        sds *nicks = Calloc(numBots, sizeof(sds));
+        sds *commands = Calloc(numBots, sizeof(sds));
+
+        for (i = 0; i < numBots; i++) {
+            if (!known[i]) {
+                expected[i] = knownSum / numKnown;
+            }
+
+            networks[i] = bots[i]->network;
+            nicks[i] = bots[i]->botNick;
+            commands[i] = bots[i]->xdccCmd;
+        }
+
+        for (i = 1; i < numBots; i++) {
+            uint64_t time = expected[i];
+            sds network = networks[i], nick = nicks[i], command = commands[i];
+
+            for (j = i; j > 0 && expected[j - 1] > time; j--) {
+                expected[j] = expected[j - 1];
+                networks[j] = networks[j - 1];
+                nicks[j] = nicks[j - 1];
+                commands[j] = commands[j - 1];
+            }
+
+            expected[j] = time;
+            networks[j] = network;
+            nicks[j] = nick;
+            commands[j] = command;
+        }
+
+        /* the request keeps its place in the queue and its options, only the bots change */
+        if (nicks[0] != download->botNick) {
+            logprintf(LOG_INFO, "history: asking %s, that is expected to be faster than %s.", nicks[0], download->botNick);
+        }
+
+        for (i = 0; i < numBots; i++) {
+            bots[i]->network = networks[i];
+            bots[i]->botNick = nicks[i];
+            bots[i]->xdccCmd = commands[i];
+        }
+
+        FREE(networks);
+        FREE(nicks);
+        FREE(commands);
+    }
+
+    FREE(bots);
+    FREE(expected);
+    FREE(known);
+}
+
+bool isHistorySaveDue() {
+    return historyDirty && getMonotonicTimeMs() >= lastSaveTime + HISTORY_SAVE_INTERVAL_MS;
+}
+
+void saveHistory() {
+    if (!historyDirty) {
+        return;
+    }
+
+    sds path = getHistoryPath();
+    sds content = sdsnew("# network bot hour transfers failures bytes duration-ms first-byte-ms peak-speed\n");
+    struct botHistory *history;
+
+    for (history = histories; history != NULL; history = history->next) {
+        content = sdscatprintf(content, "%s %s %d %" PRIu32 " %" PRIu32 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" IRC_DCC_SIZE_T_FORMAT "\n",
+            (history->network != NULL) ? history->network : "-", history->nick, history->hour, history->transfers, history->failures,
+            history->bytes, history->durationMs, history->firstByteMs, history->peakSpeed);
+    }
+
+    /* the history is replaced at once, so that a crash does not leave a torn file */
+    if (!replaceFile(path, content, sdslen(content), false)) {
+        logprintf(LOG_ERR, "could not save the history to %s: %s", path, strerror(errno));
+    }
+
+    historyDirty = false;
+    lastSaveTime = getMonotonicTimeMs();
+    sdsfree(content);
+    sdsfree(path);
+}
+
+void freeHistory() {
+    while (histories != NULL) {
+        struct botHistory *next = histories->next;
+        sdsfree(histories->network);
+        sdsfree(histories->nick);
+        FREE(histories);
+        histories = next;
+    }
+}
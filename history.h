@@ -0,0 +1,51 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "helper.h"
+#include "argument_parser.h"
+
+/* the throughput of the bots is kept in this file in the config directory. */
+#define HISTORY_FILE_NAME "history"
+/* the history is written at most this often and when xdccget exits. */
+#define HISTORY_SAVE_INTERVAL_MS 60000
+/* when a bot reaches this many transfers in an hour of the day, its counters of the hour are halved,
+   so that the last weeks weigh more than the old transfers. */
+#define HISTORY_DECAY_TRANSFERS 64
+/* the hour of the day is used for the ranking, if the bot had this many transfers in it. otherwise all hours are used. */
+#define HISTORY_MIN_HOUR_TRANSFERS 3
+/* the bots are compared by the expected time for a file of this size, because the size is not known before the offer. */
+#define HISTORY_REFERENCE_SIZE ((irc_dcc_size_t) 256 * 1024 * 1024)
+/* the expected time of a bot, whose transfers never received a byte */
+#define HISTORY_UNREACHABLE_MS ((uint64_t) 7 * 24 * 3600 * 1000)
+
+/* what a single transfer of a bot achieved. */
+struct transferStats {
+    /* the bytes, that were received, and the time from the first byte to the end of the transfer */
+    irc_dcc_size_t bytes;
+    uint64_t durationMs;
+    /* the time from the accepted offer to the first byte */
+    uint64_t firstByteMs;
+    irc_dcc_size_t peakSpeed;
+    bool failed;
+};
+
+/* reads the history of the last runs, unless useHistory is set to false. */
+void loadHistory(struct xdccGetConfig *config);
+
+/* adds a finished or failed transfer to the history of the bot in the current hour of the day. network is NULL for
+   the network of the command line. */
+void recordTransferHistory(const char *network, const char *botNick, struct transferStats *stats);
+
+/* orders the bots of download and its mirrors by the expected time, that they need for a file, at the current hour
+   of the day. a failed transfer counts as a transfer, that has to be repeated. bots without a history are expected
+   to be as fast as the mean of the other bots, so that the order of the request breaks the ties. */
+void rankMirrors(struct dccDownload *download);
+
+/* returns true, if transfers were recorded and HISTORY_SAVE_INTERVAL_MS has passed. */
+bool isHistorySaveDue();
+
+void saveHistory();
+
+void freeHistory();
+
+#endif
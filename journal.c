@@ -0,0 +1,445 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+
+#ifdef _MSC_VER
+#include <io.h>
+#endif
+
+#include "journal.h"
+#include "file.h"
+#include "os_specific.h"
+
+static int journalFd = -1;
+static int journalLockFd = -1;
+static sds journalBuffer = NULL;
+static uint64_t nextJournalId = 1;
+static uint64_t lastCommitTime = 0;
+/* the records in the journal file and the downloads, that are not finished yet */
+static uint64_t numJournalRecords = 0;
+static uint64_t numUnfinishedDownloads = 0;
+
+static sds getJournalPath(const char *fileName) {
+    sds configDir = getConfigDirectory();
+    sds path = sdscatprintf(sdsempty(), "%s%s", configDir, fileName);
+    sdsfree(configDir);
+    return path;
+}
+
+/* returns the next field of line, that is separated by a space, and moves line behind it. */
+static char* nextField(char **line) {
+    char *field = *line;
+    char *space = strchr(field, ' ');
+
+    if (space != NULL) {
+        *space = '\0';
+        *line = space + 1;
+    }
+    else {
+        *line = field + strlen(field);
+    }
+
+    return field;
+}
+
+static struct dccDownload* findJournaledDownload(struct dccDownload *downloads, uint64_t id) {
+    struct dccDownload *current;
+
+    for (current = downloads; current != NULL; current = current->next) {
+        if (current->journalId == id) {
+            return current;
+        }
+    }
+
+    return NULL;
+}
+
+static void removeJournaledDownload(struct dccDownload **downloads, uint64_t id) {
+    struct dccDownload **current = downloads;
+
+    while (*current != NULL) {
+        if ((*current)->journalId == id) {
+            struct dccDownload *download = *current;
+            *current = download->next;
+            freeDccDownload(download);
+            return;
+        }
+
+        current = &(*current)->next;
+    }
+}
+
+static struct dccDownload* parseQueuedRecord(char *line, uint64_t id) {
+    uint32_t weight = (uint32_t) strtoul(nextField(&line), NULL, 10);
+    int priority = (int) strtol(nextField(&line), NULL, 10);
+    time_t deadline = (time_t) strtoll(nextField(&line), NULL, 10);
+    /* the rest is written like a line of the queue file, e.g. "@rizon bot xdcc send #1 | bot2 xdcc send #7" */
+    struct dccDownload *download = parseDccDownloadLine(line);
+
+    if (download == NULL) {
+        return NULL;
+    }
+
+    download->journalId = id;
+    download->weight = weight;
+    download->priority = priority;
+    download->deadline = deadline;
+
+    return download;
+}
+
+/* applies a single record to the list of unfinished downloads. a torn last line of a crash is ignored. */
+static void replayRecord(char *line, struct dccDownload **downloads, sds *queueFile, uint64_t *queueFileOffset) {
+    char *type = nextField(&line);
+
+    if (str_equals(type, "S")) {
+        sdsfree(*queueFile);
+        *queueFile = sdsnew(line);
+        *queueFileOffset = 0;
+        return;
+    }
+
+    if (str_equals(type, "O")) {
+        *queueFileOffset = strtoull(line, NULL, 10);
+        return;
+    }
+
+    uint64_t id = strtoull(nextField(&line), NULL, 10);
+
+    if (id == 0) {
+        return;
+    }
+
+    if (id >= nextJournalId) {
+        nextJournalId = id + 1;
+    }
+
+    if (str_equals(type, "Q")) {
+        struct dccDownload *download = parseQueuedRecord(line, id);
+        struct dccDownload **last = downloads;
+
+        if (download == NULL) {
+            return;
+        }
+
+        while (*last != NULL) {
+            last = &(*last)->next;
+        }
+
+        *last = download;
+        return;
+    }
+
+    struct dccDownload *download = findJournaledDownload(*downloads, id);
+
+    if (download == NULL) {
+        return;
+    }
+
+    if (str_equals(type, "R")) {
+        download->requested = true;
+    }
+    else if (str_equals(type, "P")) {
+        download->requested = true;
+        download->journalOffset = strtoull(line, NULL, 10);
+    }
+    else if (str_equals(type, "C") || str_equals(type, "D")) {
+        removeJournaledDownload(downloads, id);
+    }
+}
+
+static struct dccDownload* replayJournal(sds journalPath, sds *queueFile, uint64_t *queueFileOffset) {
+    struct dccDownload *downloads = NULL;
+    int numLines = 0;
+    int i;
+
+    if (!file_exists(journalPath)) {
+        return NULL;
+    }
+
+    sds content = readTextFile(journalPath);
+    sds *lines = sdssplitlen(content, sdslen(content), "\n", 1, &numLines);
+
+    /* every record ends with a newline, so the last part is either empty or a record, that was torn by a crash */
+    for (i = 0; i < numLines - 1; i++) {
+        replayRecord(lines[i], &downloads, queueFile, queueFileOffset);
+    }
+
+    sdsfreesplitres(lines, numLines);
+    sdsfree(content);
+
+    return downloads;
+}
+
+static sds appendQueuedRecord(sds records, struct dccDownload *download) {
+    struct dccDownload *mirror;
+
+    records = sdscatprintf(records, "Q %" PRIu64 " %" PRIu32 " %d %" PRId64 " ", download->journalId,
+        download->weight, download->priority, (int64_t) download->deadline);
+
+    if (download->network != NULL) {
+        records = sdscatprintf(records, "@%s ", download->network);
+    }
+
+    records = sdscatprintf(records, "%s %s", download->botNick, download->xdccCmd);
+
+    for (mirror = download->mirrors; mirror != NULL; mirror = mirror->next) {
+        records = sdscatprintf(records, " | %s%s%s %s", mirror->network != NULL ? "@" : "",
+            mirror->network != NULL ? mirror->network : "", mirror->botNick, mirror->xdccCmd);
+    }
+
+    return sdscat(records, "\n");
+}
+
+static uint64_t countLines(sds records) {
+    uint64_t numLines = 0;
+    size_t i;
+
+    for (i = 0; i < sdslen(records); i++) {
+        if (records[i] == '\n') {
+            numLines++;
+        }
+    }
+
+    return numLines;
+}
+
+/* writes only the unfinished downloads into a new journal and replaces the old one with it. */
+static bool compactJournal(sds journalPath, struct dccDownload *downloads, const char *queueFile, uint64_t queueFileOffset) {
+    sds records = sdsempty();
+    struct dccDownload *current;
+    uint64_t numDownloads = 0;
+    bool success = false;
+
+    if (queueFile != NULL) {
+        records = sdscatprintf(records, "S %s\nO %" PRIu64 "\n", queueFile, queueFileOffset);
+    }
+
+    for (current = downloads; current != NULL; current = current->next) {
+        records = appendQueuedRecord(records, current);
+        numDownloads++;
+
+        if (current->journalOffset != 0) {
+            records = sdscatprintf(records, "P %" PRIu64 " %" IRC_DCC_SIZE_T_FORMAT "\n", current->journalId, current->journalOffset);
+        }
+        else if (current->requested) {
+            records = sdscatprintf(records, "R %" PRIu64 "\n", current->journalId);
+        }
+    }
+
+    /* a crash keeps the old journal, until the compacted one is on the disk */
+    success = replaceFile(journalPath, records, sdslen(records), true);
+
+    if (success) {
+        numJournalRecords = countLines(records);
+        numUnfinishedDownloads = numDownloads;
+    }
+    else {
+        logprintf(LOG_ERR, "could not compact the journal %s: %s", journalPath, strerror(errno));
+    }
+
+    sdsfree(records);
+    return success;
+}
+
+struct dccDownload* openJournal(const char *queueFile, uint64_t *queueFileOffset) {
+    sds lockPath = getJournalPath(JOURNAL_LOCK_FILE_NAME);
+    sds journalPath = getJournalPath(JOURNAL_FILE_NAME);
+    sds journaledQueueFile = NULL;
+    struct dccDownload *downloads = NULL;
+
+    *queueFileOffset = 0;
+
+    /* the lock stays with this process, so that a second xdccget does not replay the same journal */
+    journalLockFd = open(lockPath, O_WRONLY | O_CREAT, 0600);
+
+    if (journalLockFd == -1 || !lockFile(journalLockFd)) {
+        logprintf(LOG_WARN, "the journal is used by an other xdccget process. this process runs without a journal.");
+
+        if (journalLockFd != -1) {
+            close(journalLockFd);
+            journalLockFd = -1;
+        }
+
+        goto cleanup;
+    }
+
+    downloads = replayJournal(journalPath, &journaledQueueFile, queueFileOffset);
+
+    /* a different queue file is read from the start */
+    if (queueFile == NULL || journaledQueueFile == NULL || !str_equals(queueFile, journaledQueueFile) || str_equals(queueFile, "-")) {
+        *queueFileOffset = 0;
+    }
+
+    if (!compactJournal(journalPath, downloads, queueFile, *queueFileOffset)) {
+        goto cleanup;
+    }
+
+    journalFd = open(journalPath, O_WRONLY | O_APPEND, 0);
+
+    if (journalFd == -1) {
+        logprintf(LOG_ERR, "could not open the journal %s: %s", journalPath, strerror(errno));
+        goto cleanup;
+    }
+
+    journalBuffer = sdsempty();
+    lastCommitTime = getMonotonicTimeMs();
+
+cleanup:
+    sdsfree(journaledQueueFile);
+    sdsfree(journalPath);
+    sdsfree(lockPath);
+
+    return downloads;
+}
+
+bool isJournalOpen() {
+    return journalFd != -1;
+}
+
+void journalQueuedDownload(struct dccDownload *download) {
+    if (!isJournalOpen()) {
+        return;
+    }
+
+    if (download->journalId == 0) {
+        download->journalId = nextJournalId++;
+    }
+
+    journalBuffer = appendQueuedRecord(journalBuffer, download);
+    numUnfinishedDownloads++;
+}
+
+void journalRequestedDownload(struct dccDownload *download) {
+    if (!isJournalOpen() || download->journalId == 0) {
+        return;
+    }
+
+    download->requested = true;
+    journalBuffer = sdscatprintf(journalBuffer, "R %" PRIu64 "\n", download->journalId);
+}
+
+void journalDownloadProgress(struct dccDownload *download, irc_dcc_size_t offset) {
+    if (!isJournalOpen() || download->journalId == 0 || download->journalOffset == offset) {
+        return;
+    }
+
+    download->journalOffset = offset;
+    journalBuffer = sdscatprintf(journalBuffer, "P %" PRIu64 " %" IRC_DCC_SIZE_T_FORMAT "\n", download->journalId, offset);
+}
+
+void journalFinishedDownload(struct dccDownload *download, bool completed) {
+    if (!isJournalOpen() || download->journalId == 0) {
+        return;
+    }
+
+    journalBuffer = sdscatprintf(journalBuffer, "%s %" PRIu64 "\n", completed ? "C" : "D", download->journalId);
+
+    if (numUnfinishedDownloads != 0) {
+        numUnfinishedDownloads--;
+    }
+}
+
+void journalRequeuedDownload(struct dccDownload *download) {
+    if (!isJournalOpen() || download->journalId == 0) {
+        return;
+    }
+
+    /* the new record follows the record of the taken pack, so that the replay keeps the order of the queue */
+    journalBuffer = sdscatprintf(journalBuffer, "D %" PRIu64 "\n", download->journalId);
+    download->journalId = nextJournalId++;
+    journalBuffer = appendQueuedRecord(journalBuffer, download);
+}
+
+void journalQueueFileOffset(uint64_t offset) {
+    if (!isJournalOpen()) {
+        return;
+    }
+
+    journalBuffer = sdscatprintf(journalBuffer, "O %" PRIu64 "\n", offset);
+}
+
+/* the unfinished downloads are replayed from the journal itself, so that the queue does not have to hand them over.
+   a journal, that can not be replaced, is appended to further. */
+static void recompactJournal() {
+    sds journalPath = getJournalPath(JOURNAL_FILE_NAME);
+    sds queueFile = NULL;
+    uint64_t queueFileOffset = 0;
+    uint64_t numRecordsBefore = numJournalRecords;
+    struct dccDownload *downloads = replayJournal(journalPath, &queueFile, &queueFileOffset);
+
+    /* windows does not replace a file, that is still open */
+    close(journalFd);
+
+    if (compactJournal(journalPath, downloads, queueFile, queueFileOffset)) {
+        logprintf(LOG_INFO, "compacted the journal from %" PRIu64 " to %" PRIu64 " records.", numRecordsBefore, numJournalRecords);
+    }
+
+    journalFd = open(journalPath, O_WRONLY | O_APPEND, 0);
+
+    if (journalFd == -1) {
+        logprintf(LOG_ERR, "could not open the journal %s again, running without a journal: %s", journalPath, strerror(errno));
+    }
+
+    while (downloads != NULL) {
+        struct dccDownload *next = downloads->next;
+        freeDccDownload(downloads);
+        downloads = next;
+    }
+
+    sdsfree(queueFile);
+    sdsfree(journalPath);
+}
+
+bool isJournalCommitDue() {
+    return isJournalOpen() && getMonotonicTimeMs() >= lastCommitTime + JOURNAL_COMMIT_INTERVAL_MS;
+}
+
+void commitJournal() {
+    if (!isJournalOpen()) {
+        return;
+    }
+
+    lastCommitTime = getMonotonicTimeMs();
+
+    if (sdslen(journalBuffer) == 0) {
+        return;
+    }
+
+    /* all records since the last commit share a single fsync */
+    if (write(journalFd, journalBuffer, sdslen(journalBuffer)) != (ssize_t) sdslen(journalBuffer) || !syncFile(journalFd)) {
+        logprintf(LOG_ERR, "could not write the journal: %s", strerror(errno));
+    }
+
+    numJournalRecords += countLines(journalBuffer);
+    sdsclear(journalBuffer);
+
+    if (numJournalRecords >= JOURNAL_COMPACT_MIN_RECORDS && numJournalRecords > (numUnfinishedDownloads + 1) * JOURNAL_COMPACT_RATIO) {
+        recompactJournal();
+    }
+}
+
+void closeJournal(bool finished) {
+    commitJournal();
+
+    /* nothing is left to continue, so the next run starts over with its queue file */
+    if (finished && isJournalOpen()) {
+        sds journalPath = getJournalPath(JOURNAL_FILE_NAME);
+        remove(journalPath);
+        sdsfree(journalPath);
+    }
+
+    if (journalFd != -1) {
+        close(journalFd);
+        journalFd = -1;
+    }
+
+    if (journalLockFd != -1) {
+        close(journalLockFd);
+        journalLockFd = -1;
+    }
+
+    sdsfree(journalBuffer);
+    journalBuffer = NULL;
+}
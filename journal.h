@@ -0,0 +1,52 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "helper.h"
+#include "argument_parser.h"
+
+/* the journal and its lock file are placed in the config directory. */
+#define JOURNAL_FILE_NAME "journal"
+#define JOURNAL_LOCK_FILE_NAME "journal.lock"
+/* the records are collected and written with a single fsync in this interval. */
+#define JOURNAL_COMMIT_INTERVAL_MS 1000
+/* a running journal is compacted again, when it holds at least this many records and more than
+   JOURNAL_COMPACT_RATIO records for every unfinished download, e.g. of finished downloads or old progress. */
+#define JOURNAL_COMPACT_MIN_RECORDS 4096
+#define JOURNAL_COMPACT_RATIO 8
+
+/*
+ * The journal is an append-only text file with one record per line:
+ *   S <queue file>          the queue file of the run
+ *   O <offset>              the queue file was read up to this byte offset
+ *   Q <id> <weight> <priority> <deadline> [@<network>] <bot> <xdcc command> [| <mirror>...]
+ *   R <id>                  the request was sent to the bot
+ *   P <id> <offset>         the transfer of the request has received offset bytes
+ *   C <id>                  the download completed
+ *   D <id>                  the download failed and is not retried
+ */
+
+/* replays the journal of the last run and compacts it. the unfinished requests are returned as a list
+   linked by next in the order of the queue. queueFileOffset is set to the offset, at which queueFile
+   continues, or 0 if the journal belongs to an other queue file. returns NULL, if nothing is unfinished. */
+struct dccDownload* openJournal(const char *queueFile, uint64_t *queueFileOffset);
+
+bool isJournalOpen();
+
+void journalQueuedDownload(struct dccDownload *download);
+void journalRequestedDownload(struct dccDownload *download);
+void journalDownloadProgress(struct dccDownload *download, irc_dcc_size_t offset);
+void journalFinishedDownload(struct dccDownload *download, bool completed);
+/* records a batch again under a new id, after its next pack was taken from it. */
+void journalRequeuedDownload(struct dccDownload *download);
+void journalQueueFileOffset(uint64_t offset);
+
+/* returns true, if records are waiting and the commit interval has passed. */
+bool isJournalCommitDue();
+
+/* writes the collected records and syncs them to the disk. compacts the journal, when most of its records are stale. */
+void commitJournal();
+
+/* commits the last records and closes the journal. the journal is removed, if finished is true. */
+void closeJournal(bool finished);
+
+#endif
@@ -7,18 +7,46 @@ extern "C" {
     
 #define MAX_PARAMS_ALLOWED 100
 
+/* packs a command of up to 8 bytes into a word, so that the commands can be dispatched with a switch. */
+#define IRC_COMMAND_WORD(a, b, c, d, e, f, g, h) \
+    ((uint64_t) (unsigned char) (a) | (uint64_t) (unsigned char) (b) << 8 | (uint64_t) (unsigned char) (c) << 16 \
+    | (uint64_t) (unsigned char) (d) << 24 | (uint64_t) (unsigned char) (e) << 32 | (uint64_t) (unsigned char) (f) << 40 \
+    | (uint64_t) (unsigned char) (g) << 48 | (uint64_t) (unsigned char) (h) << 56)
+
+/* the strings of the result point into the input buffer of the session. they are only valid during the callbacks. */
 struct irc_parser_result_t {
     irc_session_t *session;
+    /* the message tags like time=2024-01-01T12:00:00.000Z;msgid=abc without the @, or NULL */
+    char *tags;
     char *nick;
     char *name;
     char *host;
     char *command;
+    /* the command packed by IRC_COMMAND_WORD, or 0 if it is longer than 8 bytes */
+    uint64_t command_word;
+    /* the code of a numeric reply like 376, or -1 for the other commands */
+    int numeric;
     unsigned int num_params;
     char *params[MAX_PARAMS_ALLOWED+1];
 };
 
 typedef struct irc_parser_result_t irc_parser_result_t;
 
+/* what the line filter sees of a line, before it is tokenized. the slices point into the input buffer and are not
+   terminated with NUL. a missing origin or target has the length 0. */
+struct irc_line_info_t {
+    const char *origin;
+    size_t origin_len;
+    uint64_t command_word;
+    int numeric;
+    const char *target;
+    size_t target_len;
+    /* the text after the target starts with the CTCP delimiter 0x01 */
+    int is_ctcp;
+};
+
+typedef struct irc_line_info_t irc_line_info_t;
+
 irc_parser* createParser();
 void line_parser_set_session(irc_parser *parser, irc_session_t *session);
 void free_line_parser(irc_parser *parser);
@@ -75,6 +75,27 @@ typedef void (*irc_event_dcc_send_reverse_t) (irc_session_t * session, const cha
 
 typedef bool (*irc_event_dcc_verify_incoming_dcc_request_t) (irc_session_t * session, const char * nick);
 
+/*
+ * returns the amount of bytes the dcc session with the given context may read
+ * right now. if 0 is returned, the socket of the dcc session is not watched
+ * for incoming data until the quota is positive again.
+ */
+typedef irc_dcc_size_t (*irc_dcc_read_quota_callback_t) (irc_session_t * session, irc_dcc_t dccid, void * ctx);
+
+/*
+ * is called, when the descriptors of the network loop are collected or
+ * processed. lets the application watch own descriptors with
+ * irc_watch_descriptor() and check them with irc_is_descriptor_ready().
+ */
+typedef void (*irc_descriptors_callback_t) (irc_session_t * session);
+
+/*
+ * is asked for the lines, that are neither addressed to us nor needed by the
+ * library, e.g. the messages and joins of others on a channel, before they are
+ * tokenized. a line is only parsed and dispatched, if 1 is returned.
+ */
+typedef int (*irc_line_filter_callback_t) (irc_session_t * session, const irc_line_info_t *line);
+
 
 /*! \brief Event callbacks structure.
  *
@@ -339,6 +360,24 @@ typedef struct
         
         irc_keep_alive_callback_t       keep_alive_callback;
 
+        /* this callback is asked before reading from a dcc socket, how many bytes
+         * may be received. can be used to throttle the downloads without blocking
+         * the network loop. if not set, the dcc sessions are not throttled.
+         */
+        irc_dcc_read_quota_callback_t   dcc_read_quota;
+
+        /* these callbacks add the descriptors of the application to the network
+         * loop and process them after it woke up, e.g. a control socket, that
+         * should be served without an own thread.
+         */
+        irc_descriptors_callback_t      add_descriptors;
+        irc_descriptors_callback_t      process_descriptors;
+
+        /* decides about the lines of others, that no event of the application
+         * needs. if not set, all lines are parsed like before.
+         */
+        irc_line_filter_callback_t      line_filter;
+
 
 } irc_callbacks_t;
 
@@ -348,6 +348,76 @@ int irc_is_connected (irc_session_t * session);
  */
 int irc_run (irc_session_t * session);
 
+/*!
+ * \fn int irc_run_sessions (irc_session_t ** sessions, int count)
+ * \brief Runs the event loop for several sessions at the same time.
+ *
+ * \param sessions The initiated and connected sessions, e.g. to different
+ *  IRC networks.
+ * \param count The number of sessions.
+ *
+ * \return Return code 0 means, that all sessions are disconnected. Other
+ *  value means, that the loop itself failed.
+ *
+ * Works like irc_run(), but the sockets and the DCC sessions of all sessions
+ * are watched with a single call of the fd watcher. A session, that fails or
+ * is disconnected, is left out, while the others keep running; its error is
+ * kept in irc_errno(). The keep alive callbacks of all sessions are called in
+ * every iteration and the loop waits at most the shortest run timeout of the
+ * sessions. The add_descriptors and process_descriptors callbacks of a
+ * session, that is left out, are still called, so that the descriptors of the
+ * application are served, while any session runs.
+ *
+ * \ingroup running 
+ */
+int irc_run_sessions (irc_session_t ** sessions, int count);
+
+/*!
+ * \fn void irc_set_run_timeout (irc_session_t * session, long timeout_ms)
+ * \brief Sets the maximum time irc_run() waits for network events.
+ *
+ * \param session An initiated session.
+ * \param timeout_ms The timeout in milliseconds, must be positive.
+ *
+ * The keep alive callback is called at least once per timeout, therefore
+ * a smaller timeout allows a finer granularity for periodic tasks like
+ * refilling the bandwidth quota of throttled dcc sessions.
+ *
+ * \ingroup running 
+ */
+void irc_set_run_timeout (irc_session_t * session, long timeout_ms);
+
+/*! The descriptor is watched for incoming data. */
+#define LIBIRC_WATCH_READ   0x01
+/*! The descriptor is watched for free space to write. */
+#define LIBIRC_WATCH_WRITE  0x02
+
+/*!
+ * \fn void irc_watch_descriptor (irc_session_t * session, int fd, int flags)
+ * \brief Adds a descriptor of the application to the network loop.
+ *
+ * \param session An initiated session.
+ * \param fd The descriptor to watch.
+ * \param flags LIBIRC_WATCH_READ and/or LIBIRC_WATCH_WRITE.
+ *
+ * Must be called from the add_descriptors callback, because the watched
+ * descriptors are reset before every iteration of irc_run(). The result is
+ * checked with irc_is_descriptor_ready() in the process_descriptors callback.
+ *
+ * \ingroup running 
+ */
+void irc_watch_descriptor (irc_session_t * session, int fd, int flags);
+
+/*!
+ * \fn int irc_is_descriptor_ready (irc_session_t * session, int fd, int flags)
+ * \brief Checks a descriptor, that was added with irc_watch_descriptor().
+ *
+ * \return 1, if the descriptor can be read or written like given in flags.
+ *
+ * \ingroup running 
+ */
+int irc_is_descriptor_ready (irc_session_t * session, int fd, int flags);
+
 
 /*!
  * \fn int irc_add_select_descriptors (irc_session_t * session)
@@ -1286,6 +1356,102 @@ int irc_dcc_sendfile (irc_session_t * session, void * ctx, const char * nick, co
 int irc_dcc_destroy (irc_session_t * session, irc_dcc_t dccid);
 
 
+/*!
+ * \fn void irc_set_adaptive_dcc_buffers (irc_session_t * session, irc_dcc_size_t max_buffer_size)
+ * \brief Enables the adaptive sizing of the receive buffers of DCC sessions.
+ *
+ * \param session An initiated session.
+ * \param max_buffer_size The maximum receive buffer of a single DCC session
+ *  in bytes. 0 disables the adaptive mode and leaves the buffers to the kernel.
+ *
+ * Once per second the round trip time of every receiving DCC session is read
+ * with TCP_INFO and multiplied with the measured throughput. The SO_RCVBUF of
+ * the socket is then sized towards twice this bandwidth-delay product, so the
+ * TCP window can open on long distance links, and shrinks again for slow or
+ * throttled sessions. The chosen values are logged on information level.
+ * Platforms without TCP_INFO keep the default buffers.
+ *
+ * \ingroup dccstuff
+ */
+void irc_set_adaptive_dcc_buffers (irc_session_t * session, irc_dcc_size_t max_buffer_size);
+
+/*!
+ * \fn void irc_get_line_counters (irc_session_t * session, uint64_t * processed, uint64_t * dropped)
+ * \brief Returns how many lines of the server were parsed and how many were dropped.
+ *
+ * \param session An initiated and connected session.
+ * \param processed Receives the number of lines, that were parsed and dispatched.
+ * \param dropped Receives the number of lines, that were dropped before they
+ *        were parsed, because no event and no line filter wanted them.
+ *
+ * \ingroup running
+ */
+void irc_get_line_counters (irc_session_t * session, uint64_t * processed, uint64_t * dropped);
+
+/*!
+ * \fn void irc_set_flood_control (irc_session_t * session, long burst_ms, long line_penalty_ms)
+ * \brief Sets the flood control of the lines, that are sent to the server.
+ *
+ * \param session An initiated session.
+ * \param burst_ms How far the penalty of the server may run ahead of the
+ *        clock. 0 disables the flood control.
+ * \param line_penalty_ms The penalty of a line.
+ *
+ * Like the servers do it, every line adds its penalty to a timer, that runs
+ * with the clock. The lines are held back, while the timer is more than
+ * burst_ms ahead, so that the server never counts an excess flood. PONG,
+ * the registration, QUIT and CTCP replies are sent at once, the joins and
+ * modes go before the messages. The defaults follow RFC 1459 with 10 seconds
+ * and 2 seconds.
+ *
+ * \ingroup running
+ */
+void irc_set_flood_control (irc_session_t * session, long burst_ms, long line_penalty_ms);
+
+/*! \brief The state of the send queue of a session. */
+typedef struct {
+    /* the lines, that wait for the flood control */
+    unsigned int waiting_lines;
+    /* the bytes, that were passed to the socket queue, but not written yet */
+    size_t unsent_bytes;
+    /* the lines, that waited, and the sum and the maximum of their delays */
+    uint64_t sent_lines;
+    uint64_t delay_sum_ms;
+    uint64_t max_delay_ms;
+} irc_send_queue_stats_t;
+
+/*!
+ * \fn void irc_get_send_queue_stats (irc_session_t * session, irc_send_queue_stats_t * stats)
+ * \brief Returns the depth of the send queue and the delays of the flood control.
+ *
+ * \ingroup running
+ */
+void irc_get_send_queue_stats (irc_session_t * session, irc_send_queue_stats_t * stats);
+
+/*! \brief The lag of the lines of the server, measured by their server-time tags. */
+typedef struct {
+    /* the lines with a server-time tag */
+    uint64_t samples;
+    /* the delay of the last line and the largest delay above the fastest line */
+    uint64_t current_ms;
+    uint64_t max_ms;
+} irc_server_lag_t;
+
+/*!
+ * \fn void irc_get_server_lag (irc_session_t * session, irc_server_lag_t * lag)
+ * \brief Returns the lag of the lines of the server.
+ *
+ * The server-time tag tells, when the server sent a line. Its delay to the
+ * clock includes the skew of the clocks, so the fastest line is taken as the
+ * skew and the delays are counted above it. Lines, that are far older, are
+ * replays of a bouncer and are skipped. All values are 0, if the server did not
+ * grant server-time.
+ *
+ * \ingroup running
+ */
+void irc_get_server_lag (irc_session_t * session, irc_server_lag_t * lag);
+
+
 /*!
  * \fn void irc_get_version (unsigned int * high, unsigned int * low)
  * \brief Obtains a libircclient version.
@@ -1382,6 +1548,41 @@ int irc_errno (irc_session_t * session);
 const char * irc_strerror (int ircerrno);
 
 
+/*!
+ * \fn int irc_set_sasl (irc_session_t * session, const char * mechanism, const char * user, const char * password)
+ * \brief Logs in with SASL during the registration.
+ *
+ * \param session An initiated session, that is not connected yet.
+ * \param mechanism "PLAIN" or "EXTERNAL", or NULL to log in without SASL.
+ * \param user The account, that is logged in with PLAIN.
+ * \param password The password of the account for PLAIN.
+ *
+ * \return Return code 0 means success. Other value means error, the error
+ *         code may be obtained through irc_errno().
+ *
+ * The capabilities are negotiated with CAP LS 302 before NICK and USER. If
+ * the server offers the mechanism, the authentication runs before the
+ * registration is finished, so that the client is logged in, when it gets
+ * the welcome. EXTERNAL needs the client certificate of a TLS connection.
+ * If the authentication fails, the registration goes on without it and
+ * irc_is_sasl_authenticated() returns 0. Besides sasl, the capabilities
+ * no-implicit-names (or its draft/no-implicit-names draft), message-tags and
+ * server-time are requested, if the server offers them. The tags of a line
+ * are passed in the tags field of the result of the events and the
+ * server-time measures the lag, see irc_get_server_lag().
+ *
+ * \ingroup conndisc
+ */
+int irc_set_sasl (irc_session_t * session, const char * mechanism, const char * user, const char * password);
+
+/*!
+ * \fn int irc_is_sasl_authenticated (irc_session_t * session)
+ * \brief Returns 1, if the session was logged in with SASL.
+ *
+ * \ingroup conndisc
+ */
+int irc_is_sasl_authenticated (irc_session_t * session);
+
 /*!
  * \fn void irc_option_set (irc_session_t * session, unsigned int option)
  * \brief Sets the libircclient option.
@@ -0,0 +1,259 @@
+/*
+ * The capability negotiation of IRCv3 and the SASL authentication, that
+ * runs in it. The server holds the registration back, until CAP END is sent,
+ * so that the client is logged in, before it is welcomed. A server without
+ * capabilities ignores CAP or answers with an error and registers as before.
+ */
+
+#include <string.h>
+
+#include "session.h"
+#include "capabilities.h"
+#include "../helper.h"
+
+/* the capabilities, that are requested, if the server offers them. they cut the traffic or add tags to the lines */
+static const char * const libirc_wanted_caps[] = {
+    "no-implicit-names",
+    "draft/no-implicit-names",
+    "message-tags",
+    "server-time"
+};
+
+static void libirc_base64_encode(const unsigned char *data, size_t len, char *out) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i;
+
+    for (i = 0; i + 2 < len; i += 3) {
+        *out++ = alphabet[data[i] >> 2];
+        *out++ = alphabet[((data[i] & 0x03) << 4) | (data[i + 1] >> 4)];
+        *out++ = alphabet[((data[i + 1] & 0x0f) << 2) | (data[i + 2] >> 6)];
+        *out++ = alphabet[data[i + 2] & 0x3f];
+    }
+
+    if (i < len) {
+        *out++ = alphabet[data[i] >> 2];
+
+        if (i + 1 < len) {
+            *out++ = alphabet[((data[i] & 0x03) << 4) | (data[i + 1] >> 4)];
+            *out++ = alphabet[(data[i + 1] & 0x0f) << 2];
+        }
+        else {
+            *out++ = alphabet[(data[i] & 0x03) << 4];
+            *out++ = '=';
+        }
+
+        *out++ = '=';
+    }
+
+    *out = '\0';
+}
+
+/* returns true, if the comma separated list contains item. */
+static bool libirc_list_contains(const char *list, size_t list_len, const char *item) {
+    size_t item_len = strlen(item);
+    const char *end = list + list_len;
+
+    while (list < end) {
+        const char *comma = memchr(list, ',', (size_t) (end - list));
+        size_t len = (size_t) (((comma != NULL) ? comma : end) - list);
+
+        if (len == item_len && strncasecmp(list, item, len) == 0)
+            return true;
+
+        list += len + 1;
+    }
+
+    return false;
+}
+
+/* returns true, if the space separated list of capabilities contains cap. */
+static bool libirc_caps_contain(const char *caps, const char *cap) {
+    size_t cap_len = strlen(cap);
+
+    while (*caps != '\0') {
+        size_t len = strcspn(caps, " ");
+
+        if (len == cap_len && strncasecmp(caps, cap, len) == 0)
+            return true;
+
+        caps += len;
+
+        while (*caps == ' ')
+            caps++;
+    }
+
+    return false;
+}
+
+static void libirc_cap_add_request(irc_session_t * session, const char *cap) {
+    size_t len = strlen(session->cap_request);
+
+    if (len + strlen(cap) + 2 > sizeof (session->cap_request))
+        return;
+
+    if (len != 0)
+        session->cap_request[len++] = ' ';
+
+    strcpy(session->cap_request + len, cap);
+}
+
+/* sends CAP END, when no request waits for its answer and the authentication is over. */
+static void libirc_cap_end(irc_session_t * session) {
+    if (!(session->flags & SESSIONFL_CAP_NEGOTIATING) || session->cap_pending != 0 || (session->flags & SESSIONFL_SASL_IN_PROGRESS))
+        return;
+
+    session->flags &= ~SESSIONFL_CAP_NEGOTIATING;
+    irc_send_raw(session, "CAP END");
+}
+
+void libirc_cap_start(irc_session_t * session) {
+    session->flags |= SESSIONFL_CAP_NEGOTIATING;
+    session->flags &= ~(SESSIONFL_SASL_IN_PROGRESS | SESSIONFL_SASL_AUTHENTICATED);
+    session->cap_request[0] = '\0';
+    session->cap_pending = 0;
+    irc_send_raw(session, "CAP LS 302");
+}
+
+/* picks the capabilities of a line of CAP LS. with version 302 the values of sasl name its mechanisms. */
+static void libirc_cap_ls(irc_session_t * session, const char *caps) {
+    const char *pos = caps;
+    size_t i;
+
+    while (*pos != '\0') {
+        size_t len = strcspn(pos, " ");
+        size_t name_len = strcspn(pos, "= ");
+
+        if (name_len > len)
+            name_len = len;
+
+        for (i = 0; i < sizeof (libirc_wanted_caps) / sizeof (libirc_wanted_caps[0]); i++) {
+            if (name_len == strlen(libirc_wanted_caps[i]) && strncasecmp(pos, libirc_wanted_caps[i], name_len) == 0)
+                libirc_cap_add_request(session, libirc_wanted_caps[i]);
+        }
+
+        if (session->sasl_mechanism != NULL && name_len == 4 && strncasecmp(pos, "sasl", 4) == 0
+                && (name_len == len || libirc_list_contains(pos + name_len + 1, len - name_len - 1, session->sasl_mechanism)))
+            session->flags |= SESSIONFL_SASL_OFFERED;
+
+        pos += len;
+
+        while (*pos == ' ')
+            pos++;
+    }
+}
+
+/* sasl gets its own request, so that a refused capability does not prevent the authentication. */
+static void libirc_cap_request(irc_session_t * session) {
+    if (session->flags & SESSIONFL_SASL_OFFERED) {
+        irc_send_raw(session, "CAP REQ :sasl");
+        session->cap_pending++;
+    }
+
+    if (session->cap_request[0] != '\0') {
+        irc_send_raw(session, "CAP REQ :%s", session->cap_request);
+        session->cap_pending++;
+    }
+
+    libirc_cap_end(session);
+}
+
+void libirc_cap_handle(irc_session_t * session, irc_parser_result_t *result) {
+    const char *subcommand;
+    const char *caps;
+
+    if (result->num_params < 3 || !(session->flags & SESSIONFL_CAP_NEGOTIATING))
+        return;
+
+    subcommand = result->params[1];
+    caps = result->params[result->num_params - 1];
+
+    if (strcasecmp(subcommand, "LS") == 0) {
+        libirc_cap_ls(session, caps);
+
+        /* CAP * LS * :caps announces more lines */
+        if (result->num_params < 4 || strcmp(result->params[2], "*") != 0)
+            libirc_cap_request(session);
+    }
+    else if (strcasecmp(subcommand, "ACK") == 0 || strcasecmp(subcommand, "NAK") == 0) {
+        if (session->cap_pending != 0)
+            session->cap_pending--;
+
+        if (strcasecmp(subcommand, "ACK") == 0 && libirc_caps_contain(caps, "sasl") && session->sasl_mechanism != NULL) {
+            session->flags |= SESSIONFL_SASL_IN_PROGRESS;
+            irc_send_raw(session, "AUTHENTICATE %s", session->sasl_mechanism);
+        }
+        else if (strcasecmp(subcommand, "NAK") == 0) {
+            logprintf(LOG_INFO, "the server refused the capabilities %s", caps);
+        }
+
+        libirc_cap_end(session);
+    }
+}
+
+/* answers the challenge of the server. PLAIN sends the account and the password, EXTERNAL uses the client certificate
+   of the tls connection. a payload is sent in pieces of 400 bytes, a last piece of exactly 400 bytes is followed by +. */
+void libirc_sasl_authenticate(irc_session_t * session, irc_parser_result_t *result) {
+    if (!(session->flags & SESSIONFL_SASL_IN_PROGRESS) || result->num_params < 1 || strcmp(result->params[0], "+") != 0)
+        return;
+
+    if (strcasecmp(session->sasl_mechanism, "PLAIN") != 0) {
+        irc_send_raw(session, "AUTHENTICATE +");
+        return;
+    }
+
+    size_t user_len = strlen(session->sasl_user);
+    size_t password_len = strlen(session->sasl_password);
+    size_t len = 2 * user_len + password_len + 2;
+    unsigned char *payload = Malloc(len);
+    char *encoded = Malloc((len + 2) / 3 * 4 + 1);
+    size_t encoded_len, offset;
+
+    /* authorization identity, authentication identity and password, separated by NUL */
+    memcpy(payload, session->sasl_user, user_len);
+    payload[user_len] = '\0';
+    memcpy(payload + user_len + 1, session->sasl_user, user_len);
+    payload[2 * user_len + 1] = '\0';
+    memcpy(payload + 2 * user_len + 2, session->sasl_password, password_len);
+
+    libirc_base64_encode(payload, len, encoded);
+    encoded_len = strlen(encoded);
+
+    for (offset = 0; offset < encoded_len; offset += 400)
+        irc_send_raw(session, "AUTHENTICATE %.400s", encoded + offset);
+
+    if (encoded_len % 400 == 0)
+        irc_send_raw(session, "AUTHENTICATE +");
+
+    memset(payload, 0, len);
+    memset(encoded, 0, encoded_len);
+    FREE(payload);
+    FREE(encoded);
+}
+
+/* the numerics 900 to 908 end the authentication. a failed one lets the registration go on without it */
+void libirc_sasl_numeric(irc_session_t * session, int code, irc_parser_result_t *result) {
+    if (!(session->flags & SESSIONFL_SASL_IN_PROGRESS))
+        return;
+
+    switch (code) {
+        case 900:
+            return;
+        case 903:
+        case 907:
+            logprintf(LOG_INFO, "authenticated with sasl %s as %s.", session->sasl_mechanism, session->sasl_user);
+            session->flags |= SESSIONFL_SASL_AUTHENTICATED;
+            break;
+        case 902:
+        case 904:
+        case 905:
+        case 906:
+        case 908:
+            logprintf(LOG_WARN, "sasl %s failed: %s", session->sasl_mechanism, (result->num_params > 0) ? result->params[result->num_params - 1] : "");
+            break;
+        default:
+            return;
+    }
+
+    session->flags &= ~SESSIONFL_SASL_IN_PROGRESS;
+    libirc_cap_end(session);
+}
@@ -0,0 +1,24 @@
+#ifndef CAPABILITIES_H
+#define CAPABILITIES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* sends CAP LS in front of the registration. */
+void libirc_cap_start(irc_session_t * session);
+
+/* handles the CAP replies of the server. */
+void libirc_cap_handle(irc_session_t * session, irc_parser_result_t *result);
+
+/* answers AUTHENTICATE + of the server with the credentials. */
+void libirc_sasl_authenticate(irc_session_t * session, irc_parser_result_t *result);
+
+/* ends the authentication with the numerics 900 to 908. */
+void libirc_sasl_numeric(irc_session_t * session, int code, irc_parser_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 #include "params.h"
 #include "irc_line_parser.h"
 #include "strings_utils.h"
+#include "capabilities.h"
 
 #ifdef _MSC_VER
 #define strncasecmp _strnicmp
@@ -22,41 +23,52 @@ static void irc_privmsg_command(irc_session_t *session, const char *command, irc
 static void irc_notice_command(irc_session_t *session, const char *command, irc_parser_result_t *result);
 static void irc_invite_command(irc_session_t *session, const char *command, irc_parser_result_t *result);
 static void irc_kill_command(irc_session_t *session, const char *command, irc_parser_result_t *result);
+static void irc_cap_command(irc_session_t *session, const char *command, irc_parser_result_t *result);
+static void irc_authenticate_command(irc_session_t *session, const char *command, irc_parser_result_t *result);
 static void irc_unknown_command(irc_session_t *session, const char *command, irc_parser_result_t *result);
 
-static irc_command_t const commands[] = {
-    {"PING", irc_ping_command},
-    {"NICK", irc_nick_command},
-    {"QUIT", irc_quit_command},
-    {"JOIN", irc_join_command},
-    {"PART", irc_part_command},
-    {"MODE", irc_mode_command},
-    {"TOPIC", irc_topic_command},
-    {"KICK", irc_kick_command},
-    {"PRIVMSG", irc_privmsg_command},
-    {"NOTICE", irc_notice_command},
-    {"INVITE", irc_invite_command},
-    {"KILL", irc_kill_command}
-};
-
+static irc_command_t const pingCommand = {"PING", irc_ping_command};
+static irc_command_t const nickCommand = {"NICK", irc_nick_command};
+static irc_command_t const quitCommand = {"QUIT", irc_quit_command};
+static irc_command_t const joinCommand = {"JOIN", irc_join_command};
+static irc_command_t const partCommand = {"PART", irc_part_command};
+static irc_command_t const modeCommand = {"MODE", irc_mode_command};
+static irc_command_t const topicCommand = {"TOPIC", irc_topic_command};
+static irc_command_t const kickCommand = {"KICK", irc_kick_command};
+static irc_command_t const privmsgCommand = {"PRIVMSG", irc_privmsg_command};
+static irc_command_t const noticeCommand = {"NOTICE", irc_notice_command};
+static irc_command_t const inviteCommand = {"INVITE", irc_invite_command};
+static irc_command_t const killCommand = {"KILL", irc_kill_command};
+static irc_command_t const capCommand = {"CAP", irc_cap_command};
+static irc_command_t const authenticateCommand = {"AUTHENTICATE", irc_authenticate_command};
 static irc_command_t const unknownCommand = {"UNKNOWN", irc_unknown_command};
 
-const irc_command_t* get_command(const char *commandString, size_t n) {
-    size_t i = 0;
-    
-    if (n == 0) {
-        return &unknownCommand;
+/* the word of the command was packed, while the line was tokenized, so that the compiler turns the switch into a
+   jump table or a few compares. a new command only needs a new case. */
+const irc_command_t* get_command(uint64_t commandWord) {
+    switch (commandWord) {
+        case IRC_COMMAND_WORD('P', 'I', 'N', 'G', 0, 0, 0, 0): return &pingCommand;
+        case IRC_COMMAND_WORD('N', 'I', 'C', 'K', 0, 0, 0, 0): return &nickCommand;
+        case IRC_COMMAND_WORD('Q', 'U', 'I', 'T', 0, 0, 0, 0): return &quitCommand;
+        case IRC_COMMAND_WORD('J', 'O', 'I', 'N', 0, 0, 0, 0): return &joinCommand;
+        case IRC_COMMAND_WORD('P', 'A', 'R', 'T', 0, 0, 0, 0): return &partCommand;
+        case IRC_COMMAND_WORD('M', 'O', 'D', 'E', 0, 0, 0, 0): return &modeCommand;
+        case IRC_COMMAND_WORD('T', 'O', 'P', 'I', 'C', 0, 0, 0): return &topicCommand;
+        case IRC_COMMAND_WORD('K', 'I', 'C', 'K', 0, 0, 0, 0): return &kickCommand;
+        case IRC_COMMAND_WORD('P', 'R', 'I', 'V', 'M', 'S', 'G', 0): return &privmsgCommand;
+        case IRC_COMMAND_WORD('N', 'O', 'T', 'I', 'C', 'E', 0, 0): return &noticeCommand;
+        case IRC_COMMAND_WORD('I', 'N', 'V', 'I', 'T', 'E', 0, 0): return &inviteCommand;
+        case IRC_COMMAND_WORD('K', 'I', 'L', 'L', 0, 0, 0, 0): return &killCommand;
+        case IRC_COMMAND_WORD('C', 'A', 'P', 0, 0, 0, 0, 0): return &capCommand;
+        default: return &unknownCommand;
     }
-    
-    size_t commandLength = sizeof(commands) / sizeof(irc_command_t);
-    
-    for (; i < commandLength; i++) {
-        const irc_command_t *irc_command = &commands[i];
-        if ( strn_equals(commandString, irc_command->name, n) ) {
-            return irc_command;
-        }
+}
+
+const irc_command_t* get_long_command(const char *command) {
+    if (strcmp(command, "AUTHENTICATE") == 0) {
+        return &authenticateCommand;
     }
-    
+
     return &unknownCommand;
 }
 
@@ -146,18 +158,14 @@ static void handle_ctcp_request(irc_session_t *session, irc_parser_result_t *res
         libirc_dcc_request(session, result, ctcp_buf);
     }
     else if (is_action_message(ctcp_buf) && session->callbacks.event_ctcp_action) {
-        // this removes "ACTION" in front of the message
-        char *buf = Calloc(strlen(ctcp_buf)+1, sizeof(char));
-        memcpy(buf, ctcp_buf+7, strlen(ctcp_buf)-7);
-        params[1] = buf; 
+        // this removes "ACTION" in front of the message. the params are slices, so no copy is needed
+        params[1] = ctcp_buf + 7;
         result->num_params = 2;
 
         (*session->callbacks.event_ctcp_action) (session, "ACTION", result);
     }
     else {
-        char *buf = Calloc(strlen(ctcp_buf)+1, sizeof(char));
-        memcpy(buf, ctcp_buf, strlen(ctcp_buf));
-        params[0] = buf;
+        params[0] = ctcp_buf;
         result->num_params = 1;
 
         if (session->callbacks.event_ctcp_req)
@@ -166,7 +174,8 @@ static void handle_ctcp_request(irc_session_t *session, irc_parser_result_t *res
 }
 
 static inline bool is_ctcp_request (const char *string) {
-    return string[0] == 0x01 && string[strlen(string)-1] == 0x01;
+    size_t len = strlen(string);
+    return len >= 2 && string[0] == 0x01 && string[len-1] == 0x01;
 }
 
 static inline bool is_private_message(const char *string, const char *nick) {
@@ -193,23 +202,17 @@ static void irc_privmsg_command(irc_session_t *session, const char *command, irc
 
 static void irc_notice_command(irc_session_t *session, const char *command, irc_parser_result_t *result) {
     char **params = result->params;
-    size_t msglen = strlen (params[1]);
-    unsigned int i = 0;
 
     if ( result->num_params > 1 && is_ctcp_request(params[1]) && session->callbacks.event_ctcp_rep)
     {
-        char *ctcp_buf = Calloc(LIBIRC_BUFFER_SIZE, sizeof(char));
+        char ctcp_buf[LIBIRC_BUFFER_SIZE];
+        size_t msglen = strlen (params[1]) - 2;
 
-        msglen -= 2;
         if (msglen > (sizeof(ctcp_buf) - 1))
             msglen = sizeof(ctcp_buf) - 1;
 
         memcpy (ctcp_buf, params[1] + 1, msglen);
         ctcp_buf[msglen] = '\0';
-
-        for (i = 0; i < result->num_params; i++) {
-            FREE(result->params[i]);
-        }
         
         params[0] = ctcp_buf;
         result->num_params  = 1;
@@ -234,6 +237,14 @@ static void irc_kill_command(irc_session_t *session, const char *command, irc_pa
     /* ignore this event - not all servers generate this */
 }
 
+static void irc_cap_command(irc_session_t *session, const char *command, irc_parser_result_t *result) {
+    libirc_cap_handle(session, result);
+}
+
+static void irc_authenticate_command(irc_session_t *session, const char *command, irc_parser_result_t *result) {
+    libirc_sasl_authenticate(session, result);
+}
+
 static void irc_unknown_command(irc_session_t *session, const char *command, irc_parser_result_t *result) {
     /*
     * The "unknown" event is triggered upon receipt of any number of 
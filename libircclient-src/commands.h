@@ -19,7 +19,11 @@ extern "C" {
     
     typedef struct irc_command_t irc_command_t;
     
-    const irc_command_t* get_command(const char *commandString, size_t n);
+    /* returns the handler of a command, that was packed with IRC_COMMAND_WORD. */
+    const irc_command_t* get_command(uint64_t commandWord);
+    
+    /* returns the handler of a command, that is too long for a packed word. */
+    const irc_command_t* get_long_command(const char *command);
     
 #ifdef	__cplusplus
 }
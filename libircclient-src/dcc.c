@@ -11,6 +11,7 @@
  * License for more details.
  */
 #include <inttypes.h>
+#include <limits.h>
 #include <string.h>
 
 #ifdef _MSC_VER
@@ -20,6 +21,7 @@
 #endif
 
 #include "dcc.h"
+#include "dcc_offer.h"
 #include "params.h"
 #include "irc_line_parser.h"
 #include "session.h"
@@ -28,12 +30,26 @@
 #include "../xdccget.h"
 #include "portable_endian.h"
 
-#define NO_SSL     0
-#define USE_SSL    1
-
 static void send_current_file_offset_to_sender (irc_session_t *session, irc_dcc_session_t *dcc);
 static void recv_dcc_file(irc_session_t *ircsession, irc_dcc_session_t *dcc);
 
+static unsigned short libirc_dcc_remote_port(irc_dcc_session_t *dcc) {
+    if (dcc->remote_addr.sa.sa_family == AF_INET6)
+        return ntohs(dcc->remote_addr.v6.sin6_port);
+
+    return ntohs(dcc->remote_addr.v4.sin_port);
+}
+
+/* formats the address of the bot into buf, that has to hold INET6_ADDRSTRLEN chars. */
+static const char* libirc_dcc_remote_ip(irc_dcc_session_t *dcc, char *buf) {
+    const void *addr = (dcc->remote_addr.sa.sa_family == AF_INET6) ? (const void*) &dcc->remote_addr.v6.sin6_addr : (const void*) &dcc->remote_addr.v4.sin_addr;
+
+    if (inet_ntop(dcc->remote_addr.sa.sa_family, addr, buf, INET6_ADDRSTRLEN) == NULL)
+        strcpy(buf, "?");
+
+    return buf;
+}
+
 static irc_dcc_session_t * libirc_find_dcc_session(irc_session_t * session, irc_dcc_t dccid, int lock_list) {
     irc_dcc_session_t * s, *found = 0;
 
@@ -141,12 +157,27 @@ static inline int hasSocketPendingData (irc_dcc_session_t *dcc) {
     return 0;
 }
 
+static size_t libirc_dcc_read_quota(irc_session_t *ircsession, irc_dcc_session_t *dcc) {
+    if (ircsession->callbacks.dcc_read_quota == NULL || dcc->ctx == NULL) {
+        return LIBIRC_DCC_BUFFER_SIZE;
+    }
+
+    irc_dcc_size_t quota = (*ircsession->callbacks.dcc_read_quota) (ircsession, dcc->id, dcc->ctx);
+
+    return (quota < LIBIRC_DCC_BUFFER_SIZE) ? (size_t) quota : LIBIRC_DCC_BUFFER_SIZE;
+}
+
 static void recv_dcc_file(irc_session_t *ircsession, irc_dcc_session_t *dcc) {
     int rcvdBytes, err = 0;
 
-    size_t amount = LIBIRC_DCC_BUFFER_SIZE;
-
     do {
+        size_t amount = libirc_dcc_read_quota(ircsession, dcc);
+
+        /* the quota of this session is exhausted, the remaining data stays in the socket buffer. */
+        if (amount == 0) {
+            return;
+        }
+
 #ifdef ENABLE_SSL
         if (dcc->ssl == 0)
             rcvdBytes = socket_recv(&dcc->sock, dcc->incoming_buf, amount);
@@ -177,6 +208,12 @@ static void recv_dcc_file(irc_session_t *ircsession, irc_dcc_session_t *dcc) {
 
             dcc->file_confirm_offset += rcvdBytes;
             (*dcc->cb)(ircsession, dcc->id, err, dcc->ctx, dcc->incoming_buf, rcvdBytes);
+
+            /* the callback closed the session, e.g. after the last byte of a segment */
+            if (dcc->state == LIBIRC_STATE_REMOVED) {
+                libirc_mutex_lock(&ircsession->mutex_dcc);
+                return;
+            }
         
       /* if DONT_CONFIRM_OFFSETS_FLAG is set dont send the file offset to the bots
            because some bots dont want to receive the file offsets...*/
@@ -268,7 +305,7 @@ static irc_dcc_session_t * libirc_find_dcc_session_by_port(irc_session_t * sessi
         libirc_mutex_lock(&session->mutex_dcc);
 
     for (s = session->dcc_sessions; s; s = s->next) {
-        if (ntohs(s->remote_addr.sin_port) == port) {
+        if (libirc_dcc_remote_port(s) == port) {
             found = s;
             break;
         }
@@ -325,6 +362,90 @@ static void libirc_remove_dcc_session(irc_session_t * session, irc_dcc_session_t
     free(dcc);
 }
 
+/* returns the smoothed round trip time of the connection in microseconds or 0, if it is not available. */
+static unsigned int libirc_dcc_get_rtt_us(irc_dcc_session_t *dcc) {
+#if defined (TCP_INFO) && !defined (_MSC_VER)
+    struct tcp_info info;
+    socklen_t infoLen = sizeof(info);
+
+    memset(&info, 0, sizeof(info));
+
+    if (getsockopt(dcc->sock, IPPROTO_TCP, TCP_INFO, &info, &infoLen) == 0)
+        return info.tcpi_rtt;
+#endif
+    return 0;
+}
+
+/* returns the size of the receive buffer, that is comparable with the size, that was set. */
+static int libirc_dcc_get_rcvbuf(irc_dcc_session_t *dcc) {
+    int size = 0;
+    socklen_t sizeLen = sizeof(size);
+
+    if (getsockopt(dcc->sock, SOL_SOCKET, SO_RCVBUF, (char*) &size, &sizeLen) != 0)
+        return 0;
+
+#ifdef __linux__
+    // linux doubles the requested size for its bookkeeping and reports the doubled value
+    size /= 2;
+#endif
+
+    return size;
+}
+
+/*
+ * Sizes the receive buffer of a dcc session towards twice its bandwidth-delay
+ * product. If the window limits the transfer, the throughput follows the buffer
+ * and it grows every interval until the link is the limit. Slow or throttled
+ * sessions have a small product, so their buffer shrinks again.
+ */
+static void libirc_dcc_tune_rcvbuf(irc_session_t *ircsession, irc_dcc_session_t *dcc) {
+    uint64_t now = getMonotonicTimeMs();
+
+    if (dcc->tune_time_ms == 0) {
+        dcc->tune_time_ms = now;
+        dcc->tune_offset = dcc->file_confirm_offset;
+        return;
+    }
+
+    uint64_t elapsed = now - dcc->tune_time_ms;
+
+    if (elapsed < LIBIRC_DCC_TUNE_INTERVAL_MS)
+        return;
+
+    irc_dcc_size_t throughput = ((dcc->file_confirm_offset - dcc->tune_offset) * 1000) / elapsed;
+    unsigned int rtt = libirc_dcc_get_rtt_us(dcc);
+
+    dcc->tune_time_ms = now;
+    dcc->tune_offset = dcc->file_confirm_offset;
+
+    if (rtt == 0)
+        return;
+
+    irc_dcc_size_t target = 2 * ((throughput * rtt) / 1000000);
+
+    if (target < LIBIRC_DCC_MIN_RCVBUF)
+        target = LIBIRC_DCC_MIN_RCVBUF;
+
+    if (target > ircsession->dcc_max_rcvbuf)
+        target = ircsession->dcc_max_rcvbuf;
+
+    irc_dcc_size_t current = dcc->rcvbuf_size ? (irc_dcc_size_t) dcc->rcvbuf_size : (irc_dcc_size_t) libirc_dcc_get_rcvbuf(dcc);
+
+    // only act on clear changes, every resize costs a syscall and may drop kernel autotuning
+    if (target <= current + current / 4 && target >= current / 2)
+        return;
+
+    int size = (int) target;
+
+    if (setsockopt(dcc->sock, SOL_SOCKET, SO_RCVBUF, (const char*) &size, sizeof(size)) != 0)
+        return;
+
+    dcc->rcvbuf_size = libirc_dcc_get_rcvbuf(dcc);
+
+    logprintf(LOG_INFO, "dcc %u: rtt %u us, %" IRC_DCC_SIZE_T_FORMAT " bytes/s, receive buffer %" IRC_DCC_SIZE_T_FORMAT " -> %d bytes (wanted %d)",
+        dcc->id, rtt, throughput, current, dcc->rcvbuf_size, size);
+}
+
 static void libirc_dcc_add_descriptors(irc_session_t * ircsession) {
     irc_dcc_session_t * dcc, *dcc_next;
 
@@ -350,7 +471,12 @@ static void libirc_dcc_add_descriptors(irc_session_t * ircsession) {
                 break;
 
             case LIBIRC_STATE_CONNECTED:
-                fdwatch_set_fd(dcc->sock, FDW_READ);
+                if (ircsession->dcc_max_rcvbuf != 0)
+                    libirc_dcc_tune_rcvbuf(ircsession, dcc);
+
+                // throttled sessions are dropped from the read set until they got new quota
+                if (libirc_dcc_read_quota(ircsession, dcc) > 0)
+                    fdwatch_set_fd(dcc->sock, FDW_READ);
                 break;
 
             case LIBIRC_STATE_CONFIRM_SIZE:
@@ -457,23 +583,7 @@ static void libirc_dcc_process_descriptors(irc_session_t * ircsession) {
     libirc_mutex_unlock(&ircsession->mutex_dcc);
 }
 
-#if 0
-static void optimizeSocketBufferSize(const irc_dcc_session_t *dcc) {
-    int bufferSize = 0;
-    socklen_t bufSizeLen = sizeof(int);
-
-    getsockopt(dcc->sock, SOL_SOCKET, SO_RCVBUF, &bufferSize, &bufSizeLen);
-    bufferSize *= 2;
-    bufferSize *= 16;
-
-    DBG_OK("got buffer size of %d!", bufferSize);
-
-    setsockopt(dcc->sock, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
-}
-
-#endif
-
-static int libirc_new_dcc_session(irc_session_t * session, unsigned long ip, unsigned short port, void * ctx, irc_dcc_session_t ** pdcc, int ssl) {
+static int libirc_new_dcc_session(irc_session_t * session, const libirc_dcc_offer_t *offer, void * ctx, irc_dcc_session_t ** pdcc) {
     irc_dcc_session_t * dcc = malloc(sizeof (irc_dcc_session_t));
 
     if (!dcc)
@@ -487,18 +597,17 @@ static int libirc_new_dcc_session(irc_session_t * session, unsigned long ip, uns
     if (libirc_mutex_init(&dcc->mutex_outbuf))
         goto cleanup_exit_error;
 
-    if (socket_create(PF_INET, SOCK_STREAM, &dcc->sock))
+    // a reverse send listens on ipv4, because the bot is told the ipv4 address of listenIp
+    if (socket_create((offer->family == AF_INET6 && offer->port != 0) ? PF_INET6 : PF_INET, SOCK_STREAM, &dcc->sock))
         goto cleanup_exit_error;
 
 	// make socket non-blocking, so connect() call won't block
     if (socket_make_nonblocking(&dcc->sock))
         goto cleanup_exit_error;
 
-    //optimizeSocketBufferSize(dcc);
- 
 #if defined (ENABLE_SSL)
     dcc->ssl = 0;
-    if (ssl) {
+    if (offer->ssl) {
         dcc->ssl = 1;
         if (!isSslIntitialized()) {
             DBG_OK("need to init ssl context!");
@@ -521,9 +630,16 @@ static int libirc_new_dcc_session(irc_session_t * session, unsigned long ip, uns
 #endif
 
     memset(&dcc->remote_addr, 0, sizeof (dcc->remote_addr));
-    dcc->remote_addr.sin_family = AF_INET;
-    dcc->remote_addr.sin_addr.s_addr = htonl(ip); // what idiot came up with idea to send IP address in host-byteorder?
-    dcc->remote_addr.sin_port = htons(port);
+    if (offer->family == AF_INET6) {
+        dcc->remote_addr.v6.sin6_family = AF_INET6;
+        dcc->remote_addr.v6.sin6_addr = offer->ip6;
+        dcc->remote_addr.v6.sin6_port = htons(offer->port);
+    }
+    else {
+        dcc->remote_addr.v4.sin_family = AF_INET;
+        dcc->remote_addr.v4.sin_addr.s_addr = htonl(offer->ip); // what idiot came up with idea to send IP address in host-byteorder?
+        dcc->remote_addr.v4.sin_port = htons(offer->port);
+    }
 
     dcc->state = LIBIRC_STATE_INIT;
 
@@ -570,54 +686,41 @@ int irc_dcc_destroy(irc_session_t * session, irc_dcc_t dccid) {
     return 0;
 }
 
-static void accept_dcc_send(irc_session_t * session, const char * nick, const char * req, char *filename, unsigned long ip, irc_dcc_size_t size, unsigned short port, int ssl) {
-    DBG_OK("---- got dcc send req: %s ---", req);
+static void accept_dcc_send(irc_session_t * session, const char * nick, const libirc_dcc_offer_t *offer) {
+    DBG_OK("---- got dcc send req: %s ---", offer->filename);
     if (session->callbacks.event_dcc_send_req) {
         irc_dcc_session_t * dcc;
-        
-        int err = libirc_new_dcc_session(session, ip, port, 0, &dcc, ssl);
+        char addr[INET6_ADDRSTRLEN];
+
+        int err = libirc_new_dcc_session(session, offer, 0, &dcc);
         if (err) {
             session->lasterror = err;
             return;
         }
         (*session->callbacks.event_dcc_send_req) (session,
                 nick,
-                inet_ntoa(dcc->remote_addr.sin_addr),
-                filename,
-                size,
+                libirc_dcc_remote_ip(dcc, addr),
+                offer->filename,
+                offer->size,
                 dcc->id);
 
-        dcc->received_file_size = size;
+        dcc->received_file_size = offer->size;
     }
 }
 
-static inline int sscanf_wrapper(const char *const buffer, const char *const format, ...) {
-    int rc;
-
-    va_list args;
-    va_start(args, format);
-#ifdef _MSC_VER
-    rc = vsscanf_s(buffer, format, args);
-#else
-    rc = vsscanf(buffer, format, args);
-#endif
-    va_end(args);
-
-    return rc;
-}
-
-static void accept_reverse_dcc_send(irc_session_t * session, const char * nick, const char * req, char *filename, unsigned long ip, irc_dcc_size_t size, unsigned long token, int ssl) {
-    logprintf(LOG_WARN, "got a reverse dcc send request for file %s!", filename);
+static void accept_reverse_dcc_send(irc_session_t * session, const char * nick, const libirc_dcc_offer_t *offer) {
+    logprintf(LOG_WARN, "got a reverse dcc send request for file %s!", offer->filename);
     //logprintf(LOG_WARN, "xdccget does not support reverse dcc send requests yet!", filename);
     irc_dcc_session_t* dcc = NULL;
-    int err = libirc_new_dcc_session(session, ip, 0, 0, &dcc, ssl);
+    char addr[INET6_ADDRSTRLEN];
+    int err = libirc_new_dcc_session(session, offer, 0, &dcc);
     if (err) {
         session->lasterror = err;
         return;
     }
     
     dcc->passive_connection = true;
-    dcc->token = token;
+    dcc->token = offer->token;
     
     struct xdccGetConfig *cfg = getCfg();
     struct sockaddr_in servaddr;
@@ -645,124 +748,100 @@ static void accept_reverse_dcc_send(irc_session_t * session, const char * nick,
     
     (*session->callbacks.event_dcc_send_req_reverse) (session,
                 nick,
-                inet_ntoa(dcc->remote_addr.sin_addr),
-                filename,
-                size,
+                libirc_dcc_remote_ip(dcc, addr),
+                offer->filename,
+                offer->size,
                 dcc->id,
-                token);
+                offer->token);
 }
 
-static void libirc_dcc_request(irc_session_t * session, irc_parser_result_t *result, const char * req) {
-    char filenamebuf[LIBIRC_BUFFER_SIZE+1];
-    unsigned long ip;
-    unsigned long token;
-    irc_dcc_size_t size;
-    unsigned short port;
-
-    filenamebuf[LIBIRC_BUFFER_SIZE] = (char) 0;
-    DBG_OK("---- got dcc req: %s ---", req);
+static void libirc_dcc_accept_resume(irc_session_t * session, irc_parser_result_t *result, const libirc_dcc_offer_t *offer) {
+    irc_dcc_session_t * dcc;
 
-    if (session->callbacks.verify_incoming_dcc_requests_req && !session->callbacks.verify_incoming_dcc_requests_req(session, result->nick)) {
-        DBG_WARN("received unknown dcc req from nick %s. ignoring that request!", result->nick);
+    if (!offer->has_size) {
+        DBG_WARN("the dcc accept of %s has no file position!", result->nick);
         return;
     }
 
-#ifdef _MSC_VER
-    if (sscanf_wrapper(req, "DCC SEND %"LIBIRC_BUFFER_SIZE_STR"s %lu 0 %" IRC_DCC_SIZE_T_FORMAT" %lu", filenamebuf, LIBIRC_BUFFER_SIZE, &ip, &size, &token) == 4) {
-#else
-    if (sscanf_wrapper(req, "DCC SEND %"LIBIRC_BUFFER_SIZE_STR"s %lu 0 %" IRC_DCC_SIZE_T_FORMAT" %lu", filenamebuf, &ip, &size, &token) == 4) {
-#endif
-       accept_reverse_dcc_send(session, result->nick, req, filenamebuf, ip, size, token, NO_SSL);
-        return;
-    }
+    // the port is 0 for the answers to a resume of a reverse send, that carry the token instead
+    bool reverse = offer->port == 0 && offer->has_token;
 
-#ifdef _MSC_VER
-    if (sscanf_wrapper(req, "DCC SEND %"LIBIRC_BUFFER_SIZE_STR"s %lu %hu %" IRC_DCC_SIZE_T_FORMAT, filenamebuf, LIBIRC_BUFFER_SIZE, &ip, &port, &size) == 4) {
-#else
-    if (sscanf_wrapper(req, "DCC SEND %"LIBIRC_BUFFER_SIZE_STR"s %lu %hu %" IRC_DCC_SIZE_T_FORMAT, filenamebuf, &ip, &port, &size) == 4) {
-#endif
-        accept_dcc_send(session, result->nick, req, filenamebuf, ip, size, port, NO_SSL);
-        return;
-    }
-    /*this matches file names that contain spaces and are are delimited by quotes,
-      so for example "This is a really long file name with spaces" would match*/
-#ifdef _MSC_VER
-    else if (sscanf_wrapper(req, "DCC SEND \"%"LIBIRC_BUFFER_SIZE_STR"[^\"]\" %lu %hu %" IRC_DCC_SIZE_T_FORMAT, filenamebuf, LIBIRC_BUFFER_SIZE, &ip, &port, &size) == 4) {
-#else
-    else if (sscanf_wrapper(req, "DCC SEND \"%"LIBIRC_BUFFER_SIZE_STR"[^\"]\" %lu %hu %" IRC_DCC_SIZE_T_FORMAT, filenamebuf, &ip, &port, &size) == 4) {
-#endif
-         accept_dcc_send(session, result->nick, req, filenamebuf, ip, size, port, NO_SSL);
-        return;
-    }
-#ifdef _MSC_VER
-    else if (sscanf_wrapper(req, "DCC SEND %"LIBIRC_BUFFER_SIZE_STR"s %lu %hu", filenamebuf, LIBIRC_BUFFER_SIZE, &ip, &port) == 3) {
-#else
-    else if (sscanf_wrapper(req, "DCC SEND %"LIBIRC_BUFFER_SIZE_STR"s %lu %hu", filenamebuf, &ip, &port) == 3) {
-#endif
-        size = 0;
-        accept_dcc_send(session, result->nick, req, filenamebuf, ip, size, port, NO_SSL);
-        return;
-    }
-#if defined (ENABLE_SSL)
-#ifdef _MSC_VER
-    else if (sscanf_wrapper(req, "DCC SSEND %"LIBIRC_BUFFER_SIZE_STR"s %lu %hu %" IRC_DCC_SIZE_T_FORMAT, filenamebuf, LIBIRC_BUFFER_SIZE, &ip, &port, &size) == 4) {
-#else
-    else if (sscanf_wrapper(req, "DCC SSEND %"LIBIRC_BUFFER_SIZE_STR"s %lu %hu %" IRC_DCC_SIZE_T_FORMAT, filenamebuf, &ip, &port, &size) == 4) {
-#endif
-        accept_dcc_send(session, result->nick, req, filenamebuf, ip, size, port, USE_SSL);
-        return;
-    }
-#endif
-    else if (sscanf_wrapper(req, "DCC ACCEPT file.ext 0 %" IRC_DCC_SIZE_T_FORMAT" %lu", &size, &token) == 2) {
-        DBG_OK("---- got dcc accept reverse req: %" IRC_DCC_SIZE_T_FORMAT " %lu ---", size, token);
-        irc_dcc_session_t * dcc;
-        dcc = libirc_find_dcc_session_by_token(session, token, 1);
+    if (reverse) {
+        DBG_OK("---- got dcc accept reverse req: %" IRC_DCC_SIZE_T_FORMAT " %lu ---", offer->size, offer->token);
+        dcc = libirc_find_dcc_session_by_token(session, offer->token, 1);
         if (dcc == NULL) {
-            DBG_WARN("cant find open dcc session with token = %lu!", token);
+            DBG_WARN("cant find open dcc session with token = %lu!", offer->token);
             return;
         }
-        
-        if (dcc->state != LIBIRC_STATE_WAITING_FOR_RESUME_ACK) {
-            DBG_WARN("dcc->state != LIBIRC_STATE_WAITING_FOR_RESUME_ACK");
+    }
+    else {
+        DBG_OK("---- got dcc accept req: %hu %" IRC_DCC_SIZE_T_FORMAT " ---", offer->port, offer->size);
+        dcc = libirc_find_dcc_session_by_port(session, offer->port, 1);
+        if (dcc == NULL) {
+            DBG_WARN("cant find open dcc session with port = %hu!", offer->port);
             return;
         }
+    }
 
-        dcc->state = LIBIRC_STATE_INIT_PASSIVE;
-
-        dcc->file_confirm_offset = size;
-
+    if (dcc->state != LIBIRC_STATE_WAITING_FOR_RESUME_ACK) {
+        DBG_WARN("dcc->state != LIBIRC_STATE_WAITING_FOR_RESUME_ACK");
         libirc_mutex_unlock(&session->mutex_dcc);
-
-        (*dcc->reverse_cb) (session, dcc->id, 1, dcc->ctx, NULL, size, result->nick, "file.ext", token);
         return;
     }
-    else if (sscanf_wrapper(req, "DCC ACCEPT file.ext %hu %" IRC_DCC_SIZE_T_FORMAT, &port, &size) == 2) {
-        DBG_OK("---- got dcc accept req: %hu %" IRC_DCC_SIZE_T_FORMAT " ---", port, size);
-        irc_dcc_session_t * dcc;
-        dcc = libirc_find_dcc_session_by_port(session, port, 1);
-        if (dcc == NULL) {
-            DBG_WARN("cant find open dcc session with port = %hu!", port);
-            return;
-        }
 
-        if (dcc->state != LIBIRC_STATE_WAITING_FOR_RESUME_ACK) {
-            DBG_WARN("dcc->state != LIBIRC_STATE_WAITING_FOR_RESUME_ACK");
-            return;
-        }
+    dcc->file_confirm_offset = offer->size;
 
+    if (reverse) {
+        dcc->state = LIBIRC_STATE_INIT_PASSIVE;
+        libirc_mutex_unlock(&session->mutex_dcc);
+        (*dcc->reverse_cb) (session, dcc->id, 1, dcc->ctx, NULL, offer->size, result->nick, offer->filename, offer->token);
+    }
+    else {
         dcc->state = LIBIRC_STATE_INIT;
+        libirc_mutex_unlock(&session->mutex_dcc);
+        (*dcc->cb) (session, dcc->id, 1, dcc->ctx, NULL, offer->size);
+    }
+}
 
-        dcc->file_confirm_offset = size;
+static void libirc_dcc_request(irc_session_t * session, irc_parser_result_t *result, char * req) {
+    libirc_dcc_offer_t offer;
 
-        libirc_mutex_unlock(&session->mutex_dcc);
+    DBG_OK("---- got dcc req: %s ---", req);
+
+    if (session->callbacks.verify_incoming_dcc_requests_req && !session->callbacks.verify_incoming_dcc_requests_req(session, result->nick)) {
+        DBG_WARN("received unknown dcc req from nick %s. ignoring that request!", result->nick);
+        return;
+    }
 
-        (*dcc->cb) (session, dcc->id, 1, dcc->ctx, NULL, size);
+    if (!libirc_dcc_tokenize(req, &offer)) {
+        logprintf(LOG_WARN, "ignoring the malformed dcc request of %s.", result->nick);
+        return;
+    }
 
+    if (strcasecmp(offer.verb, "ACCEPT") == 0) {
+        libirc_dcc_accept_resume(session, result, &offer);
         return;
+    }
 
+    bool is_send = strcasecmp(offer.verb, "SEND") == 0;
+#if defined (ENABLE_SSL)
+    is_send = is_send || strcasecmp(offer.verb, "SSEND") == 0;
+#endif
+
+    if (!is_send) {
+        DBG_ERR("BUG: Unhandled DCC message: %s", offer.verb);
+        return;
     }
 
-    DBG_ERR("BUG: Unhandled DCC message: %s", req);
+    // a port of 0 asks us to listen for the bot
+    if (offer.port != 0)
+        accept_dcc_send(session, result->nick, &offer);
+    else if (!offer.has_token)
+        logprintf(LOG_WARN, "ignoring the reverse dcc send of %s without a token.", result->nick);
+    else if (offer.ssl)
+        logprintf(LOG_WARN, "ignoring the reverse dcc ssend of %s, reverse sends over ssl are not supported.", result->nick);
+    else
+        accept_reverse_dcc_send(session, result->nick, &offer);
 }
 
 int irc_dcc_accept(irc_session_t * session, irc_dcc_t dccid, void * ctx, irc_dcc_callback_t callback) {
@@ -785,7 +864,9 @@ int irc_dcc_accept(irc_session_t * session, irc_dcc_t dccid, void * ctx, irc_dcc
 
     // Initiate the connect
 
-    if (socket_connect(&dcc->sock, (struct sockaddr *) &dcc->remote_addr, sizeof (dcc->remote_addr))) {
+    socklen_t addr_len = (dcc->remote_addr.sa.sa_family == AF_INET6) ? sizeof (dcc->remote_addr.v6) : sizeof (dcc->remote_addr.v4);
+
+    if (socket_connect(&dcc->sock, &dcc->remote_addr.sa, addr_len)) {
         libirc_dcc_destroy_nolock(session, dccid);
         libirc_mutex_unlock(&session->mutex_dcc);
         session->lasterror = LIBIRC_ERR_CONNECT;
@@ -914,7 +995,7 @@ int irc_dcc_resume(irc_session_t * session, irc_dcc_t dccid, void * ctx, irc_dcc
 
     // ctcp msg to bot
     char buf[512];
-    snprintf(buf, sizeof(buf), "DCC RESUME file.ext %hu %" IRC_DCC_SIZE_T_FORMAT "", ntohs(dcc->remote_addr.sin_port), filePosition);
+    snprintf(buf, sizeof(buf), "DCC RESUME file.ext %hu %" IRC_DCC_SIZE_T_FORMAT "", libirc_dcc_remote_port(dcc), filePosition);
     DBG_OK("%s", buf);
     irc_cmd_ctcp_request(session, nick, buf);
     dcc->state = LIBIRC_STATE_WAITING_FOR_RESUME_ACK;
@@ -39,7 +39,17 @@ struct irc_dcc_session_s {
     irc_dcc_size_t received_file_size;
     irc_dcc_size_t file_confirm_offset;
 
-    struct sockaddr_in remote_addr;
+    /* receive buffer set by the adaptive mode, 0 while the kernel decides */
+    int rcvbuf_size;
+    uint64_t tune_time_ms;
+    irc_dcc_size_t tune_offset;
+
+    /* the address of the bot, ipv4 or ipv6 as the offer gave it */
+    union {
+        struct sockaddr sa;
+        struct sockaddr_in v4;
+        struct sockaddr_in6 v6;
+    } remote_addr;
 
     char incoming_buf[LIBIRC_DCC_BUFFER_SIZE];
     unsigned int incoming_offset;
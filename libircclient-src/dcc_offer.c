@@ -0,0 +1,144 @@
+/* Copyright (C) 2004-2012 George Yunaev gyunaev@ulduzsoft.com
+ *
+ * This library is free software; you can redistribute it and/or modify it 
+ * under the terms of the GNU Lesser General Public License as published by 
+ * the Free Software Foundation; either version 3 of the License, or (at your 
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public 
+ * License for more details.
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#else
+#include <strings.h>
+#include <arpa/inet.h>
+#endif
+
+#include "dcc_offer.h"
+
+/* returns the next word of the request and terminates it, or NULL at its end. if quoted is set, a word in quotes
+   may contain spaces and is returned without the quotes. */
+static char* libirc_dcc_next_word(char **cursor, bool quoted) {
+    char *word = *cursor;
+    char *end;
+
+    while (*word == ' ')
+        word++;
+
+    if (*word == '\0')
+        return NULL;
+
+    if (quoted && *word == '"' && (end = strchr(word + 1, '"')) != NULL)
+        word++;
+    else
+        end = word + strcspn(word, " ");
+
+    if (*end != '\0')
+        *end++ = '\0';
+
+    *cursor = end;
+    return word;
+}
+
+static bool libirc_dcc_parse_number(const char *word, uint64_t max, uint64_t *value) {
+    char *end;
+
+    if (word == NULL || !isdigit((unsigned char) *word))
+        return false;
+
+    errno = 0;
+    *value = strtoull(word, &end, 10);
+    return *end == '\0' && errno == 0 && *value <= max;
+}
+
+/* the address of an offer is an ipv4 address as a number in host byte order, an ipv6 address or, from some clients,
+   a dotted ipv4 address. */
+static bool libirc_dcc_parse_address(const char *word, libirc_dcc_offer_t *offer) {
+    uint64_t ip;
+
+    if (word == NULL)
+        return false;
+
+    if (strchr(word, ':') != NULL) {
+        offer->family = AF_INET6;
+        return inet_pton(AF_INET6, word, &offer->ip6) == 1;
+    }
+
+    offer->family = AF_INET;
+
+    if (strchr(word, '.') != NULL) {
+        struct in_addr addr;
+
+        if (inet_pton(AF_INET, word, &addr) != 1)
+            return false;
+
+        offer->ip = ntohl(addr.s_addr);
+        return true;
+    }
+
+    if (!libirc_dcc_parse_number(word, UINT32_MAX, &ip))
+        return false;
+
+    offer->ip = (unsigned long) ip;
+    return true;
+}
+
+/* splits an offer like DCC SEND "file name" 3232235777 5000 1048576 [token] or an answer to a resume like
+   DCC ACCEPT file.ext 5000 1048576 [token] in a single pass over the request. the words are terminated in place.
+   returns false, if the request is malformed. */
+static bool libirc_dcc_tokenize(char *req, libirc_dcc_offer_t *offer) {
+    char *cursor = req;
+    char *word;
+    uint64_t value;
+
+    memset(offer, 0, sizeof (*offer));
+
+    // the caller checked the DCC in front
+    libirc_dcc_next_word(&cursor, false);
+    offer->verb = libirc_dcc_next_word(&cursor, false);
+    offer->filename = libirc_dcc_next_word(&cursor, true);
+
+    if (offer->verb == NULL || offer->filename == NULL || offer->filename[0] == '\0')
+        return false;
+
+    // the answers to a resume have no address
+    if (strcasecmp(offer->verb, "ACCEPT") != 0) {
+        offer->ssl = (strcasecmp(offer->verb, "SSEND") == 0) ? USE_SSL : NO_SSL;
+
+        if (!libirc_dcc_parse_address(libirc_dcc_next_word(&cursor, false), offer))
+            return false;
+    }
+
+    if (!libirc_dcc_parse_number(libirc_dcc_next_word(&cursor, false), UINT16_MAX, &value))
+        return false;
+
+    offer->port = (unsigned short) value;
+
+    // old clients send no size. the words after the token are ignored
+    if ((word = libirc_dcc_next_word(&cursor, false)) != NULL) {
+        if (!libirc_dcc_parse_number(word, UINT64_MAX, &value))
+            return false;
+
+        offer->size = (irc_dcc_size_t) value;
+        offer->has_size = true;
+
+        if ((word = libirc_dcc_next_word(&cursor, false)) != NULL) {
+            if (!libirc_dcc_parse_number(word, ULONG_MAX, &value))
+                return false;
+
+            offer->token = (unsigned long) value;
+            offer->has_token = true;
+        }
+    }
+
+    return true;
+}
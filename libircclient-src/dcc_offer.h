@@ -0,0 +1,47 @@
+/* Copyright (C) 2004-2012 George Yunaev gyunaev@ulduzsoft.com
+ *
+ * This library is free software; you can redistribute it and/or modify it 
+ * under the terms of the GNU Lesser General Public License as published by 
+ * the Free Software Foundation; either version 3 of the License, or (at your 
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public 
+ * License for more details.
+ */
+#ifndef DCC_OFFER_H
+#define DCC_OFFER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#endif
+
+#include "libircclient.h"
+
+#define NO_SSL     0
+#define USE_SSL    1
+
+/* a dcc offer or answer of a bot, as libirc_dcc_tokenize splits it. the strings point into the request. */
+typedef struct {
+    const char *verb;
+    const char *filename;
+    /* AF_INET or AF_INET6 for the offers, the answers to a resume carry no address */
+    int family;
+    unsigned long ip;
+    struct in6_addr ip6;
+    unsigned short port;
+    irc_dcc_size_t size;
+    bool has_size;
+    unsigned long token;
+    bool has_token;
+    int ssl;
+} libirc_dcc_offer_t;
+
+#endif
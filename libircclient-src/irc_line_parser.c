@@ -17,19 +17,12 @@
 */
 
 
-#define SAFE_FREE(X) \
-do {\
-	if ( (X != NULL) ) {\
-		free(( X ));\
-		X = NULL;\
-	}\
-} while(0)
-
 void free_line_parser(irc_parser *parser) {
     FREE(parser->data);
     FREE(parser);
 }
 
+/* the fields of the result point into the line, that was parsed. they are only forgotten here. */
 void free_parser_result (irc_parser *parser) {
     irc_parser_result_t *result = parser->data;
     unsigned int i = 0;
@@ -38,69 +31,283 @@ void free_parser_result (irc_parser *parser) {
         return;
     }
     
-    SAFE_FREE(result->nick);
-    SAFE_FREE(result->name);
-    SAFE_FREE(result->host);
-    SAFE_FREE(result->command);
+    result->tags = NULL;
+    result->nick = NULL;
+    result->name = NULL;
+    result->host = NULL;
+    result->command = NULL;
+    result->command_word = 0;
+    result->numeric = -1;
     
     for (i = 0; i < result->num_params; i++) {
-        SAFE_FREE(result->params[i]);
+        result->params[i] = NULL;
     }
 
     result->num_params = 0;
 }
 
-static inline char* calloc_and_copy_string(const char *string, size_t len) {
-    char *result = Calloc(len+1, sizeof(char));
-#ifdef _MSC_VER
-    strncpy_s(result, len+1, string, len);
-#else
-    strncpy(result, string, len);
-#endif
-    return result;
-}
+/* splits the prefix <nick> [ '!' <user> ] [ '@' <host> ] or <servername> in place. */
+static inline void tokenize_prefix(char *prefix, irc_parser_result_t *result) {
+    char *at = strchr(prefix, '@');
+    char *bang = strchr(prefix, '!');
 
-static int on_nick(irc_parser *parser, const char *at, size_t len) {
-    irc_parser_result_t *result = parser->data;
-    result->nick = calloc_and_copy_string(at, len);
-    return 0;
+    result->nick = prefix;
+
+    if (bang != NULL && (at == NULL || bang < at)) {
+        *bang = '\0';
+        result->name = bang + 1;
+    }
+
+    if (at != NULL) {
+        *at = '\0';
+        result->host = at + 1;
+    }
 }
 
-static int on_name(irc_parser *parser, const char *at, size_t len) {
-    irc_parser_result_t *result = parser->data;
-    result->name = calloc_and_copy_string(at, len);
-    return 0;
+/* decodes a command. a numeric reply gets its code, the other commands their packed word. */
+static inline void decode_command(const char *command, size_t len, uint64_t *command_word, int *numeric) {
+    size_t i;
+
+    *command_word = 0;
+    *numeric = -1;
+
+    if (len == 3 && isdigit((unsigned char) command[0]) && isdigit((unsigned char) command[1]) && isdigit((unsigned char) command[2])) {
+        *numeric = (command[0] - '0') * 100 + (command[1] - '0') * 10 + (command[2] - '0');
+        return;
+    }
+
+    if (len > sizeof(*command_word)) {
+        return;
+    }
+
+    for (i = 0; i < len; i++) {
+        *command_word |= (uint64_t) (unsigned char) command[i] << (8 * i);
+    }
 }
 
-static int on_host(irc_parser *parser, const char *at, size_t len) {
-    irc_parser_result_t *result = parser->data;
-    result->host = calloc_and_copy_string(at, len);
-    return 0;
+/* finds the origin, the command and the target of the line without changing it. this is all, that the filter
+   needs, so that the lines of others are dropped without tokenizing their params. */
+static void scan_line(const char *line, size_t len, irc_line_info_t *info) {
+    const char *end = line + len;
+    const char *pos = line;
+    const char *space;
+
+    memset(info, 0, sizeof(*info));
+    info->numeric = -1;
+
+    if (pos < end && *pos == '@') {
+        space = memchr(pos, ' ', (size_t) (end - pos));
+
+        if (space == NULL) {
+            return;
+        }
+
+        pos = space + 1;
+    }
+
+    if (pos < end && *pos == ':') {
+        space = memchr(pos, ' ', (size_t) (end - pos));
+
+        if (space == NULL) {
+            return;
+        }
+
+        info->origin = pos + 1;
+        info->origin_len = strcspn(info->origin, "!@ ");
+        pos = space;
+    }
+
+    while (pos < end && *pos == ' ') {
+        pos++;
+    }
+
+    space = memchr(pos, ' ', (size_t) (end - pos));
+    decode_command(pos, (size_t) (((space != NULL) ? space : end) - pos), &info->command_word, &info->numeric);
+
+    if (space == NULL) {
+        return;
+    }
+
+    pos = space;
+
+    while (pos < end && *pos == ' ') {
+        pos++;
+    }
+
+    /* JOIN :#channel sends the target as trailing param */
+    if (pos < end && *pos == ':') {
+        pos++;
+    }
+
+    space = memchr(pos, ' ', (size_t) (end - pos));
+    info->target = pos;
+    info->target_len = (size_t) (((space != NULL) ? space : end) - pos);
+
+    if (space != NULL && space + 2 < end) {
+        info->is_ctcp = space[1] == ':' && space[2] == 0x01;
+    }
 }
 
-static int on_command(irc_parser *parser, const char *at, size_t len) {
-    irc_parser_result_t *result = parser->data;
-    result->command = calloc_and_copy_string(at, len);
-    return 0;
+static inline bool is_own_nick(irc_session_t *session, const char *name, size_t len) {
+    return session->nick != NULL && len == strlen(session->nick) && strncasecmp(name, session->nick, len) == 0;
 }
 
-static int on_param(irc_parser *parser, const char *at, size_t len) {
-    irc_parser_result_t *result = parser->data;
-    
-    if (result->num_params < MAX_PARAMS_ALLOWED) {
-        result->params[result->num_params] = calloc_and_copy_string(at, len);
-        result->num_params++;
+/* returns false for the lines, that cannot change anything for the application. the lines of the server for
+   the library, the lines from or to our nick and the commands, that are rare anyway, are always kept. the
+   lines of others are dropped, if no event is set for them, and the line filter decides about the rest. */
+static bool is_line_wanted(irc_session_t *session, const irc_line_info_t *info) {
+    irc_callbacks_t *callbacks = &session->callbacks;
+
+    if (info->numeric != -1) {
+        if ((info->numeric == 376 || info->numeric == 422) && !(session->flags & SESSIONFL_MOTD_RECEIVED)) {
+            return true;
+        }
+
+        /* the end of the sasl authentication */
+        if (info->numeric >= 900 && info->numeric <= 908) {
+            return true;
+        }
+
+        if (callbacks->event_numeric == NULL) {
+            return false;
+        }
+    }
+    else if (info->origin_len != 0 && is_own_nick(session, info->origin, info->origin_len)) {
+        return true;
     }
     else {
-        DBG_WARN("reached max params at irc_line_parsing!");
+        switch (info->command_word) {
+            case IRC_COMMAND_WORD('P', 'R', 'I', 'V', 'M', 'S', 'G', 0):
+                if (is_own_nick(session, info->target, info->target_len)) {
+                    return true;
+                }
+
+                if (info->is_ctcp ? callbacks->event_ctcp_action == NULL : callbacks->event_channel == NULL) {
+                    return false;
+                }
+                break;
+            case IRC_COMMAND_WORD('N', 'O', 'T', 'I', 'C', 'E', 0, 0):
+                if (is_own_nick(session, info->target, info->target_len)) {
+                    return true;
+                }
+
+                if (info->is_ctcp ? callbacks->event_ctcp_rep == NULL : callbacks->event_channel_notice == NULL) {
+                    return false;
+                }
+                break;
+            case IRC_COMMAND_WORD('J', 'O', 'I', 'N', 0, 0, 0, 0):
+                if (callbacks->event_join == NULL) {
+                    return false;
+                }
+                break;
+            case IRC_COMMAND_WORD('P', 'A', 'R', 'T', 0, 0, 0, 0):
+                if (callbacks->event_part == NULL) {
+                    return false;
+                }
+                break;
+            case IRC_COMMAND_WORD('Q', 'U', 'I', 'T', 0, 0, 0, 0):
+                if (callbacks->event_quit == NULL) {
+                    return false;
+                }
+                break;
+            case IRC_COMMAND_WORD('N', 'I', 'C', 'K', 0, 0, 0, 0):
+                if (callbacks->event_nick == NULL) {
+                    return false;
+                }
+                break;
+            case IRC_COMMAND_WORD('T', 'O', 'P', 'I', 'C', 0, 0, 0):
+                if (callbacks->event_topic == NULL) {
+                    return false;
+                }
+                break;
+            default:
+                return true;
+        }
     }
-    
-    return 0;
+
+    return callbacks->line_filter == NULL || (*callbacks->line_filter) (session, info) != 0;
 }
 
-static int on_error(irc_parser *parser, const char *at, size_t len) {
-    DBG_ERR("Error '%s' at parsing the irc line!", irc_parser_error_string(parser));
-    return 0;
+/* splits the line, that ends in front of its CR LF, in place into the prefix, the command and the params. the
+   separators are overwritten with NUL, so that the fields of result are strings, that point into the line, and
+   no memory is allocated for a line. the fields are valid, until the line is removed from the input buffer. */
+static void tokenize_line(char *line, size_t len, irc_parser_result_t *result) {
+    char *end = line + len;
+    char *pos = line;
+    char *space;
+
+    *end = '\0';
+
+    if (*pos == '@') {
+        space = memchr(pos, ' ', (size_t) (end - pos));
+
+        if (space == NULL) {
+            return;
+        }
+
+        *space = '\0';
+        result->tags = pos + 1;
+        pos = space + 1;
+    }
+
+    if (*pos == ':') {
+        space = memchr(pos, ' ', (size_t) (end - pos));
+
+        if (space == NULL) {
+            return;
+        }
+
+        *space = '\0';
+        tokenize_prefix(pos + 1, result);
+        pos = space + 1;
+    }
+
+    while (*pos == ' ') {
+        pos++;
+    }
+
+    if (*pos == '\0') {
+        return;
+    }
+
+    result->command = pos;
+    space = memchr(pos, ' ', (size_t) (end - pos));
+    decode_command(pos, (size_t) (((space != NULL) ? space : end) - pos), &result->command_word, &result->numeric);
+
+    if (space == NULL) {
+        return;
+    }
+
+    *space = '\0';
+    pos = space + 1;
+
+    while (pos < end) {
+        if (*pos == ' ') {
+            pos++;
+            continue;
+        }
+
+        if (result->num_params == MAX_PARAMS_ALLOWED) {
+            DBG_WARN("reached max params at irc_line_parsing!");
+            return;
+        }
+
+        /* the trailing param may contain spaces and may be empty */
+        if (*pos == ':') {
+            result->params[result->num_params++] = pos + 1;
+            return;
+        }
+
+        result->params[result->num_params++] = pos;
+        space = memchr(pos, ' ', (size_t) (end - pos));
+
+        if (space == NULL) {
+            return;
+        }
+
+        *space = '\0';
+        pos = space + 1;
+    }
 }
 
 static inline void print_parser_result(irc_parser_result_t *result) {    
@@ -140,22 +347,17 @@ static inline sds create_prefix_from_result(irc_parser_result_t *result) {
     return prefix;
 }
 
-static inline bool is_numeric_command(char *command) {
-    return strlen(command) == 3 && isdigit((int) command[0]) && isdigit((int) command[1]) && isdigit((int) command[2]);
-}
-
-static int handle_parser_result (irc_parser *parser, const char *at, size_t len) {
-    irc_parser_result_t *result = parser->data;
+static void handle_parser_result (irc_parser_result_t *result) {
     irc_session_t *session = result->session;
     
     if (result->command == NULL) {
-        return 0;
+        return;
     }
     
 //    print_parser_result(result);
     
-    if (is_numeric_command(result->command)) {
-        int code = atoi(result->command);
+    if (result->numeric != -1) {
+        int code = result->numeric;
         // We use SESSIONFL_MOTD_RECEIVED flag to check whether it is the first
         // RPL_ENDOFMOTD or ERR_NOMOTD after the connection.
         if ((code == 376 || code == 422) && !(session->flags & SESSIONFL_MOTD_RECEIVED)) {
@@ -165,30 +367,134 @@ static int handle_parser_result (irc_parser *parser, const char *at, size_t len)
                 (*session->callbacks.event_connect) (session, "CONNECT", result);
         }
 
+        // the registration is done. the server starts to count floods only now, and a server without
+        // capabilities ignored CAP LS
+        if (code == 1) {
+            session->flags &= ~SESSIONFL_CAP_NEGOTIATING;
+            session->pacer.penalty_ms = 0;
+        }
+
+        if (code >= 900 && code <= 908)
+            libirc_sasl_numeric(session, code, result);
+
         if (session->callbacks.event_numeric)
             (*session->callbacks.event_numeric) (session, code, result);
     }
     else {
-        char *command = result->command;
-        if (result->command == NULL) return 0;
+        const irc_command_t *irc_command = (result->command_word != 0) ? get_command(result->command_word) : get_long_command(result->command);
+        irc_command->execute(session, result->command, result);
+    }
+}
+
+/* the days from 1970-01-01 to the date of the proleptic gregorian calendar. */
+static int64_t days_from_civil(int year, int month, int day) {
+    int64_t y = (month <= 2) ? year - 1 : year;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+/* reads the server-time tag like time=2026-10-19T12:30:05.123Z and returns its time in milliseconds since the
+   epoch. returns 0, if the tags have no valid server-time. */
+static uint64_t parse_server_time(const char *tags) {
+    const char *pos = tags;
+    int year, month, day, hour, minute, second, ms = 0, num_read = 0;
+
+    while (strncmp(pos, "time=", 5) != 0) {
+        pos = strchr(pos, ';');
+
+        if (pos == NULL) {
+            return 0;
+        }
 
-        const irc_command_t *irc_command = get_command(command, strlen(command));
-        irc_command->execute(session, command, result);
+        pos++;
     }
 
-    return 0;
+    if (sscanf(pos + 5, "%4d-%2d-%2dT%2d:%2d:%2d%n", &year, &month, &day, &hour, &minute, &second, &num_read) != 6
+            || num_read == 0 || year < 1970 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return 0;
+    }
+
+    pos += 5 + num_read;
+
+    if (*pos == '.' && isdigit((unsigned char) pos[1]) && isdigit((unsigned char) pos[2]) && isdigit((unsigned char) pos[3])) {
+        ms = (pos[1] - '0') * 100 + (pos[2] - '0') * 10 + (pos[3] - '0');
+    }
+
+    return (uint64_t) ((days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second) * 1000 + ms);
 }
 
+/* the delay of a line is the time of the clock minus its server-time. the skew of the clocks is part of every
+   delay, so the smallest delay is taken as the skew and the lag is measured above it. */
+static void note_server_lag(irc_session_t *session, const char *tags) {
+    uint64_t sent = parse_server_time(tags);
+    int64_t delay;
+
+    if (sent == 0) {
+        return;
+    }
+
+    delay = (int64_t) getRealTimeMs() - (int64_t) sent;
+    libirc_mutex_lock(&session->mutex_session);
+
+    if (session->lag_samples != 0 && delay > session->lag_min_ms + LIBIRC_LAG_REPLAY_MS) {
+        libirc_mutex_unlock(&session->mutex_session);
+        return;
+    }
+
+    if (session->lag_samples == 0 || delay + LIBIRC_LAG_REPLAY_MS < session->lag_min_ms) {
+        /* the first line or the first live line after a replay */
+        session->lag_min_ms = delay;
+        session->lag_max_ms = delay;
+    }
+    else if (delay < session->lag_min_ms) {
+        session->lag_min_ms = delay;
+    }
+
+    if (delay > session->lag_max_ms) {
+        session->lag_max_ms = delay;
+    }
+
+    session->lag_last_ms = delay;
+    session->lag_samples++;
+    libirc_mutex_unlock(&session->mutex_session);
+}
+
+/* parses a line of the input buffer of the session, that ends with CR LF at len, and calls the handler of its
+   command. the handlers get the result like before, but its strings are slices of line instead of copies.
+   the lines, that nobody wants, are only counted. */
+void parse_line_in_place(irc_parser *parser, char *line, size_t len) {
+    irc_parser_result_t *result = parser->data;
+    irc_line_info_t info;
+
+    scan_line(line, len, &info);
+
+    if (!is_line_wanted(result->session, &info)) {
+        result->session->lines_dropped++;
+        return;
+    }
+
+    result->session->lines_processed++;
+    tokenize_line(line, len, result);
+
+    if (result->tags != NULL) {
+        note_server_lag(result->session, result->tags);
+    }
+
+    handle_parser_result(result);
+    free_parser_result(parser);
+}
+
+/* the byte wise state machine of irc_parser is not used for the lines of the session. the parser only holds the result. */
 irc_parser* create_line_parser() {
     irc_parser *parser = Calloc(1, sizeof(irc_parser));
-    irc_parser_settings parser_settings;
     irc_parser_result_t *parser_result = Calloc(1, sizeof(irc_parser_result_t));
     
-    memset(&parser_settings, 0, sizeof (parser_settings));
-    
-    irc_parser_settings_init(&parser_settings, on_nick, on_name, on_host, on_command, on_param, handle_parser_result, on_error);
-    irc_parser_init(parser, &parser_settings);
-    
+    irc_parser_reset(parser);
+    parser_result->numeric = -1;
     parser->data = parser_result;
     
     return parser;
@@ -26,9 +26,13 @@
 #include "fd_watcher.c"
 #include "errors.c"
 #include "colors.c"
+#include "output_queue.c"
+#include "send_pacer.c"
 #include "ssl.c"
+#include "dcc_offer.c"
 #include "dcc.c"
 #include "commands.c"
+#include "capabilities.c"
 #include "irc_parser.c"
 #include "irc_line_parser.c"
 #include "fd_watcher.h" 
@@ -61,6 +65,8 @@ void initWinsockLibrary () {
 }
 #endif
 
+static int num_sessions = 0;
+
 irc_session_t * irc_create_session(irc_callbacks_t * callbacks) {
     irc_session_t * session = calloc(1, sizeof (irc_session_t));
 
@@ -77,18 +83,22 @@ irc_session_t * irc_create_session(irc_callbacks_t * callbacks) {
 
     session->dcc_last_id = 1;
     session->dcc_timeout = 60;
+    session->run_timeout_ms = LIBIRC_DEFAULT_RUN_TIMEOUT_MS;
+    send_pacer_init(&session->pacer);
 
     memcpy(&session->callbacks, callbacks, sizeof (irc_callbacks_t));
 
     if (!session->callbacks.event_ctcp_req)
         session->callbacks.event_ctcp_req = libirc_event_ctcp_internal;
 
-    fdwatch_init();   
+    // the fd watcher is shared by all sessions, which can run in a single loop
+    if (num_sessions++ == 0)
+        fdwatch_init();
+
     session->line_parser = create_line_parser();
     line_parser_set_session(session->line_parser, session);
 
     memset(session->incoming_buf, 0, LIBIRC_BUFFER_SIZE);
-    memset(session->outgoing_buf, 0, LIBIRC_BUFFER_SIZE);
 
 #ifdef _MSC_VER
     initWinsockLibrary();
@@ -122,6 +132,7 @@ static void free_ircsession_strings(irc_session_t * session) {
 
 void irc_destroy_session(irc_session_t * session) {
     free_ircsession_strings(session);
+    irc_set_sasl(session, NULL, NULL, NULL);
 
     if (session->sock >= 0)
         socket_close(&session->sock);
@@ -134,7 +145,11 @@ void irc_destroy_session(irc_session_t * session) {
         libirc_remove_dcc_session(session, session->dcc_sessions, 0);
 
     free_line_parser(session->line_parser);
-    fdwatch_free();
+    output_queue_clear(&session->output);
+    send_pacer_clear(&session->pacer);
+
+    if (--num_sessions == 0)
+        fdwatch_free();
 
 #ifdef ENABLE_SSL
     if (session->ssl)
@@ -402,7 +417,7 @@ int irc_run(irc_session_t * session) {
     }
 
     while (irc_is_connected(session)) {
-        const long timeout_ms = 750;
+        const long timeout_ms = session->run_timeout_ms;
 
         fdwatch_zero();
         fdwatch_add_fd(session->sock);
@@ -428,6 +443,139 @@ int irc_run(irc_session_t * session) {
     return 0;
 }
 
+int irc_run_sessions(irc_session_t ** sessions, int count) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (sessions[i]->state != LIBIRC_STATE_CONNECTING) {
+            sessions[i]->lasterror = LIBIRC_ERR_STATE;
+            return 1;
+        }
+    }
+
+    for (;;) {
+        long timeout_ms = LIBIRC_DEFAULT_RUN_TIMEOUT_MS;
+        int num_running = 0;
+
+        fdwatch_zero();
+
+        for (i = 0; i < count; i++) {
+            // the descriptors of the application are watched, even if their session is gone
+            if (!irc_is_connected(sessions[i])) {
+                if (sessions[i]->callbacks.add_descriptors)
+                    sessions[i]->callbacks.add_descriptors(sessions[i]);
+
+                continue;
+            }
+
+            fdwatch_add_fd(sessions[i]->sock);
+            irc_add_select_descriptors(sessions[i]);
+
+            if (sessions[i]->run_timeout_ms < timeout_ms)
+                timeout_ms = sessions[i]->run_timeout_ms;
+
+            num_running++;
+        }
+
+        if (num_running == 0)
+            return 0;
+
+        if (fdwatch(timeout_ms) < 0) {
+            if (socket_error() == EINTR)
+                continue;
+
+            for (i = 0; i < count; i++)
+                sessions[i]->lasterror = LIBIRC_ERR_TERMINATED;
+
+            return 1;
+        }
+
+        for (i = 0; i < count; i++) {
+            if (sessions[i]->callbacks.keep_alive_callback)
+                sessions[i]->callbacks.keep_alive_callback(sessions[i]);
+        }
+
+        for (i = 0; i < count; i++) {
+            if (!irc_is_connected(sessions[i])) {
+                if (sessions[i]->callbacks.process_descriptors)
+                    sessions[i]->callbacks.process_descriptors(sessions[i]);
+
+                continue;
+            }
+
+            // a failed session is left out from now on, the others keep running
+            if (irc_process_select_descriptors(sessions[i]) && irc_is_connected(sessions[i]))
+                sessions[i]->state = LIBIRC_STATE_DISCONNECTED;
+        }
+    }
+}
+
+void irc_set_adaptive_dcc_buffers(irc_session_t * session, irc_dcc_size_t max_buffer_size) {
+    if (max_buffer_size != 0 && max_buffer_size < LIBIRC_DCC_MIN_RCVBUF)
+        max_buffer_size = LIBIRC_DCC_MIN_RCVBUF;
+
+    session->dcc_max_rcvbuf = max_buffer_size;
+}
+
+void irc_set_flood_control(irc_session_t * session, long burst_ms, long line_penalty_ms) {
+    session->pacer.burst_ms = burst_ms;
+    session->pacer.line_penalty_ms = line_penalty_ms;
+}
+
+void irc_get_send_queue_stats(irc_session_t * session, irc_send_queue_stats_t * stats) {
+    libirc_mutex_lock(&session->mutex_session);
+    stats->waiting_lines = session->pacer.queued_lines;
+    stats->unsent_bytes = session->output.length;
+    stats->sent_lines = session->pacer.sent_lines;
+    stats->delay_sum_ms = session->pacer.delay_sum_ms;
+    stats->max_delay_ms = session->pacer.max_delay_ms;
+    libirc_mutex_unlock(&session->mutex_session);
+}
+
+void irc_get_server_lag(irc_session_t * session, irc_server_lag_t * lag) {
+    libirc_mutex_lock(&session->mutex_session);
+    lag->samples = session->lag_samples;
+    lag->current_ms = (uint64_t) (session->lag_last_ms - session->lag_min_ms);
+    lag->max_ms = (uint64_t) (session->lag_max_ms - session->lag_min_ms);
+    libirc_mutex_unlock(&session->mutex_session);
+}
+
+void irc_get_line_counters(irc_session_t * session, uint64_t * processed, uint64_t * dropped) {
+    *processed = session->lines_processed;
+    *dropped = session->lines_dropped;
+}
+
+void irc_set_run_timeout(irc_session_t * session, long timeout_ms) {
+    if (timeout_ms <= 0)
+        timeout_ms = LIBIRC_DEFAULT_RUN_TIMEOUT_MS;
+
+    session->run_timeout_ms = timeout_ms;
+}
+
+void irc_watch_descriptor(irc_session_t * session, int fd, int flags) {
+    (void) session;
+
+    fdwatch_add_fd(fd);
+
+    if (flags & LIBIRC_WATCH_READ)
+        fdwatch_set_fd(fd, FDW_READ);
+
+    if (flags & LIBIRC_WATCH_WRITE)
+        fdwatch_set_fd(fd, FDW_WRITE);
+}
+
+int irc_is_descriptor_ready(irc_session_t * session, int fd, int flags) {
+    (void) session;
+
+    if ((flags & LIBIRC_WATCH_READ) && fdwatch_check_fd(fd, FDW_READ))
+        return 1;
+
+    if ((flags & LIBIRC_WATCH_WRITE) && fdwatch_check_fd(fd, FDW_WRITE))
+        return 1;
+
+    return 0;
+}
+
 int irc_add_select_descriptors(irc_session_t * session) {
     if (session->sock < 0
             || session->state == LIBIRC_STATE_INIT
@@ -445,13 +593,16 @@ int irc_add_select_descriptors(irc_session_t * session) {
             break;
 
         case LIBIRC_STATE_CONNECTED:
+            // the lines, that waited for the flood control, may be due now
+            send_pacer_release(&session->pacer, &session->output);
+
             // Add input descriptor if there is space in input buffer
             if (session->incoming_offset < (sizeof (session->incoming_buf) - 1)
                     || (session->flags & SESSIONFL_SSL_WRITE_WANTS_READ) != 0)
                 fdwatch_set_fd(session->sock, FDW_READ);
 
             // Add output descriptor if there is something in output buffer
-            if (libirc_findcrlf(session->outgoing_buf, session->outgoing_offset) > 0
+            if (session->output.length > 0
                     || (session->flags & SESSIONFL_SSL_READ_WANTS_WRITE) != 0)
                 fdwatch_set_fd(session->sock, FDW_WRITE);
 
@@ -461,14 +612,18 @@ int irc_add_select_descriptors(irc_session_t * session) {
     libirc_mutex_unlock(&session->mutex_session);
 
     libirc_dcc_add_descriptors(session);
+
+    if (session->callbacks.add_descriptors)
+        session->callbacks.add_descriptors(session);
+
     return 0;
 }
 
-static void libirc_process_incoming_data(irc_session_t * session, size_t process_length) {    
+/* process_length includes the CR LF of the line. the line is tokenized in place and removed from the buffer afterwards. */
+static void libirc_process_incoming_data(irc_session_t * session, char *line, size_t process_length) {    
 //    logprintf(LOG_INFO, irc_line);
 
-    irc_parser_execute(session->line_parser, session->incoming_buf, process_length);
-    free_parser_result(session->line_parser);
+    parse_line_in_place(session->line_parser, line, process_length - 2);
 }
 
 static int handle_connecting_state(irc_session_t * session) {
@@ -512,7 +667,9 @@ else
     if (gethostname(hname, sizeof (hname)) < 0)
         strcpy(hname, "unknown");
 
-    // Prepare the data, which should be sent to the server
+    // Prepare the data, which should be sent to the server. the server waits for the end of the capability negotiation
+    libirc_cap_start(session);
+
     if (session->server_password) {
         snprintf(buf, sizeof (buf), "PASS %s", session->server_password);
         irc_send_raw(session, buf);
@@ -545,6 +702,9 @@ int irc_process_select_descriptors(irc_session_t * session) {
     session->lasterror = 0;
     libirc_dcc_process_descriptors(session);
 
+    if (session->callbacks.process_descriptors)
+        session->callbacks.process_descriptors(session);
+
     // Handle "connection succeed" / "connection failed"
     if (unlikely(session->state == LIBIRC_STATE_CONNECTING
             && fdwatch_check_fd(session->sock, FDW_WRITE))) {
@@ -571,29 +731,34 @@ int irc_process_select_descriptors(irc_session_t * session) {
             return 1;
         }
 
+        unsigned int start = 0;
         session->incoming_offset += length;
 
-        // process the incoming data
-        while ((offset = libirc_findcrlf(session->incoming_buf, session->incoming_offset)) > 0) {
+        // process the incoming data. the lines are consumed from start, so that the rest of the buffer
+        // is moved down only once for all lines of the read
+        while ((offset = libirc_findcrlf(session->incoming_buf + start, session->incoming_offset - start)) > 0) {
 #if defined (ENABLE_DEBUG)
             if (IS_DEBUG_ENABLED(session))
-                libirc_dump_data("RECV", session->incoming_buf, offset);
+                libirc_dump_data("RECV", session->incoming_buf + start, offset);
 #endif
             // parse the string
-            libirc_process_incoming_data(session, offset);
+            libirc_process_incoming_data(session, session->incoming_buf + start, offset);
+            start += offset;
+        }
 
-            if (session->incoming_offset - offset > 0)
-                memmove(session->incoming_buf, session->incoming_buf + offset, (size_t)session->incoming_offset - (size_t) offset);
+        if (start != 0) {
+            if (session->incoming_offset - start > 0)
+                memmove(session->incoming_buf, session->incoming_buf + start, (size_t)session->incoming_offset - (size_t) start);
 
-            session->incoming_offset -= offset;
+            session->incoming_offset -= start;
         }
     }
 
-    // We can write a stored buffer
+    // We can write a stored buffer. the sent bytes are removed from the output queue by the write
     if (fdwatch_check_fd(session->sock, FDW_WRITE)) {
         int length;
 
-        // Because outgoing_buf could be changed asynchronously, we should lock any change
+        // Because the output queue could be changed asynchronously, we should lock any change
         libirc_mutex_lock(&session->mutex_session);
         length = session_socket_write(session);
 
@@ -607,24 +772,18 @@ int irc_process_select_descriptors(irc_session_t * session) {
             return 1;
         }
 
-#if defined (ENABLE_DEBUG)
-        if (IS_DEBUG_ENABLED(session))
-            libirc_dump_data("SEND", session->outgoing_buf, length);
-#endif
-
-        if (length > 0 && session->outgoing_offset - length > 0)
-            memmove(session->outgoing_buf, session->outgoing_buf + length, ((size_t) session->outgoing_offset) - ((size_t)length));
-
-        session->outgoing_offset -= length;
         libirc_mutex_unlock(&session->mutex_session);
     }
 
     return 0;
 }
 
+/* the line is appended to the output queue, that grows as needed, so that a burst of commands is never refused.
+   the flood control may hold it back, until the server accepts it without a penalty. */
 int irc_send_raw(irc_session_t * session, const char * format, ...) {
     char buf[1024];
     va_list va_alist;
+    int length;
 
     if (session->state != LIBIRC_STATE_CONNECTED) {
         session->lasterror = LIBIRC_ERR_STATE;
@@ -632,22 +791,23 @@ int irc_send_raw(irc_session_t * session, const char * format, ...) {
     }
 
     va_start(va_alist, format);
-    vsnprintf(buf, sizeof (buf), format, va_alist);
+    length = vsnprintf(buf, sizeof (buf) - 2, format, va_alist);
     va_end(va_alist);
 
-    libirc_mutex_lock(&session->mutex_session);
-
-    if ((strlen(buf) + 2) >= (sizeof (session->outgoing_buf) - session->outgoing_offset)) {
-        libirc_mutex_unlock(&session->mutex_session);
-        session->lasterror = LIBIRC_ERR_NOMEM;
+    if (length < 0) {
+        session->lasterror = LIBIRC_ERR_INVAL;
         return 1;
     }
 
-    strncpy(session->outgoing_buf + session->outgoing_offset, buf, strlen(buf));
-    session->outgoing_offset += strlen(buf);
-    session->outgoing_buf[session->outgoing_offset++] = 0x0D;
-    session->outgoing_buf[session->outgoing_offset++] = 0x0A;
+    // a line of irc has at most 512 bytes, the rest of a longer one is cut off
+    if ((size_t) length > sizeof (buf) - 3)
+        length = sizeof (buf) - 3;
 
+    buf[length++] = 0x0D;
+    buf[length++] = 0x0A;
+
+    libirc_mutex_lock(&session->mutex_session);
+    send_pacer_push(&session->pacer, &session->output, buf, (size_t) length, send_pacer_get_priority(buf));
     libirc_mutex_unlock(&session->mutex_session);
     return 0;
 }
@@ -845,6 +1005,35 @@ const char* irc_get_ssl_ciphers_used(irc_session_t *session) {
 }
 #endif
 
+int irc_set_sasl(irc_session_t * session, const char * mechanism, const char * user, const char * password) {
+    if (session->sasl_password)
+        memset(session->sasl_password, 0, strlen(session->sasl_password));
+
+    free(session->sasl_mechanism);
+    free(session->sasl_user);
+    free(session->sasl_password);
+    session->sasl_mechanism = NULL;
+    session->sasl_user = NULL;
+    session->sasl_password = NULL;
+
+    if (mechanism == NULL)
+        return 0;
+
+    if (strcasecmp(mechanism, "PLAIN") == 0 && (user == NULL || password == NULL)) {
+        session->lasterror = LIBIRC_ERR_INVAL;
+        return 1;
+    }
+
+    session->sasl_mechanism = strdup(mechanism);
+    session->sasl_user = strdup(user ? user : "");
+    session->sasl_password = strdup(password ? password : "");
+    return 0;
+}
+
+int irc_is_sasl_authenticated(irc_session_t * session) {
+    return (session->flags & SESSIONFL_SASL_AUTHENTICATED) != 0;
+}
+
 void irc_option_set(irc_session_t * session, unsigned int option) {
     session->options |= option;
 }
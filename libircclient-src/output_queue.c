@@ -0,0 +1,106 @@
+#include "output_queue.h"
+#include "../helper.h"
+
+static irc_output_chunk_t* output_queue_new_chunk(irc_output_queue_t *queue) {
+    irc_output_chunk_t *chunk = queue->spare;
+
+    if (chunk != NULL) {
+        queue->spare = NULL;
+    }
+    else {
+        chunk = Malloc(sizeof(irc_output_chunk_t));
+    }
+
+    chunk->next = NULL;
+    chunk->start = 0;
+    chunk->end = 0;
+
+    if (queue->tail != NULL) {
+        queue->tail->next = chunk;
+    }
+    else {
+        queue->head = chunk;
+    }
+
+    queue->tail = chunk;
+    return chunk;
+}
+
+/* a line may be split over two chunks. the chunks are sent with one writev, so that the server still gets it at once. */
+void output_queue_append(irc_output_queue_t *queue, const char *data, size_t len) {
+    queue->length += len;
+
+    while (len > 0) {
+        irc_output_chunk_t *chunk = queue->tail;
+
+        if (chunk == NULL || chunk->end == sizeof(chunk->data)) {
+            chunk = output_queue_new_chunk(queue);
+        }
+
+        size_t free_space = sizeof(chunk->data) - chunk->end;
+        size_t n = (len < free_space) ? len : free_space;
+
+        memcpy(chunk->data + chunk->end, data, n);
+        chunk->end += n;
+        data += n;
+        len -= n;
+    }
+}
+
+int output_queue_get_iov(irc_output_queue_t *queue, socket_iov_t *iov, int count) {
+    irc_output_chunk_t *chunk;
+    int i = 0;
+
+    for (chunk = queue->head; chunk != NULL && i < count; chunk = chunk->next) {
+        if (chunk->end > chunk->start) {
+            SOCKET_IOV_SET(&iov[i], chunk->data + chunk->start, chunk->end - chunk->start);
+            i++;
+        }
+    }
+
+    return i;
+}
+
+void output_queue_consume(irc_output_queue_t *queue, size_t len) {
+    queue->length -= (len < queue->length) ? len : queue->length;
+
+    while (queue->head != NULL) {
+        irc_output_chunk_t *chunk = queue->head;
+        size_t waiting = chunk->end - chunk->start;
+
+        if (len < waiting) {
+            chunk->start += len;
+            return;
+        }
+
+        len -= waiting;
+
+        /* the last chunk is only rewound, because the next line is appended to it anyway */
+        if (chunk == queue->tail) {
+            chunk->start = 0;
+            chunk->end = 0;
+            return;
+        }
+
+        queue->head = chunk->next;
+
+        if (queue->spare == NULL) {
+            queue->spare = chunk;
+        }
+        else {
+            FREE(chunk);
+        }
+    }
+}
+
+void output_queue_clear(irc_output_queue_t *queue) {
+    while (queue->head != NULL) {
+        irc_output_chunk_t *next = queue->head->next;
+        FREE(queue->head);
+        queue->head = next;
+    }
+
+    FREE(queue->spare);
+    queue->tail = NULL;
+    queue->length = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef OUTPUT_QUEUE_H
+#define OUTPUT_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the lines for the server are appended to a list of chunks, that grows with a burst of commands. a chunk is
+   freed, when all of its bytes were sent, so that the rest of the queue is never moved. */
+typedef struct irc_output_chunk_s {
+    struct irc_output_chunk_s *next;
+    /* the bytes before start were sent, the bytes from start to end are waiting */
+    size_t start;
+    size_t end;
+    char data[LIBIRC_OUTPUT_CHUNK_SIZE];
+} irc_output_chunk_t;
+
+typedef struct {
+    irc_output_chunk_t *head;
+    irc_output_chunk_t *tail;
+    /* a sent chunk is kept for the next lines, so that a steady trickle of commands does not allocate */
+    irc_output_chunk_t *spare;
+    size_t length;
+} irc_output_queue_t;
+
+void output_queue_append(irc_output_queue_t *queue, const char *data, size_t len);
+
+/* fills iov with the waiting bytes of up to count chunks and returns the number of used entries. */
+int output_queue_get_iov(irc_output_queue_t *queue, socket_iov_t *iov, int count);
+
+/* removes len sent bytes from the front of the queue. */
+void output_queue_consume(irc_output_queue_t *queue, size_t len);
+
+void output_queue_clear(irc_output_queue_t *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
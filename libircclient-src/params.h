@@ -22,7 +22,24 @@
 #define LIBIRC_BUFFER_SIZE			2048
 #define LIBIRC_BUFFER_SIZE_STR                  "2048"
 
+#define LIBIRC_DEFAULT_RUN_TIMEOUT_MS	750
+
+/* the queue of the lines for the server grows by chunks of this size. up to LIBIRC_OUTPUT_IOV_MAX chunks are sent at once */
+#define LIBIRC_OUTPUT_CHUNK_SIZE	4096
+#define LIBIRC_OUTPUT_IOV_MAX		16
+
+/* the flood control of rfc 1459, 8.10: every line adds a penalty to a timer of the server, that may run this far ahead of the clock */
+#define LIBIRC_FLOOD_BURST_MS		10000
+#define LIBIRC_FLOOD_LINE_PENALTY_MS	2000
+
+/* a line, whose server-time is this far behind the fastest line, is a replay of a bouncer and no lag */
+#define LIBIRC_LAG_REPLAY_MS		60000
+
 #define LIBIRC_DCC_BUFFER_SIZE      BUFSIZ
+
+/* adaptive SO_RCVBUF sizing of dcc sessions, see irc_set_adaptive_dcc_buffers() */
+#define LIBIRC_DCC_TUNE_INTERVAL_MS 1000
+#define LIBIRC_DCC_MIN_RCVBUF       65536
 /*#define LIBIRC_DCC_BUFFER_SIZE    0x8000  // 32768 bytes*/
 
 #define LIBIRC_STATE_INIT			0
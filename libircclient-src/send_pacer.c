@@ -0,0 +1,148 @@
+#include "send_pacer.h"
+#include "../helper.h"
+
+void send_pacer_init(irc_send_pacer_t *pacer) {
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->burst_ms = LIBIRC_FLOOD_BURST_MS;
+    pacer->line_penalty_ms = LIBIRC_FLOOD_LINE_PENALTY_MS;
+}
+
+static inline bool has_command(const char *line, const char *command) {
+    size_t len = strlen(command);
+    return strncmp(line, command, len) == 0 && (line[len] == ' ' || line[len] == '\0');
+}
+
+static inline bool is_ctcp(const char *line) {
+    const char *text = strstr(line, " :");
+    return text != NULL && text[2] == 0x01;
+}
+
+/* the services like NickServ or ChanServ end their nick with "Serv". */
+static bool is_service_target(const char *line) {
+    const char *target = strchr(line, ' ');
+    size_t len;
+
+    if (target == NULL) {
+        return false;
+    }
+
+    target++;
+    len = strcspn(target, " ");
+    return len > 4 && strncasecmp(target + len - 4, "Serv", 4) == 0;
+}
+
+/* the answers to the server and the registration jump the queue. a CTCP like DCC RESUME or the reply to a reverse
+   DCC SEND is the answer to a bot, that waits for it, so it does not wait behind our own messages. the login at the
+   services goes before the joins, that may need it, and the other messages to the bots and channels trail. */
+int send_pacer_get_priority(const char *line) {
+    if (has_command(line, "PONG") || has_command(line, "PING") || has_command(line, "QUIT")
+            || has_command(line, "PASS") || has_command(line, "NICK") || has_command(line, "USER")
+            || has_command(line, "CAP") || has_command(line, "AUTHENTICATE")) {
+        return LIBIRC_PRIORITY_URGENT;
+    }
+
+    if (has_command(line, "NOTICE")) {
+        return is_ctcp(line) ? LIBIRC_PRIORITY_URGENT : LIBIRC_PRIORITY_NORMAL;
+    }
+
+    if (has_command(line, "PRIVMSG")) {
+        if (is_ctcp(line)) {
+            return LIBIRC_PRIORITY_URGENT;
+        }
+
+        return is_service_target(line) ? LIBIRC_PRIORITY_NORMAL : LIBIRC_PRIORITY_BULK;
+    }
+
+    return LIBIRC_PRIORITY_NORMAL;
+}
+
+/* the penalty of the server runs with the clock, but never below it. */
+static inline void send_pacer_charge(irc_send_pacer_t *pacer, uint64_t now) {
+    if (pacer->penalty_ms < now) {
+        pacer->penalty_ms = now;
+    }
+
+    pacer->penalty_ms += (uint64_t) pacer->line_penalty_ms;
+}
+
+static inline bool send_pacer_is_within_burst(irc_send_pacer_t *pacer, uint64_t now) {
+    return pacer->burst_ms <= 0 || pacer->penalty_ms < now + (uint64_t) pacer->burst_ms;
+}
+
+void send_pacer_push(irc_send_pacer_t *pacer, irc_output_queue_t *output, const char *line, size_t len, int priority) {
+    uint64_t now = getMonotonicTimeMs();
+
+    /* an urgent line still counts for the server, so it delays the next lines */
+    if (priority == LIBIRC_PRIORITY_URGENT) {
+        output_queue_append(output, line, len);
+        send_pacer_charge(pacer, now);
+        return;
+    }
+
+    irc_paced_line_t *paced = Malloc(sizeof(irc_paced_line_t) + len);
+    paced->next = NULL;
+    paced->queued_ms = now;
+    paced->len = len;
+    memcpy(paced->data, line, len);
+
+    if (pacer->tail[priority] != NULL) {
+        pacer->tail[priority]->next = paced;
+    }
+    else {
+        pacer->head[priority] = paced;
+    }
+
+    pacer->tail[priority] = paced;
+    pacer->queued_lines++;
+
+    send_pacer_release(pacer, output);
+}
+
+void send_pacer_release(irc_send_pacer_t *pacer, irc_output_queue_t *output) {
+    uint64_t now = getMonotonicTimeMs();
+    int priority = LIBIRC_PRIORITY_NORMAL;
+
+    while (pacer->queued_lines != 0 && send_pacer_is_within_burst(pacer, now)) {
+        while (pacer->head[priority] == NULL) {
+            priority++;
+        }
+
+        irc_paced_line_t *paced = pacer->head[priority];
+        uint64_t delay = now - paced->queued_ms;
+
+        pacer->head[priority] = paced->next;
+
+        if (pacer->head[priority] == NULL) {
+            pacer->tail[priority] = NULL;
+        }
+
+        pacer->queued_lines--;
+        output_queue_append(output, paced->data, paced->len);
+        send_pacer_charge(pacer, now);
+
+        pacer->sent_lines++;
+        pacer->delay_sum_ms += delay;
+
+        if (delay > pacer->max_delay_ms) {
+            pacer->max_delay_ms = delay;
+        }
+
+        FREE(paced);
+    }
+}
+
+void send_pacer_clear(irc_send_pacer_t *pacer) {
+    int priority;
+
+    for (priority = 0; priority < LIBIRC_PRIORITIES; priority++) {
+        while (pacer->head[priority] != NULL) {
+            irc_paced_line_t *next = pacer->head[priority]->next;
+            FREE(pacer->head[priority]);
+            pacer->head[priority] = next;
+        }
+
+        pacer->tail[priority] = NULL;
+    }
+
+    pacer->queued_lines = 0;
+}
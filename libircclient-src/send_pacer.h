@@ -0,0 +1,54 @@
+#ifndef SEND_PACER_H
+#define SEND_PACER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the priorities of the lines for the server. urgent lines are sent at once, the others wait for the flood control
+   and the normal lines go before the bulk. */
+#define LIBIRC_PRIORITY_URGENT  0
+#define LIBIRC_PRIORITY_NORMAL  1
+#define LIBIRC_PRIORITY_BULK    2
+#define LIBIRC_PRIORITIES       3
+
+typedef struct irc_paced_line_s {
+    struct irc_paced_line_s *next;
+    uint64_t queued_ms;
+    size_t len;
+    char data[];
+} irc_paced_line_t;
+
+/* holds the lines back, that the server would count as a flood. the server keeps a penalty time for a client, that
+   grows with every line and runs with the clock. if it gets too far ahead, the server stops reading or kills the
+   client with excess flood, so the lines are only passed to the output queue, while it stays within the burst. */
+typedef struct {
+    irc_paced_line_t *head[LIBIRC_PRIORITIES];
+    irc_paced_line_t *tail[LIBIRC_PRIORITIES];
+    unsigned int queued_lines;
+    /* the penalty time of the server for the sent lines. a burst_ms of 0 disables the flood control */
+    uint64_t penalty_ms;
+    long burst_ms;
+    long line_penalty_ms;
+    uint64_t sent_lines;
+    uint64_t delay_sum_ms;
+    uint64_t max_delay_ms;
+} irc_send_pacer_t;
+
+void send_pacer_init(irc_send_pacer_t *pacer);
+
+/* returns the priority of a line by its command and its target. */
+int send_pacer_get_priority(const char *line);
+
+void send_pacer_push(irc_send_pacer_t *pacer, irc_output_queue_t *output, const char *line, size_t len, int priority);
+
+/* passes the waiting lines to output, as far as the flood control allows it. */
+void send_pacer_release(irc_send_pacer_t *pacer, irc_output_queue_t *output);
+
+void send_pacer_clear(irc_send_pacer_t *pacer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
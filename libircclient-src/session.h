@@ -21,6 +21,8 @@
 #include "dcc.h"
 #include "libirc_events.h"
 #include "irc_parser.h"
+#include "output_queue.h"
+#include "send_pacer.h"
 
 
 // Session flags
@@ -29,20 +31,37 @@
 #define SESSIONFL_SSL_WRITE_WANTS_READ	(0x00000004)
 #define SESSIONFL_SSL_READ_WANTS_WRITE	(0x00000008)
 #define SESSIONFL_USES_IPV6				(0x00000010)
+#define SESSIONFL_CAP_NEGOTIATING		(0x00000020)
+#define SESSIONFL_SASL_OFFERED			(0x00000040)
+#define SESSIONFL_SASL_IN_PROGRESS		(0x00000080)
+#define SESSIONFL_SASL_AUTHENTICATED	(0x00000100)
+
+#define LIBIRC_CAP_REQUEST_SIZE			256
 
 struct irc_session_s {
     void * ctx;
     irc_parser *line_parser;
     int dcc_timeout;
+    long run_timeout_ms;
+    irc_dcc_size_t dcc_max_rcvbuf;
 
     int options;
     int lasterror;
 
     char incoming_buf[LIBIRC_BUFFER_SIZE];
     unsigned int incoming_offset;
-
-    char outgoing_buf[LIBIRC_BUFFER_SIZE];
-    unsigned int outgoing_offset;
+    uint64_t lines_processed;
+    uint64_t lines_dropped;
+
+    /* the delays of the lines with a server-time tag. the smallest delay is the skew of the clocks, the
+       delays above it are the lag. see irc_get_server_lag */
+    uint64_t lag_samples;
+    int64_t lag_min_ms;
+    int64_t lag_last_ms;
+    int64_t lag_max_ms;
+
+    irc_output_queue_t output;
+    irc_send_pacer_t pacer;
     port_mutex_t mutex_session;
 
     socket_t sock;
@@ -55,6 +74,13 @@ struct irc_session_s {
     char * username;
     char * nick;
 
+    /* the capabilities, that are requested, and the answers, that are still missing. see capabilities.c */
+    char cap_request[LIBIRC_CAP_REQUEST_SIZE];
+    unsigned int cap_pending;
+    char * sasl_mechanism;
+    char * sasl_user;
+    char * sasl_password;
+
     union {
 		struct in_addr  v4;
 #if defined( ENABLE_IPV6 )
@@ -22,12 +22,17 @@
 #include <arpa/inet.h>	
 #include <netinet/in.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 #define IS_SOCKET_ERROR(a)	((a)<0)
 typedef int socket_t;
+typedef struct iovec	socket_iov_t;
+#define SOCKET_IOV_SET(iov, data, size)	((iov)->iov_base = (data), (iov)->iov_len = (size))
 #else
 #include "Ws2tcpip.h"
 #define IS_SOCKET_ERROR(a)	((a)==SOCKET_ERROR)
 typedef SOCKET			socket_t;
+typedef WSABUF			socket_iov_t;
+#define SOCKET_IOV_SET(iov, data, size)	((iov)->buf = (data), (iov)->len = (ULONG) (size))
 #endif
 
 #include "../helper.h"
@@ -124,6 +129,29 @@ static int socket_send(socket_t * sock, const void *buf, size_t len) {
     return length;
 }
 
+/* sends the buffers of iov with a single system call. */
+static int socket_sendv(socket_t * sock, socket_iov_t * iov, int count) {
+#ifndef _MSC_VER
+    ssize_t length;
+
+    while ((length = writev(*sock, iov, count)) < 0) {
+        int err = socket_error();
+
+        if (err != EINTR && err != EAGAIN)
+            break;
+    }
+
+    return (int) length;
+#else
+    DWORD length = 0;
+
+    if (WSASend(*sock, iov, (DWORD) count, &length, 0, NULL, NULL) == SOCKET_ERROR)
+        return -1;
+
+    return (int) length;
+#endif
+}
+
 static inline void init_irc_addr(struct irc_addr_t *t, struct addrinfo *addr)
 {
     t->length = addr->ai_addrlen;
@@ -318,13 +318,30 @@ static int ssl_recv(irc_session_t * session) {
     return -1;
 }
 
+/* writes the chunks of the output queue one after another, so that each chunk becomes a single TLS record instead of
+   one record per line. a write, that has to be repeated, gets the same chunk again. the sent bytes are consumed. */
 static int ssl_send(irc_session_t * session) {
+    irc_output_chunk_t *chunk;
+    int sent = 0;
+    int count = 0;
+
+    if (session->output.length == 0)
+        return 0;
+
     ERR_clear_error();
 
-    int count = SSL_write(session->ssl, session->outgoing_buf, session->outgoing_offset);
+    while ((chunk = session->output.head) != NULL && chunk->end > chunk->start) {
+        count = SSL_write(session->ssl, chunk->data + chunk->start, (int) (chunk->end - chunk->start));
 
-    if (count > 0)
-        return count;
+        if (count <= 0)
+            break;
+
+        output_queue_consume(&session->output, (size_t) count);
+        sent += count;
+    }
+
+    if (sent > 0 || count > 0)
+        return sent;
     else if (count == 0)
         return -1;
     else {
@@ -419,11 +436,18 @@ static int session_socket_write(irc_session_t* session) {
     }
 #endif
 
-    length = socket_send(&session->sock, session->outgoing_buf, session->outgoing_offset);
+    socket_iov_t iov[LIBIRC_OUTPUT_IOV_MAX];
+    int count = output_queue_get_iov(&session->output, iov, LIBIRC_OUTPUT_IOV_MAX);
+
+    if (count == 0)
+        return 0;
+
+    length = socket_sendv(&session->sock, iov, count);
 
     // There is no "retry" errors for regular sockets
     if (length <= 0)
         return -1;
 
+    output_queue_consume(&session->output, (size_t) length);
     return length;
 }
@@ -23,14 +23,21 @@
 #include "strings_utils.h"
 
 /*
- * Finds a separator (\x0D\x0A), which separates two lines.
+ * Finds a separator (\x0D\x0A), which separates two lines, and returns the offset behind it.
+ * memchr of the libc compares a word or a vector of bytes at once, so the LF is searched with it.
  */
 static int libirc_findcrlf (const char * buf, int length)
 {
-	int offset = 0;
-	for ( ; offset < (length - 1); offset++ )
-		if ( buf[offset] == 0x0D && buf[offset+1] == 0x0A )
-			return (offset + 2);
+	const char *end = buf + length;
+	const char *lf = buf + 1;
+
+	while ( lf < end && (lf = memchr (lf, 0x0A, (size_t) (end - lf))) != NULL )
+	{
+		if ( lf[-1] == 0x0D )
+			return (int) (lf - buf) + 1;
+
+		lf++;
+	}
 
 	return 0;
 }
@@ -0,0 +1,136 @@
+#include <string.h>
+
+#include "network.h"
+#include "argument_parser.h"
+#include "os_specific.h"
+
+static struct ircNetwork* newNetwork(sds name, sds server, uint16_t port, sds *channelsToJoin, uint32_t numChannels) {
+    struct ircNetwork *network = Calloc(1, sizeof(struct ircNetwork));
+    network->name = name;
+    network->server = server;
+    network->port = port;
+    network->channelsToJoin = channelsToJoin;
+    network->numChannels = numChannels;
+    return network;
+}
+
+struct ircNetwork* parseNetwork(const char *definition) {
+    int count;
+    sds line = sdstrim(sdsnew(definition), " \t");
+    sds *fields = sdssplitlen(line, sdslen(line), " ", 1, &count);
+    struct ircNetwork *network = NULL;
+
+    /* the login command is the rest of the line and contains spaces itself */
+    if (count >= 4) {
+        unsigned long port = strtoul(fields[2], NULL, 10);
+        uint32_t numChannels = 0;
+        sds *channelsToJoin = parseChannels(fields[3], &numChannels);
+
+        if (port != 0 && port <= 65535 && channelsToJoin != NULL) {
+            network = newNetwork(sdsdup(fields[0]), sdsdup(fields[1]), (uint16_t) port, channelsToJoin, numChannels);
+
+            if (count >= 5) {
+                network->nick = sdsdup(fields[4]);
+            }
+
+            if (count >= 6) {
+                network->loginCommand = sdsjoinsds(fields + 5, count - 5, " ", 1);
+            }
+        }
+        else if (channelsToJoin != NULL) {
+            sdsfreesplitres(channelsToJoin, numChannels);
+        }
+    }
+
+    sdsfreesplitres(fields, count);
+    sdsfree(line);
+    return network;
+}
+
+static sds* copyChannels(sds *channelsToJoin, uint32_t numChannels) {
+    sds *copy = Calloc(numChannels, sizeof(sds));
+    uint32_t i;
+
+    for (i = 0; i < numChannels; i++) {
+        copy[i] = sdsdup(channelsToJoin[i]);
+    }
+
+    return copy;
+}
+
+void addCommandLineNetwork(struct xdccGetConfig *config) {
+    struct ircNetwork *network = newNetwork(NULL, sdsnew(config->ircServer), config->port,
+        copyChannels(config->channelsToJoin, config->numChannels), config->numChannels);
+
+    if (config->login_command != NULL) {
+        network->loginCommand = sdsdup(config->login_command);
+    }
+
+    network->next = config->networks;
+    config->networks = network;
+}
+
+bool isSameNetwork(const char *name, const char *other) {
+    if (name == NULL || other == NULL) {
+        return name == other;
+    }
+
+    return strcasecmp(name, other) == 0;
+}
+
+struct ircNetwork* findNetwork(struct xdccGetConfig *config, const char *name) {
+    struct ircNetwork *network;
+
+    for (network = config->networks; network != NULL; network = network->next) {
+        if (isSameNetwork(network->name, name)) {
+            return network;
+        }
+    }
+
+    return NULL;
+}
+
+struct ircNetwork* getSessionNetwork(irc_session_t *session) {
+    return (struct ircNetwork*) irc_get_ctx(session);
+}
+
+bool isNetworkUsable(struct ircNetwork *network) {
+    return network->session != NULL && irc_is_connected(network->session);
+}
+
+const char* getNetworkName(struct ircNetwork *network) {
+    return network->name != NULL ? network->name : network->server;
+}
+
+bool quitNetworks(struct xdccGetConfig *config, const char *reason) {
+    struct ircNetwork *network;
+    bool quitSent = false;
+
+    for (network = config->networks; network != NULL; network = network->next) {
+        if (isNetworkUsable(network)) {
+            irc_cmd_quit(network->session, reason);
+            quitSent = true;
+        }
+    }
+
+    return quitSent;
+}
+
+void freeNetworks(struct ircNetwork *networks) {
+    while (networks != NULL) {
+        struct ircNetwork *next = networks->next;
+
+        if (networks->session != NULL) {
+            irc_destroy_session(networks->session);
+        }
+
+        sdsfreesplitres(networks->channelsToJoin, networks->numChannels);
+        sdsfree(networks->name);
+        sdsfree(networks->server);
+        sdsfree(networks->nick);
+        sdsfree(networks->loginCommand);
+        FREE(networks);
+
+        networks = next;
+    }
+}
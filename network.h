@@ -0,0 +1,73 @@
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include "helper.h"
+
+/* the channels are joined with lists like JOIN #a,#b,#c, that are at most this long */
+#define NETWORK_JOIN_LIST_MAX 400
+/* the requests are sent, when every channel was joined or refused, or after this time, if the server does not answer all joins */
+#define NETWORK_JOIN_TIMEOUT_MS 15000
+
+/* when the phases of the startup of a network were reached, in ms of the monotonic clock. 0 while a phase is pending. */
+struct startupTimes {
+    uint64_t connect;
+    uint64_t welcome;
+    uint64_t loginSent;
+    uint64_t joinsSent;
+    uint64_t joined;
+    uint64_t requestsSent;
+    uint64_t firstByte;
+};
+
+/* a connection to an irc server with its own channels, nick and login command. the network of the
+   command line has no name, the others come from network lines of the config file. a request is
+   sent over the network, that is given with @name in front of its bot cmd. */
+struct ircNetwork {
+    sds name;
+    sds server;
+    uint16_t port;
+    sds *channelsToJoin;
+    uint32_t numChannels;
+    sds nick;
+    sds loginCommand;
+    irc_session_t *session;
+    /* set, when the connect event was handled and the login or the joins were sent */
+    bool connectEventDone;
+    /* set, when the channels were joined and the queue may send requests over this network */
+    bool requestsSent;
+    /* the channels, that were joined or refused by the server */
+    uint32_t numChannelsSettled;
+    struct startupTimes startup;
+    struct ircNetwork *next;
+};
+
+/* parses a network line like "rizon irc.rizon.net 6667 #chan1,#chan2 [<nick> [<login-command>]]".
+   returns NULL, if the line is not valid. */
+struct ircNetwork* parseNetwork(const char *definition);
+
+/* creates the network of the command line and puts it in front of the networks of the config. */
+void addCommandLineNetwork(struct xdccGetConfig *config);
+
+/* compares the names of two networks case insensitive like the names of irc. NULL is the network of the command line. */
+bool isSameNetwork(const char *name, const char *other);
+
+/* returns the network with this name, that is compared like isSameNetwork, or the network of the command line, if
+   name is NULL. */
+struct ircNetwork* findNetwork(struct xdccGetConfig *config, const char *name);
+
+/* returns the network, that session belongs to. */
+struct ircNetwork* getSessionNetwork(irc_session_t *session);
+
+/* returns false, if the network could not connect or lost its connection. */
+bool isNetworkUsable(struct ircNetwork *network);
+
+/* returns a short name of the network for log messages. */
+const char* getNetworkName(struct ircNetwork *network);
+
+/* sends QUIT over all connected networks. returns false, if no network is connected. */
+bool quitNetworks(struct xdccGetConfig *config, const char *reason);
+
+/* destroys the sessions of the networks and frees them. */
+void freeNetworks(struct ircNetwork *networks);
+
+#endif
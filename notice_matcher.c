@@ -0,0 +1,426 @@
+#include <string.h>
+#include <ctype.h>
+
+#include "notice_matcher.h"
+
+struct noticePatternDefinition {
+    const char *text;
+    enum botReply reply;
+    enum noticeField field;
+};
+
+struct noticePatternKind {
+    const char *name;
+    enum botReply reply;
+    enum noticeField field;
+};
+
+/* a pattern of the automaton. the patterns with the same text are chained by next in the order of the pattern set. */
+struct matcherPattern {
+    sds text;
+    enum botReply reply;
+    enum noticeField field;
+    int32_t next;
+};
+
+/* a deterministic aho-corasick automaton over the case folded characters of the patterns. the characters, that no
+   pattern contains, share the class 0, so that a row of the transitions has only numClasses entries. */
+struct noticeMatcher {
+    struct matcherPattern *patterns;
+    uint32_t numPatterns;
+    uint16_t classOf[256];
+    uint32_t numClasses;
+    uint32_t numNodes;
+    /* the next node for a node and a class, numNodes rows of numClasses entries. the root is node 0 */
+    uint32_t *transitions;
+    /* the first pattern, that ends at a node, or -1 */
+    int32_t *firstPattern;
+    /* the nearest node on the failure chain of a node, at which a pattern ends, or 0 */
+    uint32_t *outputLink;
+};
+
+/* the notices of iroffer and its forks, the servers and nickserv. the first reply pattern in this order, that is
+   found, decides the reply. */
+static struct noticePatternDefinition builtinPatterns[] = {
+    {"invalid pack", BOT_REPLY_INVALID_PACK, NOTICE_FIELD_NONE},
+    {"sending you", BOT_REPLY_SENDING, NOTICE_FIELD_NONE},
+    {"already requested", BOT_REPLY_ALREADY_QUEUED, NOTICE_FIELD_NONE},
+    {"already queued", BOT_REPLY_ALREADY_QUEUED, NOTICE_FIELD_NONE},
+    {"have that item queued", BOT_REPLY_ALREADY_QUEUED, NOTICE_FIELD_NONE},
+    {"queue for you is full", BOT_REPLY_RETRY_LATER, NOTICE_FIELD_NONE},
+    {"is full, try again later", BOT_REPLY_RETRY_LATER, NOTICE_FIELD_NONE},
+    {"position", BOT_REPLY_QUEUED, NOTICE_FIELD_QUEUE_POSITION},
+    {"try again later", BOT_REPLY_RETRY_LATER, NOTICE_FIELD_NONE},
+    {"only have", BOT_REPLY_RETRY_LATER, NOTICE_FIELD_MAX_TRANSFERS},
+    {"all slots full", BOT_REPLY_RETRY_LATER, NOTICE_FIELD_NO_SLOTS},
+    {"denied", BOT_REPLY_RETRY_LATER, NOTICE_FIELD_NONE},
+    {"queue of size", BOT_REPLY_NONE, NOTICE_FIELD_QUEUE_SIZE},
+    {" slots open", BOT_REPLY_NONE, NOTICE_FIELD_SLOTS},
+    {"md5sum", BOT_REPLY_NONE, NOTICE_FIELD_MD5},
+    {"md5", BOT_REPLY_NONE, NOTICE_FIELD_MD5},
+    {"you are connected", BOT_REPLY_NONE, NOTICE_FIELD_CONNECTED},
+    {"password accepted", BOT_REPLY_NONE, NOTICE_FIELD_PASSWORD_ACCEPTED},
+    {"you are now identified", BOT_REPLY_NONE, NOTICE_FIELD_PASSWORD_ACCEPTED},
+    {"i recognize you", BOT_REPLY_NONE, NOTICE_FIELD_PASSWORD_ACCEPTED},
+};
+
+/* the kinds of the patterns of the config file */
+static struct noticePatternKind noticePatternKinds[] = {
+    {"sending", BOT_REPLY_SENDING, NOTICE_FIELD_NONE},
+    {"queued", BOT_REPLY_QUEUED, NOTICE_FIELD_QUEUE_POSITION},
+    {"already-queued", BOT_REPLY_ALREADY_QUEUED, NOTICE_FIELD_NONE},
+    {"retry-later", BOT_REPLY_RETRY_LATER, NOTICE_FIELD_NONE},
+    {"invalid-pack", BOT_REPLY_INVALID_PACK, NOTICE_FIELD_NONE},
+    {"md5", BOT_REPLY_NONE, NOTICE_FIELD_MD5},
+    {"password-accepted", BOT_REPLY_NONE, NOTICE_FIELD_PASSWORD_ACCEPTED},
+};
+
+static struct noticeMatcher matcher;
+
+bool parseNoticePattern(const char *value, struct noticePattern **patterns) {
+    size_t numKinds = sizeof (noticePatternKinds) / sizeof (struct noticePatternKind);
+    const char *text = strchr(value, ' ');
+    size_t i;
+
+    if (text == NULL) {
+        return false;
+    }
+
+    sds kind = sdsnewlen(value, text - value);
+    sds trimmedText = sdstrim(sdsnew(text), " \t");
+
+    for (i = 0; i < numKinds; i++) {
+        if (str_equals(kind, noticePatternKinds[i].name)) {
+            break;
+        }
+    }
+
+    sdsfree(kind);
+
+    if (i == numKinds || sdslen(trimmedText) == 0) {
+        sdsfree(trimmedText);
+        return false;
+    }
+
+    struct noticePattern *pattern = Calloc(1, sizeof(struct noticePattern));
+    struct noticePattern **last = patterns;
+
+    pattern->text = trimmedText;
+    pattern->reply = noticePatternKinds[i].reply;
+    pattern->field = noticePatternKinds[i].field;
+
+    /* keep the order of the config file, the first reply pattern wins */
+    while (*last != NULL) {
+        last = &(*last)->next;
+    }
+
+    *last = pattern;
+    return true;
+}
+
+void freeNoticePatterns(struct noticePattern *patterns) {
+    while (patterns != NULL) {
+        struct noticePattern *next = patterns->next;
+        sdsfree(patterns->text);
+        FREE(patterns);
+        patterns = next;
+    }
+}
+
+static void addMatcherPattern(const char *text, enum botReply reply, enum noticeField field) {
+    struct matcherPattern *pattern = &matcher.patterns[matcher.numPatterns++];
+
+    pattern->text = sdsnew(text);
+    pattern->reply = reply;
+    pattern->field = field;
+    pattern->next = -1;
+}
+
+/* the upper and the lower case of a character share a class. */
+static void assignClasses(const char *text) {
+    for (; *text != '\0'; text++) {
+        unsigned char lower = (unsigned char) tolower((unsigned char) *text);
+
+        if (matcher.classOf[lower] == 0) {
+            matcher.classOf[lower] = (uint16_t) matcher.numClasses;
+            matcher.classOf[(unsigned char) toupper(lower)] = (uint16_t) matcher.numClasses;
+            matcher.numClasses++;
+        }
+    }
+}
+
+static void insertPattern(int32_t index) {
+    struct matcherPattern *pattern = &matcher.patterns[index];
+    uint32_t node = 0;
+    size_t i;
+
+    for (i = 0; i < sdslen(pattern->text); i++) {
+        uint32_t *next = &matcher.transitions[node * matcher.numClasses + matcher.classOf[(unsigned char) pattern->text[i]]];
+
+        if (*next == 0) {
+            *next = matcher.numNodes++;
+        }
+
+        node = *next;
+    }
+
+    /* the patterns with the same text keep their order in the chain */
+    int32_t *last = &matcher.firstPattern[node];
+
+    while (*last != -1) {
+        last = &matcher.patterns[*last].next;
+    }
+
+    *last = index;
+}
+
+/* turns the trie into the automaton. the nodes are visited by depth, so that the failure node of a node is complete,
+   when its missing transitions are copied from it. */
+static void linkFailures() {
+    uint32_t *failure = Calloc(matcher.numNodes, sizeof(uint32_t));
+    uint32_t *queue = Calloc(matcher.numNodes, sizeof(uint32_t));
+    uint32_t head = 0, tail = 0;
+    uint32_t c;
+
+    for (c = 0; c < matcher.numClasses; c++) {
+        uint32_t child = matcher.transitions[c];
+
+        if (child != 0) {
+            queue[tail++] = child;
+        }
+    }
+
+    while (head < tail) {
+        uint32_t node = queue[head++];
+        uint32_t *row = &matcher.transitions[node * matcher.numClasses];
+        uint32_t *failureRow = &matcher.transitions[failure[node] * matcher.numClasses];
+
+        for (c = 0; c < matcher.numClasses; c++) {
+            if (row[c] == 0) {
+                row[c] = failureRow[c];
+                continue;
+            }
+
+            uint32_t child = row[c];
+            failure[child] = failureRow[c];
+            matcher.outputLink[child] = (matcher.firstPattern[failure[child]] != -1) ? failure[child] : matcher.outputLink[failure[child]];
+            queue[tail++] = child;
+        }
+    }
+
+    FREE(failure);
+    FREE(queue);
+}
+
+void buildNoticeMatcher(struct noticePattern *configured) {
+    size_t numBuiltin = sizeof (builtinPatterns) / sizeof (struct noticePatternDefinition);
+    struct noticePattern *current;
+    uint32_t numPatterns = (uint32_t) numBuiltin;
+    size_t maxNodes = 1;
+    uint32_t i;
+
+    freeNoticeMatcher();
+
+    for (current = configured; current != NULL; current = current->next) {
+        numPatterns++;
+    }
+
+    matcher.patterns = Calloc(numPatterns, sizeof(struct matcherPattern));
+    /* class 0 is for the characters, that are in no pattern */
+    matcher.numClasses = 1;
+
+    for (current = configured; current != NULL; current = current->next) {
+        addMatcherPattern(current->text, current->reply, current->field);
+    }
+
+    for (i = 0; i < numBuiltin; i++) {
+        addMatcherPattern(builtinPatterns[i].text, builtinPatterns[i].reply, builtinPatterns[i].field);
+    }
+
+    for (i = 0; i < matcher.numPatterns; i++) {
+        assignClasses(matcher.patterns[i].text);
+        maxNodes += sdslen(matcher.patterns[i].text);
+    }
+
+    matcher.transitions = Calloc(maxNodes * matcher.numClasses, sizeof(uint32_t));
+    matcher.firstPattern = Malloc(maxNodes * sizeof(int32_t));
+    matcher.outputLink = Calloc(maxNodes, sizeof(uint32_t));
+    matcher.numNodes = 1;
+    memset(matcher.firstPattern, 0xFF, maxNodes * sizeof(int32_t));
+
+    for (i = 0; i < matcher.numPatterns; i++) {
+        insertPattern((int32_t) i);
+    }
+
+    linkFailures();
+}
+
+/* reads the number behind a pattern like 7 in "position 7" or "position #7". */
+static bool parseNumberBehind(const char *text, uint32_t *value, const char **end) {
+    while (*text == ' ' || *text == '#' || *text == ':') {
+        text++;
+    }
+
+    if (!isdigit((unsigned char) *text)) {
+        return false;
+    }
+
+    *value = (uint32_t) strtoul(text, (char**) end, 10);
+    return true;
+}
+
+/* reads "2 of 5" in front of the pattern like in "2 of 5 slots open". */
+static void parseSlots(const char *message, const char *start, struct noticeMatch *match) {
+    const char *end = start;
+
+    while (start > message && isdigit((unsigned char) start[-1])) {
+        start--;
+    }
+
+    if (start == end || start - message < 4 || strncasecmp(start - 4, " of ", 4) != 0) {
+        return;
+    }
+
+    uint32_t totalSlots = (uint32_t) strtoul(start, NULL, 10);
+    end = start - 4;
+    start = end;
+
+    while (start > message && isdigit((unsigned char) start[-1])) {
+        start--;
+    }
+
+    if (start == end) {
+        return;
+    }
+
+    if (match->openSlots == BOT_UNKNOWN) {
+        match->openSlots = (uint32_t) strtoul(start, NULL, 10);
+    }
+
+    match->totalSlots = totalSlots;
+}
+
+/* reads the checksum behind a pattern like "md5sum: 0123..." or "MD5 0123...". the separators in between are skipped. */
+static void parseMD5(const char *text, struct noticeMatch *match) {
+    size_t i;
+
+    while (*text == ' ' || *text == ':' || *text == '=' || *text == '(') {
+        text++;
+    }
+
+    for (i = 0; i < NOTICE_MD5_LENGTH; i++) {
+        if (!isxdigit((unsigned char) text[i])) {
+            return;
+        }
+    }
+
+    if (isxdigit((unsigned char) text[NOTICE_MD5_LENGTH])) {
+        return;
+    }
+
+    memcpy(match->md5, text, NOTICE_MD5_LENGTH);
+    match->md5[NOTICE_MD5_LENGTH] = '\0';
+}
+
+/* records the values of a pattern, that was found from start to end. the first value of each kind wins. */
+static void applyPattern(const char *message, const char *start, const char *end, struct matcherPattern *pattern, struct noticeMatch *match) {
+    uint32_t value;
+
+    switch (pattern->field) {
+        case NOTICE_FIELD_QUEUE_POSITION:
+            if (match->queuePosition == BOT_UNKNOWN && parseNumberBehind(end, &value, &end)) {
+                match->queuePosition = value;
+
+                /* "position 2 of 10" also tells the size of the queue */
+                if (strncasecmp(end, " of ", 4) == 0 && match->queueSize == BOT_UNKNOWN && parseNumberBehind(end + 4, &value, &end)) {
+                    match->queueSize = value;
+                }
+            }
+            break;
+        case NOTICE_FIELD_QUEUE_SIZE:
+            if (match->queueSize == BOT_UNKNOWN && parseNumberBehind(end, &value, &end)) {
+                match->queueSize = value;
+            }
+            break;
+        case NOTICE_FIELD_MAX_TRANSFERS:
+            if (match->maxTransfersPerUser == BOT_UNKNOWN && parseNumberBehind(end, &value, &end)) {
+                match->maxTransfersPerUser = value;
+            }
+            break;
+        case NOTICE_FIELD_SLOTS:
+            parseSlots(message, start, match);
+            break;
+        case NOTICE_FIELD_NO_SLOTS:
+            match->openSlots = 0;
+            break;
+        case NOTICE_FIELD_MD5:
+            if (match->md5[0] == '\0') {
+                parseMD5(end, match);
+            }
+            break;
+        case NOTICE_FIELD_CONNECTED:
+            match->connected = true;
+            break;
+        case NOTICE_FIELD_PASSWORD_ACCEPTED:
+            match->passwordAccepted = true;
+            break;
+        case NOTICE_FIELD_NONE:
+            break;
+    }
+}
+
+void matchNotice(const char *message, struct noticeMatch *match) {
+    int32_t replyPattern = -1;
+    uint32_t state = 0;
+    const char *current;
+
+    memset(match, 0, sizeof(struct noticeMatch));
+    match->reply = BOT_REPLY_NONE;
+    match->queuePosition = BOT_UNKNOWN;
+    match->queueSize = BOT_UNKNOWN;
+    match->openSlots = BOT_UNKNOWN;
+    match->totalSlots = BOT_UNKNOWN;
+    match->maxTransfersPerUser = BOT_UNKNOWN;
+
+    if (matcher.transitions == NULL) {
+        return;
+    }
+
+    for (current = message; *current != '\0'; current++) {
+        state = matcher.transitions[state * matcher.numClasses + matcher.classOf[(unsigned char) *current]];
+
+        uint32_t node = (matcher.firstPattern[state] != -1) ? state : matcher.outputLink[state];
+
+        for (; node != 0; node = matcher.outputLink[node]) {
+            int32_t index;
+
+            for (index = matcher.firstPattern[node]; index != -1; index = matcher.patterns[index].next) {
+                struct matcherPattern *pattern = &matcher.patterns[index];
+
+                applyPattern(message, current + 1 - sdslen(pattern->text), current + 1, pattern, match);
+
+                if (pattern->reply != BOT_REPLY_NONE && (replyPattern == -1 || index < replyPattern)) {
+                    replyPattern = index;
+                }
+            }
+        }
+    }
+
+    if (replyPattern != -1) {
+        match->reply = matcher.patterns[replyPattern].reply;
+    }
+}
+
+void freeNoticeMatcher() {
+    uint32_t i;
+
+    for (i = 0; i < matcher.numPatterns; i++) {
+        sdsfree(matcher.patterns[i].text);
+    }
+
+    FREE(matcher.patterns);
+    FREE(matcher.transitions);
+    FREE(matcher.firstPattern);
+    FREE(matcher.outputLink);
+    memset(&matcher, 0, sizeof(struct noticeMatcher));
+}
@@ -0,0 +1,72 @@
+#ifndef NOTICE_MATCHER_H
+#define NOTICE_MATCHER_H
+
+#include "helper.h"
+#include "bots.h"
+
+/* the length of a md5 checksum in hex digits */
+#define NOTICE_MD5_LENGTH 32
+
+/* what a pattern tells besides the reply of a bot, when it is found in a notice. */
+enum noticeField {
+    NOTICE_FIELD_NONE,
+    /* the number behind the pattern is the position in the queue of the bot, like 7 in "position 7 of 10".
+       the number behind "of" is the size of the queue */
+    NOTICE_FIELD_QUEUE_POSITION,
+    /* the number behind the pattern is the size of the queue of the bot */
+    NOTICE_FIELD_QUEUE_SIZE,
+    /* "2 of 5" in front of the pattern are the open slots and all slots of the bot */
+    NOTICE_FIELD_SLOTS,
+    /* the bot has no open slot */
+    NOTICE_FIELD_NO_SLOTS,
+    /* the number behind the pattern is the number of transfers, that the bot allows a single user */
+    NOTICE_FIELD_MAX_TRANSFERS,
+    /* the hex digits behind the pattern are the md5 checksum of the file */
+    NOTICE_FIELD_MD5,
+    /* the server accepted the connect */
+    NOTICE_FIELD_CONNECTED,
+    /* nickserv accepted the password of the login command */
+    NOTICE_FIELD_PASSWORD_ACCEPTED
+};
+
+/* a pattern of the config file like noticePattern=retry-later no free slots. the patterns are matched case insensitive. */
+struct noticePattern {
+    sds text;
+    /* the answer to a request, that the pattern means, or BOT_REPLY_NONE */
+    enum botReply reply;
+    enum noticeField field;
+    struct noticePattern *next;
+};
+
+/* what the patterns found in a notice. */
+struct noticeMatch {
+    /* the reply of the first pattern in the order of the pattern set, that was found */
+    enum botReply reply;
+    /* BOT_UNKNOWN, if the notice does not tell them */
+    uint32_t queuePosition;
+    uint32_t queueSize;
+    uint32_t openSlots;
+    uint32_t totalSlots;
+    uint32_t maxTransfersPerUser;
+    /* the checksum in hex digits or an empty string */
+    char md5[NOTICE_MD5_LENGTH + 1];
+    bool connected;
+    bool passwordAccepted;
+};
+
+/* parses a pattern like "<kind> <text>" and appends it to patterns. kind is one of sending, queued, already-queued,
+   retry-later, invalid-pack, md5 or password-accepted. returns false, if the pattern is not valid. */
+bool parseNoticePattern(const char *value, struct noticePattern **patterns);
+
+void freeNoticePatterns(struct noticePattern *patterns);
+
+/* compiles the configured patterns and the built in patterns of iroffer, the servers and nickserv into a single
+   automaton. the configured patterns come first, so that their replies win over the built in ones. */
+void buildNoticeMatcher(struct noticePattern *configured);
+
+/* finds all patterns in message in a single pass and fills match with the values behind them. */
+void matchNotice(const char *message, struct noticeMatch *match);
+
+void freeNoticeMatcher();
+
+#endif
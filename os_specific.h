@@ -2,6 +2,7 @@
 #define OS_SPECIFIC_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "sds.h"
 
@@ -15,6 +16,7 @@
 
 #ifdef _MSC_VER
 #define strcasecmp _stricmp
+#define strncasecmp _strnicmp
 #define strdup(p) _strdup(p)
 #endif
 
@@ -24,6 +26,41 @@ const char* getHomeDir();
 void createInterruptHandler(void (*handler) (int));
 void createAlarmHandler(void (*handler) (int));
 void enableAlarm(int seconds);
+/* installs the handler, that is called when the user requests to reload the config file. */
+void createReloadHandler(void (*handler) (int));
+
+/* returns a monotonic timestamp in milliseconds, which is not affected by changes of the system time. */
+uint64_t getMonotonicTimeMs();
+
+/* returns the time of the system clock in milliseconds since the epoch. */
+uint64_t getRealTimeMs();
+
+int64_t getProcessId();
+
+/* flushes the written data of fd to the disk. */
+bool syncFile(int fd);
+
+/* creates the file at path or extends it to size bytes without touching its data, so that it can be written
+   at any offset. returns false, if the disk has not enough space or the file cant be opened. */
+bool preallocateFile(const char *path, uint64_t size);
+
+/* takes an exclusive lock on fd, that is held until fd is closed. returns false, if an other process holds it. */
+bool lockFile(int fd);
+
+/* returns true, if a read of fd would not block, e.g. because a pipe has data or was closed. */
+bool hasPendingInput(int fd);
+
+/* creates a listening local stream socket at path, e.g. a unix domain socket. a stale socket file of a
+   process, that is gone, is replaced. returns -1 on errors or if an other process listens at path. */
+int openLocalSocket(const char *path);
+/* accepts a pending client of the listening socket without blocking. returns -1, if no client is waiting. */
+int acceptLocalSocket(int fd);
+void closeLocalSocket(int fd);
+
+/* maps the named shared memory segment of size bytes and creates it, if it does not exist yet.
+   created is set to true, if this process created the segment. returns NULL on errors. */
+void* mapSharedMemory(const char *name, size_t size, bool *created);
+void unmapSharedMemory(void *mem, size_t size);
 
 
 void startChecksumThread(sds md5ChecksumSDS, sds completePath);
@@ -2,7 +2,15 @@
 #include <signal.h>
 #include <pwd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <pthread.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/un.h>
 #ifdef __GETRANDOM_DEFINED__
  #include <sys/random.h>
 #else
@@ -76,10 +84,198 @@ void createAlarmHandler(void (*handler) (int)) {
     init_signal(SIGALRM, handler);
 }
 
+void createReloadHandler(void (*handler) (int)) {
+    init_signal(SIGHUP, handler);
+}
+
 void enableAlarm(int seconds) {
     alarm(seconds);
 }
 
+uint64_t getMonotonicTimeMs() {
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        logprintf(LOG_ERR, "could not read the monotonic clock!");
+        exitPgm(EXIT_FAILURE);
+    }
+
+    return ((uint64_t) ts.tv_sec) * 1000 + ((uint64_t) ts.tv_nsec) / 1000000;
+}
+
+uint64_t getRealTimeMs() {
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
+        logprintf(LOG_ERR, "could not read the system clock!");
+        exitPgm(EXIT_FAILURE);
+    }
+
+    return ((uint64_t) ts.tv_sec) * 1000 + ((uint64_t) ts.tv_nsec) / 1000000;
+}
+
+int64_t getProcessId() {
+    return (int64_t) getpid();
+}
+
+bool syncFile(int fd) {
+    return fsync(fd) == 0;
+}
+
+bool preallocateFile(const char *path, uint64_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT, 0666);
+    struct stat st;
+    bool success;
+    int error;
+
+    if (fd == -1) {
+        return false;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return false;
+    }
+
+    /* posix_fallocate returns an error number instead of setting errno and never shrinks the file */
+    error = posix_fallocate(fd, 0, (off_t) size);
+
+    if (error == EOPNOTSUPP || error == EINVAL) {
+        /* file systems without support for it still get the size, but the space is not reserved then. a smaller
+           size would cut off data, that was already downloaded */
+        success = st.st_size >= (off_t) size || ftruncate(fd, (off_t) size) == 0;
+    }
+    else {
+        /* a failed posix_fallocate may keep the blocks, that it got, so the file gets its old size back */
+        if (error != 0 && ftruncate(fd, st.st_size) == -1) {
+            logprintf(LOG_WARN, "could not give the space of %s back: %s", path, strerror(errno));
+        }
+
+        success = error == 0;
+        errno = error;
+    }
+
+    success = close(fd) == 0 && success;
+    return success;
+}
+
+bool lockFile(int fd) {
+    return flock(fd, LOCK_EX | LOCK_NB) == 0;
+}
+
+bool hasPendingInput(int fd) {
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    return poll(&pfd, 1, 0) > 0;
+}
+
+int openLocalSocket(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        logprintf(LOG_ERR, "the path of the socket %s is too long.", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd == -1) {
+        return -1;
+    }
+
+    /* the socket file survives a crash. it is only replaced, if nobody listens at it anymore */
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0) {
+        logprintf(LOG_ERR, "an other process listens at the socket %s.", path);
+        close(fd);
+        return -1;
+    }
+
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        logprintf(LOG_ERR, "could not listen at the socket %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int acceptLocalSocket(int fd) {
+    int client = accept(fd, NULL, NULL);
+
+    if (client != -1) {
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+    }
+
+    return client;
+}
+
+void closeLocalSocket(int fd) {
+    close(fd);
+}
+
+void* mapSharedMemory(const char *name, size_t size, bool *created) {
+    struct stat st;
+    void *mem = NULL;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    *created = false;
+
+    if (fd != -1) {
+        *created = true;
+
+        if (ftruncate(fd, size) == -1) {
+            logprintf(LOG_ERR, "could not resize the shared memory %s: %s", name, strerror(errno));
+            close(fd);
+            shm_unlink(name);
+            return NULL;
+        }
+    }
+    else if (errno == EEXIST) {
+        fd = shm_open(name, O_RDWR, 0600);
+
+        if (fd == -1) {
+            logprintf(LOG_ERR, "could not open the shared memory %s: %s", name, strerror(errno));
+            return NULL;
+        }
+
+        if (fstat(fd, &st) == -1 || (size_t) st.st_size < size) {
+            logprintf(LOG_ERR, "the shared memory %s has not the expected size.", name);
+            close(fd);
+            return NULL;
+        }
+    }
+    else {
+        logprintf(LOG_ERR, "could not create the shared memory %s: %s", name, strerror(errno));
+        return NULL;
+    }
+
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mem == MAP_FAILED) {
+        logprintf(LOG_ERR, "could not map the shared memory %s: %s", name, strerror(errno));
+        return NULL;
+    }
+
+    return mem;
+}
+
+void unmapSharedMemory(void *mem, size_t size) {
+    munmap(mem, size);
+}
+
 static unsigned int getRandomSeed() {
     unsigned int seed = 0;
 #ifdef __GETRANDOM_DEFINED__
@@ -3,10 +3,16 @@
 #include "hashing_algo.h"
 
 #include <stdbool.h>
+#include <winsock2.h>
+#include <afunix.h>
 #include <windows.h>
 #include <VersionHelpers.h>
 #include <Shlobj.h>
 #include <bcrypt.h>
+#include <io.h>
+#include <fcntl.h>
+#include <share.h>
+#include <sys/stat.h>
 #pragma comment(lib, "bcrypt.lib")
 #ifndef STATUS_SUCCESS
 #define STATUS_SUCCESS ((NTSTATUS)0x00000000L)
@@ -88,6 +94,138 @@ static void create_timer_queue_timer(int seconds) {
     }
 }
 
+uint64_t getMonotonicTimeMs() {
+    return (uint64_t) GetTickCount64();
+}
+
+uint64_t getRealTimeMs() {
+    FILETIME ft;
+    ULARGE_INTEGER time;
+
+    GetSystemTimeAsFileTime(&ft);
+    time.LowPart = ft.dwLowDateTime;
+    time.HighPart = ft.dwHighDateTime;
+
+    /* the file time counts 100 ns since 1601-01-01 */
+    return (time.QuadPart - 116444736000000000ULL) / 10000;
+}
+
+int64_t getProcessId() {
+    return (int64_t) GetCurrentProcessId();
+}
+
+bool syncFile(int fd) {
+    return _commit(fd) == 0;
+}
+
+bool preallocateFile(const char *path, uint64_t size) {
+    int fd;
+    bool success;
+
+    if (_sopen_s(&fd, path, _O_WRONLY | _O_CREAT | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE) != 0) {
+        return false;
+    }
+
+    /* a smaller size would cut off data, that was already downloaded */
+    success = _filelengthi64(fd) >= (__int64) size || _chsize_s(fd, (__int64) size) == 0;
+    success = _close(fd) == 0 && success;
+    return success;
+}
+
+bool lockFile(int fd) {
+    HANDLE file = (HANDLE) _get_osfhandle(fd);
+    OVERLAPPED overlapped;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    return LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped) != 0;
+}
+
+int openLocalSocket(const char *path) {
+    struct sockaddr_un addr;
+    SOCKET fd;
+    u_long nonBlocking = 1;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        logprintf(LOG_ERR, "the path of the socket %s is too long.", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd == INVALID_SOCKET) {
+        return -1;
+    }
+
+    /* the socket file survives a crash. it is only replaced, if nobody listens at it anymore */
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0) {
+        logprintf(LOG_ERR, "an other process listens at the socket %s.", path);
+        closesocket(fd);
+        return -1;
+    }
+
+    DeleteFileA(path);
+
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        logprintf(LOG_ERR, "could not listen at the socket %s: error %d", path, WSAGetLastError());
+        closesocket(fd);
+        return -1;
+    }
+
+    ioctlsocket(fd, FIONBIO, &nonBlocking);
+    return (int) fd;
+}
+
+int acceptLocalSocket(int fd) {
+    SOCKET client = accept((SOCKET) fd, NULL, NULL);
+    u_long nonBlocking = 1;
+
+    if (client == INVALID_SOCKET) {
+        return -1;
+    }
+
+    ioctlsocket(client, FIONBIO, &nonBlocking);
+    return (int) client;
+}
+
+void closeLocalSocket(int fd) {
+    closesocket((SOCKET) fd);
+}
+
+bool hasPendingInput(int fd) {
+    /* the console and pipes can not be polled like sockets, so the queue is read blocking on windows. */
+    return true;
+}
+
+void* mapSharedMemory(const char *name, size_t size, bool *created) {
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD) size, name);
+
+    if (mapping == NULL) {
+        logprintf(LOG_ERR, "could not create the shared memory %s: %lu", name, GetLastError());
+        return NULL;
+    }
+
+    *created = GetLastError() != ERROR_ALREADY_EXISTS;
+
+    /* the view keeps the mapping alive, so the handle is not needed anymore */
+    void *mem = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    CloseHandle(mapping);
+
+    if (mem == NULL) {
+        logprintf(LOG_ERR, "could not map the shared memory %s: %lu", name, GetLastError());
+        return NULL;
+    }
+
+    return mem;
+}
+
+void unmapSharedMemory(void *mem, size_t size) {
+    UnmapViewOfFile(mem);
+}
+
 const char* getPathSeperator() {
 	return "\\";
 }
@@ -113,6 +251,10 @@ void createAlarmHandler(void (*handler) (int)) {
     setup_timer_event();
 }
 
+void createReloadHandler(void (*handler) (int)) {
+    /* windows has no SIGHUP, the config file is only watched for changes there. */
+}
+
 void enableAlarm(int seconds) {
     create_timer_queue_timer(seconds);
 }
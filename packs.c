@@ -0,0 +1,151 @@
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+#include "packs.h"
+#include "os_specific.h"
+
+/* parses a pack number like #10 or 10. */
+static bool parsePackNumber(const char *text, uint32_t *pack) {
+    char *end = NULL;
+
+    if (*text == '#') {
+        text++;
+    }
+
+    if (!isdigit((unsigned char) *text)) {
+        return false;
+    }
+
+    unsigned long number = strtoul(text, &end, 10);
+
+    if (*end != '\0' || number == 0 || number > UINT32_MAX) {
+        return false;
+    }
+
+    *pack = (uint32_t) number;
+    return true;
+}
+
+static bool parsePackItem(sds item, struct packRange *range) {
+    char *dash = strchr(item, '-');
+
+    if (dash == NULL) {
+        if (!parsePackNumber(item, &range->first)) {
+            return false;
+        }
+
+        range->last = range->first;
+        return true;
+    }
+
+    *dash = '\0';
+    return parsePackNumber(item, &range->first) && parsePackNumber(dash + 1, &range->last) && range->first <= range->last;
+}
+
+struct packRange* parsePackList(const char *list) {
+    int count = 0;
+    sds *items = sdssplitlen(list, strlen(list), ",", 1, &count);
+    struct packRange *ranges = NULL;
+    struct packRange **last = &ranges;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        struct packRange *range = Calloc(1, sizeof(struct packRange));
+
+        sdstrim(items[i], " \t");
+
+        if (!parsePackItem(items[i], range)) {
+            FREE(range);
+            freePackRanges(ranges);
+            ranges = NULL;
+            break;
+        }
+
+        *last = range;
+        last = &range->next;
+    }
+
+    sdsfreesplitres(items, count);
+    return ranges;
+}
+
+void freePackRanges(struct packRange *ranges) {
+    while (ranges != NULL) {
+        struct packRange *next = ranges->next;
+        FREE(ranges);
+        ranges = next;
+    }
+}
+
+bool isPackListContinuation(const char *part) {
+    return (*part == '#' || isdigit((unsigned char) *part)) && strpbrk(part, " \t") == NULL;
+}
+
+/* writes the xdcc command of the batch, e.g. "xdcc send #11-#80,#95". prefix is the first word of the command. */
+static void setBatchCommand(struct dccDownload *batch, const char *prefix) {
+    struct packRange *range;
+    sds command = sdscatprintf(sdsempty(), "%s send ", prefix);
+
+    /* a single pack is an ordinary request */
+    if (batch->packRanges->next == NULL && batch->packRanges->first == batch->packRanges->last) {
+        command = sdscatprintf(command, "#%" PRIu32, batch->packRanges->first);
+        freePackRanges(batch->packRanges);
+        batch->packRanges = NULL;
+    }
+
+    for (range = batch->packRanges; range != NULL; range = range->next) {
+        command = sdscatprintf(command, (range->first == range->last) ? "#%" PRIu32 : "#%" PRIu32 "-#%" PRIu32,
+            range->first, range->last);
+
+        if (range->next != NULL) {
+            command = sdscat(command, ",");
+        }
+    }
+
+    sdsfree(batch->xdccCmd);
+    batch->xdccCmd = command;
+}
+
+void parseBatchRequest(struct dccDownload *download) {
+    int count = 0;
+    sds *words = sdssplitlen(download->xdccCmd, sdslen(download->xdccCmd), " ", 1, &count);
+
+    /* "xdcc batch" is understood by some bots itself, but then the packs can not be scheduled and resumed one by one */
+    if (count == 3 && (strcasecmp(words[1], "send") == 0 || strcasecmp(words[1], "batch") == 0)
+            && (strcasecmp(words[1], "batch") == 0 || strpbrk(words[2], "-,") != NULL)) {
+        download->packRanges = parsePackList(words[2]);
+
+        if (download->packRanges != NULL) {
+            setBatchCommand(download, words[0]);
+        }
+        else {
+            logprintf(LOG_WARN, "the packs %s of %s are not valid. sending the request as it is.", words[2], download->botNick);
+        }
+    }
+
+    sdsfreesplitres(words, count);
+}
+
+struct dccDownload* takeNextPack(struct dccDownload *batch) {
+    struct packRange *range = batch->packRanges;
+    sds prefix = sdsnewlen(batch->xdccCmd, strcspn(batch->xdccCmd, " "));
+    struct dccDownload *download = newDccDownload(sdsdup(batch->botNick), sdscatprintf(sdsempty(), "%s send #%" PRIu32, prefix, range->first));
+
+    download->network = (batch->network != NULL) ? sdsdup(batch->network) : NULL;
+    download->weight = batch->weight;
+    download->priority = batch->priority;
+    download->deadline = batch->deadline;
+
+    if (range->first == range->last) {
+        batch->packRanges = range->next;
+        FREE(range);
+    }
+    else {
+        range->first++;
+    }
+
+    setBatchCommand(batch, prefix);
+    sdsfree(prefix);
+    return download;
+}
@@ -0,0 +1,32 @@
+#ifndef PACKS_H
+#define PACKS_H
+
+#include "helper.h"
+#include "argument_parser.h"
+
+/* the packs first to last of a request like "bot xdcc send #10-#80". */
+struct packRange {
+    uint32_t first;
+    uint32_t last;
+    struct packRange *next;
+};
+
+/* parses a list of packs and ranges like "#10-#80,#95" or "10-80,95" into ranges.
+   returns NULL, if the list is not valid. */
+struct packRange* parsePackList(const char *list);
+
+void freePackRanges(struct packRange *ranges);
+
+/* returns true, if a part of a comma separated list of requests only holds packs like "#95" or "95-99", that belong
+   to the request before it. */
+bool isPackListContinuation(const char *part);
+
+/* turns a request like "bot xdcc send #10-#80,#95" or "bot xdcc batch 10-80" into a batch, that is expanded into
+   a single request for each pack, when it is its turn in the queue. a request for a single pack is not changed. */
+void parseBatchRequest(struct dccDownload *download);
+
+/* returns the request for the next pack of the batch and removes the pack from the batch. the xdcc command of the
+   batch then lists the remaining packs. when only one pack is left, the batch becomes the request for it. */
+struct dccDownload* takeNextPack(struct dccDownload *batch);
+
+#endif
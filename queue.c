@@ -0,0 +1,1017 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+
+#ifdef _MSC_VER
+#include <io.h>
+#endif
+
+#include "queue.h"
+#include "journal.h"
+#include "bots.h"
+#include "network.h"
+#include "segments.h"
+#include "concurrency.h"
+#include "packs.h"
+#include "history.h"
+#include "os_specific.h"
+
+static struct xdccGetConfig *queueConfig = NULL;
+/* requests that were read but not sent yet, in the order of the queue */
+static struct dccDownload *pendingDownloads = NULL;
+static struct dccDownload *lastPendingDownload = NULL;
+static uint32_t numPendingDownloads = 0;
+/* requests that were sent to the bots and are not finished yet, the oldest first */
+static struct dccDownload *requestedDownloads = NULL;
+static uint32_t numRequestedDownloads = 0;
+
+static int queueInput = -1;
+static sds queueInputBuffer = NULL;
+static bool queueInputEof = false;
+static uint64_t queueLineNumber = 0;
+/* the bytes of the queue file, that were parsed into requests */
+static uint64_t queueInputOffset = 0;
+
+static void appendPendingDownload(struct dccDownload *download) {
+    rankMirrors(download);
+    download->next = NULL;
+
+    if (lastPendingDownload == NULL) {
+        pendingDownloads = download;
+    }
+    else {
+        lastPendingDownload->next = download;
+    }
+
+    lastPendingDownload = download;
+    numPendingDownloads++;
+}
+
+/* puts a request, that a bot refused for now, in front of the others again. */
+static void prependPendingDownload(struct dccDownload *download) {
+    download->next = pendingDownloads;
+    pendingDownloads = download;
+
+    if (lastPendingDownload == NULL) {
+        lastPendingDownload = download;
+    }
+
+    numPendingDownloads++;
+}
+
+void enqueueDownload(struct dccDownload *download) {
+    appendPendingDownload(download);
+    journalQueuedDownload(download);
+}
+
+static void openQueueFile(sds queueFile, uint64_t offset) {
+    if (str_equals(queueFile, "-")) {
+        queueInput = 0;
+    }
+    else {
+        queueInput = open(queueFile, O_RDONLY);
+    }
+
+    if (queueInput == -1) {
+        logprintf(LOG_ERR, "Cant open the queue file %s. Exiting now.", queueFile);
+        exitPgm(EXIT_FAILURE);
+    }
+
+    /* the requests before offset were already read by an earlier run, that was interrupted */
+    if (offset != 0 && lseek(queueInput, (off_t) offset, SEEK_SET) == (off_t) offset) {
+        logprintf(LOG_INFO, "continuing the queue file %s at byte %" PRIu64 ".", queueFile, offset);
+        queueInputOffset = offset;
+    }
+
+    queueInputBuffer = sdsempty();
+    logprintf(LOG_INFO, "reading the download requests from %s.", str_equals(queueFile, "-") ? "stdin" : queueFile);
+}
+
+static void closeQueueFile() {
+    if (queueInput > 0) {
+        close(queueInput);
+    }
+
+    queueInput = -1;
+    queueInputEof = false;
+    sdsfree(queueInputBuffer);
+    queueInputBuffer = NULL;
+}
+
+static void parseQueueLine(const char *queueLine) {
+    sds line = sdstrim(sdsnew(queueLine), " \t\r");
+
+    /* empty lines and comments are allowed in the queue file */
+    if (sdslen(line) != 0 && line[0] != ';') {
+        struct dccDownload *download = parseDccDownloadLine(line);
+
+        if (download != NULL) {
+            enqueueDownload(download);
+        }
+        else {
+            logprintf(LOG_WARN, "ignoring the invalid request in line %" PRIu64 " of the queue: %s", queueLineNumber, line);
+        }
+    }
+
+    sdsfree(line);
+}
+
+/* parses all complete lines of the input buffer. the last incomplete line stays in the buffer. */
+static void parseQueueInputBuffer() {
+    char *start = queueInputBuffer;
+    char *end;
+
+    while (numPendingDownloads < QUEUE_READ_AHEAD && (end = strchr(start, '\n')) != NULL) {
+        *end = '\0';
+        queueLineNumber++;
+        parseQueueLine(start);
+        start = end + 1;
+    }
+
+    if (start != queueInputBuffer) {
+        /* written after the queued records, so a torn commit can only repeat requests but never lose them */
+        queueInputOffset += start - queueInputBuffer;
+        journalQueueFileOffset(queueInputOffset);
+    }
+
+    sdsrange(queueInputBuffer, start - queueInputBuffer, -1);
+}
+
+/* reads requests from the queue file, until QUEUE_READ_AHEAD requests are pending.
+   a pipe is only read, while it has data, so that the event loop is not blocked. */
+static void readQueueFile() {
+    char chunk[QUEUE_READ_CHUNK];
+
+    while (queueInput != -1 && numPendingDownloads < QUEUE_READ_AHEAD) {
+        parseQueueInputBuffer();
+
+        if (numPendingDownloads >= QUEUE_READ_AHEAD) {
+            return;
+        }
+
+        if (queueInputEof) {
+            DBG_OK("reached the end of the queue after %" PRIu64 " lines.", queueLineNumber);
+            closeQueueFile();
+            return;
+        }
+
+        if (!hasPendingInput(queueInput)) {
+            return;
+        }
+
+        int readBytes = read(queueInput, chunk, sizeof(chunk));
+
+        if (readBytes < 0) {
+            logprintf(LOG_ERR, "Cant read the queue file: %s", strerror(errno));
+            closeQueueFile();
+        }
+        else if (readBytes == 0) {
+            queueInputEof = true;
+
+            /* the last line may not end with a newline */
+            if (sdslen(queueInputBuffer) != 0) {
+                queueInputBuffer = sdscat(queueInputBuffer, "\n");
+            }
+        }
+        else {
+            queueInputBuffer = sdscatlen(queueInputBuffer, chunk, readBytes);
+        }
+    }
+}
+
+static bool isSameBot(struct dccDownload *download, const char *network, const char *botNick) {
+    return isSameNetwork(download->network, network) && strcasecmp(download->botNick, botNick) == 0;
+}
+
+static bool isSamePack(struct dccDownload *download, struct dccDownload *request) {
+    return isSameBot(download, request->network, request->botNick) && str_equals(download->xdccCmd, request->xdccCmd);
+}
+
+/* the history may have put a mirror in front of the bot, that the line of the request named first. so the request
+   matches, if one of the bots of download is the first bot of request. */
+static bool isSameRequest(struct dccDownload *download, struct dccDownload *request) {
+    struct dccDownload *mirror;
+
+    if (isSamePack(download, request)) {
+        return true;
+    }
+
+    for (mirror = download->mirrors; mirror != NULL; mirror = mirror->next) {
+        if (isSamePack(mirror, request)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool isPendingDownload(struct dccDownload *download) {
+    struct dccDownload *current;
+
+    for (current = pendingDownloads; current != NULL; current = current->next) {
+        if (isSameRequest(current, download)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* puts the unfinished requests of the last run in front of the queue. */
+static uint64_t replayJournal(struct xdccGetConfig *config) {
+    uint64_t queueFileOffset = 0;
+    struct dccDownload *download = openJournal(config->queueFile, &queueFileOffset);
+    uint32_t numReplayed = 0;
+
+    while (download != NULL) {
+        struct dccDownload *next = download->next;
+        appendPendingDownload(download);
+        numReplayed++;
+        download = next;
+    }
+
+    if (numReplayed != 0) {
+        logprintf(LOG_INFO, "continuing %u unfinished downloads from the journal.", numReplayed);
+    }
+
+    return queueFileOffset;
+}
+
+void initDownloadQueue(struct xdccGetConfig *config) {
+    uint64_t queueFileOffset = 0;
+    uint32_t i;
+
+    queueConfig = config;
+
+    if (!cfg_get_bit(config, NO_JOURNAL_FLAG)) {
+        queueFileOffset = replayJournal(config);
+    }
+
+    if (config->dccDownloadArray != NULL) {
+        for (i = 0; config->dccDownloadArray[i]; i++) {
+            /* the same command line is usually given again after a crash */
+            if (isPendingDownload(config->dccDownloadArray[i])) {
+                freeDccDownload(config->dccDownloadArray[i]);
+                continue;
+            }
+
+            enqueueDownload(config->dccDownloadArray[i]);
+        }
+
+        /* the queue owns the requests from now on */
+        FREE(config->dccDownloadArray);
+        config->numDownloads = 0;
+    }
+
+    if (config->queueFile != NULL) {
+        openQueueFile(config->queueFile, queueFileOffset);
+    }
+}
+
+/* counts the requests to the bot, that are in flight. with onlyActive the requests, that wait in the queue of the bot, are left out.
+   a transfer, that ends soon, is not counted, so that the next request reaches the bot before the slot is free. */
+static uint32_t getNumRequestsToBot(const char *network, const char *botNick, bool onlyActive) {
+    struct dccDownload *current;
+    uint32_t numRequests = 0;
+
+    for (current = requestedDownloads; current != NULL; current = current->next) {
+        if (isSameBot(current, network, botNick) && !current->nearlyDone && !current->segmentRequestWaiting && !(onlyActive && current->queuedAtBot)) {
+            numRequests++;
+        }
+    }
+
+    return numRequests;
+}
+
+static uint32_t getNumActiveRequests() {
+    struct dccDownload *current;
+    uint32_t numRequests = 0;
+
+    for (current = requestedDownloads; current != NULL; current = current->next) {
+        if (!current->queuedAtBot && !current->nearlyDone && !current->segmentRequestWaiting) {
+            numRequests++;
+        }
+    }
+
+    return numRequests;
+}
+
+/* a request, that waits in the queue of a bot, does not block the requests to the other bots. */
+static bool isWindowFull() {
+    uint32_t window = getConcurrencyWindow();
+    return window != 0 && getNumActiveRequests() >= window;
+}
+
+bool isDownloadWindowLimited() {
+    return numPendingDownloads != 0 && isWindowFull();
+}
+
+/* the window of a bot is the smaller one of maxConcurrentDownloadsPerBot and the limit per user, that the bot told. */
+static bool isBotWindowFull(struct dccDownload *download, struct botState *state) {
+    if (queueConfig->maxConcurrentDownloadsPerBot != 0
+        && getNumRequestsToBot(download->network, download->botNick, false) >= queueConfig->maxConcurrentDownloadsPerBot) {
+        return true;
+    }
+
+    return state != NULL && state->maxTransfersPerUser != BOT_UNKNOWN
+        && getNumRequestsToBot(download->network, download->botNick, true) >= state->maxTransfersPerUser;
+}
+
+/* a lower rank starts sooner. a bot with open slots comes first, then the bots without a notice yet
+   and at last the bots, that queue the requests, by the length of their queue. */
+static uint64_t getBotRank(struct botState *state) {
+    if (state == NULL) {
+        return 1;
+    }
+
+    if (state->openSlots != BOT_UNKNOWN && state->openSlots != 0) {
+        return 0;
+    }
+
+    if (state->queuePosition != BOT_UNKNOWN) {
+        return 2 + (uint64_t) state->queuePosition;
+    }
+
+    if (state->openSlots == 0 && state->queueSize != BOT_UNKNOWN) {
+        return 2 + (uint64_t) state->queueSize;
+    }
+
+    return 1;
+}
+
+/* a request can be sent, when its network has joined the channels. it is dropped, when the network
+   is not configured or could not connect, because it would stay in the queue forever. */
+static bool isNetworkReady(struct dccDownload *download, bool *dropDownload) {
+    struct ircNetwork *network = findNetwork(queueConfig, download->network);
+
+    if (network == NULL) {
+        logprintf(LOG_ERR, "dropping %s %s, because the network %s is not configured.", download->botNick, download->xdccCmd, download->network);
+        *dropDownload = true;
+        return false;
+    }
+
+    if (!isNetworkUsable(network)) {
+        logprintf(LOG_ERR, "dropping %s %s, because the network %s is not connected.", download->botNick, download->xdccCmd, getNetworkName(network));
+        *dropDownload = true;
+        return false;
+    }
+
+    return network->requestsSent;
+}
+
+static void removePendingDownload(struct dccDownload **current, struct dccDownload *previous) {
+    struct dccDownload *download = *current;
+
+    *current = download->next;
+
+    if (lastPendingDownload == download) {
+        lastPendingDownload = previous;
+    }
+
+    numPendingDownloads--;
+    download->next = NULL;
+}
+
+/* removes the pending request, that is expected to start first, from the queue. a request is startable, when
+   its network is ready, its bot has a free slot and the bot neither backs off nor got a request just now. the order
+   of the queue breaks ties. of a batch only its next pack is taken, the batch stays in the queue. */
+static struct dccDownload* takeStartableDownload() {
+    struct dccDownload **current = &pendingDownloads;
+    struct dccDownload *previous = NULL;
+    struct dccDownload **best = NULL;
+    struct dccDownload *bestPrevious = NULL;
+    uint64_t bestRank = 0;
+    uint64_t now = getMonotonicTimeMs();
+
+    while (*current != NULL) {
+        struct dccDownload *download = *current;
+        struct botState *state = findBotState(download->network, download->botNick);
+        bool dropDownload = false;
+        bool startable = isNetworkReady(download, &dropDownload) && !isBotBackingOff(state, now) && !isBotRequestPaced(state, now)
+            && !isBotWindowFull(download, state);
+
+        if (dropDownload) {
+            removePendingDownload(current, previous);
+            journalFinishedDownload(download, false);
+            freeDccDownload(download);
+            continue;
+        }
+
+        if (startable && (best == NULL || getBotRank(state) < bestRank)) {
+            best = current;
+            bestPrevious = previous;
+            bestRank = getBotRank(state);
+        }
+
+        previous = download;
+        current = &download->next;
+    }
+
+    if (best == NULL) {
+        return NULL;
+    }
+
+    struct dccDownload *download = *best;
+
+    if (download->packRanges != NULL) {
+        struct dccDownload *pack = takeNextPack(download);
+        journalQueuedDownload(pack);
+        journalRequeuedDownload(download);
+        return pack;
+    }
+
+    removePendingDownload(best, bestPrevious);
+    return download;
+}
+
+/* returns the network of a request to a mirror, if it joined its channels, or NULL. */
+static struct ircNetwork* findReadyNetwork(struct dccDownload *download) {
+    struct ircNetwork *network = findNetwork(queueConfig, download->network);
+
+    if (network == NULL || !isNetworkUsable(network) || !network->requestsSent) {
+        return NULL;
+    }
+
+    return network;
+}
+
+static bool sendBotRequest(struct ircNetwork *network, struct dccDownload *download) {
+    if (download->network != NULL) {
+        logprintf(LOG_INFO, "/msg %s %s on %s\n", download->botNick, download->xdccCmd, download->network);
+    }
+    else {
+        logprintf(LOG_INFO, "/msg %s %s\n", download->botNick, download->xdccCmd);
+    }
+
+    if (irc_cmd_msg(network->session, download->botNick, download->xdccCmd) == 1) {
+        logprintf(LOG_ERR, "Cannot send xdcc command to bot!");
+        return false;
+    }
+
+    download->requestTime = getMonotonicTimeMs();
+    getBotState(download->network, download->botNick)->lastRequestTime = download->requestTime;
+    return true;
+}
+
+static void addRequestedDownload(struct dccDownload *download) {
+    struct dccDownload **last = &requestedDownloads;
+
+    while (*last != NULL) {
+        last = &(*last)->next;
+    }
+
+    *last = download;
+    numRequestedDownloads++;
+}
+
+static void removeRequestedDownload(struct dccDownload *download) {
+    struct dccDownload **current = &requestedDownloads;
+
+    while (*current != NULL) {
+        if (*current == download) {
+            *current = download->next;
+            numRequestedDownloads--;
+            download->next = NULL;
+            return;
+        }
+
+        current = &(*current)->next;
+    }
+}
+
+/* puts a request, that the bot refused or did not answer, back to the front of the queue. returns false and fails
+   the request, if it was sent maxRequestRetries times again already. */
+static bool retryRequest(struct dccDownload *download) {
+    if (queueConfig->maxRequestRetries != 0 && download->retries >= queueConfig->maxRequestRetries) {
+        logprintf(LOG_ERR, "giving up %s to %s after %" PRIu32 " attempts.", download->xdccCmd, download->botNick, download->retries + 1);
+        finishQueuedDownload(download, false);
+        return false;
+    }
+
+    download->retries++;
+    download->answered = false;
+    removeRequestedDownload(download);
+    prependPendingDownload(download);
+    return true;
+}
+
+static bool isRequestExpired(struct dccDownload *download, uint64_t now) {
+    return queueConfig->requestTimeout != 0 && !download->started && !download->queuedAtBot && !download->segmentRequestWaiting
+        && download->requestTime != 0 && now >= download->requestTime + (uint64_t) queueConfig->requestTimeout * 1000;
+}
+
+/* frees the slots of the requests, whose bot did not answer or did not send the offer in time. the bot may be gone
+   or may have lost the request, so it backs off, before it is asked again. */
+static void expireUnansweredRequests() {
+    struct dccDownload *current = requestedDownloads;
+    uint64_t now = getMonotonicTimeMs();
+
+    while (current != NULL) {
+        struct dccDownload *download = current;
+
+        current = download->next;
+
+        if (!isRequestExpired(download, now)) {
+            continue;
+        }
+
+        logprintf(LOG_WARN, "%s did not %s %s within %" PRIu64 "s.", download->botNick, download->answered ? "send the offer of" : "answer",
+            download->xdccCmd, (uint64_t) queueConfig->requestTimeout);
+        backOffBot(getBotState(download->network, download->botNick), now);
+
+        if (download->segmented != NULL || download->segmentOf != NULL) {
+            dropSegmentSource(download);
+        }
+        else if (download->raceOf != NULL) {
+            finishQueuedDownload(download, false);
+        }
+        else {
+            retryRequest(download);
+        }
+
+        /* a dropped source may have ended the segmented download and freed other requests */
+        current = requestedDownloads;
+    }
+}
+
+/* sends the requests for segments, that wait for the windows, the pacing or the back off of their bots. they belong to
+   running downloads and go before the pending requests. a source, whose network is gone, is dropped. */
+static void sendWaitingSegmentRequests() {
+    struct dccDownload *current = requestedDownloads;
+    uint64_t now = getMonotonicTimeMs();
+
+    while (current != NULL && !isWindowFull()) {
+        struct dccDownload *source = current;
+        struct botState *state = findBotState(source->network, source->botNick);
+        bool dropSource = false;
+
+        current = source->next;
+
+        if (!source->segmentRequestWaiting) {
+            continue;
+        }
+
+        if (!isNetworkReady(source, &dropSource)) {
+            if (dropSource) {
+                source->segmentRequestWaiting = false;
+                dropSegmentSource(source);
+                /* the dropped source may have ended the segmented download and freed other sources */
+                current = requestedDownloads;
+            }
+            continue;
+        }
+
+        if (isBotBackingOff(state, now) || isBotRequestPaced(state, now) || isBotWindowFull(source, state)) {
+            continue;
+        }
+
+        source->segmentRequestWaiting = false;
+
+        if (!sendBotRequest(findNetwork(queueConfig, source->network), source)) {
+            dropSegmentSource(source);
+            current = requestedDownloads;
+            continue;
+        }
+
+        /* the offers of a bot are matched to its requests in the order, in which they were sent */
+        removeRequestedDownload(source);
+        addRequestedDownload(source);
+    }
+}
+
+void startQueuedDownloads() {
+    expireUnansweredRequests();
+    sendWaitingSegmentRequests();
+
+    while (!isWindowFull()) {
+        readQueueFile();
+
+        struct dccDownload *download = takeStartableDownload();
+
+        if (download == NULL) {
+            return;
+        }
+
+        if (!sendBotRequest(findNetwork(queueConfig, download->network), download)) {
+            freeDccDownload(download);
+            continue;
+        }
+
+        addRequestedDownload(download);
+        journalRequestedDownload(download);
+    }
+}
+
+/* the file, that a request to a mirror expects, is the file of the request, that it races or sends segments of.
+   returns NULL for the other requests, that take any file. */
+static const char* getExpectedFile(struct dccDownload *download) {
+    if (download->raceOf != NULL) {
+        return download->raceOf->offeredFile;
+    }
+
+    if (download->segmentOf != NULL) {
+        return download->segmentOf->offeredFile;
+    }
+
+    return NULL;
+}
+
+struct dccDownload* findOfferedDownload(const char *network, const char *botNick, const char *filename) {
+    struct dccDownload *current;
+    struct dccDownload *anyFile = NULL;
+    struct dccDownload *oldest = NULL;
+
+    for (current = requestedDownloads; current != NULL; current = current->next) {
+        if (current->started || current->segmentRequestWaiting || !isSameBot(current, network, botNick)) {
+            continue;
+        }
+
+        const char *expectedFile = getExpectedFile(current);
+
+        if (expectedFile != NULL && str_equals(expectedFile, filename)) {
+            return current;
+        }
+
+        if (expectedFile == NULL && anyFile == NULL) {
+            anyFile = current;
+        }
+
+        if (oldest == NULL) {
+            oldest = current;
+        }
+    }
+
+    /* a file, that no request to a mirror expects, belongs to an ordinary request of the bot. without one the
+       mirror gets it and refuses it */
+    return (anyFile != NULL) ? anyFile : oldest;
+}
+
+struct dccDownload* takeRequestedDownload(const char *network, const char *botNick, const char *filename) {
+    struct dccDownload *download = findOfferedDownload(network, botNick, filename);
+
+    if (download != NULL) {
+        sdsfree(download->offeredFile);
+        download->offeredFile = sdsnew(filename);
+        download->started = true;
+        download->answered = true;
+        download->queuedAtBot = false;
+    }
+
+    return download;
+}
+
+struct dccDownload* findRequestedDownload(const char *network, const char *botNick) {
+    struct dccDownload *current;
+    struct dccDownload *found = NULL;
+
+    for (current = requestedDownloads; current != NULL; current = current->next) {
+        if (isSameBot(current, network, botNick) && !current->segmentRequestWaiting) {
+            found = current;
+        }
+    }
+
+    return found;
+}
+
+bool isRequestedBot(const char *network, const char *botNick) {
+    return findRequestedDownload(network, botNick) != NULL;
+}
+
+struct dccDownload* findRequestedDownloadByCmd(struct dccDownload *request) {
+    struct dccDownload *current;
+
+    for (current = requestedDownloads; current != NULL; current = current->next) {
+        if (isSameRequest(current, request)) {
+            return current;
+        }
+    }
+
+    return NULL;
+}
+
+bool cancelPendingDownload(struct dccDownload *request) {
+    struct dccDownload **current = &pendingDownloads;
+    struct dccDownload *previous = NULL;
+
+    while (*current != NULL) {
+        struct dccDownload *download = *current;
+
+        if (isSameRequest(download, request)) {
+            *current = download->next;
+
+            if (lastPendingDownload == download) {
+                lastPendingDownload = previous;
+            }
+
+            numPendingDownloads--;
+            journalFinishedDownload(download, false);
+            freeDccDownload(download);
+            return true;
+        }
+
+        previous = download;
+        current = &download->next;
+    }
+
+    return false;
+}
+
+/* returns the oldest request to the bot, that the bot did not answer yet. */
+static struct dccDownload* findUnansweredRequest(const char *network, const char *botNick) {
+    struct dccDownload *current;
+
+    for (current = requestedDownloads; current != NULL; current = current->next) {
+        if (!current->started && !current->answered && !current->segmentRequestWaiting && isSameBot(current, network, botNick)) {
+            return current;
+        }
+    }
+
+    return NULL;
+}
+
+struct dccDownload* startMirrorRequest(struct dccDownload *download) {
+    struct dccDownload *mirror = download->mirrors;
+
+    if (mirror == NULL || download->raceDownload != NULL) {
+        return NULL;
+    }
+
+    struct ircNetwork *network = findReadyNetwork(mirror);
+
+    if (network == NULL) {
+        return NULL;
+    }
+
+    download->mirrors = mirror->next;
+    mirror->next = NULL;
+
+    if (!sendBotRequest(network, mirror)) {
+        freeDccDownload(mirror);
+        return NULL;
+    }
+
+    /* the remaining mirrors can race the mirror, if it straggles as well */
+    mirror->mirrors = download->mirrors;
+    download->mirrors = NULL;
+    mirror->raceOf = download;
+    download->raceDownload = mirror;
+    addRequestedDownload(mirror);
+    return mirror;
+}
+
+void startSegmentedDownload(struct dccDownload *download, struct segmentedFile *file) {
+    struct dccDownload *mirror;
+
+    download->segmented = file;
+    download->numSegmentSources = 1;
+
+    while ((mirror = download->mirrors) != NULL) {
+        download->mirrors = mirror->next;
+        mirror->next = NULL;
+        mirror->segmentOf = download;
+        mirror->segmentRequestWaiting = true;
+        download->numSegmentSources++;
+        addRequestedDownload(mirror);
+    }
+
+    sendWaitingSegmentRequests();
+}
+
+static struct dccDownload* getSegmentedDownload(struct dccDownload *source) {
+    return (source->segmentOf != NULL) ? source->segmentOf : source;
+}
+
+/* the bot of source does not send segments anymore. the segmented download fails, when no bot is left. */
+static void leaveSegmentedDownload(struct dccDownload *download) {
+    download->numSegmentSources--;
+
+    if (download->numSegmentSources == 0 && !isSegmentedFileComplete(download->segmented)) {
+        logprintf(LOG_ERR, "no bot is left, that sends the missing segments of %s.", download->segmented->path);
+        finishQueuedDownload(download, false);
+    }
+}
+
+void restartSegmentRequest(struct dccDownload *source) {
+    struct botState *state = findBotState(source->network, source->botNick);
+
+    if (state != NULL) {
+        releaseBotSlot(state);
+    }
+
+    source->started = false;
+    source->answered = false;
+    source->queuedAtBot = false;
+    source->segmentRequestWaiting = true;
+    sendWaitingSegmentRequests();
+}
+
+void dropSegmentSource(struct dccDownload *source) {
+    struct dccDownload *download = getSegmentedDownload(source);
+
+    if (source != download) {
+        finishQueuedDownload(source, false);
+        return;
+    }
+
+    /* the request of the file stays in the window without a transfer, until the mirrors finished the file */
+    source->started = true;
+    source->answered = true;
+    leaveSegmentedDownload(download);
+}
+
+/* frees the requests to the mirrors, that were asked for segments again but did not offer them yet, and closes the file. */
+static void endSegmentedDownload(struct dccDownload *download) {
+    struct dccDownload **current = &requestedDownloads;
+
+    while (*current != NULL) {
+        struct dccDownload *source = *current;
+
+        if (source->segmentOf == download) {
+            *current = source->next;
+            numRequestedDownloads--;
+            freeDccDownload(source);
+        }
+        else {
+            current = &source->next;
+        }
+    }
+
+    closeSegmentedFile(download->segmented);
+    download->segmented = NULL;
+}
+
+void handOverDownload(struct dccDownload *straggler, struct dccDownload *race) {
+    straggler->raceDownload = NULL;
+    race->raceOf = NULL;
+
+    race->journalId = straggler->journalId;
+    race->journalOffset = straggler->journalOffset;
+    race->weight = straggler->weight;
+    race->priority = straggler->priority;
+    race->deadline = straggler->deadline;
+    straggler->journalId = 0;
+
+    if (race->md5 == NULL) {
+        race->md5 = straggler->md5;
+        straggler->md5 = NULL;
+    }
+}
+
+/* a request to a mirror must not outlive the request, that it races, and must not be queued on its own. */
+static void endRace(struct dccDownload *download) {
+    struct dccDownload *race = download->raceDownload;
+
+    if (download->raceOf != NULL) {
+        /* the mirror failed before it took over. the straggling request keeps the other mirrors */
+        if (!download->started) {
+            download->raceOf->mirrors = download->mirrors;
+            download->mirrors = NULL;
+        }
+
+        download->raceOf->raceDownload = NULL;
+        download->raceOf = NULL;
+    }
+
+    if (race == NULL) {
+        return;
+    }
+
+    download->raceDownload = NULL;
+    race->raceOf = NULL;
+
+    /* the transfer of the mirror did not start yet, its offer is refused from now on */
+    if (!race->started) {
+        removeRequestedDownload(race);
+        freeDccDownload(race);
+    }
+}
+
+void handleBotNotice(const char *network, const char *botNick, const struct noticeMatch *match) {
+    if (!isRequestedBot(network, botNick)) {
+        return;
+    }
+
+    struct botState *state = getBotState(network, botNick);
+    enum botReply reply = parseBotNotice(state, match);
+    struct dccDownload *download = findUnansweredRequest(network, botNick);
+
+    switch (reply) {
+        case BOT_REPLY_SENDING:
+            if (download != NULL) {
+                download->answered = true;
+            }
+            break;
+        case BOT_REPLY_QUEUED:
+        case BOT_REPLY_ALREADY_QUEUED:
+            if (state->queuePosition != BOT_UNKNOWN) {
+                logprintf(LOG_INFO, "%s queued the request at position %" PRIu32 ".", botNick, state->queuePosition);
+            }
+
+            if (download != NULL) {
+                download->answered = true;
+                download->queuedAtBot = true;
+            }
+            break;
+        case BOT_REPLY_RETRY_LATER:
+            /* the other bots send the segments meanwhile */
+            if (download != NULL && (download->segmented != NULL || download->segmentOf != NULL)) {
+                logprintf(LOG_INFO, "%s can not send a segment of %s now.", botNick, getSegmentedDownload(download)->segmented->path);
+                dropSegmentSource(download);
+            }
+            /* a mirror, that can not send now, does not help a straggling transfer */
+            else if (download != NULL && download->raceOf != NULL) {
+                logprintf(LOG_INFO, "the mirror %s refused %s, keeping the running transfer.", botNick, download->xdccCmd);
+                finishQueuedDownload(download, false);
+            }
+            else if (download != NULL) {
+                backOffBot(state, getMonotonicTimeMs());
+
+                if (retryRequest(download)) {
+                    logprintf(LOG_INFO, "%s refused %s for now. sending it again in %" PRIu64 "s or when a transfer of the bot ends.",
+                        botNick, download->xdccCmd, (state->retryTime - getMonotonicTimeMs()) / 1000);
+                }
+            }
+            break;
+        case BOT_REPLY_INVALID_PACK:
+            if (download != NULL && (download->segmented != NULL || download->segmentOf != NULL)) {
+                logprintf(LOG_ERR, "%s does not have the pack of %s.", botNick, download->xdccCmd);
+                dropSegmentSource(download);
+            }
+            else if (download != NULL) {
+                logprintf(LOG_ERR, "%s does not have the pack of %s.", botNick, download->xdccCmd);
+                finishQueuedDownload(download, false);
+            }
+            break;
+        case BOT_REPLY_NONE:
+            break;
+    }
+}
+
+uint32_t getNumPendingDownloads() {
+    return numPendingDownloads;
+}
+
+uint32_t getNumRequestedDownloads() {
+    return numRequestedDownloads;
+}
+
+void finishQueuedDownload(struct dccDownload *download, bool completed) {
+    struct dccDownload *segmentedDownload = download != NULL ? download->segmentOf : NULL;
+
+    if (download == NULL) {
+        return;
+    }
+
+    journalFinishedDownload(download, completed);
+    removeRequestedDownload(download);
+    endRace(download);
+
+    if (download->segmented != NULL) {
+        endSegmentedDownload(download);
+    }
+
+    /* the bot has a free slot now, so a request, that it refused, can be sent again */
+    if (download->started) {
+        struct botState *state = findBotState(download->network, download->botNick);
+
+        if (state != NULL) {
+            releaseBotSlot(state);
+        }
+    }
+
+    freeDccDownload(download);
+
+    if (segmentedDownload != NULL) {
+        leaveSegmentedDownload(segmentedDownload);
+    }
+}
+
+bool isDownloadQueueDrained() {
+    return numRequestedDownloads == 0 && numPendingDownloads == 0 && queueInput == -1;
+}
+
+static void freeDownloadList(struct dccDownload *download) {
+    while (download != NULL) {
+        struct dccDownload *next = download->next;
+        freeDccDownload(download);
+        download = next;
+    }
+}
+
+void freeDownloadQueue() {
+    bool drained = isDownloadQueueDrained();
+
+    freeDownloadList(pendingDownloads);
+    freeDownloadList(requestedDownloads);
+
+    pendingDownloads = NULL;
+    lastPendingDownload = NULL;
+    requestedDownloads = NULL;
+    numPendingDownloads = 0;
+    numRequestedDownloads = 0;
+
+    closeQueueFile();
+    closeJournal(drained);
+    freeBotStates();
+}
@@ -0,0 +1,103 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "helper.h"
+#include "argument_parser.h"
+
+/* default for maxConcurrentDownloads, the number of requests that are in flight at the same time. */
+#define QUEUE_DEFAULT_MAX_DOWNLOADS 8
+/* the queue file is read lazily. at most this many requests are parsed ahead of the window. */
+#define QUEUE_READ_AHEAD 64
+#define QUEUE_READ_CHUNK 4096
+/* default for stragglerSpeedRatio. a transfer with a quarter of the median speed of the others is raced by a mirror */
+#define QUEUE_DEFAULT_STRAGGLER_RATIO 25
+/* the next request to a bot is sent, when the transfer from it is expected to end within this many seconds */
+#define QUEUE_PIPELINE_LEAD_SECS 5
+/* default for requestTimeout. a bot, that neither queued nor sent the pack in this many seconds, is asked again */
+#define QUEUE_DEFAULT_REQUEST_TIMEOUT_SECS 180
+/* default for maxRequestRetries */
+#define QUEUE_DEFAULT_MAX_RETRIES 8
+
+/* takes over the requests from the command line and opens the queue file of the config, if one is set.
+   a queue file of - reads the requests from stdin. the unfinished requests of the journal are put first. */
+void initDownloadQueue(struct xdccGetConfig *config);
+
+/* appends download to the end of the queue and writes it to the journal. */
+void enqueueDownload(struct dccDownload *download);
+
+/* sends the next requests of the queue to the bots, until the global window or the windows
+   of the bots are full. new requests are read from the queue file, when they are needed.
+   a request waits, until its network has joined the channels, and is dropped, if its network
+   is unknown or not connected. a request, that the bot neither queued nor sent within requestTimeout,
+   gives its slots free and is sent again or fails after maxRequestRetries. */
+void startQueuedDownloads();
+
+/* the network of the following functions is the name of the network or NULL for the network of the command line. */
+
+/* returns the request to botNick, that the offer of filename belongs to, like findOfferedDownload and marks it as
+   started. returns NULL, if no request to botNick is in flight. */
+struct dccDownload* takeRequestedDownload(const char *network, const char *botNick, const char *filename);
+
+/* returns the most recent request to botNick, that is in flight, or NULL. */
+struct dccDownload* findRequestedDownload(const char *network, const char *botNick);
+
+/* returns true, if a request to botNick is in flight, so that its dcc transfers are accepted. */
+bool isRequestedBot(const char *network, const char *botNick);
+
+/* returns the request, that is in flight and has a bot with the same network, bot and xdcc command as the first bot
+   of request, or NULL. the bots of a request with mirrors may have been reordered by the history. */
+struct dccDownload* findRequestedDownloadByCmd(struct dccDownload *request);
+
+/* removes a request, that was not sent yet and has a bot with the same network, bot and xdcc command as the first bot
+   of request, from the queue. returns false, if no such request is pending. */
+bool cancelPendingDownload(struct dccDownload *request);
+
+/* returns true, if requests wait, because the global window is full. */
+bool isDownloadWindowLimited();
+
+uint32_t getNumPendingDownloads();
+uint32_t getNumRequestedDownloads();
+
+/* applies a notice of botNick to its oldest request, that it did not answer yet. a request, that the bot refuses
+   for now, goes back to the front of the queue and is sent again, when the bot backed off or one of its transfers ended.
+   it fails, when the bot refused it maxRequestRetries times. */
+void handleBotNotice(const char *network, const char *botNick, const struct noticeMatch *match);
+
+/* sends the request of download to its next mirror, because the transfer of download straggles. when the mirror
+   offers the same file, it takes over and resumes the partial file. returns NULL, if no mirror is left or the
+   network of the mirror is not ready. */
+struct dccDownload* startMirrorRequest(struct dccDownload *download);
+
+/* returns the request, that the dcc offer of filename by botNick belongs to, without taking it. a request to a
+   mirror, that races a transfer or sends segments of a file, only gets an offer of that file first. the other
+   offers go to the oldest ordinary request to botNick or, if there is none, to its oldest request. */
+struct dccDownload* findOfferedDownload(const char *network, const char *botNick, const char *filename);
+
+/* the request to a mirror replaces the straggling request, that it raced. it inherits the journal record and
+   the checksum, so that it is finished in place of the straggling request. */
+void handOverDownload(struct dccDownload *straggler, struct dccDownload *race);
+
+/* the bot of download offered a file, that is split into segments. the mirrors of download are asked for the
+   same file, so that every bot sends an other segment. the requests to the mirrors wait for the windows and the
+   pacing of their bots like the pending requests. the segmented download ends with download. */
+void startSegmentedDownload(struct dccDownload *download, struct segmentedFile *file);
+
+/* asks the bot of a request, that finished its segment, for the next segment of the file. the request waits for
+   the windows and the pacing of the bot again. the transfer of the finished segment must be closed before, because
+   the bot counts it as long as it is open. */
+void restartSegmentRequest(struct dccDownload *source);
+
+/* the bot of source has no segment to send or failed. the request to a mirror is freed. the request of the
+   segmented file waits for the mirrors instead and fails, when no bot is left to send the missing segments. */
+void dropSegmentSource(struct dccDownload *source);
+
+/* removes a finished or failed request from the window and frees it. the free slot is used by
+   the next call of startQueuedDownloads. completed is false, if the download failed. */
+void finishQueuedDownload(struct dccDownload *download, bool completed);
+
+/* returns true, if all requests were sent and finished and the queue file has no more requests. */
+bool isDownloadQueueDrained();
+
+void freeDownloadQueue();
+
+#endif
@@ -0,0 +1,191 @@
+#include <string.h>
+
+#include "schedule.h"
+#include "os_specific.h"
+
+static const char *dayNames[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+static int parseDayName(const char *name, size_t len) {
+    int i;
+
+    if (len != 3) {
+        return -1;
+    }
+
+    for (i = 0; i < 7; i++) {
+        if (strncasecmp(name, dayNames[i], 3) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* parses a list like mon-fri or sat,sun into a bitmask of weekdays. returns 0 on errors. */
+static uint8_t parseDays(const char *value) {
+    uint8_t days = 0;
+    const char *current = value;
+
+    if (strcasecmp(value, "daily") == 0) {
+        return SCHEDULE_ALL_DAYS;
+    }
+
+    while (*current != '\0') {
+        size_t len = strcspn(current, ",");
+        const char *dash = memchr(current, '-', len);
+        int first, last;
+
+        if (dash != NULL) {
+            first = parseDayName(current, dash - current);
+            last = parseDayName(dash + 1, len - (dash - current) - 1);
+        }
+        else {
+            first = last = parseDayName(current, len);
+        }
+
+        if (first == -1 || last == -1) {
+            return 0;
+        }
+
+        /* ranges like fri-mon wrap around the weekend */
+        for (;;) {
+            days |= 1 << first;
+
+            if (first == last) {
+                break;
+            }
+
+            first = (first + 1) % 7;
+        }
+
+        current += len;
+
+        if (*current == ',') {
+            current++;
+        }
+    }
+
+    return days;
+}
+
+static bool parseTimeRange(const char *value, uint16_t *startMinute, uint16_t *endMinute) {
+    unsigned int startHour, startMin, endHour, endMin;
+    char rest = 0;
+
+#ifdef _MSC_VER
+    int ret = sscanf_s(value, "%u:%u-%u:%u%c", &startHour, &startMin, &endHour, &endMin, &rest, 1);
+#else
+    int ret = sscanf(value, "%u:%u-%u:%u%c", &startHour, &startMin, &endHour, &endMin, &rest);
+#endif
+
+    /* 24:00 is allowed as end of the day */
+    if (ret != 4 || startHour > 23 || startMin > 59 || endHour > 24 || endMin > 59 || (endHour == 24 && endMin != 0)) {
+        return false;
+    }
+
+    *startMinute = startHour * 60 + startMin;
+    *endMinute = endHour * 60 + endMin;
+
+    return true;
+}
+
+static irc_dcc_size_t parseRuleSpeed(sds value, bool *valid) {
+    *valid = true;
+
+    if (strcasecmp(value, "unlimited") == 0) {
+        return NO_SPEED_LIMIT;
+    }
+
+    irc_dcc_size_t speed = parseTransferSpeed(value);
+    *valid = speed != NO_SPEED_LIMIT;
+
+    return speed;
+}
+
+bool parseThrottleRule(const char *value, struct throttleRule **rules) {
+    int count = 0;
+    bool valid = false;
+    sds *tokens = sdssplitargs(value, &count);
+
+    if (tokens == NULL) {
+        return false;
+    }
+
+    if (count == 2 || count == 3) {
+        struct throttleRule *rule = Safe_Malloc(sizeof(struct throttleRule));
+        bool validSpeed = false;
+
+        rule->days = (count == 3) ? parseDays(tokens[0]) : SCHEDULE_ALL_DAYS;
+        rule->speed = parseRuleSpeed(tokens[count - 1], &validSpeed);
+        valid = rule->days != 0 && validSpeed && parseTimeRange(tokens[count - 2], &rule->startMinute, &rule->endMinute);
+
+        if (valid) {
+            struct throttleRule **last = rules;
+
+            /* keep the order of the config file, the first matching rule wins */
+            while (*last != NULL) {
+                last = &(*last)->next;
+            }
+
+            *last = rule;
+        }
+        else {
+            FREE(rule);
+        }
+    }
+
+    sdsfreesplitres(tokens, count);
+
+    return valid;
+}
+
+static bool isDaySet(struct throttleRule *rule, int weekday) {
+    return (rule->days & (1 << ((weekday + 7) % 7))) != 0;
+}
+
+static bool ruleMatches(struct throttleRule *rule, struct tm *localTime) {
+    int minute = localTime->tm_hour * 60 + localTime->tm_min;
+
+    if (rule->startMinute == rule->endMinute) {
+        return isDaySet(rule, localTime->tm_wday);
+    }
+
+    if (rule->startMinute < rule->endMinute) {
+        return isDaySet(rule, localTime->tm_wday) && minute >= rule->startMinute && minute < rule->endMinute;
+    }
+
+    /* the part after midnight belongs to the day, on which the rule started */
+    return (isDaySet(rule, localTime->tm_wday) && minute >= rule->startMinute)
+        || (isDaySet(rule, localTime->tm_wday - 1) && minute < rule->endMinute);
+}
+
+irc_dcc_size_t getScheduledTransferSpeed(struct throttleRule *rules, time_t now, irc_dcc_size_t fallback) {
+    struct throttleRule *current;
+    struct tm localTime;
+
+    if (rules == NULL) {
+        return fallback;
+    }
+
+#ifdef _MSC_VER
+    localtime_s(&localTime, &now);
+#else
+    localtime_r(&now, &localTime);
+#endif
+
+    for (current = rules; current != NULL; current = current->next) {
+        if (ruleMatches(current, &localTime)) {
+            return current->speed;
+        }
+    }
+
+    return fallback;
+}
+
+void freeThrottleSchedule(struct throttleRule *rules) {
+    while (rules != NULL) {
+        struct throttleRule *next = rules->next;
+        FREE(rules);
+        rules = next;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <time.h>
+
+#include "helper.h"
+
+#define SCHEDULE_ALL_DAYS 0x7F
+
+/* a time of day rule, that overrides maxTransferSpeed, e.g. "mon-fri 08:00-18:00 20MByte". */
+struct throttleRule {
+    /* bit n is set, if the rule applies on the weekday n (0 is sunday like in struct tm) */
+    uint8_t days;
+    /* minutes after midnight. if end is before start, the rule lasts over midnight */
+    uint16_t startMinute;
+    uint16_t endMinute;
+    irc_dcc_size_t speed;
+    struct throttleRule *next;
+};
+
+/* parses a rule like "[days] HH:MM-HH:MM <speed|unlimited>" and appends it to rules.
+   days are e.g. mon-fri, sat,sun or daily. returns false, if the rule is not valid. */
+bool parseThrottleRule(const char *value, struct throttleRule **rules);
+
+/* returns the speed of the first rule, that matches the time now, or fallback if no rule matches. */
+irc_dcc_size_t getScheduledTransferSpeed(struct throttleRule *rules, time_t now, irc_dcc_size_t fallback);
+
+void freeThrottleSchedule(struct throttleRule *rules);
+
+#endif
@@ -0,0 +1,320 @@
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "segments.h"
+#include "file.h"
+#include "os_specific.h"
+
+static struct segmentedFile *segmentedFiles = NULL;
+
+static sds getBitmapPath(const char *path) {
+    return sdscatprintf(sdsempty(), "%s%s", path, SEGMENT_BITMAP_SUFFIX);
+}
+
+static uint32_t getRangeOf(irc_dcc_size_t offset) {
+    return (uint32_t) (offset / SEGMENT_RANGE_SIZE);
+}
+
+/* returns the first range, that starts at or behind offset. */
+static uint32_t getRangeFrom(irc_dcc_size_t offset) {
+    return (uint32_t) ((offset + SEGMENT_RANGE_SIZE - 1) / SEGMENT_RANGE_SIZE);
+}
+
+static irc_dcc_size_t getRangeOffset(struct segmentedFile *file, uint32_t range) {
+    irc_dcc_size_t offset = (irc_dcc_size_t) range * SEGMENT_RANGE_SIZE;
+    return offset < file->fileSize ? offset : file->fileSize;
+}
+
+static void markRangeDone(struct segmentedFile *file, uint32_t range) {
+    if (file->ranges[range] == '0') {
+        file->ranges[range] = '1';
+        file->numRangesDone++;
+        file->dirty = true;
+    }
+}
+
+/* reads the bitmap of an interrupted segmented download. a bitmap of an other file size or range size is not used. */
+static bool loadBitmap(struct segmentedFile *file) {
+    sds content = readTextFile(file->bitmapPath);
+    int numLines = 0;
+    sds *lines = sdssplitlen(content, sdslen(content), "\n", 1, &numLines);
+    irc_dcc_size_t fileSize = 0;
+    uint32_t rangeSize = 0;
+    bool loaded = false;
+    uint32_t i;
+
+    if (numLines >= 2 && sscanf(lines[0], "%" SCNu64 " %" SCNu32, &fileSize, &rangeSize) == 2
+            && fileSize == file->fileSize && rangeSize == SEGMENT_RANGE_SIZE && sdslen(lines[1]) == file->numRanges) {
+        for (i = 0; i < file->numRanges; i++) {
+            if (lines[1][i] == '1') {
+                markRangeDone(file, i);
+            }
+        }
+
+        loaded = true;
+    }
+
+    sdsfreesplitres(lines, numLines);
+    sdsfree(content);
+    return loaded;
+}
+
+static bool saveBitmap(struct segmentedFile *file) {
+    sds content = sdscatprintf(sdsempty(), "%" IRC_DCC_SIZE_T_FORMAT " %" PRIu32 "\n%s\n", file->fileSize,
+        (uint32_t) SEGMENT_RANGE_SIZE, file->ranges);
+    /* the bitmap is replaced at once, so that a crash never leaves a torn bitmap, that claims missing ranges, or
+       no bitmap beside the preallocated file */
+    bool success = replaceFile(file->bitmapPath, content, sdslen(content), false);
+
+    if (success) {
+        file->dirty = false;
+    }
+    else {
+        logprintf(LOG_ERR, "could not save the segments of %s: %s", file->path, strerror(errno));
+    }
+
+    sdsfree(content);
+    return success;
+}
+
+static void freeSegmentedFile(struct segmentedFile *file) {
+    while (file->segments != NULL) {
+        struct fileSegment *next = file->segments->next;
+        FREE(file->segments);
+        file->segments = next;
+    }
+
+    sdsfree(file->path);
+    sdsfree(file->bitmapPath);
+    sdsfree(file->ranges);
+    FREE(file);
+}
+
+struct segmentedFile* openSegmentedFile(const char *path, irc_dcc_size_t fileSize) {
+    struct segmentedFile *file = Calloc(1, sizeof(struct segmentedFile));
+    uint32_t i;
+
+    file->path = sdsnew(path);
+    file->bitmapPath = getBitmapPath(path);
+    file->fileSize = fileSize;
+    file->numRanges = getRangeFrom(fileSize);
+    file->ranges = sdsnewlen(NULL, file->numRanges);
+    memset(file->ranges, '0', file->numRanges);
+
+    if (file_exists(file->bitmapPath)) {
+        if (!loadBitmap(file)) {
+            logprintf(LOG_WARN, "the segments of %s dont match the offered file. downloading it again.", path);
+        }
+    }
+    else if (file_exists(file->path)) {
+        /* a partial download of a single bot has written the file from the start */
+        irc_dcc_size_t written = get_file_size(file->path);
+
+        for (i = 0; i < getRangeOf(written) && i < file->numRanges; i++) {
+            markRangeDone(file, i);
+        }
+
+        if (written >= fileSize && file->numRanges > 0) {
+            markRangeDone(file, file->numRanges - 1);
+        }
+    }
+
+    /* the bitmap has to exist, before the file gets its full size. otherwise it would look complete after a crash. */
+    if (!saveBitmap(file)) {
+        freeSegmentedFile(file);
+        return NULL;
+    }
+
+    if (!preallocateFile(path, fileSize)) {
+        logprintf(LOG_ERR, "could not preallocate %" IRC_DCC_SIZE_T_FORMAT " bytes for %s: %s", fileSize, path, strerror(errno));
+        remove(file->bitmapPath);
+        freeSegmentedFile(file);
+        return NULL;
+    }
+
+    file->next = segmentedFiles;
+    segmentedFiles = file;
+    return file;
+}
+
+bool hasSegmentBitmap(const char *path) {
+    sds bitmapPath = getBitmapPath(path);
+    bool exists = file_exists(bitmapPath);
+    sdsfree(bitmapPath);
+    return exists;
+}
+
+static bool isRangeAssigned(struct segmentedFile *file, uint32_t range) {
+    irc_dcc_size_t offset = getRangeOffset(file, range);
+    struct fileSegment *segment;
+
+    for (segment = file->segments; segment != NULL; segment = segment->next) {
+        if (offset >= segment->start && offset < segment->end) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static struct fileSegment* addSegment(struct segmentedFile *file, uint32_t firstRange, uint32_t endRange) {
+    struct fileSegment *segment = Calloc(1, sizeof(struct fileSegment));
+
+    segment->start = getRangeOffset(file, firstRange);
+    segment->position = segment->start;
+    segment->end = getRangeOffset(file, endRange);
+    segment->nextRange = firstRange;
+    segment->next = file->segments;
+    file->segments = segment;
+    return segment;
+}
+
+/* returns the segment, whose untransferred part has the most ranges, that are not complete yet. */
+static struct fileSegment* findBiggestSegment(struct segmentedFile *file, uint32_t *firstRange, uint32_t *endRange) {
+    struct fileSegment *biggest = NULL;
+    struct fileSegment *segment;
+    uint32_t biggestRanges = 0;
+
+    for (segment = file->segments; segment != NULL; segment = segment->next) {
+        /* the range, that is written right now, stays with the running transfer */
+        uint32_t first = getRangeFrom(segment->position);
+        uint32_t end = getRangeFrom(segment->end);
+
+        if (end > first && end - first > biggestRanges) {
+            biggest = segment;
+            biggestRanges = end - first;
+            *firstRange = first;
+            *endRange = end;
+        }
+    }
+
+    return biggest;
+}
+
+/* finds the ranges of the next segment. split is set to the running segment, that has to stop at firstRange. */
+static bool findNextSegment(struct segmentedFile *file, uint32_t *firstRange, uint32_t *endRange, struct fileSegment **split) {
+    *firstRange = 0;
+    *split = NULL;
+
+    /* a missing part, that no bot sends, e.g. the part of a bot, that failed */
+    while (*firstRange < file->numRanges && (file->ranges[*firstRange] == '1' || isRangeAssigned(file, *firstRange))) {
+        (*firstRange)++;
+    }
+
+    if (*firstRange < file->numRanges) {
+        *endRange = *firstRange + 1;
+
+        while (*endRange < file->numRanges && file->ranges[*endRange] == '0' && !isRangeAssigned(file, *endRange)) {
+            (*endRange)++;
+        }
+
+        return true;
+    }
+
+    /* the new bot takes the second half of the biggest running segment, which then stops in the middle */
+    *split = findBiggestSegment(file, firstRange, endRange);
+
+    if (*split == NULL || *endRange - *firstRange < 2 * SEGMENT_MIN_SPLIT_RANGES) {
+        return false;
+    }
+
+    *firstRange += (*endRange - *firstRange) / 2;
+    return true;
+}
+
+bool canAssignSegment(struct segmentedFile *file) {
+    uint32_t firstRange;
+    uint32_t endRange;
+    struct fileSegment *split;
+
+    return findNextSegment(file, &firstRange, &endRange, &split);
+}
+
+struct fileSegment* assignSegment(struct segmentedFile *file) {
+    uint32_t firstRange;
+    uint32_t endRange;
+    struct fileSegment *split;
+
+    if (!findNextSegment(file, &firstRange, &endRange, &split)) {
+        return NULL;
+    }
+
+    if (split != NULL) {
+        split->end = getRangeOffset(file, firstRange);
+    }
+
+    return addSegment(file, firstRange, endRange);
+}
+
+void moveSegment(struct fileSegment *segment, irc_dcc_size_t offset) {
+    segment->position = offset;
+
+    /* a range, that the segment starts in the middle of, is not written completely by it */
+    segment->nextRange = getRangeFrom(offset);
+}
+
+irc_dcc_size_t clampToSegment(struct fileSegment *segment, irc_dcc_size_t length) {
+    if (segment->position >= segment->end) {
+        return 0;
+    }
+
+    return (segment->end - segment->position < length) ? segment->end - segment->position : length;
+}
+
+void advanceSegment(struct segmentedFile *file, struct fileSegment *segment, irc_dcc_size_t length) {
+    segment->position += length;
+
+    while (segment->nextRange < file->numRanges && getRangeOffset(file, segment->nextRange + 1) <= segment->position) {
+        markRangeDone(file, segment->nextRange);
+        segment->nextRange++;
+    }
+}
+
+void releaseSegment(struct segmentedFile *file, struct fileSegment *segment) {
+    struct fileSegment **current;
+
+    for (current = &file->segments; *current != NULL; current = &(*current)->next) {
+        if (*current == segment) {
+            *current = segment->next;
+            FREE(segment);
+            return;
+        }
+    }
+}
+
+void saveSegmentedFiles() {
+    struct segmentedFile *file;
+
+    for (file = segmentedFiles; file != NULL; file = file->next) {
+        if (file->dirty) {
+            saveBitmap(file);
+        }
+    }
+}
+
+void closeSegmentedFile(struct segmentedFile *file) {
+    struct segmentedFile **current;
+
+    if (isSegmentedFileComplete(file)) {
+        remove(file->bitmapPath);
+    }
+    else if (file->dirty) {
+        saveBitmap(file);
+    }
+
+    for (current = &segmentedFiles; *current != NULL; current = &(*current)->next) {
+        if (*current == file) {
+            *current = file->next;
+            break;
+        }
+    }
+
+    freeSegmentedFile(file);
+}
+
+void closeAllSegmentedFiles() {
+    while (segmentedFiles != NULL) {
+        closeSegmentedFile(segmentedFiles);
+    }
+}
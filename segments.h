@@ -0,0 +1,87 @@
+#ifndef SEGMENTS_H
+#define SEGMENTS_H
+
+#include "helper.h"
+
+/* the completion of a segmented file is tracked in ranges of this size. segments start at range boundaries. */
+#define SEGMENT_RANGE_SIZE (1024 * 1024)
+/* smaller files are downloaded from a single bot */
+#define SEGMENT_MIN_FILE_SIZE (16 * 1024 * 1024)
+/* a running segment is only split, if both halves get at least this many ranges */
+#define SEGMENT_MIN_SPLIT_RANGES 4
+/* the range bitmap is stored beside the file with this suffix, until the file is complete */
+#define SEGMENT_BITMAP_SUFFIX ".segments"
+
+/* the part of a segmented file, that a single bot sends. */
+struct fileSegment {
+    /* the ranges are marked as complete from here */
+    irc_dcc_size_t start;
+    /* the next byte, that is written */
+    irc_dcc_size_t position;
+    /* the transfer is stopped before this byte */
+    irc_dcc_size_t end;
+    /* the first range, that was not marked as complete by this segment yet */
+    uint32_t nextRange;
+    struct fileSegment *next;
+};
+
+/* a preallocated file, that several bots write at different offsets at the same time. */
+struct segmentedFile {
+    sds path;
+    sds bitmapPath;
+    irc_dcc_size_t fileSize;
+    uint32_t numRanges;
+    /* one char per range, 1 if the range was written completely, otherwise 0 */
+    sds ranges;
+    uint32_t numRangesDone;
+    /* the segments, that are transferred right now */
+    struct fileSegment *segments;
+    /* set, when ranges were completed since the bitmap was saved */
+    bool dirty;
+    struct segmentedFile *next;
+};
+
+/* opens the segmented file at path and preallocates it. the bitmap of an earlier run is loaded, so that only
+   the missing ranges are downloaded. the data of a file, that was downloaded without segments, is kept as well.
+   returns NULL, if the file cant be preallocated. */
+struct segmentedFile* openSegmentedFile(const char *path, irc_dcc_size_t fileSize);
+
+/* returns true, if a segmented download of path was interrupted, so that the file has its full size but is not complete. */
+bool hasSegmentBitmap(const char *path);
+
+/* gives the next bot a segment of the file. a missing part, that no bot sends, is preferred. otherwise the
+   biggest running segment is split in half. returns NULL, if nothing is left, that is worth a new transfer. */
+struct fileSegment* assignSegment(struct segmentedFile *file);
+
+/* returns true, if assignSegment would give a bot a segment. */
+bool canAssignSegment(struct segmentedFile *file);
+
+/* the bot resumed the segment at offset, which may differ from the requested position. */
+void moveSegment(struct fileSegment *segment, irc_dcc_size_t offset);
+
+/* returns the bytes of a received block, that belong to the segment. the rest of the block is dropped. */
+irc_dcc_size_t clampToSegment(struct fileSegment *segment, irc_dcc_size_t length);
+
+/* advances the segment by length written bytes and marks the ranges, that are complete now. */
+void advanceSegment(struct segmentedFile *file, struct fileSegment *segment, irc_dcc_size_t length);
+
+static inline bool isSegmentDone(struct fileSegment *segment) {
+    return segment->position >= segment->end;
+}
+
+/* ends the transfer of segment. its missing ranges can be assigned again. */
+void releaseSegment(struct segmentedFile *file, struct fileSegment *segment);
+
+static inline bool isSegmentedFileComplete(struct segmentedFile *file) {
+    return file->numRangesDone == file->numRanges;
+}
+
+/* writes the bitmaps of all segmented files, whose ranges changed. the data of the file must be flushed before. */
+void saveSegmentedFiles();
+
+/* saves the bitmap of file or removes it, if the file is complete, and frees file. */
+void closeSegmentedFile(struct segmentedFile *file);
+
+void closeAllSegmentedFiles();
+
+#endif
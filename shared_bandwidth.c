@@ -0,0 +1,304 @@
+#include "shared_bandwidth.h"
+#include "bandwidth.h"
+#include "os_specific.h"
+
+#ifndef _MSC_VER
+
+#include <stdatomic.h>
+#include <inttypes.h>
+
+#define SHARED_BANDWIDTH_MAGIC 0x78646363
+
+struct sharedBandwidthSlot {
+    /* 0 if the slot is free */
+    _Atomic int64_t pid;
+    _Atomic uint64_t heartbeat;
+    /* bytes taken from the bucket, that the process has not received yet */
+    _Atomic uint64_t leased;
+};
+
+struct sharedBandwidthSegment {
+    /* set by the creator of the segment, after everything else is initialised */
+    _Atomic uint32_t magic;
+    _Atomic uint64_t rate;
+    _Atomic uint64_t tokens;
+    _Atomic uint64_t lastRefill;
+    _Atomic uint64_t lastReap;
+    struct sharedBandwidthSlot slots[SHARED_BANDWIDTH_SLOTS];
+};
+
+static struct sharedBandwidthSegment *segment = NULL;
+static struct sharedBandwidthSlot *ownSlot = NULL;
+static int64_t ownPid = 0;
+static bool warnedAboutSlots = false;
+/* the time and the rate of the attach to a segment, that was not initialised yet */
+static uint64_t attachTime = 0;
+static irc_dcc_size_t attachRate = 0;
+
+static inline uint64_t min_u64(uint64_t a, uint64_t b) {
+    return (a < b) ? a : b;
+}
+
+static uint64_t getSharedCapacity() {
+    uint64_t capacity = (atomic_load(&segment->rate) * BANDWIDTH_BURST_MS) / 1000;
+    return (capacity < BANDWIDTH_MIN_BURST) ? BANDWIDTH_MIN_BURST : capacity;
+}
+
+static void addSharedTokens(uint64_t amount) {
+    uint64_t capacity = getSharedCapacity();
+    uint64_t tokens = atomic_load(&segment->tokens);
+    uint64_t newTokens;
+
+    do {
+        newTokens = min_u64(tokens + amount, capacity);
+    } while (!atomic_compare_exchange_weak(&segment->tokens, &tokens, newTokens));
+}
+
+static uint64_t takeSharedTokens(uint64_t amount) {
+    uint64_t tokens = atomic_load(&segment->tokens);
+    uint64_t taken;
+
+    do {
+        taken = min_u64(tokens, amount);
+    } while (!atomic_compare_exchange_weak(&segment->tokens, &tokens, tokens - taken));
+
+    return taken;
+}
+
+static void refillSharedBucket(uint64_t now) {
+    uint64_t lastRefill = atomic_load(&segment->lastRefill);
+
+    /* only the process that moves the refill time forward adds the tokens for the elapsed time */
+    if (now <= lastRefill || !atomic_compare_exchange_strong(&segment->lastRefill, &lastRefill, now)) {
+        return;
+    }
+
+    addSharedTokens((atomic_load(&segment->rate) * (now - lastRefill)) / 1000);
+}
+
+static void reapStaleLeases(uint64_t now) {
+    uint64_t lastReap = atomic_load(&segment->lastReap);
+    int i;
+
+    if (now < lastReap + SHARED_BANDWIDTH_REAP_INTERVAL_MS || !atomic_compare_exchange_strong(&segment->lastReap, &lastReap, now)) {
+        return;
+    }
+
+    for (i = 0; i < SHARED_BANDWIDTH_SLOTS; i++) {
+        struct sharedBandwidthSlot *slot = &segment->slots[i];
+        int64_t pid = atomic_load(&slot->pid);
+        uint64_t heartbeat = atomic_load(&slot->heartbeat);
+
+        if (pid == 0 || slot == ownSlot || heartbeat + SHARED_BANDWIDTH_LEASE_TIMEOUT_MS > now) {
+            continue;
+        }
+
+        if (atomic_compare_exchange_strong(&slot->pid, &pid, 0)) {
+            uint64_t leased = atomic_exchange(&slot->leased, 0);
+            addSharedTokens(leased);
+            logprintf(LOG_WARN, "reclaimed the bandwidth lease of %" PRIu64 " bytes from the xdccget process %" PRId64 ", which did not respond anymore.", leased, pid);
+        }
+    }
+}
+
+/* the slots of a new segment are zeroed already. */
+static void initSegment(irc_dcc_size_t rate, uint64_t now) {
+    atomic_store(&segment->rate, rate);
+    atomic_store(&segment->tokens, 0);
+    atomic_store(&segment->lastRefill, now);
+    atomic_store(&segment->lastReap, now);
+    atomic_store(&segment->magic, SHARED_BANDWIDTH_MAGIC);
+}
+
+/* the creator of the segment may have died, before it finished the initialisation. then the first process, that
+   waited long enough, initialises it. a creator, that was only slow, stores the same values again. */
+static bool isSegmentReady(uint64_t now) {
+    if (atomic_load(&segment->magic) == SHARED_BANDWIDTH_MAGIC) {
+        return true;
+    }
+
+    if (now < attachTime + SHARED_BANDWIDTH_INIT_TIMEOUT_MS) {
+        return false;
+    }
+
+    logprintf(LOG_WARN, "the creator of the shared bandwidth bucket did not initialise it within %d ms, initialising it again.", SHARED_BANDWIDTH_INIT_TIMEOUT_MS);
+    initSegment(attachRate, now);
+    return true;
+}
+
+/* makes sure, that this process owns a slot. the slot may have been reclaimed, if the process was suspended for a while. */
+static bool claimSlot(uint64_t now) {
+    int i;
+
+    if (ownSlot != NULL && atomic_load(&ownSlot->pid) == ownPid) {
+        return true;
+    }
+
+    ownSlot = NULL;
+
+    for (i = 0; i < SHARED_BANDWIDTH_SLOTS; i++) {
+        struct sharedBandwidthSlot *slot = &segment->slots[i];
+        int64_t pid = 0;
+
+        if (atomic_load(&slot->pid) != 0) {
+            continue;
+        }
+
+        atomic_store(&slot->heartbeat, now);
+        atomic_store(&slot->leased, 0);
+
+        if (atomic_compare_exchange_strong(&slot->pid, &pid, ownPid)) {
+            ownSlot = slot;
+            DBG_OK("using slot %d of the shared bandwidth bucket", i);
+            return true;
+        }
+    }
+
+    if (!warnedAboutSlots) {
+        logprintf(LOG_WARN, "all %d slots of the shared bandwidth bucket are in use, waiting for a free slot.", SHARED_BANDWIDTH_SLOTS);
+        warnedAboutSlots = true;
+    }
+
+    return false;
+}
+
+bool attachSharedBandwidth(const char *name, irc_dcc_size_t rate) {
+    bool created = false;
+    uint64_t now = getMonotonicTimeMs();
+
+    segment = mapSharedMemory(name, sizeof(struct sharedBandwidthSegment), &created);
+
+    if (segment == NULL) {
+        return false;
+    }
+
+    if (!atomic_is_lock_free(&segment->tokens) || !atomic_is_lock_free(&segment->slots[0].pid)) {
+        logprintf(LOG_ERR, "the shared bandwidth bucket needs lock free atomic operations, which are not available on this platform.");
+        unmapSharedMemory(segment, sizeof(struct sharedBandwidthSegment));
+        segment = NULL;
+        return false;
+    }
+
+    attachTime = now;
+    attachRate = rate;
+
+    if (created) {
+        initSegment(rate, now);
+    }
+    else if (atomic_load(&segment->magic) == SHARED_BANDWIDTH_MAGIC) {
+        setSharedBandwidthRate(rate);
+    }
+
+    ownPid = getProcessId();
+    logprintf(LOG_INFO, "sharing the bandwidth with the other xdccget processes on this host via %s.", name);
+
+    return true;
+}
+
+bool isSharedBandwidthAttached() {
+    return segment != NULL;
+}
+
+void setSharedBandwidthRate(irc_dcc_size_t rate) {
+    attachRate = rate;
+
+    uint64_t oldRate = atomic_exchange(&segment->rate, rate);
+
+    if (oldRate != rate) {
+        logprintf(LOG_INFO, "changed the host wide bandwidth limit from %" PRIu64 " to %" PRIu64 " bytes per second.", oldRate, (uint64_t) rate);
+    }
+}
+
+irc_dcc_size_t leaseSharedBandwidth(irc_dcc_size_t amount, uint64_t now) {
+    /* the creator of the segment has not finished the initialisation yet */
+    if (!isSegmentReady(now)) {
+        return 0;
+    }
+
+    if (!claimSlot(now)) {
+        return 0;
+    }
+
+    atomic_store(&ownSlot->heartbeat, now);
+    reapStaleLeases(now);
+    refillSharedBucket(now);
+
+    uint64_t taken = takeSharedTokens(amount);
+    atomic_fetch_add(&ownSlot->leased, taken);
+
+    return taken;
+}
+
+void consumeSharedBandwidth(irc_dcc_size_t amount) {
+    if (ownSlot == NULL) {
+        return;
+    }
+
+    uint64_t leased = atomic_load(&ownSlot->leased);
+
+    /* the lease may have been reclaimed in the meantime, so never go below zero */
+    while (!atomic_compare_exchange_weak(&ownSlot->leased, &leased, leased - min_u64(leased, amount)));
+}
+
+void settleSharedBandwidth(irc_dcc_size_t held) {
+    if (ownSlot == NULL) {
+        return;
+    }
+
+    uint64_t leased = atomic_load(&ownSlot->leased);
+
+    /* a process, that started with tokens of its own, may hold more than it leased */
+    while (leased > held && !atomic_compare_exchange_weak(&ownSlot->leased, &leased, held));
+
+    if (leased > held) {
+        addSharedTokens(leased - held);
+    }
+}
+
+void detachSharedBandwidth() {
+    if (segment == NULL) {
+        return;
+    }
+
+    if (ownSlot != NULL) {
+        int64_t pid = ownPid;
+
+        if (atomic_compare_exchange_strong(&ownSlot->pid, &pid, 0)) {
+            addSharedTokens(atomic_exchange(&ownSlot->leased, 0));
+        }
+
+        ownSlot = NULL;
+    }
+
+    unmapSharedMemory(segment, sizeof(struct sharedBandwidthSegment));
+    segment = NULL;
+}
+
+#else
+
+bool attachSharedBandwidth(const char *name, irc_dcc_size_t rate) {
+    logprintf(LOG_ERR, "sharing the bandwidth between xdccget processes is not supported in builds with visual studio.");
+    return false;
+}
+
+bool isSharedBandwidthAttached() {
+    return false;
+}
+
+void setSharedBandwidthRate(irc_dcc_size_t rate) {
+}
+
+irc_dcc_size_t leaseSharedBandwidth(irc_dcc_size_t amount, uint64_t now) {
+    return amount;
+}
+
+void consumeSharedBandwidth(irc_dcc_size_t amount) {
+}
+
+void settleSharedBandwidth(irc_dcc_size_t held) {
+}
+
+void detachSharedBandwidth() {
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SHARED_BANDWIDTH_H
+#define SHARED_BANDWIDTH_H
+
+#include "helper.h"
+
+#define SHARED_BANDWIDTH_DEFAULT_NAME "/xdccget-bandwidth"
+/* maximum number of xdccget processes, that can share the host wide bucket. */
+#define SHARED_BANDWIDTH_SLOTS 64
+/* a process that did not refresh its heartbeat for this time is treated as crashed and its lease is reclaimed. */
+#define SHARED_BANDWIDTH_LEASE_TIMEOUT_MS 5000
+/* how often the processes look for leases of crashed processes. */
+#define SHARED_BANDWIDTH_REAP_INTERVAL_MS 1000
+/* a segment, whose creator did not finish the initialisation in this time, is initialised again by the others. */
+#define SHARED_BANDWIDTH_INIT_TIMEOUT_MS 2000
+
+/* maps the host wide bucket from the shared memory segment name and registers this process at it.
+   rate is the host wide limit in bytes per second. returns false, if the segment can not be used. */
+bool attachSharedBandwidth(const char *name, irc_dcc_size_t rate);
+
+bool isSharedBandwidthAttached();
+
+/* changes the host wide limit for all processes. */
+void setSharedBandwidthRate(irc_dcc_size_t rate);
+
+/* takes up to amount bytes from the host wide bucket and leases them to this process.
+   also refreshes the heartbeat of this process and reclaims the leases of crashed processes. */
+irc_dcc_size_t leaseSharedBandwidth(irc_dcc_size_t amount, uint64_t now);
+
+/* marks amount bytes of the lease of this process as received. */
+void consumeSharedBandwidth(irc_dcc_size_t amount);
+
+/* held are the leased bytes, that this process still holds in its buckets. the part of the lease above it was
+   dropped by the caps of the buckets and goes back to the host wide bucket. */
+void settleSharedBandwidth(irc_dcc_size_t held);
+
+/* gives the unused lease back to the host wide bucket and frees the slot of this process. */
+void detachSharedBandwidth();
+
+#endif
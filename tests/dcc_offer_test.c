@@ -0,0 +1,200 @@
+/* checks the tokenizer of the dcc offers against a corpus of offers and against the sscanf cascade, that parsed
+   them before, and measures both. the cascade is kept here as it was in dcc.c. exits with 1, if an offer is parsed
+   wrong. */
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../libircclient-src/dcc_offer.c"
+#include "../libircclient-src/params.h"
+
+#define BENCH_ROUNDS 200000
+
+struct offerCase {
+    const char *req;
+    bool valid;
+    const char *verb;
+    const char *filename;
+    unsigned long ip;
+    unsigned short port;
+    irc_dcc_size_t size;
+    bool has_size;
+    unsigned long token;
+    bool has_token;
+    /* the old cascade parsed the offer the same way */
+    bool legacy;
+};
+
+static const struct offerCase corpus[] = {
+    { "DCC SEND file.mkv 3232235777 5000 1048576", true, "SEND", "file.mkv", 3232235777UL, 5000, 1048576, true, 0, false, true },
+    { "DCC SEND file.mkv 3232235777 5000", true, "SEND", "file.mkv", 3232235777UL, 5000, 0, false, 0, false, true },
+    { "DCC SEND \"my file.mkv\" 3232235777 5000 1048576", true, "SEND", "my file.mkv", 3232235777UL, 5000, 1048576, true, 0, false, true },
+    { "DCC SEND file.mkv 3232235777 0 1048576 42", true, "SEND", "file.mkv", 3232235777UL, 0, 1048576, true, 42, true, true },
+    { "DCC SEND big.iso 167772161 65535 18446744073709551615", true, "SEND", "big.iso", 167772161UL, 65535, UINT64_MAX, true, 0, false, true },
+    { "DCC SSEND file.mkv 3232235777 5000 1048576", true, "SSEND", "file.mkv", 3232235777UL, 5000, 1048576, true, 0, false, true },
+    { "DCC ACCEPT file.ext 5000 524288", true, "ACCEPT", "file.ext", 0, 5000, 524288, true, 0, false, true },
+    { "DCC ACCEPT file.ext 0 524288 42", true, "ACCEPT", "file.ext", 0, 0, 524288, true, 42, true, true },
+    /* the old cascade kept the quotes of a name without spaces and knew no other names in the answers to a resume */
+    { "DCC SEND \"file.mkv\" 3232235777 5000 1048576", true, "SEND", "file.mkv", 3232235777UL, 5000, 1048576, true, 0, false, false },
+    { "DCC ACCEPT \"my file.mkv\" 5000 524288", true, "ACCEPT", "my file.mkv", 0, 5000, 524288, true, 0, false, false },
+    /* the old cascade read no dotted or ipv6 addresses */
+    { "DCC SEND file.mkv 192.168.1.1 5000 1048576", true, "SEND", "file.mkv", 3232235777UL, 5000, 1048576, true, 0, false, false },
+    { "DCC SEND file.mkv 2001:db8::1 5000 1048576", true, "SEND", "file.mkv", 0, 5000, 1048576, true, 0, false, false },
+    /* the old cascade ignored the garbage behind a number or wrapped the numbers around */
+    { "DCC SEND file.mkv 3232235777 5000 1048576x", false, NULL, NULL, 0, 0, 0, false, 0, false, false },
+    { "DCC SEND file.mkv 3232235777 70000 1048576", false, NULL, NULL, 0, 0, 0, false, 0, false, false },
+    { "DCC SEND file.mkv 4294967296 5000 1048576", false, NULL, NULL, 0, 0, 0, false, 0, false, false },
+    { "DCC SEND file.mkv 3232235777 5000 -1", false, NULL, NULL, 0, 0, 0, false, 0, false, false },
+    { "DCC SEND file.mkv 3232235777", false, NULL, NULL, 0, 0, 0, false, 0, false, false },
+    { "DCC SEND \"\" 3232235777 5000 1048576", false, NULL, NULL, 0, 0, 0, false, 0, false, false },
+    { "DCC SEND", false, NULL, NULL, 0, 0, 0, false, 0, false, false },
+};
+
+#define NUM_CASES (sizeof(corpus) / sizeof(corpus[0]))
+
+/* the cascade of dcc.c before the tokenizer. filename must hold LIBIRC_BUFFER_SIZE + 1 chars. */
+static bool oldParseOffer(const char *req, libirc_dcc_offer_t *offer, char *filename) {
+    unsigned long ip = 0;
+    unsigned long token = 0;
+    irc_dcc_size_t size = 0;
+    unsigned short port = 0;
+
+    memset(offer, 0, sizeof (*offer));
+    filename[LIBIRC_BUFFER_SIZE] = '\0';
+    offer->filename = filename;
+    offer->verb = "SEND";
+
+    if (sscanf(req, "DCC SEND %" LIBIRC_BUFFER_SIZE_STR "s %lu 0 %" PRIu64 " %lu", filename, &ip, &size, &token) == 4) {
+        offer->has_size = true;
+        offer->has_token = true;
+    }
+    else if (sscanf(req, "DCC SEND %" LIBIRC_BUFFER_SIZE_STR "s %lu %hu %" PRIu64, filename, &ip, &port, &size) == 4) {
+        offer->has_size = true;
+    }
+    else if (sscanf(req, "DCC SEND \"%" LIBIRC_BUFFER_SIZE_STR "[^\"]\" %lu %hu %" PRIu64, filename, &ip, &port, &size) == 4) {
+        offer->has_size = true;
+    }
+    else if (sscanf(req, "DCC SEND %" LIBIRC_BUFFER_SIZE_STR "s %lu %hu", filename, &ip, &port) == 3) {
+        size = 0;
+    }
+    else if (sscanf(req, "DCC SSEND %" LIBIRC_BUFFER_SIZE_STR "s %lu %hu %" PRIu64, filename, &ip, &port, &size) == 4) {
+        offer->verb = "SSEND";
+        offer->ssl = USE_SSL;
+        offer->has_size = true;
+    }
+    else if (sscanf(req, "DCC ACCEPT file.ext 0 %" PRIu64 " %lu", &size, &token) == 2) {
+        offer->verb = "ACCEPT";
+        offer->filename = "file.ext";
+        offer->has_size = true;
+        offer->has_token = true;
+    }
+    else if (sscanf(req, "DCC ACCEPT file.ext %hu %" PRIu64, &port, &size) == 2) {
+        offer->verb = "ACCEPT";
+        offer->filename = "file.ext";
+        offer->has_size = true;
+    }
+    else {
+        return false;
+    }
+
+    offer->ip = ip;
+    offer->port = port;
+    offer->size = size;
+    offer->token = token;
+    return true;
+}
+
+static bool isExpectedOffer(const struct offerCase *c, const libirc_dcc_offer_t *offer) {
+    return strcmp(offer->verb, c->verb) == 0 && strcmp(offer->filename, c->filename) == 0 && offer->ip == c->ip
+        && offer->port == c->port && offer->has_size == c->has_size && (!c->has_size || offer->size == c->size)
+        && offer->has_token == c->has_token && offer->token == c->token;
+}
+
+static bool checkTokenizer(const struct offerCase *c) {
+    char req[LIBIRC_BUFFER_SIZE];
+    libirc_dcc_offer_t offer;
+    bool valid;
+
+    snprintf(req, sizeof(req), "%s", c->req);
+    valid = libirc_dcc_tokenize(req, &offer);
+
+    if (valid != c->valid || (valid && !isExpectedOffer(c, &offer))) {
+        fprintf(stderr, "the tokenizer parsed \"%s\" wrong\n", c->req);
+        return false;
+    }
+
+    return true;
+}
+
+static bool checkCascade(const struct offerCase *c) {
+    char filename[LIBIRC_BUFFER_SIZE + 1];
+    libirc_dcc_offer_t offer;
+
+    if (!oldParseOffer(c->req, &offer, filename) || !isExpectedOffer(c, &offer)) {
+        fprintf(stderr, "the old cascade and the tokenizer differ on \"%s\"\n", c->req);
+        return false;
+    }
+
+    return true;
+}
+
+static uint64_t getTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/* parses the offers, that both understand, BENCH_ROUNDS times and returns the mean time of an offer. */
+static double benchmark(bool tokenizer) {
+    char filename[LIBIRC_BUFFER_SIZE + 1];
+    char req[LIBIRC_BUFFER_SIZE];
+    libirc_dcc_offer_t offer;
+    uint64_t numParsed = 0;
+    uint64_t start = getTimeNs();
+    volatile unsigned long sink = 0;
+    uint32_t round;
+    size_t i;
+
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        for (i = 0; i < NUM_CASES; i++) {
+            if (!corpus[i].legacy) {
+                continue;
+            }
+
+            if (tokenizer) {
+                /* the tokenizer terminates the words in place, the copy is part of its cost in dcc.c as well */
+                strcpy(req, corpus[i].req);
+                libirc_dcc_tokenize(req, &offer);
+            }
+            else {
+                oldParseOffer(corpus[i].req, &offer, filename);
+            }
+
+            sink += offer.port;
+            numParsed++;
+        }
+    }
+
+    return (double) (getTimeNs() - start) / (double) numParsed;
+}
+
+int main() {
+    int failures = 0;
+    size_t i;
+
+    for (i = 0; i < NUM_CASES; i++) {
+        if (!checkTokenizer(&corpus[i])) {
+            failures++;
+        }
+
+        if (corpus[i].legacy && !checkCascade(&corpus[i])) {
+            failures++;
+        }
+    }
+
+    printf("%d of %zu offers parsed wrong\n", failures, NUM_CASES);
+    printf("sscanf cascade: %.1f ns per offer\n", benchmark(false));
+    printf("tokenizer:      %.1f ns per offer\n", benchmark(true));
+
+    return (failures == 0) ? 0 : 1;
+}
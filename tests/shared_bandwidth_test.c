@@ -0,0 +1,180 @@
+/* runs several processes against one host wide bucket. every process leases like the bandwidth limiter and a
+   mock sender delivers all leased bytes at once. checks, that the processes together stay at the host wide
+   rate, that a segment of a creator, that died before the initialisation, is taken over and that the dropped
+   part of a lease goes back to the bucket. exits with 1, if a check fails. */
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../shared_bandwidth.c"
+
+#define TEST_PROCESSES 4
+#define TEST_RATE (1024 * 1024)
+#define TEST_DURATION_MS 2000
+#define TEST_TICK_MS 10
+
+static struct xdccGetConfig testConfig;
+
+struct xdccGetConfig *getCfg() {
+    return &testConfig;
+}
+
+void exitPgm(int retCode) {
+    exit(retCode);
+}
+
+static void sleepMs(uint64_t ms) {
+    struct timespec ts = { (time_t) (ms / 1000), (long) (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static void getTestName(char *name, size_t size, const char *test) {
+    snprintf(name, size, "/xdccget-test-%s-%" PRId64, test, getProcessId());
+}
+
+/* leases like refillBandwidthBuckets for TEST_DURATION_MS and returns the received bytes. the mock sender
+   delivers every leased byte in the same tick. */
+static uint64_t runMockReceiver(const char *name) {
+    uint64_t start = getMonotonicTimeMs();
+    uint64_t received = 0;
+    uint64_t now;
+
+    if (!attachSharedBandwidth(name, TEST_RATE)) {
+        return 0;
+    }
+
+    while ((now = getMonotonicTimeMs()) < start + TEST_DURATION_MS) {
+        irc_dcc_size_t taken = leaseSharedBandwidth(TEST_RATE, now);
+
+        consumeSharedBandwidth(taken);
+        received += taken;
+        sleepMs(TEST_TICK_MS);
+    }
+
+    detachSharedBandwidth();
+    return received;
+}
+
+static bool testHostWideRate() {
+    char name[64];
+    pid_t children[TEST_PROCESSES];
+    int fds[2];
+    uint64_t total = 0;
+    int i;
+
+    getTestName(name, sizeof(name), "rate");
+
+    if (pipe(fds) == -1) {
+        return false;
+    }
+
+    for (i = 0; i < TEST_PROCESSES; i++) {
+        children[i] = fork();
+
+        if (children[i] == 0) {
+            uint64_t received = runMockReceiver(name);
+            _exit(write(fds[1], &received, sizeof(received)) == sizeof(received) ? 0 : 1);
+        }
+    }
+
+    close(fds[1]);
+
+    for (i = 0; i < TEST_PROCESSES; i++) {
+        uint64_t received = 0;
+
+        if (read(fds[0], &received, sizeof(received)) == sizeof(received)) {
+            total += received;
+        }
+
+        waitpid(children[i], NULL, 0);
+    }
+
+    close(fds[0]);
+    shm_unlink(name);
+
+    /* the bucket starts empty and holds at most a burst */
+    uint64_t limit = (uint64_t) TEST_RATE * TEST_DURATION_MS / 1000 + (TEST_RATE * BANDWIDTH_BURST_MS) / 1000;
+    uint64_t lowest = limit * 3 / 4;
+
+    printf("%d processes received %" PRIu64 " bytes in %d ms at a host wide limit of %d bytes per second\n",
+        TEST_PROCESSES, total, TEST_DURATION_MS, TEST_RATE);
+
+    return total <= limit && total >= lowest;
+}
+
+static bool testDeadCreator() {
+    char name[64];
+    bool created = false;
+    bool passed;
+    pid_t child;
+
+    getTestName(name, sizeof(name), "creator");
+
+    /* the creator dies right after it created the segment */
+    child = fork();
+
+    if (child == 0) {
+        _exit(mapSharedMemory(name, sizeof(struct sharedBandwidthSegment), &created) != NULL && created ? 0 : 1);
+    }
+
+    waitpid(child, NULL, 0);
+
+    if (!attachSharedBandwidth(name, TEST_RATE)) {
+        shm_unlink(name);
+        return false;
+    }
+
+    passed = leaseSharedBandwidth(TEST_RATE, getMonotonicTimeMs()) == 0;
+    sleepMs(SHARED_BANDWIDTH_INIT_TIMEOUT_MS + 100);
+    leaseSharedBandwidth(TEST_RATE, getMonotonicTimeMs());
+    sleepMs(100);
+    passed = passed && leaseSharedBandwidth(TEST_RATE, getMonotonicTimeMs()) != 0;
+
+    detachSharedBandwidth();
+    shm_unlink(name);
+
+    printf("a segment of a dead creator was %staken over\n", passed ? "" : "not ");
+    return passed;
+}
+
+static bool testSettledLease() {
+    char name[64];
+    irc_dcc_size_t taken;
+    uint64_t tokens;
+    bool passed;
+
+    getTestName(name, sizeof(name), "settle");
+
+    if (!attachSharedBandwidth(name, TEST_RATE)) {
+        shm_unlink(name);
+        return false;
+    }
+
+    leaseSharedBandwidth(TEST_RATE, getMonotonicTimeMs());
+    sleepMs(100);
+    taken = leaseSharedBandwidth(TEST_RATE, getMonotonicTimeMs());
+
+    /* the buckets of the process dropped all but a quarter of the lease */
+    tokens = atomic_load(&segment->tokens);
+    settleSharedBandwidth(taken / 4);
+    passed = taken != 0 && atomic_load(&ownSlot->leased) == taken / 4
+        && atomic_load(&segment->tokens) == min_u64(tokens + taken - taken / 4, getSharedCapacity());
+
+    detachSharedBandwidth();
+    shm_unlink(name);
+
+    printf("the dropped part of a lease of %" PRIu64 " bytes was %sgiven back\n", (uint64_t) taken, passed ? "" : "not ");
+    return passed;
+}
+
+int main() {
+    int failures = 0;
+
+    testConfig.logLevel = LOG_ERR;
+
+    failures += testHostWideRate() ? 0 : 1;
+    failures += testDeadCreator() ? 0 : 1;
+    failures += testSettledLease() ? 0 : 1;
+
+    return (failures == 0) ? 0 : 1;
+}
@@ -11,35 +11,34 @@
 #include "helper.h"
 #include "file.h"
 #include "config.h"
+#include "bandwidth.h"
+#include "schedule.h"
+#include "queue.h"
+#include "journal.h"
+#include "control.h"
+#include "network.h"
+#include "segments.h"
+#include "concurrency.h"
+#include "history.h"
+#include "notice_matcher.h"
 #include "os_specific.h"
 
 #define NICKLEN 24
-
-#ifdef _MSC_VER
-int usleep(DWORD usec)
-{
-    HANDLE timer;
-    LARGE_INTEGER ft;
-
-    ft.QuadPart = -(10 * (__int64)usec);
-
-    timer = CreateWaitableTimer(NULL, TRUE, NULL);
-    if (timer != NULL) {
-        SetWaitableTimer(timer, &ft, 0, NULL, NULL, 0);
-        WaitForSingleObject(timer, INFINITE);
-        CloseHandle(timer);
-    }
-    return 0;
-}
-#endif
+/* the network of the command line and the networks of the config file, that are connected at the same time */
+#define MAX_NETWORKS 16
+/* the context of a finished transfer is kept for this time, so that libircclient can still
+   confirm the last offset and close the dcc session, before the context is freed. */
+#define FINISHED_DOWNLOAD_LINGER_MS 5000
 
 static struct xdccGetConfig cfg;
 
+/* the transfers, that are running right now */
 static uint32_t numActiveDownloads = 0;
-static uint32_t finishedDownloads = 0;
+static uint32_t downloadContextSize = 0;
 static struct dccDownloadContext **downloadContext = NULL;
-static struct dccDownloadProgress *lastDownload = NULL;
-static struct dccDownloadProgress *curDownload = NULL;
+static struct dccDownloadContext *finishedDownloads = NULL;
+static sds lastDownloadPath = NULL;
+static bool queueDrained = false;
 
 void on_connect_event(irc_session_t* session);
 
@@ -47,11 +46,57 @@ struct xdccGetConfig *getCfg() {
     return &cfg;
 }
 
+static void freeDownloadContext(struct dccDownloadContext *context) {
+    if (context->progress != NULL) {
+        freeDccProgress(context->progress);
+    }
+
+    Close(context->fd);
+    FREE(context);
+}
+
+/* frees the contexts of finished transfers after FINISHED_DOWNLOAD_LINGER_MS or all of them, if force is set. */
+static void freeFinishedDownloads(bool force) {
+    uint64_t now = getMonotonicTimeMs();
+    struct dccDownloadContext **current = &finishedDownloads;
+
+    while (*current != NULL) {
+        struct dccDownloadContext *context = *current;
+
+        if (!force && now < context->finishTime + FINISHED_DOWNLOAD_LINGER_MS) {
+            current = &context->nextFinished;
+            continue;
+        }
+
+        *current = context->nextFinished;
+
+        /* the dcc session may be stuck, e.g. if the bot does not close the connection. then no callback must reach the context anymore */
+        if (!force) {
+            irc_dcc_destroy(context->session, context->dccid);
+        }
+
+        freeDownloadContext(context);
+    }
+}
+
+/* records the received bytes of the running transfers in the journal. */
+static void journalDownloadProgresses() {
+    uint32_t i;
+
+    for (i = 0; i < numActiveDownloads; i++) {
+        /* a resumed transfer has no offset, until the bot accepted the resume. segments are recorded in their bitmap */
+        if (downloadContext[i]->download != NULL && downloadContext[i]->segment == NULL && downloadContext[i]->progress->sizeRcvd != 0) {
+            journalDownloadProgress(downloadContext[i]->download, downloadContext[i]->progress->sizeRcvd);
+        }
+    }
+}
+
 void doCleanUp() {
     uint32_t i;
 
-    if (cfg.session)
-        irc_destroy_session(cfg.session);
+    freeNetworks(cfg.networks);
+    cfg.networks = NULL;
+    cfg.session = NULL;
 
     for (i = 0; i < cfg.numChannels; i++) {
         sdsfree(cfg.channelsToJoin[i]);
@@ -63,28 +108,34 @@ void doCleanUp() {
         }
     }
 
-    for (i = 0; i < cfg.numDownloads && downloadContext[i]; i++) {
-        struct dccDownloadContext *current_context = downloadContext[i];
-        struct dccDownloadProgress *current_progress = current_context->progress;
-
-        if (current_progress != NULL) {
-            bool finishedDownloading = current_progress->sizeRcvd == current_progress->completeFileSize;
+    /* the journal is closed by freeDownloadQueue with the last progress of the transfers */
+    journalDownloadProgresses();
 
-            if (!finishedDownloading) {
-                Close(current_context->fd);
-                current_context->fd = NULL;
-            }
-
-            freeDccProgress(current_context->progress);
-        }
-
-        FREE(downloadContext[i]);
+    for (i = 0; i < numActiveDownloads; i++) {
+        freeDownloadContext(downloadContext[i]);
     }
 
+    numActiveDownloads = 0;
+    closeControlSocket();
+    freeFinishedDownloads(true);
+    /* the files of the transfers are closed, so that the bitmaps only record written ranges */
+    closeAllSegmentedFiles();
+    saveHistory();
+    freeHistory();
+    freeDownloadQueue();
+    freeBandwidthLimiter();
+    freeThrottleSchedule(cfg.throttleSchedule);
+    freeNoticePatterns(cfg.noticePatterns);
+    freeNoticeMatcher();
+
     sdsfree(cfg.targetDir);
     sdsfree(cfg.nick);
     sdsfree(cfg.login_command);
     sdsfree(cfg.listen_ip);
+    sdsfree(cfg.sharedBandwidthName);
+    sdsfree(cfg.queueFile);
+    sdsfree(cfg.controlSocket);
+    sdsfree(lastDownloadPath);
     FREE(cfg.dccDownloadArray);
     FREE(cfg.channelsToJoin);
     FREE(downloadContext);
@@ -95,11 +146,12 @@ void exitPgm(int retCode) {
     exit(retCode);
 }
 
+void reload_handler(int signum) {
+    requestConfigReload();
+}
+
 void interrupt_handler(int signum) {
-    if (cfg.session && irc_is_connected(cfg.session)) {
-        irc_cmd_quit(cfg.session, "Goodbye!");
-    }
-    else {
+    if (!quitNetworks(&cfg, "Goodbye!")) {
         exitPgm(0);
     }
 }
@@ -140,74 +192,32 @@ void output_handler(int signum) {
     cfg_set_bit(getCfg(), OUTPUT_FLAG);
 }
 
-static sds extractMD5(const char* string) {
-    const unsigned int MD5_STR_SIZE = 32;
-    char md5ChecksumString[33];
-    md5ChecksumString[MD5_STR_SIZE] = (char)0;
-
-    char* md5sum = strstr(string, "md5sum");
-
-    if (md5sum != NULL) {
-        strncpy(md5ChecksumString, md5sum + 8, MD5_STR_SIZE);
-        return sdsnew(md5ChecksumString);
-    }
-
-    md5sum = strstr(string, "MD5");
-
-    if (md5sum != NULL) {
-        strncpy(md5ChecksumString, md5sum + 4, MD5_STR_SIZE);
-        return sdsnew(md5ChecksumString);
-    }
-
-    md5sum = strstr(string, "md5");
-
-    if (md5sum != NULL) {
-        strncpy(md5ChecksumString, md5sum + 4, MD5_STR_SIZE);
-        return sdsnew(md5ChecksumString);
-    }
-
-    return NULL;
-}
-
-static void checkMD5ChecksumNotice(const char * event, irc_parser_result_t *result) {
-    if (!str_equals(event, "NOTICE")) {
+static void checkMD5ChecksumNotice(irc_session_t *session, irc_parser_result_t *result, struct noticeMatch *match) {
+    if (match->md5[0] == '\0') {
         return;
     }
 
-    if (result->num_params != 2) {
-        return;
-    }
+    sds md5ChecksumSDS = sdsnew(match->md5);
 
-    sds md5ChecksumSDS = extractMD5(result->params[1]);
+    /* the checksum belongs to the running request of the bot or otherwise to the last finished download */
+    struct dccDownload *download = (result->nick != NULL) ? findRequestedDownload(getSessionNetwork(session)->name, result->nick) : NULL;
 
-    if (md5ChecksumSDS == NULL) {
+    if (download != NULL) {
+        sdsfree(download->md5);
+        download->md5 = md5ChecksumSDS;
         return;
     }
 
-    if (lastDownload == NULL) {
-        if (cfg.numDownloads == 1) {
-            cfg.dccDownloadArray[0]->md5 = md5ChecksumSDS;
-        }
+    if (lastDownloadPath == NULL) {
+        sdsfree(md5ChecksumSDS);
         return;
     }
 
-    startChecksumThread(md5ChecksumSDS, sdsdup(lastDownload->completePath));
+    startChecksumThread(md5ChecksumSDS, sdsdup(lastDownloadPath));
 }
 
-static void check_connected_event(irc_session_t* session, const char* event, irc_parser_result_t* result) {
-    if (!str_equals(event, "NOTICE")) {
-        return;
-    }
-
-    if (result->num_params != 2) {
-        return;
-    }
-
-    const char *event_string = result->params[1];
-
-    char *found = strstr(event_string, "You are connected");
-
-    if (found != NULL) {
+static void check_connected_event(irc_session_t* session, struct noticeMatch *match) {
+    if (match->connected) {
         on_connect_event(session);
     }
 }
@@ -230,58 +240,181 @@ void dump_event (irc_session_t * session, const char * event, irc_parser_result_
     sdsfree(param_string);
 }
 
-static void join_channels(irc_session_t *session) {
-    for (uint32_t i = 0; i < cfg.numChannels; i++) {
-        logprintf(LOG_INFO, "joining %s\n", cfg.channelsToJoin[i]);
-        irc_cmd_join (session, cfg.channelsToJoin[i], 0);
+/* logs, how long the network needed for a phase of the startup since the connect. each phase is logged once. */
+static void logStartupPhase(struct ircNetwork *network, uint64_t *phaseTime, const char *phase) {
+    if (*phaseTime != 0) {
+        return;
     }
+
+    *phaseTime = getMonotonicTimeMs();
+    logprintf(LOG_INFO, "startup of %s: %s %" PRIu64 " ms after the connect.", getNetworkName(network), phase, *phaseTime - network->startup.connect);
 }
 
-static void send_xdcc_requests(irc_session_t *session) {
-    int i;
-    if (!cfg_get_bit(&cfg, SENDED_FLAG)) {
-        for (i = 0; cfg.dccDownloadArray[i] != NULL; i++) {
-            char *botNick = cfg.dccDownloadArray[i]->botNick;
-            char *xdccCommand = cfg.dccDownloadArray[i]->xdccCmd;
+static bool isChannelToJoin(struct ircNetwork *network, const char *channel) {
+    for (uint32_t i = 0; i < network->numChannels; i++) {
+        if (strcasecmp(network->channelsToJoin[i], channel) == 0) {
+            return true;
+        }
+    }
 
-            logprintf(LOG_INFO, "/msg %s %s\n", botNick, xdccCommand);
-            bool cmdSendingFailed = irc_cmd_msg(session, botNick, xdccCommand) == 1;
+    return false;
+}
 
-            if (cmdSendingFailed) {
-                logprintf(LOG_ERR, "Cannot send xdcc command to bot!");
-            }
-        }
+/* the replies, with that a server refuses a join */
+static inline bool isJoinError(int numeric) {
+    switch (numeric) {
+        case 403: case 405: case 437: case 471: case 473: case 474: case 475: case 477: case 489:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* opens the download queue for the network of session. the first requests are sent at once,
+   the others when a slot of the window is free. */
+static void send_xdcc_requests(irc_session_t *session) {
+    struct ircNetwork *network = getSessionNetwork(session);
 
+    if (!network->requestsSent) {
+        logStartupPhase(network, &network->startup.requestsSent, "sent the first requests");
+        network->requestsSent = true;
         cfg_set_bit(&cfg, SENDED_FLAG);
+        startQueuedDownloads();
     }
 }
 
-static inline bool isPasswordAccepted(const char *message) {
-    const char *password_sequences[] = {
-        "Password accepted",
-        "You are now identified",
-        "I recognize you"
-    };
+/* quits, when all requests of the queue are done. with checksum verification or in the daemon mode xdccget stays connected. */
+static void quitIfQueueDrained() {
+    if (queueDrained || cfg_get_bit(&cfg, DAEMON_FLAG) || !cfg_get_bit(&cfg, SENDED_FLAG) || numActiveDownloads != 0 || !isDownloadQueueDrained()) {
+        return;
+    }
 
-    size_t num_sequences = sizeof(password_sequences) / sizeof(const char*);
-    for (size_t i = 0; i < num_sequences; i++) {
-        char *t = strstr(message, password_sequences[i]);
-        if (t != NULL) {
-            return true;
+    queueDrained = true;
+    enableAlarm(0);
+
+    if (!cfg_get_bit(&cfg, VERIFY_CHECKSUM_FLAG)) {
+        quitNetworks(&cfg, "Goodbye!");
+    }
+}
+
+/* sends the requests, when the server answered every join. the networks with a login command wait for voice instead. */
+static void checkChannelsJoined(irc_session_t *session) {
+    struct ircNetwork *network = getSessionNetwork(session);
+
+    if (network->numChannelsSettled < network->numChannels) {
+        return;
+    }
+
+    logStartupPhase(network, &network->startup.joined, "joined the channels");
+
+    /* a network, that joins after the send delay, sends its requests right away */
+    if (cfg.sendDelay == NULL || cfg_get_bit(&cfg, SENDED_FLAG)) {
+        if (network->loginCommand == NULL) {
+            send_xdcc_requests(session);
         }
     }
+}
 
-    return false;
+/* joins the channels with as few JOIN lines as possible, so that the server answers them at once. a network, that logged
+   in with sasl, has joined already, when NickServ sets +r. */
+static void join_channels(irc_session_t *session) {
+    struct ircNetwork *network = getSessionNetwork(session);
+
+    if (network->startup.joinsSent != 0) {
+        return;
+    }
+
+    sds channels = sdsempty();
+
+    for (uint32_t i = 0; i < network->numChannels; i++) {
+        if (sdslen(channels) != 0 && sdslen(channels) + 1 + sdslen(network->channelsToJoin[i]) > NETWORK_JOIN_LIST_MAX) {
+            logprintf(LOG_INFO, "joining %s on %s", channels, getNetworkName(network));
+            irc_cmd_join(session, channels, 0);
+            sdsclear(channels);
+        }
+
+        if (sdslen(channels) != 0) {
+            channels = sdscat(channels, ",");
+        }
+
+        channels = sdscatsds(channels, network->channelsToJoin[i]);
+    }
+
+    if (sdslen(channels) != 0) {
+        logprintf(LOG_INFO, "joining %s on %s", channels, getNetworkName(network));
+        irc_cmd_join(session, channels, 0);
+    }
+
+    sdsfree(channels);
+    logStartupPhase(network, &network->startup.joinsSent, "sent the joins");
+
+    /* a network without channels need not wait */
+    checkChannelsJoined(session);
 }
 
+/* a server, that does not answer all joins, does not keep the requests back for ever. */
+static void checkJoinTimeouts() {
+    struct ircNetwork *network;
+    uint64_t now = getMonotonicTimeMs();
+
+    for (network = cfg.networks; network != NULL; network = network->next) {
+        if (network->startup.joinsSent != 0 && network->startup.joined == 0 && now >= network->startup.joinsSent + NETWORK_JOIN_TIMEOUT_MS
+                && isNetworkUsable(network)) {
+            logprintf(LOG_WARN, "%s did not answer all joins within %d seconds. sending the requests anyway.", getNetworkName(network), NETWORK_JOIN_TIMEOUT_MS / 1000);
+            network->numChannelsSettled = network->numChannels;
+            checkChannelsJoined(network->session);
+        }
+    }
+}
+
+/* a network, whose server does not set +r, joins, when nickserv accepted the password of the login command. */
+static void checkPasswordAccepted(irc_session_t *session, struct noticeMatch *match) {
+    if (match->passwordAccepted && getSessionNetwork(session)->loginCommand != NULL) {
+        join_channels(session);
+    }
+}
+
+/* the answers of the bots tell the queue, whether a request is queued, refused for now or will be sent. */
+static void checkBotNotice(irc_session_t *session, irc_parser_result_t *result, struct noticeMatch *match) {
+    if (result->nick == NULL) {
+        return;
+    }
+
+    handleBotNotice(getSessionNetwork(session)->name, result->nick, match);
+
+    /* a refused or invalid request frees a slot of the window */
+    startQueuedDownloads();
+    quitIfQueueDrained();
+}
+
+/* the notice is searched once for the patterns of the bots, the checksums, the server and nickserv. */
 void event_notice(irc_session_t * session, const char * event, irc_parser_result_t *result) {
+    struct noticeMatch match;
+
     dump_event(session, event, result);
-    checkMD5ChecksumNotice(event, result);
-    check_connected_event(session, event, result);
+
+    if (result->num_params != 2) {
+        return;
+    }
+
+    /* the colors of the bots would split the patterns */
+    char *message = irc_color_strip_from_mirc(result->params[1]);
+
+    if (message == NULL) {
+        return;
+    }
+
+    matchNotice(message, &match);
+    free(message);
+
+    checkMD5ChecksumNotice(session, result, &match);
+    checkBotNotice(session, result, &match);
+    checkPasswordAccepted(session, &match);
+    check_connected_event(session, &match);
 }
 
 void event_mode(irc_session_t * session, const char * event, irc_parser_result_t *result) {
-    if (cfg.login_command != NULL && result->num_params > 1) {
+    if (getSessionNetwork(session)->loginCommand != NULL && result->num_params > 1) {
         if (str_equals(result->params[1], "+v")) {
             send_xdcc_requests(session);
         }
@@ -290,7 +423,7 @@ void event_mode(irc_session_t * session, const char * event, irc_parser_result_t
 }
 
 void event_umode(irc_session_t * session, const char * event, irc_parser_result_t *result) {
-    if (cfg.login_command != NULL) {
+    if (getSessionNetwork(session)->loginCommand != NULL) {
         if (str_equals(result->params[0], "+r")) {
             join_channels(session);
         }
@@ -298,27 +431,29 @@ void event_umode(irc_session_t * session, const char * event, irc_parser_result_
 }
 
 
+/* only our own joins pass the line filter. a channel, that the server joined us to, is not waited for */
 void event_join (irc_session_t * session, const char * event, irc_parser_result_t *result)
 {
-    irc_cmd_user_mode (session, "+i");
+    struct ircNetwork *network = getSessionNetwork(session);
 
-    if (cfg.sendDelay == NULL) {
-        if (cfg.login_command == NULL) {
-            send_xdcc_requests(session);
-        }
+    if (result->num_params > 0 && isChannelToJoin(network, result->params[0])) {
+        network->numChannelsSettled++;
+        checkChannelsJoined(session);
     }
 }
 
 static void send_login_command(irc_session_t *session) {
-    cfg.login_command = sdstrim(cfg.login_command, " \t");
+    struct ircNetwork *network = getSessionNetwork(session);
+    network->loginCommand = sdstrim(network->loginCommand, " \t");
 
-    if (sdslen(cfg.login_command) >= 9) {
-        sds user = sdsdup(cfg.login_command);
-        sds auth_command = sdsdup(cfg.login_command);
+    if (sdslen(network->loginCommand) >= 9) {
+        sds user = sdsdup(network->loginCommand);
+        sds auth_command = sdsdup(network->loginCommand);
         sdsrange(user, 0, 8);
         sdsrange(auth_command, 9, sdslen(auth_command));
 
-        logprintf(LOG_INFO, "sending login-command: %s", cfg.login_command);
+        logprintf(LOG_INFO, "sending login-command: %s", network->loginCommand);
+        logStartupPhase(network, &network->startup.loginSent, "sent the login");
 
         bool cmdSendingFailed = irc_cmd_msg(session, user, auth_command) == 1;
 
@@ -334,8 +469,9 @@ static void send_login_command(irc_session_t *session) {
 }
 
 void on_connect_event(irc_session_t* session) {
+    struct ircNetwork *network = getSessionNetwork(session);
 
-    if (cfg_get_bit(&cfg, ON_CONNECT_EVENT_DONE)) {
+    if (network->connectEventDone) {
         return;
     }
 
@@ -343,14 +479,16 @@ void on_connect_event(irc_session_t* session) {
     logprintf(LOG_INFO, "using cipher suite: %s", irc_get_ssl_ciphers_used(session));
 #endif
 
-    if (cfg.login_command != NULL) {
+    irc_cmd_user_mode (session, "+i");
+
+    if (network->loginCommand != NULL && !irc_is_sasl_authenticated(session)) {
         send_login_command(session);
     }
     else {
         join_channels(session);
     }
 
-    cfg_set_bit(&cfg, ON_CONNECT_EVENT_DONE);
+    network->connectEventDone = true;
 }
 
 void event_connect (irc_session_t *session, const char * event, irc_parser_result_t *result)
@@ -375,6 +513,7 @@ void event_numeric (irc_session_t * session, unsigned int event, irc_parser_resu
     snprintf (buf, sizeof(buf), "%d", event);
 
     if (event == 1 && result->num_params >= 2) {
+        logStartupPhase(getSessionNetwork(session), &getSessionNetwork(session)->startup.welcome, "was welcomed");
         dump_event (session, buf, result);
         char* ipaddr = strrchr(result->params[1], '@');
         if (ipaddr) {
@@ -389,41 +528,366 @@ void event_numeric (irc_session_t * session, unsigned int event, irc_parser_resu
                 logprintf(LOG_INFO, "using the external ip address %s for passive dcc connections!", conv);
             }
         }
+
+        /* the registration is done with the welcome. the end of the motd is not waited for */
+        on_connect_event(session);
+    }
+    else if (isJoinError(event) && result->num_params >= 3 && isChannelToJoin(getSessionNetwork(session), result->params[1])) {
+        logprintf(LOG_WARN, "could not join %s on %s: %s", result->params[1], getNetworkName(getSessionNetwork(session)), result->params[result->num_params - 1]);
+        getSessionNetwork(session)->numChannelsSettled++;
+        checkChannelsJoined(session);
     }
 }
 
 static bool isValidRequestFromNick(irc_session_t *session, const char *botNick) {
-    unsigned int i = 0;
-    
-    struct dccDownload **dccDownloads = cfg.dccDownloadArray;
+    if (cfg_get_bit(&cfg, ACCEPT_ALL_NICKS_FLAG)) {
+        return true;
+    }
+
+    return isRequestedBot(getSessionNetwork(session)->name, botNick);
+}
+
+static void addDownloadContext(struct dccDownloadContext *context) {
+    if (numActiveDownloads == downloadContextSize) {
+        downloadContextSize = (downloadContextSize == 0) ? 4 : downloadContextSize * 2;
+        downloadContext = Realloc(downloadContext, downloadContextSize * sizeof(struct dccDownloadContext*));
+    }
+
+    downloadContext[numActiveDownloads] = context;
+    numActiveDownloads++;
+}
+
+static void removeDownloadContext(struct dccDownloadContext *context) {
+    uint32_t i;
+
+    for (i = 0; i < numActiveDownloads; i++) {
+        if (downloadContext[i] == context) {
+            memmove(&downloadContext[i], &downloadContext[i + 1], (numActiveDownloads - i - 1) * sizeof(struct dccDownloadContext*));
+            numActiveDownloads--;
+            return;
+        }
+    }
+}
+
+/* adds the transfer of context to the history of its bot. */
+static void recordTransfer(struct dccDownloadContext *context, bool failed) {
+    struct dccDownload *download = context->download;
+    uint64_t now = getMonotonicTimeMs();
+    struct transferStats stats;
+
+    if (download == NULL) {
+        return;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    stats.failed = failed;
+    stats.peakSpeed = context->peakSpeed;
+
+    if (context->firstByteTime != 0) {
+        stats.bytes = context->progress->sizeRcvd - context->firstByteOffset;
+        stats.durationMs = now - context->firstByteTime;
+        stats.firstByteMs = context->firstByteTime - context->offerTime;
+    }
+    else {
+        stats.firstByteMs = now - context->offerTime;
+    }
+
+    recordTransferHistory(download->network, download->botNick, &stats);
+}
+
+/* stops the transfer of context. the context is freed after FINISHED_DOWNLOAD_LINGER_MS. */
+static void retireDownloadContext(struct dccDownloadContext *context) {
+    context->finished = true;
+    context->finishTime = getMonotonicTimeMs();
+
+    Close(context->fd);
+    context->fd = NULL;
+    detachDownloadBandwidth(context);
+    removeDownloadContext(context);
+
+    if (context->segment != NULL) {
+        releaseSegment(context->segmentedFile, context->segment);
+        context->segment = NULL;
+        context->segmentedFile = NULL;
+    }
+
+    context->nextFinished = finishedDownloads;
+    finishedDownloads = context;
+}
+
+/* ends the transfer of context and gives its slot in the window to the next request of the queue.
+   completed is false, if the transfer failed. */
+static void finishDownload(struct dccDownloadContext *context, bool completed) {
+    retireDownloadContext(context);
+
+    finishQueuedDownload(context->download, completed);
+    context->download = NULL;
+
+    startQueuedDownloads();
+    quitIfQueueDrained();
+}
+
+static void completeDownload(struct dccDownload *download, sds completePath) {
+    printf("\nDownload completed!\n");
+    fflush(NULL);
+
+    sdsfree(lastDownloadPath);
+    lastDownloadPath = sdsdup(completePath);
+
+    if (cfg_get_bit(&cfg, VERIFY_CHECKSUM_FLAG) && download != NULL && download->md5 != NULL) {
+        startChecksumThread(download->md5, sdsdup(lastDownloadPath));
+        download->md5 = NULL;
+    }
+}
+
+/* ends the transfer of a segment. the bot is asked for the next segment, if one is left. when the last
+   segment was written, the request of the file is finished. completed is false, if the transfer failed. */
+static void finishSegment(struct dccDownloadContext *context, bool completed) {
+    struct dccDownload *source = context->download;
+    struct dccDownload *download = (source->segmentOf != NULL) ? source->segmentOf : source;
+    struct segmentedFile *file = context->segmentedFile;
+
+    retireDownloadContext(context);
+    context->download = NULL;
+
+    if (isSegmentedFileComplete(file)) {
+        completeDownload(download, file->path);
+        finishQueuedDownload(download, true);
+    }
+    else if (completed && canAssignSegment(file)) {
+        /* the bot counts the open transfer against its limit per user and would refuse the next request */
+        irc_dcc_destroy(context->session, context->dccid);
+        restartSegmentRequest(source);
+    }
+    else {
+        dropSegmentSource(source);
+    }
 
-    if (dccDownloads == NULL) {
+    startQueuedDownloads();
+    quitIfQueueDrained();
+}
+
+/* aborts the transfers of all bots, that send segments of the file of download. */
+static void abortSegmentedDownload(struct dccDownload *download) {
+    uint32_t i = numActiveDownloads;
+
+    while (i > 0) {
+        struct dccDownloadContext *context = downloadContext[--i];
+
+        if (context->download != NULL && (context->download == download || context->download->segmentOf == download)) {
+            retireDownloadContext(context);
+            context->download = NULL;
+            irc_dcc_destroy(context->session, context->dccid);
+        }
+    }
+
+    finishQueuedDownload(download, false);
+}
+
+bool cancelDownload(struct dccDownload *request) {
+    struct dccDownload *download;
+    uint32_t i;
+
+    if (cancelPendingDownload(request)) {
+        return true;
+    }
+
+    download = findRequestedDownloadByCmd(request);
+
+    if (download == NULL) {
         return false;
     }
 
-    if (cfg_get_bit(&cfg, ACCEPT_ALL_NICKS_FLAG)) {
+    if (download->segmentOf != NULL || download->segmented != NULL) {
+        abortSegmentedDownload((download->segmentOf != NULL) ? download->segmentOf : download);
         return true;
     }
 
-    for (i = 0; dccDownloads[i]; i++) {
-        if (strcasecmp(dccDownloads[i]->botNick, botNick) == 0) {
+    for (i = 0; i < numActiveDownloads; i++) {
+        struct dccDownloadContext *context = downloadContext[i];
+
+        if (context->download == download) {
+            irc_dcc_t dccid = context->dccid;
+            irc_session_t *session = context->session;
+            finishDownload(context, false);
+            irc_dcc_destroy(session, dccid);
             return true;
         }
     }
 
-    return false;
-}
+    /* the bot did not offer the file yet. without the request its offer is refused */
+    finishQueuedDownload(download, false);
+    return true;
+}
+
+static struct dccDownloadContext* findDownloadContext(struct dccDownload *download) {
+    uint32_t i;
+
+    for (i = 0; i < numActiveDownloads; i++) {
+        if (downloadContext[i]->download == download) {
+            return downloadContext[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int compareSpeeds(const void *a, const void *b) {
+    irc_dcc_size_t speedA = *(const irc_dcc_size_t*) a;
+    irc_dcc_size_t speedB = *(const irc_dcc_size_t*) b;
+    return (speedA > speedB) - (speedA < speedB);
+}
+
+/* returns the median of the average speeds of the other transfers, that were measured over a full window, or 0. */
+static irc_dcc_size_t getMedianSpeed(struct dccDownloadContext *excluded) {
+    irc_dcc_size_t *speeds = Calloc(numActiveDownloads, sizeof(irc_dcc_size_t));
+    irc_dcc_size_t median = 0;
+    uint32_t numSpeeds = 0;
+    uint32_t i;
+
+    for (i = 0; i < numActiveDownloads; i++) {
+        if (downloadContext[i] != excluded && downloadContext[i]->progress->curSpeed.isSpeedArrayFilled) {
+            speeds[numSpeeds] = downloadContext[i]->progress->averageSpeed;
+            numSpeeds++;
+        }
+    }
+
+    if (numSpeeds != 0) {
+        qsort(speeds, numSpeeds, sizeof(irc_dcc_size_t), compareSpeeds);
+        median = speeds[numSpeeds / 2];
+    }
+
+    FREE(speeds);
+    return median;
+}
+
+/* a transfer straggles, when its speed over the last NUM_AVERAGE_SPEED_VALUES seconds is far below
+   the median of the other transfers or its remaining time exceeds stragglerMaxEta. */
+static bool isStraggling(struct dccDownloadContext *context) {
+    struct dccDownloadProgress *progress = context->progress;
+
+    if (!progress->curSpeed.isSpeedArrayFilled) {
+        return false;
+    }
+
+    if (cfg.stragglerMaxEta != 0) {
+        irc_dcc_size_t remainingSize = progress->completeFileSize - progress->sizeRcvd;
+
+        if (progress->averageSpeed == 0 || remainingSize / progress->averageSpeed > (irc_dcc_size_t) cfg.stragglerMaxEta) {
+            return true;
+        }
+    }
+
+    if (cfg.stragglerSpeedRatio != 0) {
+        irc_dcc_size_t medianSpeed = getMedianSpeed(context);
+
+        if (medianSpeed != 0 && progress->averageSpeed * 100 < medianSpeed * cfg.stragglerSpeedRatio) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* asks the next mirror of every straggling transfer for the same file. */
+static void raceStragglers() {
+    uint32_t i;
+
+    for (i = 0; i < numActiveDownloads; i++) {
+        struct dccDownloadContext *context = downloadContext[i];
+        struct dccDownload *download = context->download;
+
+        if (download == NULL || download->mirrors == NULL || download->raceDownload != NULL || context->segment != NULL || !isStraggling(context)) {
+            continue;
+        }
+
+        struct dccDownload *race = startMirrorRequest(download);
+
+        if (race != NULL) {
+            logprintf(LOG_INFO, "the transfer of %s from %s straggles with %" IRC_DCC_SIZE_T_FORMAT " bytes/s, asking the mirror %s.",
+                context->progress->completePath, download->botNick, context->progress->averageSpeed, race->botNick);
+        }
+    }
+}
+
+/* a transfer, that ends within QUEUE_PIPELINE_LEAD_SECS, frees its slot in the windows already, so that
+   the next request to the bot is sent and the bot starts the next pack without a pause. */
+static void pipelineEndingTransfers() {
+    uint32_t i;
+
+    for (i = 0; i < numActiveDownloads; i++) {
+        struct dccDownloadContext *context = downloadContext[i];
+        struct dccDownloadProgress *progress = context->progress;
+
+        if (context->download == NULL || context->download->nearlyDone || context->segment != NULL || progress->averageSpeed == 0
+            || progress->sizeRcvd >= progress->completeFileSize) {
+            continue;
+        }
+
+        if ((progress->completeFileSize - progress->sizeRcvd) / progress->averageSpeed <= QUEUE_PIPELINE_LEAD_SECS) {
+            context->download->nearlyDone = true;
+        }
+    }
+}
+
+static void trackPeakSpeeds() {
+    uint32_t i;
+
+    for (i = 0; i < numActiveDownloads; i++) {
+        if (downloadContext[i]->progress->averageSpeed > downloadContext[i]->peakSpeed) {
+            downloadContext[i]->peakSpeed = downloadContext[i]->progress->averageSpeed;
+        }
+    }
+}
+
+sds appendDownloadStatus(sds status) {
+    uint32_t i;
+
+    for (i = 0; i < numActiveDownloads; i++) {
+        struct dccDownloadContext *context = downloadContext[i];
+        struct dccDownloadProgress *progress = context->progress;
+
+        status = sdscatprintf(status, "DOWNLOAD %s %" IRC_DCC_SIZE_T_FORMAT " %" IRC_DCC_SIZE_T_FORMAT " %" IRC_DCC_SIZE_T_FORMAT " %s\n",
+            context->download != NULL ? context->download->botNick : "-", progress->sizeRcvd, progress->completeFileSize,
+            progress->averageSpeed, progress->completePath);
+    }
+
+    return status;
+}
+
+// This callback is used when we receive a file from the remote party
+
+void callback_dcc_recv_file(irc_session_t * session, irc_dcc_t id, int status, void * ctx, const char * data, irc_dcc_size_t length) {
+    if (ctx == NULL) {
+        DBG_WARN("callback_dcc_recv_file called with ctx = NULL!");
+        return;
+    }
+
+    struct dccDownloadContext *context = (struct dccDownloadContext*) ctx;
+    struct dccDownloadProgress *progress = context->progress;
+
+    /* libircclient reports the close of the session after the last byte */
+    if (context->finished) {
+        return;
+    }
+
+    if (status) {
+        DBG_ERR("File sent error: %d\nerror desc: %s", status, irc_strerror(status));
+        logprintf(LOG_WARN, "the download of %s failed: %s", progress->completePath, irc_strerror(status));
+        recordTransfer(context, true);
 
-// This callback is used when we receive a file from the remote party
+        if (context->segment != NULL) {
+            finishSegment(context, false);
+        }
+        else {
+            finishDownload(context, false);
+        }
 
-void callback_dcc_recv_file(irc_session_t * session, irc_dcc_t id, int status, void * ctx, const char * data, irc_dcc_size_t length) {
-    if (data == NULL) {
-        DBG_WARN("callback_dcc_recv_file called with data = NULL!");
         return;
     }
 
-    if (ctx == NULL) {
-        DBG_WARN("callback_dcc_recv_file called with ctx = NULL!");
+    if (data == NULL) {
+        DBG_WARN("callback_dcc_recv_file called with data = NULL!");
         return;
     }
 
@@ -432,39 +896,41 @@ void callback_dcc_recv_file(irc_session_t * session, irc_dcc_t id, int status, v
         return;
     }
 
-    if (status) {
-        DBG_ERR("File sent error: %d\nerror desc: %s", status, irc_strerror(status));
-        return;
+    consumeDownloadBandwidth(context, length);
+
+    if (unlikely(context->firstByteTime == 0)) {
+        struct ircNetwork *network = getSessionNetwork(context->session);
+        context->firstByteTime = getMonotonicTimeMs();
+        context->firstByteOffset = progress->sizeRcvd;
+        logStartupPhase(network, &network->startup.firstByte, "received the first byte");
     }
 
-    struct dccDownloadContext *context = (struct dccDownloadContext*) ctx;
-    struct dccDownloadProgress *progress = context->progress;
+    if (context->segment != NULL) {
+        /* the bot sends on behind the segment. that part belongs to an other bot */
+        irc_dcc_size_t segmentLength = clampToSegment(context->segment, length);
+
+        progress->sizeRcvd += segmentLength;
+        Write(context->fd, data, segmentLength);
+        recordGoodput(segmentLength);
+        advanceSegment(context->segmentedFile, context->segment, segmentLength);
+
+        if (isSegmentDone(context->segment)) {
+            recordTransfer(context, false);
+            finishSegment(context, true);
+        }
+
+        return;
+    }
 
     progress->sizeRcvd += length;
     Write(context->fd, data, length);
+    recordGoodput(length);
 
     if (unlikely(progress->sizeRcvd == progress->completeFileSize)) {
-        enableAlarm(0);
         outputProgress(progress);
-        lastDownload = curDownload;
-        printf("\nDownload completed!\n");
-        fflush(NULL);
-
-        Close(context->fd);
-        context->fd = NULL;
-
-        finishedDownloads++;
-
-        if (!(cfg_get_bit(&cfg, VERIFY_CHECKSUM_FLAG))) {
-            if (finishedDownloads == numActiveDownloads) {
-                irc_cmd_quit(cfg.session, "Goodbye!");
-            }
-        }
-        else {
-            if (cfg.numDownloads == 1 && cfg.dccDownloadArray[0]->md5) {
-                startChecksumThread(cfg.dccDownloadArray[0]->md5, sdsdup(lastDownload->completePath));
-            }
-        }
+        recordTransfer(context, false);
+        completeDownload(context->download, progress->completePath);
+        finishDownload(context, true);
     }
 }
 
@@ -475,6 +941,10 @@ void callback_dcc_resume_file_reverse (irc_session_t * session, irc_dcc_t dccid,
     Seek(context->fd, length, SEEK_SET);
     DBG_OK("before irc_dcc_accept_reverse!\n");
 
+    if (context->segment != NULL) {
+        moveSegment(context->segment, length);
+    }
+
     struct dccDownloadProgress *tdp = context->progress;
     tdp->sizeRcvd = length;
     tdp->sizeNow = length;
@@ -483,7 +953,7 @@ void callback_dcc_resume_file_reverse (irc_session_t * session, irc_dcc_t dccid,
     int ret = irc_dcc_accept_reverse (session, dccid, ctx, callback_dcc_recv_file, nick, filename, tdp->completeFileSize, token);
 
     if (ret != 0) {
-        logprintf(LOG_ERR, "Could wait for bot\nError was: %s\n", irc_strerror(irc_errno(cfg.session)));
+        logprintf(LOG_ERR, "Could wait for bot\nError was: %s\n", irc_strerror(irc_errno(session)));
         exitPgm(EXIT_FAILURE);
     }
 
@@ -497,6 +967,10 @@ void callback_dcc_resume_file (irc_session_t * session, irc_dcc_t dccid, int sta
     Seek(context->fd, length, SEEK_SET);
     DBG_OK("before irc_dcc_accept!\n");
 
+    if (context->segment != NULL) {
+        moveSegment(context->segment, length);
+    }
+
     struct dccDownloadProgress *tdp = context->progress;
     tdp->sizeRcvd = length;
     tdp->sizeNow = length;
@@ -505,7 +979,7 @@ void callback_dcc_resume_file (irc_session_t * session, irc_dcc_t dccid, int sta
     int ret = irc_dcc_accept (session, dccid, ctx, callback_dcc_recv_file);
 
     if (ret != 0) {
-        logprintf(LOG_ERR, "Could not connect to bot\nError was: %s\n", irc_strerror(irc_errno(cfg.session)));
+        logprintf(LOG_ERR, "Could not connect to bot\nError was: %s\n", irc_strerror(irc_errno(session)));
         exitPgm(EXIT_FAILURE);
     }
 
@@ -576,22 +1050,199 @@ struct dccDownloadContext* prepareRecvFileRequest (irc_session_t *session, const
     sds completePath = getCompletePath(filename);
     sdsfree(absolutePath);
 
-    struct dccDownloadProgress *progress = newDccProgress(completePath, size);
-    curDownload = progress;
-
-    struct dccDownloadContext *context = Malloc(sizeof(struct dccDownloadContext));
-    downloadContext[numActiveDownloads] = context;
-    numActiveDownloads++;
-    context->progress = progress;
+    struct dccDownloadContext *context = Safe_Malloc(sizeof(struct dccDownloadContext));
+    context->progress = newDccProgress(completePath, size);
+    context->dccid = dccid;
+    context->session = session;
+    context->offerTime = getMonotonicTimeMs();
+    context->download = takeRequestedDownload(getSessionNetwork(session)->name, nick, filename);
+    addDownloadContext(context);
+    attachDownloadBandwidth(context, nick, context->download);
 
     DBG_OK("nick at recvFileReq is %s\n", nick);
     return context;
 }
 
 
+/* the file on the disk decides the resume offset. the journal only tells, if the last run was interrupted. */
+static void logJournaledOffset(struct dccDownloadContext *context, irc_dcc_size_t fileSize) {
+    if (context->download == NULL || context->download->journalOffset == 0) {
+        return;
+    }
+
+    if (context->download->journalOffset > fileSize) {
+        logprintf(LOG_WARN, "the journal recorded %" IRC_DCC_SIZE_T_FORMAT " bytes of %s, but only %" IRC_DCC_SIZE_T_FORMAT " bytes are on the disk.",
+            context->download->journalOffset, context->progress->completePath, fileSize);
+    }
+    else {
+        logprintf(LOG_INFO, "continuing the interrupted download of %s.", context->progress->completePath);
+    }
+}
+
+/* a mirror, that races a straggling transfer, takes over, if it offers the same file. the straggling
+   transfer is aborted and the mirror resumes its partial file. returns false, if the offer is refused. */
+static bool takeOverFromStraggler(irc_session_t *session, const char *nick, const char *filename, irc_dcc_size_t size, irc_dcc_t dccid) {
+    struct dccDownload *race = findOfferedDownload(getSessionNetwork(session)->name, nick, filename);
+
+    if (race == NULL || race->raceOf == NULL) {
+        return true;
+    }
+
+    struct dccDownloadContext *straggler = findDownloadContext(race->raceOf);
+    sds completePath = getCompletePath(filename);
+    bool isSameFile = straggler != NULL && str_equals(straggler->progress->completePath, completePath)
+        && straggler->progress->completeFileSize == size;
+    sdsfree(completePath);
+
+    if (!isSameFile) {
+        logprintf(LOG_WARN, "the mirror %s offered %s, which is not the file of the straggling transfer. refusing it.", nick, filename);
+        irc_dcc_destroy(session, dccid);
+        finishQueuedDownload(race, false);
+        return false;
+    }
+
+    logprintf(LOG_INFO, "the mirror %s takes over the transfer of %s.", nick, filename);
+
+    irc_session_t *stragglerSession = straggler->session;
+    irc_dcc_t stragglerId = straggler->dccid;
+    recordTransfer(straggler, false);
+    handOverDownload(race->raceOf, race);
+    finishDownload(straggler, false);
+    irc_dcc_destroy(stragglerSession, stragglerId);
+    return true;
+}
+
+/* refuses the transfer of a file, that is already complete, and goes on with the next request of the queue. */
+static bool skipDownloadedFile(irc_session_t *session, const char *nick, const char *filename, irc_dcc_size_t size, irc_dcc_t dccid) {
+    sds completePath = getCompletePath(filename);
+    /* a segmented file has its full size from the start */
+    bool isDownloaded = file_exists(completePath) && get_file_size(completePath) == size && !hasSegmentBitmap(completePath);
+
+    if (isDownloaded) {
+        logprintf(LOG_WARN, "file %s is already downloaded, skipping it.", completePath);
+        irc_dcc_destroy(session, dccid);
+        finishQueuedDownload(takeRequestedDownload(getSessionNetwork(session)->name, nick, filename), true);
+        startQueuedDownloads();
+        quitIfQueueDrained();
+    }
+
+    sdsfree(completePath);
+    return isDownloaded;
+}
+
+/* a file is split into segments, if it was split by an earlier run or if it is big and its request has mirrors. */
+static bool shouldSegmentFile(struct dccDownload *download, const char *completePath, irc_dcc_size_t size) {
+    if (hasSegmentBitmap(completePath)) {
+        return true;
+    }
+
+    return cfg_get_bit(&cfg, SEGMENTED_DOWNLOADS_FLAG) && download->mirrors != NULL && download->raceDownload == NULL
+        && size >= SEGMENT_MIN_FILE_SIZE;
+}
+
+/* accepts the offer of a bot, that sends a segment of a file, at the offset of the segment, that it is assigned.
+   returns false, if the file is not downloaded in segments, so that the offer is accepted as usual. */
+static bool acceptSegmentOffer(irc_session_t *session, const char *nick, const char *addr, const char *filename,
+        irc_dcc_size_t size, irc_dcc_t dccid, bool reverse, unsigned long token) {
+    struct dccDownload *source = findOfferedDownload(getSessionNetwork(session)->name, nick, filename);
+    int ret;
+
+    if (source == NULL) {
+        return false;
+    }
+
+    struct dccDownload *download = (source->segmentOf != NULL) ? source->segmentOf : source;
+    sds completePath = getCompletePath(filename);
+
+    if (download->segmented == NULL) {
+        struct segmentedFile *file = NULL;
+
+        if (shouldSegmentFile(download, completePath, size)) {
+            file = openSegmentedFile(completePath, size);
+        }
+
+        sdsfree(completePath);
+
+        /* without segments the file is downloaded from the bot, that offered it first */
+        if (file == NULL) {
+            return false;
+        }
+
+        logprintf(LOG_INFO, "downloading %s in segments. %" PRIu32 " of its %" PRIu32 " ranges are missing.", file->path,
+            file->numRanges - file->numRangesDone, file->numRanges);
+        startSegmentedDownload(download, file);
+    }
+    else {
+        bool isSameFile = str_equals(download->segmented->path, completePath) && download->segmented->fileSize == size;
+        sdsfree(completePath);
+
+        if (!isSameFile) {
+            logprintf(LOG_WARN, "%s offered %s, which is not the file of the segmented download. refusing it.", nick, filename);
+            irc_dcc_destroy(session, dccid);
+            dropSegmentSource(source);
+            startQueuedDownloads();
+            quitIfQueueDrained();
+            return true;
+        }
+    }
+
+    struct segmentedFile *file = download->segmented;
+    struct fileSegment *segment = assignSegment(file);
+
+    if (segment == NULL) {
+        logprintf(LOG_INFO, "no segment of %s is left for %s.", file->path, nick);
+        irc_dcc_destroy(session, dccid);
+        dropSegmentSource(source);
+        startQueuedDownloads();
+        quitIfQueueDrained();
+        return true;
+    }
+
+    struct dccDownloadContext *context = prepareRecvFileRequest(session, nick, addr, filename, size, dccid);
+    struct dccDownloadProgress *progress = context->progress;
+
+    context->segment = segment;
+    context->segmentedFile = file;
+    context->fd = Open(file->path, "rw");
+    Seek(context->fd, segment->position, SEEK_SET);
+
+    progress->sizeRcvd = segment->position;
+    progress->sizeNow = segment->position;
+    progress->sizeLast = segment->position;
+
+    logprintf(LOG_INFO, "%s sends the bytes %" IRC_DCC_SIZE_T_FORMAT " to %" IRC_DCC_SIZE_T_FORMAT " of %s.", nick,
+        segment->start, segment->end, file->path);
+
+    if (segment->position == 0 && reverse) {
+        ret = irc_dcc_accept_reverse(session, dccid, context, callback_dcc_recv_file, nick, filename, size, token);
+    }
+    else if (segment->position == 0) {
+        ret = irc_dcc_accept(session, dccid, context, callback_dcc_recv_file);
+    }
+    else if (reverse) {
+        ret = irc_dcc_resume_reverse(session, dccid, context, callback_dcc_resume_file_reverse, nick, filename, segment->position, token);
+    }
+    else {
+        ret = irc_dcc_resume(session, dccid, context, callback_dcc_resume_file, nick, segment->position);
+    }
+
+    if (ret != 0) {
+        logprintf(LOG_ERR, "Could not connect to bot\nError was: %s\n", irc_strerror(irc_errno(session)));
+        exitPgm(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
 void recvFileRequestReverse (irc_session_t *session, const char *nick, const char *addr, const char *filename, irc_dcc_size_t size, irc_dcc_t dccid, unsigned long token) {
     irc_dcc_size_t fileSize;
     int ret = 0;
+
+    if (skipDownloadedFile(session, nick, filename, size, dccid) || !takeOverFromStraggler(session, nick, filename, size, dccid)
+        || acceptSegmentOffer(session, nick, addr, filename, size, dccid, true, token)) {
+        return;
+    }
+
     struct dccDownloadContext* context = prepareRecvFileRequest(session, nick, addr, filename, size, dccid);
     sds completePath = getCompletePath(filename);
 
@@ -600,20 +1251,16 @@ void recvFileRequestReverse (irc_session_t *session, const char *nick, const cha
         fileSize = get_file_size(completePath);
         DBG_OK("fileSize = %lu", fileSize);
 
-        if (size == (irc_dcc_size_t) fileSize) {
-            logprintf(LOG_ERR, "file %s is already downloaded, exit pgm now.", completePath);
-            exitPgm(EXIT_FAILURE);
-        }
-
         /* file already exists but is empty. so accept it, rather than resume... */
         if (fileSize == 0) {
             goto accept_flag_reverse;
         }
 
         logprintf(LOG_INFO, "file %s already exists, need to resume.\n", completePath);
+        logJournaledOffset(context, fileSize);
         ret = irc_dcc_resume_reverse(session, dccid, context, callback_dcc_resume_file_reverse, nick, filename, fileSize, token);
         if (ret != 0) {
-            logprintf(LOG_ERR, "Could not connect to bot\nError was: %s\n", irc_strerror(irc_errno(cfg.session)));
+            logprintf(LOG_ERR, "Could not connect to bot\nError was: %s\n", irc_strerror(irc_errno(session)));
             exitPgm(EXIT_FAILURE);
         }
     } else {
@@ -622,7 +1269,7 @@ void recvFileRequestReverse (irc_session_t *session, const char *nick, const cha
 accept_flag_reverse:
         ret = irc_dcc_accept_reverse(session, dccid, context, callback_dcc_recv_file, nick, filename, size, token);
         if (ret != 0) {
-            logprintf(LOG_ERR, "Could not wait for connection from bot\nError was: %s\n", irc_strerror(irc_errno(cfg.session)));
+            logprintf(LOG_ERR, "Could not wait for connection from bot\nError was: %s\n", irc_strerror(irc_errno(session)));
             exitPgm(EXIT_FAILURE);
         }
     }
@@ -634,6 +1281,12 @@ void recvFileRequest (irc_session_t *session, const char *nick, const char *addr
 {
     irc_dcc_size_t fileSize;
     int ret = 0;
+
+    if (skipDownloadedFile(session, nick, filename, size, dccid) || !takeOverFromStraggler(session, nick, filename, size, dccid)
+        || acceptSegmentOffer(session, nick, addr, filename, size, dccid, false, 0)) {
+        return;
+    }
+
     struct dccDownloadContext *context = prepareRecvFileRequest(session, nick, addr, filename, size, dccid);
     sds completePath = getCompletePath(filename);
 
@@ -642,20 +1295,16 @@ void recvFileRequest (irc_session_t *session, const char *nick, const char *addr
         fileSize = get_file_size(completePath);
         DBG_OK("fileSize = %llu", fileSize);
 
-        if (size == fileSize) {
-            logprintf(LOG_ERR, "file %s is already downloaded, exit pgm now.", completePath);
-            exitPgm(EXIT_FAILURE);
-        }
-
         /* file already exists but is empty. so accept it, rather than resume... */
         if (fileSize == 0) {
             goto accept_flag;
         }
 
         logprintf(LOG_INFO, "file %s already exists, need to resume.\n", completePath);
+        logJournaledOffset(context, fileSize);
         ret = irc_dcc_resume(session, dccid, context, callback_dcc_resume_file, nick, fileSize);
         if (ret != 0) {
-            logprintf(LOG_ERR, "Could not connect to bot\nError was: %s\n", irc_strerror(irc_errno(cfg.session)));
+            logprintf(LOG_ERR, "Could not connect to bot\nError was: %s\n", irc_strerror(irc_errno(session)));
             exitPgm(EXIT_FAILURE);
         }
     }
@@ -665,7 +1314,7 @@ void recvFileRequest (irc_session_t *session, const char *nick, const char *addr
 accept_flag:
         ret = irc_dcc_accept(session, dccid, context, callback_dcc_recv_file);
         if (ret != 0) {
-            logprintf(LOG_ERR, "Could not connect to bot\nError was: %s\n", irc_strerror(irc_errno(cfg.session)));
+            logprintf(LOG_ERR, "Could not connect to bot\nError was: %s\n", irc_strerror(irc_errno(session)));
             exitPgm(EXIT_FAILURE);
         }
     }
@@ -673,78 +1322,184 @@ accept_flag:
     sdsfree(completePath);
 }
 
-irc_dcc_size_t getCurrentTransferSpeed() {
-    irc_dcc_size_t speed = 0;
-
-    for (uint32_t i = 0; i < numActiveDownloads; i++) {
-        speed += downloadContext[i]->progress->averageSpeed;
+irc_dcc_size_t getDccReadQuota(irc_session_t *session, irc_dcc_t dccid, void *ctx) {
+    /* a transfer, that stopped at the end of its segment, is not read anymore, until it is destroyed */
+    if (((struct dccDownloadContext*) ctx)->finished) {
+        return 0;
     }
 
-    return speed;
+    return getDownloadQuota((struct dccDownloadContext*) ctx);
 }
 
-static inline irc_dcc_size_t getAdjustmentValue (irc_dcc_size_t a, irc_dcc_size_t b) {
-	return (b != 0) ? a / b : 1;
-}
+bool shouldSendXdccRequests(irc_session_t* session) {
+    if (cfg.sendDelay != NULL && !cfg_get_bit(&cfg, SENDED_FLAG)) {
+        if (cfg.sendDelay->timeToSendCommand < time(NULL)) {
+            return true;
+        }
+    }
 
-sleeptime_t getSleepTime() {
-    const int factor = 5;
-    static sleeptime_t sleepTime = 0;
-    irc_dcc_size_t currentSpeed = getCurrentTransferSpeed();
+    return false;
+}
 
-    if (cfg.maxTransferSpeed == NO_SPEED_LIMIT) {
-        return 0;
-    }
+/* records the ranges, that the segmented transfers wrote, in the bitmaps of their files. */
+static void saveSegmentProgresses() {
+    uint32_t i;
 
-    if (currentSpeed > cfg.maxTransferSpeed) {
-        sleepTime += getAdjustmentValue(currentSpeed, cfg.maxTransferSpeed) * factor;
-    } else {
-        irc_dcc_size_t adjustment = getAdjustmentValue(cfg.maxTransferSpeed, currentSpeed) * factor;
-        if (sleepTime >= adjustment) {
-            sleepTime -= adjustment;
-        }
-        else {
-            sleepTime = 0;
+    for (i = 0; i < numActiveDownloads; i++) {
+        if (downloadContext[i]->segment != NULL) {
+            Flush(downloadContext[i]->fd);
         }
     }
 
-    return sleepTime;
+    saveSegmentedFiles();
 }
 
-void sleeping() {
-    sleeptime_t sleepTime = getSleepTime();
-    if (sleepTime != 0) {
-        int ret = usleep(sleepTime);
-        if (ret != 0) {
-            if (errno != EINTR) {	
-                logprintf(LOG_ERR, "Problem while usleep!\nError was: %s\n", strerror(errno));
-                exitPgm(EXIT_FAILURE);
-            }
-        } 
-    }
-}
+/* after the send delay the requests are sent over all networks, that are connected. */
+static void send_delayed_xdcc_requests() {
+    struct ircNetwork *network;
 
-bool shouldSendXdccRequests(irc_session_t* session) {
-    if (cfg.sendDelay != NULL && !cfg_get_bit(&cfg, SENDED_FLAG)) {
-        if (cfg.sendDelay->timeToSendCommand < time(NULL)) {
-            return true;
+    for (network = cfg.networks; network != NULL; network = network->next) {
+        if (isNetworkUsable(network)) {
+            send_xdcc_requests(network->session);
         }
     }
-
-    return false;
 }
 
 void print_output_callback (irc_session_t *session) {
     if (unlikely(shouldSendXdccRequests(session))) {
-        send_xdcc_requests(session);
+        send_delayed_xdcc_requests();
+    }
+
+    checkJoinTimeouts();
+
+    if (cfg_get_bit(getCfg(), SENDED_FLAG)) {
+        /* new requests may have arrived on stdin */
+        startQueuedDownloads();
+        quitIfQueueDrained();
+    }
+
+    if (unlikely(finishedDownloads != NULL)) {
+        freeFinishedDownloads(false);
+    }
+
+    if (unlikely(isJournalCommitDue())) {
+        journalDownloadProgresses();
+        commitJournal();
+    }
+
+    if (unlikely(isHistorySaveDue())) {
+        saveHistory();
     }
 
     if (unlikely(cfg_get_bit(getCfg(), OUTPUT_FLAG))) {
         output_all_progesses();
         cfg_clear_bit(getCfg(), OUTPUT_FLAG);
+        /* the speeds were measured again by the output */
+        raceStragglers();
+        pipelineEndingTransfers();
+        trackPeakSpeeds();
+        saveSegmentProgresses();
+        updateConcurrencyWindow(numActiveDownloads, isDownloadWindowLimited());
+    }
+
+    if (unlikely(shouldReloadConfig())) {
+        reloadConfigFile(getCfg());
+        updateBandwidthLimits();
+    }
+
+    refillBandwidthBuckets();
+}
+
+/* a login command like "NickServ identify [account] password" gives the credentials for sasl PLAIN. the account is the
+   nick, if it is not given. other login commands are sent after the welcome like before. */
+static void setSaslLogin(struct ircNetwork *network, const char *nick) {
+    int count = 0;
+    sds *fields;
+
+    if (network->loginCommand == NULL || cfg_get_bit(&cfg, NO_SASL_FLAG)) {
+        return;
+    }
+
+    network->loginCommand = sdstrim(network->loginCommand, " \t");
+    fields = sdssplitlen(network->loginCommand, sdslen(network->loginCommand), " ", 1, &count);
+
+    if ((count == 3 || count == 4) && strcasecmp(fields[0], "NickServ") == 0 && strcasecmp(fields[1], "identify") == 0) {
+        irc_set_sasl(network->session, "PLAIN", (count == 4) ? fields[2] : nick, fields[count - 1]);
+    }
+
+    sdsfreesplitres(fields, count);
+}
+
+/* creates the session of network and connects it to its server. returns false, if the connect failed. */
+static bool connectNetwork(struct ircNetwork *network, irc_callbacks_t *callbacks) {
+    const char *nick = (network->nick != NULL) ? network->nick : cfg.nick;
+    int ret;
+
+    network->session = irc_create_session(callbacks);
+
+    if (!network->session) {
+        logprintf(LOG_ERR, "Could not create session\n");
+        return false;
+    }
+
+    irc_set_ctx(network->session, network);
+    network->startup.connect = getMonotonicTimeMs();
+
+    if (cfg_get_bit(&cfg, ADAPTIVE_SOCKET_BUFFERS_FLAG)) {
+        irc_set_adaptive_dcc_buffers(network->session, cfg.maxSocketBufferSize);
+    }
+
+    irc_set_verify_nick_callback(network->session, isValidRequestFromNick);
+    setSaslLogin(network, nick);
+
+    if (isBandwidthLimited()) {
+        irc_set_run_timeout(network->session, BANDWIDTH_REFILL_INTERVAL_MS);
     }
 
-    sleeping();
+#ifdef ENABLE_SSL
+    irc_set_cert_verify_callback(network->session, openssl_check_certificate_callback);
+#endif
+
+    if (cfg_get_bit(&cfg, USE_IPV4_FLAG)) {
+        ret = irc_connect4(network->session, network->server, network->port, 0, nick, 0, 0);
+    }
+#ifdef ENABLE_IPV6
+    else if (cfg_get_bit(&cfg, USE_IPV6_FLAG)) {
+        ret = irc_connect6(network->session, network->server, network->port, 0, nick, 0, 0);
+    }
+#endif
+    else {
+        ret = irc_connect(network->session, network->server, network->port, 0, nick, 0, 0);
+    }
+
+    if (ret != 0) {
+        logprintf(LOG_ERR, "Could not connect to server %s and port %u.\nError was: %s\n", network->server, network->port, irc_strerror(irc_errno(network->session)));
+        /* the requests to this network are dropped by the queue */
+        irc_destroy_session(network->session);
+        network->session = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/* the library already keeps the lines to our nick, so that only the lines of others on the channels come here.
+   of them only the welcome of the server and what the bots of the queue say matter. */
+static int filterLine(irc_session_t *session, const irc_line_info_t *line) {
+    char nick[128];
+
+    if (line->numeric != -1) {
+        return line->numeric == 1 || isJoinError(line->numeric);
+    }
+
+    /* event_join reacts to our own joins only */
+    if (line->command_word == IRC_COMMAND_WORD('J', 'O', 'I', 'N', 0, 0, 0, 0) || line->origin_len == 0 || line->origin_len >= sizeof(nick)) {
+        return 0;
+    }
+
+    memcpy(nick, line->origin, line->origin_len);
+    nick[line->origin_len] = '\0';
+    return isRequestedBot(getSessionNetwork(session)->name, nick);
 }
 
 void initCallbacks(irc_callbacks_t *callbacks) {
@@ -763,6 +1518,10 @@ void initCallbacks(irc_callbacks_t *callbacks) {
     callbacks->event_mode = event_mode;
     callbacks->event_numeric = event_numeric;
     callbacks->keep_alive_callback = print_output_callback;
+    callbacks->add_descriptors = addControlDescriptors;
+    callbacks->process_descriptors = processControlDescriptors;
+    callbacks->dcc_read_quota = getDccReadQuota;
+    callbacks->line_filter = filterLine;
 }
 
 int main (int argc, char **argv)
@@ -777,6 +1536,16 @@ int main (int argc, char **argv)
     cfg.logLevel = LOG_WARN;
     cfg.port = 6667;
     cfg.maxTransferSpeed = NO_SPEED_LIMIT;
+    cfg.maxTransferSpeedPerDownload = NO_SPEED_LIMIT;
+    cfg.maxTransferSpeedPerBot = NO_SPEED_LIMIT;
+    cfg.maxHostTransferSpeed = NO_SPEED_LIMIT;
+    cfg.defaultWeight = DOWNLOAD_DEFAULT_WEIGHT;
+    cfg.defaultPriority = DOWNLOAD_PRIORITY_NORMAL;
+    cfg.maxSocketBufferSize = DEFAULT_MAX_SOCKET_BUFFER_SIZE;
+    cfg.maxConcurrentDownloads = QUEUE_DEFAULT_MAX_DOWNLOADS;
+    cfg.requestTimeout = QUEUE_DEFAULT_REQUEST_TIMEOUT_SECS;
+    cfg.maxRequestRetries = QUEUE_DEFAULT_MAX_RETRIES;
+    cfg.stragglerSpeedRatio = QUEUE_DEFAULT_STRAGGLER_RATIO;
 //    cfg.maxTransferSpeed = getSizeOf(1, "MByte");
 
     const char *homeDir = getHomeDir();
@@ -794,22 +1563,30 @@ int main (int argc, char **argv)
     cfg.ircServer = cfg.args[0];
 
     cfg.channelsToJoin = parseChannels(cfg.args[1], &cfg.numChannels);
-    cfg.dccDownloadArray = parseDccDownloads(cfg.args[2], &cfg.numDownloads);
+    addCommandLineNetwork(&cfg);
 
-    downloadContext = Calloc(cfg.numDownloads, sizeof(struct downloadContext*));
+    if (cfg.args[2] != NULL) {
+        cfg.dccDownloadArray = parseDccDownloads(cfg.args[2], &cfg.numDownloads);
+    }
 
-    createInterruptHandler(interrupt_handler);
-    createAlarmHandler(output_handler);
+    buildNoticeMatcher(cfg.noticePatterns);
 
-    irc_callbacks_t callbacks;
-    initCallbacks(&callbacks);
-    cfg.session = irc_create_session (&callbacks);
+    /* the mirrors of the requests are ranked, when they are queued */
+    loadHistory(&cfg);
+    initDownloadQueue(&cfg);
+    initConcurrencyController(&cfg);
 
-    if (!cfg.session) {
-        logprintf(LOG_ERR, "Could not create session\n");
+    if (cfg_get_bit(&cfg, DAEMON_FLAG) && !openControlSocket(&cfg)) {
+        logprintf(LOG_ERR, "Cant open the control socket. Exiting now.");
         exitPgm(EXIT_FAILURE);
     }
 
+    initBandwidthLimiter(&cfg);
+
+    createInterruptHandler(interrupt_handler);
+    createAlarmHandler(output_handler);
+    createReloadHandler(reload_handler);
+
     logprintf(LOG_INFO, "test message for info");
     logprintf(LOG_QUIET, "test message for quiet");
     logprintf(LOG_WARN, "test message for warn");
@@ -821,41 +1598,63 @@ int main (int argc, char **argv)
     }
 
     logprintf(LOG_INFO, "nick is %s\n", cfg.nick);
-    
-    irc_set_verify_nick_callback(cfg.session, isValidRequestFromNick);
 
-#ifdef ENABLE_SSL
-    irc_set_cert_verify_callback(cfg.session, openssl_check_certificate_callback);
-#endif
+    irc_callbacks_t callbacks;
+    initCallbacks(&callbacks);
+    irc_session_t *sessions[MAX_NETWORKS];
+    int numSessions = 0;
+    struct ircNetwork *network;
+
+    for (network = cfg.networks; network != NULL; network = network->next) {
+        if (numSessions == MAX_NETWORKS) {
+            logprintf(LOG_WARN, "only %d networks can be connected. ignoring the network %s.", MAX_NETWORKS, getNetworkName(network));
+            continue;
+        }
 
-    if (cfg_get_bit(&cfg, USE_IPV4_FLAG)) {
-        ret = irc_connect4(cfg.session, cfg.ircServer, cfg.port, 0, cfg.nick, 0, 0);
-    }
-#ifdef ENABLE_IPV6
-    else if (cfg_get_bit(&cfg, USE_IPV6_FLAG)) {
-        ret = irc_connect6(cfg.session, cfg.ircServer, cfg.port, 0, cfg.nick, 0, 0);
-    }
-#endif
-    else {
-        ret = irc_connect(cfg.session, cfg.ircServer, cfg.port, 0, cfg.nick, 0, 0);
-    }
+        if (connectNetwork(network, &callbacks)) {
+            sessions[numSessions] = network->session;
+            numSessions++;
 
-    if (ret != 0) {
-        logprintf(LOG_ERR, "Could not connect to server %s and port %u.\nError was: %s\n", cfg.ircServer, cfg.port, irc_strerror(irc_errno(cfg.session)));
-        exitPgm(EXIT_FAILURE);
+            /* the first session, that connects, serves the control socket. the other networks only need the irc
+               and the dcc events */
+            callbacks.keep_alive_callback = NULL;
+            callbacks.add_descriptors = NULL;
+            callbacks.process_descriptors = NULL;
+        }
+        /* without the network of the command line xdccget is useless */
+        else if (network->name == NULL) {
+            exitPgm(EXIT_FAILURE);
+        }
     }
 
+    cfg.session = cfg.networks->session;
+
     enableAlarm(1);
 
-    ret = irc_run (cfg.session);
+    irc_run_sessions(sessions, numSessions);
 
-    if (ret != 0) {
-        if (irc_errno(cfg.session) != LIBIRC_ERR_TERMINATED && irc_errno(cfg.session) != LIBIRC_ERR_CLOSED) {
-            logprintf(LOG_ERR, "Could not connect or I/O error at server %s and port %u\nError was:%s\n", cfg.ircServer, cfg.port, irc_strerror(irc_errno(cfg.session)));
-            exitPgm(EXIT_FAILURE);
+    /* a network, that lost its connection, does not stop the others. the errors are reported at the end */
+    ret = 0;
+
+    for (network = cfg.networks; network != NULL; network = network->next) {
+        int error = (network->session != NULL) ? irc_errno(network->session) : 0;
+
+        if (network->session != NULL) {
+            uint64_t processed, dropped;
+            irc_get_line_counters(network->session, &processed, &dropped);
+            logprintf(LOG_INFO, "%s: processed %" PRIu64 " irc lines and dropped %" PRIu64 " lines of others.", getNetworkName(network), processed, dropped);
+        }
+
+        if (error != 0 && error != LIBIRC_ERR_TERMINATED && error != LIBIRC_ERR_CLOSED) {
+            logprintf(LOG_ERR, "Could not connect or I/O error at server %s and port %u\nError was:%s\n", network->server, network->port, irc_strerror(error));
+            ret = 1;
         }
     }
 
+    if (ret != 0) {
+        exitPgm(EXIT_FAILURE);
+    }
+
     doCleanUp();
     return EXIT_SUCCESS;
 }
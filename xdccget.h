@@ -3,7 +3,16 @@
 
 #include "helper.h"
 
+struct dccDownload;
+
 struct xdccGetConfig *getCfg();
 void exitPgm(int retCode);
 
+/* removes the request with the same network, bot and xdcc command as request from the queue or aborts its transfer.
+   returns false, if no such request is queued or running. */
+bool cancelDownload(struct dccDownload *request);
+
+/* appends a line DOWNLOAD <bot> <received> <size> <speed> <file> for every running transfer. */
+sds appendDownloadStatus(sds status);
+
 #endif